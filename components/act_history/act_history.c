@@ -0,0 +1,800 @@
+/**
+ * @file act_history.c
+ * @brief Actuator history: what the DAC and the relays were set to, and when.
+ *
+ * The bus scheduler hands every write that a device acked to the tap. Writes to the DAC and
+ * the relay board are decoded (auto-increment from the register in the first byte) into the
+ * channel words and the relay register, and appended to the open block as one record:
+ *
+ *   set (1 byte: ACT_HISTORY_*), time since the previous record (varint, us),
+ *   per channel set: change of the word (zigzag varint), relay register (1 byte)
+ *
+ * A record at 1 kHz with one channel moving is 4..5 bytes. Blocks of ACT_HISTORY_BLOCK_SIZE
+ * start with a header holding the time and the complete state, so the ring evicts whole
+ * blocks and every block decodes on its own, also from a stream or a file.
+ *
+ * The ring is only touched under a spinlock: the tap encodes at most 13 bytes, a reader
+ * copies one block at a time and decodes it outside the lock, so streaming does not hold
+ * up the bus or the control loop. The flush task appends closed blocks to a file, in
+ * writes of one FAT sector.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "act_history.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_sched.h"
+
+static const char *TAG = "act_history";
+
+#define HDR_SIZE (sizeof(act_history_block_t))
+#define MAX_RECORD (1 + 5 + 3 + 3 + 1) // set, time, two channel changes, relay
+#define DAC_REG_CH0 (0x02)             // GP8413 channel words, low byte first
+#define DAC_REG_CH1 (0x04)
+#define SET_MASK (ACT_HISTORY_CH0 | ACT_HISTORY_CH1 | ACT_HISTORY_RELAY | ACT_HISTORY_STANDBY)
+#define FLUSH_POLL_MS (1000)
+#define FLUSH_STOP_WAIT_MS (5000)
+
+static act_history_config_t s_cfg;
+static uint8_t *s_blocks;
+static uint32_t s_n_blocks;
+static bool s_psram;
+static uint32_t s_seq_first; // Oldest block in the ring
+static uint32_t s_seq_open;  // Block records go to
+static bool s_open_begun;    // The open block has its header
+static size_t s_open_len;    // Record bytes in the open block
+static act_history_entry_t s_state;
+static uint32_t s_records;
+static uint32_t s_bytes;
+static uint32_t s_evicted;
+static uint32_t s_ignored;
+static bool s_active;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// flush task
+static act_history_flush_config_t s_flush_cfg;
+static char s_flush_path[64];
+static char s_flush_old[64];
+static TaskHandle_t s_flush_task;
+static volatile bool s_flush_stop;
+static uint32_t s_flush_writes;
+static uint32_t s_flush_bytes;
+static uint32_t s_flush_lost;
+static uint32_t s_flush_errors;
+
+static uint8_t *block_at(uint32_t seq)
+{
+    return s_blocks + (size_t)(seq % s_n_blocks) * ACT_HISTORY_BLOCK_SIZE;
+}
+
+static size_t put_varint(uint8_t *p, uint32_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static bool get_varint(const uint8_t *p, size_t len, size_t *pos, uint32_t *v)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35 && *pos < len; shift += 7)
+    {
+        uint8_t b = p[(*pos)++];
+        value |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+        {
+            *v = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// Close the open block; returns true when there was one
+static bool seal_locked(void)
+{
+    if (!s_open_begun)
+    {
+        return false;
+    }
+    s_seq_open++;
+    s_open_begun = false;
+    s_open_len = 0;
+    return true;
+}
+
+static void begin_locked(int64_t t_us)
+{
+    if (s_seq_open - s_seq_first >= s_n_blocks)
+    {
+        s_seq_first = s_seq_open - s_n_blocks + 1;
+        s_evicted++;
+    }
+    act_history_block_t hdr = {
+        .magic = ACT_HISTORY_MAGIC,
+        .seq = s_seq_open,
+        .t_us = t_us,
+        .code = {s_state.code[0], s_state.code[1]},
+        .relay = s_state.relay,
+        .known = s_state.known,
+    };
+    memcpy(block_at(s_seq_open), &hdr, HDR_SIZE);
+    s_open_begun = true;
+    s_open_len = 0;
+    s_state.t_us = t_us;
+}
+
+// Word of a register pair written by an auto-increment transfer that starts at data[0]
+static bool decode_word(const uint8_t *data, size_t len, uint8_t reg, uint16_t *word)
+{
+    if (reg < data[0] || (size_t)(reg - data[0]) + 2 >= len)
+    {
+        return false;
+    }
+    size_t off = reg - data[0] + 1;
+    *word = (uint16_t)(data[off] | data[off + 1] << 8);
+    return true;
+}
+
+// Scheduler write tap: on the scheduler task of the port, after the device acked
+static void history_tap(int port, uint16_t addr, const uint8_t *data, size_t len, bool standby, int64_t t_us)
+{
+    uint16_t code[2] = {0};
+    uint8_t relay = 0;
+    uint8_t set = 0;
+
+    if (port == s_cfg.dac_port && addr == s_cfg.dac_addr)
+    {
+        set |= decode_word(data, len, DAC_REG_CH0, &code[0]) ? ACT_HISTORY_CH0 : 0;
+        set |= decode_word(data, len, DAC_REG_CH1, &code[1]) ? ACT_HISTORY_CH1 : 0;
+    }
+    else if (port == s_cfg.relay_port && addr == s_cfg.relay_addr)
+    {
+        if (data[0] <= M54R_REG_RELAY && (size_t)(M54R_REG_RELAY - data[0]) + 1 < len)
+        {
+            relay = data[M54R_REG_RELAY - data[0] + 1];
+            set |= ACT_HISTORY_RELAY;
+        }
+    }
+    else
+    {
+        return;
+    }
+
+    bool sealed = false;
+    portENTER_CRITICAL(&s_mux);
+    if (!s_active || s_blocks == NULL)
+    {
+        portEXIT_CRITICAL(&s_mux);
+        return;
+    }
+    if (set == 0)
+    {
+        s_ignored++;
+        portEXIT_CRITICAL(&s_mux);
+        return;
+    }
+    if (t_us < s_state.t_us)
+    {
+        t_us = s_state.t_us; // stamped on the other port just before this one got the lock
+    }
+    if (s_open_begun && (s_open_len + MAX_RECORD > ACT_HISTORY_BLOCK_SIZE - HDR_SIZE ||
+                         t_us - s_state.t_us > (int64_t)UINT32_MAX))
+    {
+        sealed = seal_locked();
+    }
+    if (!s_open_begun)
+    {
+        begin_locked(t_us);
+    }
+
+    uint8_t *p = block_at(s_seq_open) + HDR_SIZE + s_open_len;
+    size_t n = 0;
+    p[n++] = set | (standby ? ACT_HISTORY_STANDBY : 0);
+    n += put_varint(p + n, (uint32_t)(t_us - s_state.t_us));
+    for (int ch = 0; ch < 2; ch++)
+    {
+        if (set & (ACT_HISTORY_CH0 << ch))
+        {
+            n += put_varint(p + n, zigzag((int32_t)code[ch] - s_state.code[ch]));
+            s_state.code[ch] = code[ch];
+        }
+    }
+    if (set & ACT_HISTORY_RELAY)
+    {
+        p[n++] = relay;
+        s_state.relay = relay;
+    }
+    s_state.known |= set & ~ACT_HISTORY_STANDBY;
+    s_state.t_us = t_us;
+    s_open_len += n;
+    uint16_t rec_len = (uint16_t)s_open_len;
+    memcpy(block_at(s_seq_open) + offsetof(act_history_block_t, len), &rec_len, sizeof(rec_len));
+    s_records++;
+    s_bytes += n;
+    TaskHandle_t flusher = s_flush_task;
+    portEXIT_CRITICAL(&s_mux);
+
+    if (sealed && flusher)
+    {
+        xTaskNotifyGive(flusher);
+    }
+}
+
+esp_err_t act_history_start(const act_history_config_t *config)
+{
+    act_history_config_t cfg = config ? *config : (act_history_config_t)ACT_HISTORY_CONFIG_DEFAULT();
+    if (cfg.size == 0)
+    {
+        cfg.size = ACT_HISTORY_DEFAULT_SIZE;
+    }
+    uint32_t n_blocks = cfg.size / ACT_HISTORY_BLOCK_SIZE;
+    if (n_blocks < 2)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // readers copy under the lock: after this no one touches the old ring
+    uint8_t *old = NULL;
+    portENTER_CRITICAL(&s_mux);
+    s_active = false;
+    if (s_n_blocks != n_blocks)
+    {
+        old = s_blocks;
+        s_blocks = NULL;
+        s_n_blocks = 0;
+    }
+    portEXIT_CRITICAL(&s_mux);
+
+    uint8_t *blocks = NULL;
+    bool psram = s_psram;
+    if (old || s_blocks == NULL)
+    {
+        heap_caps_free(old);
+        blocks = heap_caps_malloc((size_t)n_blocks * ACT_HISTORY_BLOCK_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        psram = (blocks != NULL);
+        if (blocks == NULL)
+        {
+            blocks = heap_caps_malloc((size_t)n_blocks * ACT_HISTORY_BLOCK_SIZE, MALLOC_CAP_8BIT);
+        }
+        if (blocks == NULL)
+        {
+            ESP_LOGE(TAG, "No memory for a %u byte history ring", (unsigned)cfg.size);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    portENTER_CRITICAL(&s_mux);
+    if (blocks)
+    {
+        s_blocks = blocks;
+        s_n_blocks = n_blocks;
+        s_psram = psram;
+    }
+    s_cfg = cfg;
+    s_seq_first = s_seq_open = 0;
+    s_open_begun = false;
+    s_open_len = 0;
+    memset(&s_state, 0, sizeof(s_state));
+    s_records = s_bytes = s_evicted = s_ignored = 0;
+    s_active = true;
+    portEXIT_CRITICAL(&s_mux);
+    i2c_sched_set_write_tap(history_tap);
+
+    ESP_LOGI(TAG, "Recording into %" PRIu32 " blocks of %s RAM", n_blocks, s_psram ? "PSRAM" : "internal");
+    return ESP_OK;
+}
+
+void act_history_stop(void)
+{
+    i2c_sched_set_write_tap(NULL);
+    portENTER_CRITICAL(&s_mux);
+    s_active = false;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+bool act_history_active(void)
+{
+    return s_active;
+}
+
+bool act_history_get_state(act_history_entry_t *state)
+{
+    portENTER_CRITICAL(&s_mux);
+    *state = s_state;
+    bool active = s_active;
+    portEXIT_CRITICAL(&s_mux);
+    return active;
+}
+
+void act_history_get_status(act_history_status_t *status)
+{
+    memset(status, 0, sizeof(*status));
+    portENTER_CRITICAL(&s_mux);
+    status->active = s_active;
+    status->psram = s_psram;
+    status->size = (size_t)s_n_blocks * ACT_HISTORY_BLOCK_SIZE;
+    status->blocks = s_seq_open - s_seq_first + (s_open_begun ? 1 : 0);
+    status->records = s_records;
+    status->bytes = s_bytes;
+    status->evicted = s_evicted;
+    status->ignored = s_ignored;
+    if (status->blocks)
+    {
+        memcpy(&status->first_us, block_at(s_seq_first) + offsetof(act_history_block_t, t_us), sizeof(int64_t));
+    }
+    status->flushing = s_flush_task != NULL;
+    status->flush_writes = s_flush_writes;
+    status->flush_bytes = s_flush_bytes;
+    status->flush_lost = s_flush_lost;
+    status->flush_errors = s_flush_errors;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void act_history_seal(void)
+{
+    portENTER_CRITICAL(&s_mux);
+    seal_locked();
+    portEXIT_CRITICAL(&s_mux);
+}
+
+size_t act_history_next_block(act_history_cursor_t *cursor, uint8_t *block, bool open, uint32_t *skipped)
+{
+    size_t n = 0;
+
+    portENTER_CRITICAL(&s_mux);
+    if (s_blocks)
+    {
+        // behind the ring, or ahead of it after a restart: continue at the oldest block
+        if (!cursor->valid || cursor->seq < s_seq_first || cursor->seq > s_seq_open + 1)
+        {
+            if (skipped && cursor->valid && cursor->seq < s_seq_first)
+            {
+                *skipped += s_seq_first - cursor->seq;
+            }
+            cursor->seq = s_seq_first;
+            cursor->valid = true;
+        }
+        if (cursor->seq < s_seq_open || (open && s_open_begun && cursor->seq == s_seq_open))
+        {
+            const uint8_t *src = block_at(cursor->seq);
+            uint16_t len;
+            memcpy(&len, src + offsetof(act_history_block_t, len), sizeof(len));
+            n = HDR_SIZE + len;
+            memcpy(block, src, n);
+            cursor->seq++;
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return n;
+}
+
+esp_err_t act_history_reader_init(act_history_reader_t *reader, const uint8_t *block, size_t size)
+{
+    act_history_block_t hdr;
+    if (size < HDR_SIZE)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&hdr, block, HDR_SIZE);
+    if (hdr.magic != ACT_HISTORY_MAGIC)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (hdr.len == 0 && hdr.seq == UINT32_MAX)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (hdr.len > ACT_HISTORY_BLOCK_SIZE - HDR_SIZE || HDR_SIZE + hdr.len > size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(reader, 0, sizeof(*reader));
+    reader->rec = block + HDR_SIZE;
+    reader->len = hdr.len;
+    reader->state.t_us = hdr.t_us;
+    reader->state.code[0] = hdr.code[0];
+    reader->state.code[1] = hdr.code[1];
+    reader->state.relay = hdr.relay;
+    reader->state.known = hdr.known;
+    return ESP_OK;
+}
+
+bool act_history_read(act_history_reader_t *reader, act_history_entry_t *entry)
+{
+    act_history_entry_t st = reader->state;
+    size_t pos = reader->pos;
+    uint32_t v;
+
+    if (pos >= reader->len)
+    {
+        return false;
+    }
+    uint8_t set = reader->rec[pos++];
+    if ((set & ~SET_MASK) || !(set & ~ACT_HISTORY_STANDBY) || !get_varint(reader->rec, reader->len, &pos, &v))
+    {
+        reader->pos = reader->len; // damaged: the rest of the block is lost
+        return false;
+    }
+    st.t_us += v;
+    for (int ch = 0; ch < 2; ch++)
+    {
+        if (set & (ACT_HISTORY_CH0 << ch))
+        {
+            if (!get_varint(reader->rec, reader->len, &pos, &v))
+            {
+                reader->pos = reader->len;
+                return false;
+            }
+            st.code[ch] = (uint16_t)(st.code[ch] + unzigzag(v));
+        }
+    }
+    if (set & ACT_HISTORY_RELAY)
+    {
+        if (pos >= reader->len)
+        {
+            reader->pos = reader->len;
+            return false;
+        }
+        st.relay = reader->rec[pos++];
+    }
+    st.known |= set & ~ACT_HISTORY_STANDBY;
+    st.set = set;
+    reader->state = st;
+    reader->pos = pos;
+    *entry = st;
+    return true;
+}
+
+void act_history_format_csv(const act_history_entry_t *entry, char *line, size_t line_size)
+{
+    char ch0[8] = "", ch1[8] = "", relay[8] = "", set[5];
+    size_t n = 0;
+
+    if (entry->known & ACT_HISTORY_CH0)
+    {
+        snprintf(ch0, sizeof(ch0), "%u", entry->code[0]);
+    }
+    if (entry->known & ACT_HISTORY_CH1)
+    {
+        snprintf(ch1, sizeof(ch1), "%u", entry->code[1]);
+    }
+    if (entry->known & ACT_HISTORY_RELAY)
+    {
+        snprintf(relay, sizeof(relay), "%u", entry->relay);
+    }
+    if (entry->set & ACT_HISTORY_CH0)
+    {
+        set[n++] = '0';
+    }
+    if (entry->set & ACT_HISTORY_CH1)
+    {
+        set[n++] = '1';
+    }
+    if (entry->set & ACT_HISTORY_RELAY)
+    {
+        set[n++] = 'r';
+    }
+    if (entry->set & ACT_HISTORY_STANDBY)
+    {
+        set[n++] = 'f';
+    }
+    set[n] = '\0';
+    snprintf(line, line_size, "%" PRId64 ",%s,%s,%s,%s", entry->t_us, ch0, ch1, relay, set);
+}
+
+uint32_t act_history_write_csv(FILE *out, int64_t since_us)
+{
+    // console use only: static so a dump does not need the block on the task stack
+    static uint8_t block[ACT_HISTORY_BLOCK_SIZE];
+    act_history_cursor_t cursor = {0};
+    act_history_reader_t reader;
+    act_history_entry_t entry;
+    char line[64];
+    uint32_t written = 0;
+    size_t n;
+
+    fprintf(out, ACT_HISTORY_CSV_HEADER "\n");
+    while ((n = act_history_next_block(&cursor, block, true, NULL)) > 0)
+    {
+        if (act_history_reader_init(&reader, block, n) != ESP_OK)
+        {
+            continue;
+        }
+        while (act_history_read(&reader, &entry))
+        {
+            if (entry.t_us >= since_us)
+            {
+                act_history_format_csv(&entry, line, sizeof(line));
+                fprintf(out, "%s\n", line);
+                written++;
+            }
+        }
+    }
+    return written;
+}
+
+int act_history_write_binary(int (*write)(void *io, const uint8_t *buf, size_t len), void *io, int64_t since_us)
+{
+    static uint8_t block[ACT_HISTORY_BLOCK_SIZE];
+    static uint8_t before[ACT_HISTORY_BLOCK_SIZE]; // Last block that starts before since_us
+    act_history_cursor_t cursor = {0};
+    size_t before_len = 0;
+    int total = 0;
+    size_t n;
+
+    while ((n = act_history_next_block(&cursor, block, true, NULL)) > 0)
+    {
+        int64_t t_us;
+        memcpy(&t_us, block + offsetof(act_history_block_t, t_us), sizeof(t_us));
+        if (since_us && t_us <= since_us)
+        {
+            memcpy(before, block, n); // may still hold writes after since_us
+            before_len = n;
+            continue;
+        }
+        if (before_len)
+        {
+            if (write(io, before, before_len) < 0)
+            {
+                return -1;
+            }
+            total += (int)before_len;
+            before_len = 0;
+        }
+        if (write(io, block, n) < 0)
+        {
+            return -1;
+        }
+        total += (int)n;
+    }
+    if (before_len)
+    {
+        if (write(io, before, before_len) < 0)
+        {
+            return -1;
+        }
+        total += (int)before_len;
+    }
+    const act_history_block_t end = {.magic = ACT_HISTORY_MAGIC, .len = 0, .seq = UINT32_MAX};
+    if (write(io, (const uint8_t *)&end, HDR_SIZE) < 0)
+    {
+        return -1;
+    }
+    return total + (int)HDR_SIZE;
+}
+
+// Append to the file, which becomes <path>.old when it would grow beyond max_file_kb
+static void flush_write(const uint8_t *buf, size_t len)
+{
+    struct stat st;
+    if (s_flush_cfg.max_file_kb && stat(s_flush_path, &st) == 0 &&
+        (size_t)st.st_size + len > (size_t)s_flush_cfg.max_file_kb * 1024)
+    {
+        remove(s_flush_old);
+        if (rename(s_flush_path, s_flush_old) != 0)
+        {
+            ESP_LOGW(TAG, "Cannot rename %s", s_flush_path);
+        }
+    }
+    int fd = open(s_flush_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    bool ok = fd >= 0 && write(fd, buf, len) == (ssize_t)len;
+    if (fd >= 0 && close(fd) != 0)
+    {
+        ok = false;
+    }
+    portENTER_CRITICAL(&s_mux);
+    if (ok)
+    {
+        s_flush_writes++;
+        s_flush_bytes += len;
+    }
+    else
+    {
+        s_flush_errors++;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    if (!ok)
+    {
+        ESP_LOGW(TAG, "Write of %u bytes to %s failed", (unsigned)len, s_flush_path);
+    }
+}
+
+// Time of the first record of the open block, 0 when it has none
+static int64_t open_since(void)
+{
+    int64_t t_us = 0;
+    portENTER_CRITICAL(&s_mux);
+    if (s_open_begun && s_blocks)
+    {
+        memcpy(&t_us, block_at(s_seq_open) + offsetof(act_history_block_t, t_us), sizeof(t_us));
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return t_us;
+}
+
+// Closed blocks go into a sector-sized stage; a full stage is one write. A partial one is
+// written only when its first record waited max_age_ms, or at the stop.
+static void flush_task(void *arg)
+{
+    uint8_t *stage = arg;
+    uint8_t *block = stage + ACT_HISTORY_FLUSH_SIZE;
+    act_history_cursor_t cursor = {0};
+    size_t staged = 0;
+    int64_t staged_us = 0; // First record in the stage
+    int64_t max_age_us = (int64_t)s_flush_cfg.max_age_ms * 1000;
+    uint32_t lost = 0;
+
+    for (;;)
+    {
+        bool stop = s_flush_stop;
+        if (!stop)
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FLUSH_POLL_MS));
+            stop = s_flush_stop;
+        }
+        int64_t now = esp_timer_get_time();
+        int64_t open_us = open_since();
+        if (stop || (open_us && now - open_us >= max_age_us))
+        {
+            act_history_seal();
+        }
+
+        size_t n;
+        while ((n = act_history_next_block(&cursor, block, false, &lost)) > 0)
+        {
+            int64_t t_us;
+            memcpy(&t_us, block + offsetof(act_history_block_t, t_us), sizeof(t_us));
+            for (size_t pos = 0; pos < n;)
+            {
+                if (staged == 0)
+                {
+                    staged_us = t_us;
+                }
+                size_t take = n - pos < ACT_HISTORY_FLUSH_SIZE - staged ? n - pos : ACT_HISTORY_FLUSH_SIZE - staged;
+                memcpy(stage + staged, block + pos, take);
+                staged += take;
+                pos += take;
+                if (staged == ACT_HISTORY_FLUSH_SIZE)
+                {
+                    flush_write(stage, staged);
+                    staged = 0;
+                }
+            }
+        }
+        portENTER_CRITICAL(&s_mux);
+        s_flush_lost = lost;
+        portEXIT_CRITICAL(&s_mux);
+
+        if (staged && (stop || now - staged_us >= max_age_us))
+        {
+            flush_write(stage, staged);
+            staged = 0;
+        }
+        if (stop)
+        {
+            break;
+        }
+    }
+    free(stage);
+    portENTER_CRITICAL(&s_mux);
+    s_flush_task = NULL;
+    portEXIT_CRITICAL(&s_mux);
+    vTaskDelete(NULL);
+}
+
+esp_err_t act_history_flush_start(const act_history_flush_config_t *config)
+{
+    if (!config || !config->path || strlen(config->path) + 5 > sizeof(s_flush_path))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_flush_task)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_flush_cfg = *config;
+    strcpy(s_flush_path, config->path);
+    // <path>.old: the extension replaced, 8.3 names stay 8.3
+    strcpy(s_flush_old, config->path);
+    char *dot = strrchr(s_flush_old, '.');
+    char *slash = strrchr(s_flush_old, '/');
+    if (dot && (!slash || dot > slash))
+    {
+        *dot = '\0';
+    }
+    strcat(s_flush_old, ".old");
+
+    uint8_t *stage = malloc(ACT_HISTORY_FLUSH_SIZE + ACT_HISTORY_BLOCK_SIZE);
+    if (stage == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    s_flush_stop = false;
+    s_flush_writes = s_flush_bytes = s_flush_lost = s_flush_errors = 0;
+    TaskHandle_t task = NULL;
+    if (xTaskCreate(flush_task, "act_hist", 4096, stage, config->priority, &task) != pdPASS)
+    {
+        free(stage);
+        return ESP_ERR_NO_MEM;
+    }
+    // until the handle is stored the tap does not notify: the task polls anyway
+    portENTER_CRITICAL(&s_mux);
+    s_flush_task = task;
+    portEXIT_CRITICAL(&s_mux);
+    ESP_LOGI(TAG, "Appending to %s", s_flush_path);
+    return ESP_OK;
+}
+
+esp_err_t act_history_flush_stop(void)
+{
+    TaskHandle_t task = s_flush_task;
+    if (task == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_flush_stop = true;
+    xTaskNotifyGive(task);
+    for (int waited = 0; s_flush_task != NULL; waited += 10)
+    {
+        if (waited >= FLUSH_STOP_WAIT_MS)
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return ESP_OK;
+}
+
+void act_history_print(FILE *out)
+{
+    act_history_status_t st;
+    if (!out)
+    {
+        return;
+    }
+    act_history_get_status(&st);
+    fprintf(out, "%s, ring %u bytes %s RAM, %" PRIu32 " blocks\r\n", st.active ? "recording" : "stopped",
+            (unsigned)st.size, st.psram ? "PSRAM" : "internal", st.blocks);
+    fprintf(out, "records %" PRIu32 " (%" PRIu32 ".%" PRIu32 " bytes each), %" PRIu32 " blocks evicted, %" PRIu32
+                 " other writes\r\n",
+            st.records, st.records ? st.bytes / st.records : 0, st.records ? st.bytes * 10 / st.records % 10 : 0,
+            st.evicted, st.ignored);
+    if (st.blocks)
+    {
+        fprintf(out, "oldest record %" PRId64 " ms ago\r\n", (esp_timer_get_time() - st.first_us) / 1000);
+    }
+    if (st.flushing || st.flush_writes || st.flush_errors)
+    {
+        fprintf(out, "file %s%s: %" PRIu32 " writes, %" PRIu32 " bytes, %" PRIu32 " blocks lost, %" PRIu32
+                     " errors\r\n",
+                s_flush_path, st.flushing ? "" : " (stopped)", st.flush_writes, st.flush_bytes, st.flush_lost,
+                st.flush_errors);
+    }
+}
@@ -0,0 +1,218 @@
+// act_history.h
+// Actuator history: every DAC word and relay byte that reached the devices, timestamped and
+// delta-encoded in a (PSRAM) ring, streamed as binary or CSV, optionally appended to a file
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "gp8413_sdc.h"
+#include "m5_4relay.h"
+
+#define ACT_HISTORY_BLOCK_SIZE (512)         // Header and records: the unit of eviction, streaming and the file
+#define ACT_HISTORY_DEFAULT_SIZE (32 * 1024) // Ring size when none is given
+#define ACT_HISTORY_MAGIC (0x4841)           // "AH", first bytes of every block
+#define ACT_HISTORY_FLUSH_SIZE (4096)        // Bytes per file write: one FAT sector
+
+// What a write set, and who wrote it
+#define ACT_HISTORY_CH0 (1 << 0)     // DAC channel 0 word
+#define ACT_HISTORY_CH1 (1 << 1)     // DAC channel 1 word
+#define ACT_HISTORY_RELAY (1 << 2)   // Relay register (relays bit0..3, LEDs bit4..7)
+#define ACT_HISTORY_STANDBY (1 << 3) // Written by the scheduler standby: the failsafe
+
+#define ACT_HISTORY_CSV_HEADER "t_us,ch0,ch1,relay,set"
+
+    /**
+     * @brief Block header, in the ring and in the streams and files as it is (little endian).
+     *
+     * The state is the one before the first record of the block, so every block decodes on
+     * its own. A header with len 0 and seq UINT32_MAX ends a stream.
+     */
+    typedef struct
+    {
+        uint16_t magic;   // ACT_HISTORY_MAGIC
+        uint16_t len;     // Record bytes after the header
+        uint32_t seq;     // Block number since the start
+        int64_t t_us;     // esp_timer time of the first record
+        uint16_t code[2]; // DAC words of channel 0 and 1
+        uint8_t relay;    // Relay register
+        uint8_t known;    // ACT_HISTORY_CH0 | CH1 | RELAY: the value above was seen
+        uint16_t reserved;
+    } act_history_block_t;
+
+    // One write, with the state of both devices after it
+    typedef struct
+    {
+        int64_t t_us;
+        uint16_t code[2];
+        uint8_t relay;
+        uint8_t known; // Values seen since the start
+        uint8_t set;   // ACT_HISTORY_*: what this write set, and whether the failsafe wrote it
+    } act_history_entry_t;
+
+    // Decoder of one block
+    typedef struct
+    {
+        const uint8_t *rec;
+        size_t len;
+        size_t pos;
+        act_history_entry_t state;
+    } act_history_reader_t;
+
+    typedef struct
+    {
+        size_t size;         // Ring bytes, 0 = ACT_HISTORY_DEFAULT_SIZE
+        int dac_port;        // Port and address of the GP8413, -1: not recorded
+        uint16_t dac_addr;
+        int relay_port;      // Port and address of the M5 relay board, -1: not recorded
+        uint16_t relay_addr;
+    } act_history_config_t;
+
+#define ACT_HISTORY_CONFIG_DEFAULT()                                                        \
+    {.size = 0, .dac_port = 0, .dac_addr = GP8413_I2C_ADDRESS, .relay_port = 0, .relay_addr = M54R_ADDR}
+
+    typedef struct
+    {
+        const char *path;     // File the blocks are appended to, e.g. /data/act.bin
+        uint32_t max_age_ms;  // A record waits at most this long for a full sector
+        uint32_t max_file_kb; // Then the file becomes <path>.old (the previous one is removed)
+        int priority;         // Of the flush task
+    } act_history_flush_config_t;
+
+#define ACT_HISTORY_FLUSH_CONFIG_DEFAULT() {.path = "/data/act.bin", .max_age_ms = 60000, .max_file_kb = 128, .priority = 1}
+
+    typedef struct
+    {
+        bool active;
+        bool psram;          // Ring is in PSRAM
+        size_t size;         // Ring bytes
+        uint32_t blocks;     // Blocks in the ring, the open one included
+        uint32_t records;    // Writes recorded since the start
+        uint32_t bytes;      // Record bytes of those, headers not counted
+        uint32_t evicted;    // Blocks overwritten
+        uint32_t ignored;    // Writes to the devices that set no DAC word or relay byte (range, mode)
+        int64_t first_us;    // First record still in the ring
+        bool flushing;       // The flush task runs
+        uint32_t flush_writes;
+        uint32_t flush_bytes;
+        uint32_t flush_lost;   // Blocks evicted before the flush task took them
+        uint32_t flush_errors; // Failed file writes, the data is dropped
+    } act_history_status_t;
+
+    // Read position in the ring; zero-initialise to start at the oldest block
+    typedef struct
+    {
+        uint32_t seq;
+        bool valid;
+    } act_history_cursor_t;
+
+    /**
+     * @brief Start recording, the ring is cleared.
+     *
+     * The ring is allocated in PSRAM when there is PSRAM, else in internal RAM, and kept after
+     * a stop. Records come from the write tap of the bus scheduler: what the devices acked,
+     * from the drivers, the actuator frames, the console tools and the failsafe alike.
+     *
+     * @return ESP_OK, ESP_ERR_INVALID_ARG for a ring below two blocks, ESP_ERR_NO_MEM.
+     */
+    esp_err_t act_history_start(const act_history_config_t *config);
+
+    // Stop recording, the ring keeps its contents
+    void act_history_stop(void);
+
+    bool act_history_active(void);
+
+    void act_history_get_status(act_history_status_t *status);
+
+    /**
+     * @brief State of both devices after the last recorded write, for a live view.
+     *
+     * @return Recording; when not, the state is the one at the stop.
+     */
+    bool act_history_get_state(act_history_entry_t *state);
+
+    /**
+     * @brief Close the open block: the next record starts a new one. Lets a reader that takes
+     * closed blocks only (the flush task) see the latest records.
+     */
+    void act_history_seal(void);
+
+    /**
+     * @brief Copy the block at the cursor and advance it.
+     *
+     * A cursor that fell behind the overwritten part continues at the oldest block.
+     *
+     * @param block   ACT_HISTORY_BLOCK_SIZE bytes.
+     * @param open    Also return the open block as it is now (it is the last one).
+     * @param skipped Optional, incremented by the blocks the cursor lost.
+     * @return Bytes copied (header and records), 0 at the end.
+     */
+    size_t act_history_next_block(act_history_cursor_t *cursor, uint8_t *block, bool open, uint32_t *skipped);
+
+    /**
+     * @brief Start decoding a block (from the ring, a stream or a file).
+     *
+     * @param size Bytes available at block.
+     * @return ESP_OK, ESP_ERR_INVALID_ARG for a bad magic or length, ESP_ERR_NOT_FOUND for
+     *         the end of a stream.
+     */
+    esp_err_t act_history_reader_init(act_history_reader_t *reader, const uint8_t *block, size_t size);
+
+    // Next write of the block; false at its end (or at a damaged record)
+    bool act_history_read(act_history_reader_t *reader, act_history_entry_t *entry);
+
+    /**
+     * @brief One CSV line (without newline): t_us,ch0,ch1,relay,set
+     *
+     * Values not seen yet are empty; set is a combination of '0', '1' (DAC channel), 'r'
+     * (relay register) and 'f' (failsafe), e.g. "1520,16384,0,3,0".
+     */
+    void act_history_format_csv(const act_history_entry_t *entry, char *line, size_t line_size);
+
+    /**
+     * @brief Write the ring as CSV: a header line and one line per write.
+     *
+     * @param since_us Only writes at or after this esp_timer time, 0 = all.
+     * @return Lines written.
+     */
+    uint32_t act_history_write_csv(FILE *out, int64_t since_us);
+
+    /**
+     * @brief Stream the ring as blocks, ended by the end header.
+     *
+     * @param write    Writes everything, < 0 on error.
+     * @param since_us Only the blocks with writes at or after this time, 0 = all.
+     * @return Bytes written, -1 when the transport failed.
+     */
+    int act_history_write_binary(int (*write)(void *io, const uint8_t *buf, size_t len), void *io, int64_t since_us);
+
+    /**
+     * @brief Start the flush task: closed blocks are appended to the file in writes of
+     * ACT_HISTORY_FLUSH_SIZE bytes (partial only when a record waited max_age_ms).
+     *
+     * Starts with the blocks that are in the ring now.
+     *
+     * @return ESP_OK, ESP_ERR_INVALID_STATE when already running, ESP_ERR_NO_MEM.
+     */
+    esp_err_t act_history_flush_start(const act_history_flush_config_t *config);
+
+    /**
+     * @brief Write what is recorded so far and stop the flush task.
+     */
+    esp_err_t act_history_flush_stop(void);
+
+    // Ring, records and the flush task
+    void act_history_print(FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,270 @@
+/**
+ * @file actuator.c
+ * @brief Actuator frames: the DAC setpoints and the relay board written as one unit.
+ *
+ * A frame is staged into the register shadows of both drivers first, which drops every
+ * register the device already has. What is left is flushed from one urgent scheduler job:
+ * the DAC words in one auto-increment transfer, directly followed by the RELAY register,
+ * with no other transaction in between. The job takes the timestamp of the frame when it
+ * gets the bus, so skew (first to last write) and apply latency (call to last write) are
+ * measured per frame.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "actuator.h"
+#include <string.h>
+#include <inttypes.h>
+#include "esp_timer.h"
+#include "i2c_bus.h"
+#include "i2c_sched.h"
+
+#define PART_DAC (1 << 0)
+#define PART_RELAY (1 << 1)
+
+typedef struct
+{
+    actuator_t *act;
+    int parts; // PART_* flushed by this job
+} apply_job_t;
+
+static uint32_t transfers(const actuator_t *act)
+{
+    return (act->dac ? act->dac->regs.transfers : 0) + (act->relay ? act->relay->regs.transfers : 0);
+}
+
+// Scheduler job: the bus belongs to this port until it returns
+static esp_err_t apply_exec(void *arg)
+{
+    apply_job_t *job = arg;
+    actuator_t *act = job->act;
+    esp_err_t ret = ESP_OK;
+
+    if (act->t_us == 0)
+    {
+        act->t_us = esp_timer_get_time();
+    }
+    if ((job->parts & PART_DAC) && act->dac->regs.dirty)
+    {
+        ret = gp8413_flush(act->dac);
+    }
+    if ((job->parts & PART_RELAY) && act->relay->regs.dirty)
+    {
+        esp_err_t relay_ret = m54_flush(act->relay);
+        ret = ret != ESP_OK ? ret : relay_ret;
+    }
+    act->t_end_us = esp_timer_get_time();
+    return ret;
+}
+
+esp_err_t actuator_init(actuator_t *act, gp8413_handle_t *dac, m54_ctx_t *relay)
+{
+    if (!act || (!dac && !relay))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(act, 0, sizeof(*act));
+    act->dac = dac;
+    act->relay = relay;
+    return ESP_OK;
+}
+
+void actuator_resync(actuator_t *act, i2c_master_bus_handle_t dac_bus, i2c_master_bus_handle_t relay_bus)
+{
+    if (!act)
+    {
+        return;
+    }
+    if (dac_bus)
+    {
+        __atomic_store_n(&act->resync_dac_bus, dac_bus, __ATOMIC_RELEASE);
+    }
+    if (relay_bus)
+    {
+        __atomic_store_n(&act->resync_relay_bus, relay_bus, __ATOMIC_RELEASE);
+    }
+}
+
+// The restore a bus recovery left to this task (actuator_resync)
+static esp_err_t take_resync(actuator_t *act)
+{
+    esp_err_t ret = ESP_OK;
+    i2c_master_bus_handle_t dac_bus = __atomic_exchange_n(&act->resync_dac_bus, NULL, __ATOMIC_ACQUIRE);
+    i2c_master_bus_handle_t relay_bus = __atomic_exchange_n(&act->resync_relay_bus, NULL, __ATOMIC_ACQUIRE);
+
+    if (dac_bus && act->dac && act->dac->initialized)
+    {
+        ret = gp8413_restore(act->dac, dac_bus);
+    }
+    if (relay_bus && act->relay && act->relay->initialized)
+    {
+        m54_ctx_t *relay = act->relay;
+        relay->bus_handle = relay_bus;
+        esp_err_t relay_ret = i2c_bus_get_device(relay_bus, relay->device_address, relay->scl_speed_hz,
+                                                 &relay->dev_handle);
+        relay_ret = relay_ret != ESP_OK ? relay_ret : m54_restore(relay);
+        ret = ret != ESP_OK ? ret : relay_ret;
+    }
+    return ret;
+}
+
+static void record(actuator_t *act, int64_t start_us)
+{
+    actuator_stats_t *st = &act->stats;
+    uint32_t skew = (uint32_t)(act->t_end_us - act->t_us);
+    uint32_t latency = (uint32_t)(act->t_end_us - start_us);
+
+    st->skew_last_us = skew;
+    st->skew_max_us = skew > st->skew_max_us ? skew : st->skew_max_us;
+    st->latency_last_us = latency;
+    st->latency_max_us = latency > st->latency_max_us ? latency : st->latency_max_us;
+    st->latency_total_us += latency;
+    if (act->last_t_us)
+    {
+        uint32_t interval = (uint32_t)(act->t_us - act->last_t_us);
+        st->interval_last_us = interval;
+        if (st->interval_min_us == 0 || interval < st->interval_min_us)
+        {
+            st->interval_min_us = interval;
+        }
+        st->interval_max_us = interval > st->interval_max_us ? interval : st->interval_max_us;
+    }
+    act->last_t_us = act->t_us;
+}
+
+esp_err_t actuator_apply(actuator_t *act, const actuator_frame_t *frame, int64_t *t_us)
+{
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = ESP_OK;
+
+    if (!act || !frame)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (take_resync(act) != ESP_OK)
+    {
+        act->stats.failed++; // what did not go out stays dirty and is flushed with this frame
+    }
+    // check everything before staging anything: a bad frame changes nothing
+    if (act->dac &&
+        (!act->dac->initialized || frame->dac_mv[0] > act->dac->output_range || frame->dac_mv[1] > act->dac->output_range))
+    {
+        return act->dac->initialized ? ESP_ERR_INVALID_ARG : ESP_ERR_INVALID_STATE;
+    }
+    if (act->relay && (!act->relay->initialized || (frame->relays | frame->leds) & 0xF0))
+    {
+        return act->relay->initialized ? ESP_ERR_INVALID_ARG : ESP_ERR_INVALID_STATE;
+    }
+    int dac_port = act->dac ? i2c_bus_port_of(act->dac->bus_handle) : -1;
+    int relay_port = act->relay ? i2c_bus_port_of(act->relay->bus_handle) : -1;
+    if ((act->dac && i2c_sched_is_held(dac_port, act->dac->regs.device_address)) ||
+        (act->relay && i2c_sched_is_held(relay_port, act->relay->regs.device_address)))
+    {
+        return ESP_ERR_INVALID_STATE; // the failsafe holds the outputs
+    }
+
+    int parts = 0;
+    if (act->dac)
+    {
+        gp8413_stage_output_voltage(act->dac, frame->dac_mv[0], 0);
+        gp8413_stage_output_voltage(act->dac, frame->dac_mv[1], 1);
+        parts |= act->dac->regs.dirty ? PART_DAC : 0;
+    }
+    if (act->relay)
+    {
+        m54_stage_outputs(act->relay, frame->relays, frame->leds);
+        parts |= act->relay->regs.dirty ? PART_RELAY : 0;
+    }
+    act->stats.frames++;
+    if (parts == 0)
+    {
+        act->stats.unchanged++;
+        if (t_us)
+        {
+            *t_us = act->last_t_us;
+        }
+        return ESP_OK;
+    }
+
+    uint32_t before = transfers(act);
+    act->t_us = 0;
+    if (dac_port == relay_port || !(parts & PART_DAC) || !(parts & PART_RELAY))
+    {
+        apply_job_t job = {.act = act, .parts = parts};
+        ret = i2c_sched_run((parts & PART_DAC) ? dac_port : relay_port, I2C_SCHED_PRIO_URGENT, apply_exec, &job);
+    }
+    else
+    {
+        apply_job_t job = {.act = act, .parts = PART_DAC};
+        ret = i2c_sched_run(dac_port, I2C_SCHED_PRIO_URGENT, apply_exec, &job);
+        job.parts = PART_RELAY;
+        esp_err_t relay_ret = i2c_sched_run(relay_port, I2C_SCHED_PRIO_URGENT, apply_exec, &job);
+        ret = ret != ESP_OK ? ret : relay_ret;
+    }
+    act->stats.transactions += transfers(act) - before;
+    if (act->t_us == 0)
+    {
+        // the job never ran (deadline, scheduler stopped)
+        act->stats.failed++;
+        return ret != ESP_OK ? ret : ESP_FAIL;
+    }
+    if (ret != ESP_OK)
+    {
+        act->stats.failed++;
+    }
+    record(act, start_us);
+    if (t_us)
+    {
+        *t_us = act->t_us;
+    }
+    return ret;
+}
+
+void actuator_get_frame(const actuator_t *act, actuator_frame_t *frame)
+{
+    memset(frame, 0, sizeof(*frame));
+    if (act->dac)
+    {
+        frame->dac_mv[0] = (uint16_t)act->dac->current_voltage_ch0;
+        frame->dac_mv[1] = (uint16_t)act->dac->current_voltage_ch1;
+    }
+    if (act->relay && act->relay->initialized)
+    {
+        uint32_t relays = 0;
+        uint32_t leds = 0;
+        m54_relay_get_all(act->relay, &relays);
+        m54_led_get_all(act->relay, &leds);
+        frame->relays = (uint8_t)relays;
+        frame->leds = (uint8_t)leds;
+    }
+}
+
+void actuator_get_stats(actuator_t *act, actuator_stats_t *stats, bool reset)
+{
+    if (stats)
+    {
+        *stats = act->stats;
+    }
+    if (reset)
+    {
+        memset(&act->stats, 0, sizeof(act->stats));
+    }
+}
+
+void actuator_print(const actuator_t *act, FILE *out)
+{
+    const actuator_stats_t *st = &act->stats;
+    uint32_t applied = st->frames - st->unchanged;
+    if (!out)
+    {
+        return;
+    }
+    fprintf(out, "frames %" PRIu32 ", unchanged %" PRIu32 ", failed %" PRIu32 ", %" PRIu32 " transactions\r\n",
+            st->frames, st->unchanged, st->failed, st->transactions);
+    fprintf(out, "skew     last %6" PRIu32 " us  max %6" PRIu32 " us\r\n", st->skew_last_us, st->skew_max_us);
+    fprintf(out, "latency  last %6" PRIu32 " us  max %6" PRIu32 " us  avg %6" PRIu32 " us\r\n", st->latency_last_us,
+            st->latency_max_us, applied ? (uint32_t)(st->latency_total_us / applied) : 0);
+    fprintf(out, "interval last %6" PRIu32 " us  min %6" PRIu32 " us  max %6" PRIu32 " us\r\n", st->interval_last_us,
+            st->interval_min_us, st->interval_max_us);
+}
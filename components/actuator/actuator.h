@@ -0,0 +1,102 @@
+// actuator.h
+// Actuator frames: DAC setpoints, relays and LEDs applied together, back to back on the bus
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "gp8413_sdc.h"
+#include "m5_4relay.h"
+
+    // One complete setpoint of the machine
+    typedef struct
+    {
+        uint16_t dac_mv[2]; // GP8413 channel 0 (speed) and 1 (brake), millivolts
+        uint8_t relays;     // M5 relays, bit0..3
+        uint8_t leds;       // M5 LEDs, bit0..3
+    } actuator_frame_t;
+
+    typedef struct
+    {
+        uint32_t frames;       // actuator_apply() calls with a valid frame
+        uint32_t unchanged;    // Frames the devices already had: no bus traffic
+        uint32_t failed;       // Frames with a bus error (the rest is written with the next frame)
+        uint32_t transactions; // Bus transactions of all frames
+        uint32_t skew_last_us; // Start of the first to end of the last write of a frame
+        uint32_t skew_max_us;
+        uint32_t latency_last_us; // actuator_apply() call to end of the last write
+        uint32_t latency_max_us;
+        uint64_t latency_total_us;
+        uint32_t interval_last_us; // Between the timestamps of consecutive frames on the bus
+        uint32_t interval_min_us;
+        uint32_t interval_max_us;
+    } actuator_stats_t;
+
+    // Not locked: one task applies frames, like the driver contexts it uses
+    typedef struct
+    {
+        gp8413_handle_t *dac; // NULL: the frame has no DAC part
+        m54_ctx_t *relay;     // NULL: the frame has no relay part
+        actuator_stats_t stats;
+        int64_t last_t_us; // Timestamp of the last frame that went to the bus
+        // state of the frame being applied, used on the scheduler task
+        int64_t t_us;
+        int64_t t_end_us;
+        // rebuilt buses, set by actuator_resync() from another task
+        i2c_master_bus_handle_t resync_dac_bus;
+        i2c_master_bus_handle_t resync_relay_bus;
+    } actuator_t;
+
+    /**
+     * @brief Bind the DAC and the relay board. Clears the statistics.
+     *
+     * The frames are compared with the register shadows of the drivers, so what the console
+     * commands wrote in between is taken into account.
+     */
+    esp_err_t actuator_init(actuator_t *act, gp8413_handle_t *dac, m54_ctx_t *relay);
+
+    /**
+     * @brief Apply a complete frame.
+     *
+     * Only the registers that differ from the devices are written: at most one DAC transfer
+     * (both channels combined) and one relay write. They run back to back as one urgent
+     * scheduler job, nothing else gets the bus in between. When the DAC and the relays are on
+     * different buses the two parts follow each other.
+     *
+     * @param t_us Out (optional): time the frame went to the bus, or of the previous frame
+     *             when nothing changed.
+     * @return ESP_OK, ESP_ERR_INVALID_ARG for a setpoint out of range (nothing is sent),
+     *         ESP_ERR_INVALID_STATE while the failsafe holds the outputs, or the first bus error.
+     */
+    esp_err_t actuator_apply(actuator_t *act, const actuator_frame_t *frame, int64_t *t_us);
+
+    /**
+     * @brief Let the next actuator_apply() move a part to a rebuilt bus and write all of its
+     *        registers again, before the frame.
+     *
+     * For the bus recovery while another task applies the frames: only that task touches the
+     * driver contexts. May be called from any task; NULL leaves a part as it is.
+     */
+    void actuator_resync(actuator_t *act, i2c_master_bus_handle_t dac_bus, i2c_master_bus_handle_t relay_bus);
+
+    /**
+     * @brief The frame the devices have now (DAC setpoints and the relay shadow).
+     */
+    void actuator_get_frame(const actuator_t *act, actuator_frame_t *frame);
+
+    void actuator_get_stats(actuator_t *act, actuator_stats_t *stats, bool reset);
+
+    // Frame counters, skew, latency and interval
+    void actuator_print(const actuator_t *act, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file boot_trace.c
+ * @brief Boot profiler: where does the restart-to-ready time go.
+ *
+ * Every boot stage ends with boot_trace_mark("name"); the mark stores the name pointer and
+ * the esp_timer time in a static table under a spinlock, a few hundred nanoseconds and no
+ * allocation, so it can also be used before the heap or the console exists. The table is
+ * printed at the end of app_main and by 'bootprof'; tools/bootprof_compare.py compares two
+ * captured traces stage by stage.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "boot_trace.h"
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include "esp_timer.h"
+
+static boot_trace_mark_t s_marks[BOOT_TRACE_MAX_MARKS];
+static int s_count;
+static uint32_t s_dropped;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void boot_trace_mark(const char *name)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&s_mux);
+    if (s_count < BOOT_TRACE_MAX_MARKS)
+    {
+        s_marks[s_count].name = name;
+        s_marks[s_count].at_us = now;
+        s_count++;
+    }
+    else
+    {
+        s_dropped++;
+    }
+    portEXIT_CRITICAL_SAFE(&s_mux);
+}
+
+int boot_trace_get(boot_trace_mark_t *marks, int max, uint32_t *dropped)
+{
+    int n = 0;
+
+    portENTER_CRITICAL_SAFE(&s_mux);
+    for (; marks && n < s_count && n < max; n++)
+    {
+        marks[n] = s_marks[n];
+    }
+    if (dropped)
+    {
+        *dropped = s_dropped;
+    }
+    portEXIT_CRITICAL_SAFE(&s_mux);
+    return n;
+}
+
+void boot_trace_print(FILE *out)
+{
+    boot_trace_mark_t marks[BOOT_TRACE_MAX_MARKS];
+    uint32_t dropped;
+    int n = boot_trace_get(marks, BOOT_TRACE_MAX_MARKS, &dropped);
+
+    if (!out)
+    {
+        return;
+    }
+    // the first stage runs from esp_timer start (early in the startup code) to its mark
+    fprintf(out, "bootprof %d stages\r\n", n);
+    fprintf(out, "  #  stage              end(us)  took(us)\r\n");
+    int64_t prev = 0;
+    for (int i = 0; i < n; i++)
+    {
+        fprintf(out, "%3d  %-16s %9" PRId64 " %9" PRId64 "\r\n", i, marks[i].name, marks[i].at_us, marks[i].at_us - prev);
+        prev = marks[i].at_us;
+    }
+    if (dropped)
+    {
+        fprintf(out, "  %" PRIu32 " marks dropped, table full\r\n", dropped);
+    }
+}
@@ -0,0 +1,51 @@
+// boot_trace.h
+// Boot profiler: named stage timestamps in a static table, no allocation
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define BOOT_TRACE_MAX_MARKS (32)
+
+    // One mark: the end of a boot stage
+    typedef struct
+    {
+        const char *name; // Static string without spaces
+        int64_t at_us;    // esp_timer time
+    } boot_trace_mark_t;
+
+    /**
+     * @brief Record the end of a boot stage. Safe from any task; marks beyond
+     * BOOT_TRACE_MAX_MARKS are counted and dropped.
+     *
+     * @param name Static string without spaces (it is stored as a pointer).
+     */
+    void boot_trace_mark(const char *name);
+
+    /**
+     * @brief Copy the marks.
+     *
+     * @param marks   Output array.
+     * @param max     Size of the array.
+     * @param dropped Optional: marks that did not fit in the table.
+     * @return Number of marks copied.
+     */
+    int boot_trace_get(boot_trace_mark_t *marks, int max, uint32_t *dropped);
+
+    /**
+     * @brief Print the trace: one row per stage with its end time and duration.
+     *
+     * The format is read by tools/bootprof_compare.py, capture it from the boot log or
+     * the 'bootprof' command.
+     */
+    void boot_trace_print(FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
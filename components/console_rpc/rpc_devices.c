@@ -0,0 +1,224 @@
+/**
+ * @file rpc_devices.c
+ * @brief RPC handlers of the DAC, relay and display opcodes.
+ *
+ * Thin wrappers around the drivers: decode the little-endian body, call the driver on the
+ * context the application hands out (the same ones the console commands use), encode the
+ * reply. No logging on the request path, the console transport carries the frames.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "rpc_devices.h"
+#include <string.h>
+
+#define RPC_DISPLAY_MAX_TEXT (128)
+
+static esp_err_t dac_reply(const gp8413_handle_t *dac, uint8_t *reply, size_t *reply_len)
+{
+    if (*reply_len < 4)
+    {
+        *reply_len = 0;
+        return ESP_ERR_NO_MEM;
+    }
+    rpc_put_u16(&reply[0], (uint16_t)dac->current_voltage_ch0);
+    rpc_put_u16(&reply[2], (uint16_t)dac->current_voltage_ch1);
+    *reply_len = 4;
+    return ESP_OK;
+}
+
+static esp_err_t op_dac_set(void *ctx, const uint8_t *body, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    const rpc_devices_t *devs = ctx;
+    gp8413_handle_t *dac = devs->dac ? devs->dac() : NULL;
+    if (len != 5 || dac == NULL)
+    {
+        *reply_len = 0;
+        return len != 5 ? ESP_ERR_INVALID_SIZE : ESP_ERR_INVALID_STATE;
+    }
+    uint8_t mask = body[0];
+    uint32_t mv0 = rpc_get_u16(&body[1]);
+    uint32_t mv1 = rpc_get_u16(&body[3]);
+    if ((mask & ~0x03) || mask == 0 || mv0 > (uint32_t)dac->output_range || mv1 > (uint32_t)dac->output_range)
+    {
+        *reply_len = 0;
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // staged, both channels go out in one transfer; the set functions would log every write
+    esp_err_t ret = ESP_OK;
+    if (mask & 0x01)
+    {
+        ret = gp8413_stage_output_voltage(dac, mv0, 0);
+    }
+    if (ret == ESP_OK && (mask & 0x02))
+    {
+        ret = gp8413_stage_output_voltage(dac, mv1, 1);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = gp8413_flush(dac);
+    }
+    esp_err_t reply_ret = dac_reply(dac, reply, reply_len);
+    return ret != ESP_OK ? ret : reply_ret;
+}
+
+static esp_err_t op_dac_get(void *ctx, const uint8_t *body, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    const rpc_devices_t *devs = ctx;
+    gp8413_handle_t *dac = devs->dac ? devs->dac() : NULL;
+    if (dac == NULL)
+    {
+        *reply_len = 0;
+        return ESP_ERR_INVALID_STATE;
+    }
+    return dac_reply(dac, reply, reply_len);
+}
+
+static esp_err_t relay_reply(m54_ctx_t *relay, uint8_t *reply, size_t *reply_len)
+{
+    uint32_t state = 0;
+    esp_err_t ret = m54_relay_get_all(relay, &state);
+    if (ret != ESP_OK || *reply_len < 1)
+    {
+        *reply_len = 0;
+        return ret != ESP_OK ? ret : ESP_ERR_NO_MEM;
+    }
+    reply[0] = (uint8_t)state;
+    *reply_len = 1;
+    return ESP_OK;
+}
+
+static esp_err_t op_relay_set(void *ctx, const uint8_t *body, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    const rpc_devices_t *devs = ctx;
+    m54_ctx_t *relay = devs->relay ? devs->relay() : NULL;
+    if (len != 2 || relay == NULL)
+    {
+        *reply_len = 0;
+        return len != 2 ? ESP_ERR_INVALID_SIZE : ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = m54_relay_set_mask(relay, body[0], body[1]);
+    if (ret != ESP_OK)
+    {
+        *reply_len = 0;
+        return ret;
+    }
+    return relay_reply(relay, reply, reply_len);
+}
+
+static esp_err_t op_relay_get(void *ctx, const uint8_t *body, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    const rpc_devices_t *devs = ctx;
+    m54_ctx_t *relay = devs->relay ? devs->relay() : NULL;
+    if (relay == NULL)
+    {
+        *reply_len = 0;
+        return ESP_ERR_INVALID_STATE;
+    }
+    return relay_reply(relay, reply, reply_len);
+}
+
+static esp_err_t display_show(ssd1306_handle_t *dev)
+{
+    // asynchronous bus: queued, the copy is sent while the next request is handled
+    return ssd1306_show_async(dev);
+}
+
+static esp_err_t op_display_text(void *ctx, const uint8_t *body, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    const rpc_devices_t *devs = ctx;
+    ssd1306_handle_t *dev = devs->display ? devs->display() : NULL;
+    char text[RPC_DISPLAY_MAX_TEXT + 1];
+
+    *reply_len = 0;
+    if (len < 4 || len - 4 > RPC_DISPLAY_MAX_TEXT)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (dev == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t flags = body[0];
+    uint8_t x = body[1];
+    uint8_t y = body[2];
+    uint8_t font = body[3];
+    memcpy(text, &body[4], len - 4);
+    text[len - 4] = '\0';
+
+    if (flags & RPC_DISPLAY_CLEAR)
+    {
+        ssd1306_fill(dev, 0x00);
+    }
+    switch (font)
+    {
+    case 6:
+        ssd1306_printFixed6(dev, x, y, 1, text);
+        break;
+    case 8:
+        ssd1306_printFixed8(dev, x, y, 1, text);
+        break;
+    case 16:
+        ssd1306_printFixed16(dev, x, y, 1, text);
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+    return (flags & RPC_DISPLAY_SHOW) ? display_show(dev) : ESP_OK;
+}
+
+static esp_err_t op_display_frame(void *ctx, const uint8_t *body, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    const rpc_devices_t *devs = ctx;
+    ssd1306_handle_t *dev = devs->display ? devs->display() : NULL;
+
+    *reply_len = 0;
+    if (len < 3)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (dev == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t flags = body[0];
+    size_t offset = rpc_get_u16(&body[1]);
+    size_t n = len - 3;
+    if (offset > sizeof(dev->buffer) || n > sizeof(dev->buffer) - offset)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (flags & RPC_DISPLAY_CLEAR)
+    {
+        ssd1306_fill(dev, 0x00);
+    }
+    memcpy(&dev->buffer[offset], &body[3], n);
+    return (flags & RPC_DISPLAY_SHOW) ? display_show(dev) : ESP_OK;
+}
+
+static esp_err_t op_display_show(void *ctx, const uint8_t *body, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    const rpc_devices_t *devs = ctx;
+    ssd1306_handle_t *dev = devs->display ? devs->display() : NULL;
+
+    *reply_len = 0;
+    if (dev == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return display_show(dev);
+}
+
+const rpc_op_t rpc_device_ops[] = {
+    {RPC_OP_DAC_SET, op_dac_set},
+    {RPC_OP_DAC_GET, op_dac_get},
+    {RPC_OP_RELAY_SET, op_relay_set},
+    {RPC_OP_RELAY_GET, op_relay_get},
+    {RPC_OP_DISPLAY_TEXT, op_display_text},
+    {RPC_OP_DISPLAY_FRAME, op_display_frame},
+    {RPC_OP_DISPLAY_SHOW, op_display_show},
+};
+
+const size_t rpc_device_ops_count = sizeof(rpc_device_ops) / sizeof(rpc_device_ops[0]);
@@ -0,0 +1,39 @@
+// rpc_devices.h
+// RPC opcodes for the DAC, the relay board and the display
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "gp8413_sdc.h"
+#include "m5_4relay.h"
+#include "ssd1306.h"
+#include "rpc_server.h"
+
+    // Where the handlers get their driver contexts; NULL or a NULL result answers ESP_ERR_INVALID_STATE
+    typedef struct
+    {
+        gp8413_handle_t *(*dac)(void);
+        m54_ctx_t *(*relay)(void);
+        ssd1306_handle_t *(*display)(void);
+    } rpc_devices_t;
+
+    /**
+     * @brief Opcode table of the device handlers, for rpc_server_config_t.ops with an
+     *        rpc_devices_t as ctx.
+     *
+     * DAC_SET with both channels is one transfer (staged, then gp8413_flush), RELAY_SET
+     * is one register write, DISPLAY_SHOW queues the flush on an asynchronous bus and
+     * returns; the next show waits for it.
+     */
+    extern const rpc_op_t rpc_device_ops[];
+    extern const size_t rpc_device_ops_count;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,218 @@
+/**
+ * @file rpc_frame.c
+ * @brief COBS framing and CRC-16 of the binary console RPC.
+ *
+ * COBS replaces every zero of the payload, so 0x00 only appears as frame delimiter and a
+ * receiver that lost sync finds the next frame at the next zero. Encoding and decoding are
+ * done byte by byte into one buffer, without a second copy of the payload.
+ *
+ * Plain C without ESP-IDF dependencies: the Linux client library builds the same file.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "rpc_frame.h"
+#include <string.h>
+
+uint16_t rpc_crc16(const uint8_t *data, size_t len, uint16_t crc)
+{
+    // CRC-16/CCITT-FALSE: poly 0x1021, start 0xffff, nibble table
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+        0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    };
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = (uint16_t)(crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)];
+        crc = (uint16_t)(crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0f)];
+    }
+    return crc;
+}
+
+void rpc_decoder_init(rpc_decoder_t *dec)
+{
+    memset(dec, 0, sizeof(*dec));
+}
+
+// Complete frame in buf: check length and CRC, fill msg
+static bool decoder_finish(rpc_decoder_t *dec, rpc_msg_t *msg)
+{
+    size_t n = dec->len;
+    if (dec->overflow || n < RPC_REQ_HEADER + 2)
+    {
+        return false;
+    }
+    if (rpc_crc16(dec->buf, n - 2, 0xffff) != rpc_get_u16(&dec->buf[n - 2]))
+    {
+        return false;
+    }
+    msg->id = rpc_get_u16(dec->buf);
+    msg->op = dec->buf[2];
+    msg->status = 0;
+    size_t header = RPC_REQ_HEADER;
+    if (msg->op & RPC_OP_RESPONSE)
+    {
+        if (n < RPC_RESP_HEADER + 2)
+        {
+            return false;
+        }
+        msg->status = rpc_get_i32(&dec->buf[3]);
+        header = RPC_RESP_HEADER;
+    }
+    msg->body = &dec->buf[header];
+    msg->len = n - 2 - header;
+    return true;
+}
+
+bool rpc_decoder_push(rpc_decoder_t *dec, uint8_t byte, rpc_msg_t *msg)
+{
+    if (byte == 0x00)
+    {
+        bool ok = false;
+        if (dec->in_frame)
+        {
+            // a block that ends early is a COBS error
+            ok = (dec->left == 0) && decoder_finish(dec, msg);
+            if (ok)
+            {
+                dec->frames++;
+            }
+            else
+            {
+                dec->dropped++;
+            }
+        }
+        dec->in_frame = false;
+        dec->overflow = false;
+        dec->len = 0;
+        dec->left = 0;
+        dec->code = 0;
+        return ok;
+    }
+
+    if (!dec->in_frame)
+    {
+        dec->in_frame = true;
+        dec->code = 0; // no block before the first one
+    }
+    if (dec->overflow)
+    {
+        return false;
+    }
+    if (dec->left == 0)
+    {
+        // new block: the previous one ended in a zero unless it was a full 254 byte block
+        if (dec->code != 0 && dec->code != 0xff)
+        {
+            if (dec->len >= sizeof(dec->buf))
+            {
+                dec->overflow = true;
+                return false;
+            }
+            dec->buf[dec->len++] = 0x00;
+        }
+        dec->code = byte;
+        dec->left = byte - 1;
+        return false;
+    }
+    if (dec->len >= sizeof(dec->buf))
+    {
+        dec->overflow = true;
+        return false;
+    }
+    dec->buf[dec->len++] = byte;
+    dec->left--;
+    return false;
+}
+
+typedef struct
+{
+    uint8_t *out;
+    size_t size;
+    size_t pos;      // Next free byte
+    size_t code_pos; // Where the code of the current block goes
+    uint8_t code;
+    bool full;
+} cobs_writer_t;
+
+static void cobs_begin_block(cobs_writer_t *w)
+{
+    if (w->pos >= w->size)
+    {
+        w->full = true;
+        return;
+    }
+    w->code_pos = w->pos++;
+    w->code = 1;
+}
+
+static void cobs_put(cobs_writer_t *w, uint8_t byte)
+{
+    if (w->full)
+    {
+        return;
+    }
+    if (byte == 0x00)
+    {
+        w->out[w->code_pos] = w->code;
+        cobs_begin_block(w);
+        return;
+    }
+    if (w->pos >= w->size)
+    {
+        w->full = true;
+        return;
+    }
+    w->out[w->pos++] = byte;
+    if (++w->code == 0xff)
+    {
+        w->out[w->code_pos] = w->code;
+        cobs_begin_block(w);
+    }
+}
+
+static void cobs_put_buf(cobs_writer_t *w, const uint8_t *data, size_t len, uint16_t *crc)
+{
+    *crc = rpc_crc16(data, len, *crc);
+    for (size_t i = 0; i < len; i++)
+    {
+        cobs_put(w, data[i]);
+    }
+}
+
+size_t rpc_frame_encode(const rpc_msg_t *msg, uint8_t *out, size_t out_size)
+{
+    uint8_t header[RPC_RESP_HEADER];
+    size_t header_len = RPC_REQ_HEADER;
+    uint16_t crc = 0xffff;
+
+    if (msg->len > RPC_MAX_BODY || out_size < 3)
+    {
+        return 0;
+    }
+    rpc_put_u16(header, msg->id);
+    header[2] = msg->op;
+    if (msg->op & RPC_OP_RESPONSE)
+    {
+        rpc_put_i32(&header[3], msg->status);
+        header_len = RPC_RESP_HEADER;
+    }
+
+    out[0] = 0x00;
+    cobs_writer_t w = {.out = out, .size = out_size - 1, .pos = 1};
+    cobs_begin_block(&w);
+    cobs_put_buf(&w, header, header_len, &crc);
+    cobs_put_buf(&w, msg->body, msg->len, &crc);
+    uint8_t tail[2];
+    rpc_put_u16(tail, crc);
+    cobs_put(&w, tail[0]);
+    cobs_put(&w, tail[1]);
+    if (w.full)
+    {
+        return 0;
+    }
+    w.out[w.code_pos] = w.code;
+    out[w.pos++] = 0x00;
+    return w.pos;
+}
@@ -0,0 +1,125 @@
+// rpc_frame.h
+// Binary RPC frames for the console transport: COBS framing, CRC-16, request IDs
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * On the wire every frame is 0x00 COBS(payload) 0x00. The leading delimiter ends any
+     * text (log lines) that was written between frames, the receiver drops that as a bad
+     * frame. Payload, little endian:
+     *
+     *   request:  id:u16 op:u8 body... crc:u16
+     *   response: id:u16 op|0x80:u8 status:i32 body... crc:u16
+     *
+     * crc is CRC-16/CCITT-FALSE over everything before it. The id of a request comes back
+     * in its response, so a client can have several requests outstanding (pipelining).
+     * status is an esp_err_t. Frames with a bad CRC are dropped without a response.
+     */
+
+#define RPC_VERSION (1)
+#define RPC_MAX_BODY (1040)                                            // Largest request or response body
+#define RPC_REQ_HEADER (3)                                             // id, op
+#define RPC_RESP_HEADER (7)                                            // id, op, status
+#define RPC_MAX_PAYLOAD (RPC_RESP_HEADER + RPC_MAX_BODY + 2)           // Header, body, CRC
+#define RPC_MAX_ENCODED (RPC_MAX_PAYLOAD + RPC_MAX_PAYLOAD / 254 + 3) // COBS overhead and both delimiters
+#define RPC_OP_RESPONSE (0x80)
+
+    typedef enum
+    {
+        RPC_OP_HELLO = 0x00,         // -> version:u8 max_body:u16; also sent unsolicited (id 0) on entry
+        RPC_OP_PING = 0x01,          // body echoed
+        RPC_OP_DAC_SET = 0x10,       // mask:u8 (bit0 ch0, bit1 ch1) mv0:u16 mv1:u16 -> mv0:u16 mv1:u16
+        RPC_OP_DAC_GET = 0x11,       // -> mv0:u16 mv1:u16
+        RPC_OP_RELAY_SET = 0x20,     // mask:u8 state:u8 (bit0..3 = relay 0..3) -> state:u8
+        RPC_OP_RELAY_GET = 0x21,     // -> state:u8
+        RPC_OP_DISPLAY_TEXT = 0x30,  // flags:u8 x:u8 y:u8 font:u8 (6, 8 or 16) text...
+        RPC_OP_DISPLAY_FRAME = 0x31, // flags:u8 offset:u16 bytes... (into the 1 KB frame buffer)
+        RPC_OP_DISPLAY_SHOW = 0x32,  // flush the frame buffer
+        RPC_OP_BATCH = 0x40,         // flags:u8 then per op: op:u8 len:u16 body -> per op: op:u8 status:i32 len:u16 body
+        RPC_OP_REPL = 0x7f,          // leave binary mode, back to the text console
+    } rpc_op_code_t;
+
+#define RPC_DISPLAY_CLEAR (0x01) // DISPLAY_TEXT / DISPLAY_FRAME flag: clear the frame buffer first
+#define RPC_DISPLAY_SHOW (0x02)  // DISPLAY_TEXT / DISPLAY_FRAME flag: flush afterwards
+#define RPC_BATCH_STOP (0x01)    // BATCH flag: stop at the first op that fails
+
+    typedef struct
+    {
+        uint16_t id;
+        uint8_t op;          // RPC_OP_*, with RPC_OP_RESPONSE set in a response
+        int32_t status;      // Response only: esp_err_t
+        const uint8_t *body;
+        size_t len;
+    } rpc_msg_t;
+
+    // Streaming decoder, one per receive direction
+    typedef struct
+    {
+        uint8_t buf[RPC_MAX_PAYLOAD];
+        size_t len;
+        uint8_t code;     // COBS code of the current block
+        uint8_t left;     // Bytes left in the current block
+        bool in_frame;
+        bool overflow;    // Frame too long, skipped up to the next delimiter
+        uint32_t frames;  // Good frames
+        uint32_t dropped; // Bad CRC, too short, too long or COBS error (also text between frames)
+    } rpc_decoder_t;
+
+    uint16_t rpc_crc16(const uint8_t *data, size_t len, uint16_t crc);
+
+    void rpc_decoder_init(rpc_decoder_t *dec);
+
+    /**
+     * @brief Feed one received byte.
+     *
+     * @param msg Filled when the byte completed a good frame; body points into the decoder
+     *            and stays valid until the next call.
+     * @return true when msg holds a frame.
+     */
+    bool rpc_decoder_push(rpc_decoder_t *dec, uint8_t byte, rpc_msg_t *msg);
+
+    /**
+     * @brief Encode a request (op without RPC_OP_RESPONSE) or a response into a wire frame.
+     *
+     * @param out  Buffer, RPC_MAX_ENCODED bytes hold every frame.
+     * @return Frame length including both delimiters, 0 when it does not fit.
+     */
+    size_t rpc_frame_encode(const rpc_msg_t *msg, uint8_t *out, size_t out_size);
+
+    static inline void rpc_put_u16(uint8_t *p, uint16_t v)
+    {
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)(v >> 8);
+    }
+
+    static inline uint16_t rpc_get_u16(const uint8_t *p)
+    {
+        return (uint16_t)(p[0] | p[1] << 8);
+    }
+
+    static inline void rpc_put_i32(uint8_t *p, int32_t v)
+    {
+        uint32_t u = (uint32_t)v;
+        p[0] = (uint8_t)u;
+        p[1] = (uint8_t)(u >> 8);
+        p[2] = (uint8_t)(u >> 16);
+        p[3] = (uint8_t)(u >> 24);
+    }
+
+    static inline int32_t rpc_get_i32(const uint8_t *p)
+    {
+        return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+    }
+
+#ifdef __cplusplus
+}
+#endif
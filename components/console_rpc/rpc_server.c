@@ -0,0 +1,243 @@
+/**
+ * @file rpc_server.c
+ * @brief Binary RPC server on the console byte stream.
+ *
+ * The server reads whatever the transport has, decodes the frames in it and handles them
+ * in order. Responses are encoded into one transmit buffer and written when the bytes of
+ * that read are used up, so ten pipelined requests that arrive in one USB packet get their
+ * ten responses in one packet back. A full buffer is written early.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "rpc_server.h"
+#include <string.h>
+#include "esp_log.h"
+
+#define RPC_RX_CHUNK (256)
+#define RPC_BATCH_OP_HEADER (7) // op, status, len of one op in a batch response
+
+static rpc_decoder_t s_dec;
+static uint8_t s_rx[RPC_RX_CHUNK];
+static uint8_t s_tx[2 * RPC_MAX_ENCODED];
+static size_t s_tx_len;
+static uint8_t s_reply[RPC_MAX_BODY];
+
+static esp_err_t tx_flush(const rpc_server_config_t *config, rpc_server_stats_t *stats)
+{
+    if (s_tx_len == 0)
+    {
+        return ESP_OK;
+    }
+    int n = config->write(config->io, s_tx, s_tx_len);
+    stats->writes++;
+    stats->bytes_out += s_tx_len;
+    s_tx_len = 0;
+    return n < 0 ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t respond(const rpc_server_config_t *config, rpc_server_stats_t *stats, uint16_t id, uint8_t op,
+                         esp_err_t status, const uint8_t *body, size_t len)
+{
+    if (sizeof(s_tx) - s_tx_len < RPC_MAX_ENCODED && tx_flush(config, stats) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+    rpc_msg_t msg = {
+        .id = id,
+        .op = op | RPC_OP_RESPONSE,
+        .status = status,
+        .body = body,
+        .len = len,
+    };
+    s_tx_len += rpc_frame_encode(&msg, &s_tx[s_tx_len], sizeof(s_tx) - s_tx_len);
+    return ESP_OK;
+}
+
+static esp_err_t hello(uint8_t *reply, size_t *reply_len)
+{
+    if (*reply_len < 3)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    reply[0] = RPC_VERSION;
+    rpc_put_u16(&reply[1], RPC_MAX_BODY);
+    *reply_len = 3;
+    return ESP_OK;
+}
+
+// One opcode of the table, or a built-in one that can also run inside a batch
+static esp_err_t dispatch(const rpc_server_config_t *config, rpc_server_stats_t *stats, uint8_t op,
+                          const uint8_t *body, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    switch (op)
+    {
+    case RPC_OP_HELLO:
+        return hello(reply, reply_len);
+    case RPC_OP_PING:
+        if (len > *reply_len)
+        {
+            *reply_len = 0;
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(reply, body, len);
+        *reply_len = len;
+        return ESP_OK;
+    default:
+        break;
+    }
+    for (size_t i = 0; i < config->n_ops; i++)
+    {
+        if (config->ops[i].op == op)
+        {
+            size_t cap = *reply_len;
+            esp_err_t ret = config->ops[i].handler(config->ctx, body, len, reply, reply_len);
+            if (*reply_len > cap)
+            {
+                *reply_len = cap; // handler bug, do not send past the buffer
+            }
+            return ret;
+        }
+    }
+    stats->unknown++;
+    *reply_len = 0;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+// Ops of a batch run in order; every op gets op, status, len and its reply in the response
+static esp_err_t batch(const rpc_server_config_t *config, rpc_server_stats_t *stats, const uint8_t *body, size_t len,
+                       uint8_t *reply, size_t *reply_len)
+{
+    size_t cap = *reply_len;
+    size_t out = 0;
+    size_t pos = 1;
+    esp_err_t result = ESP_OK;
+
+    *reply_len = 0;
+    if (len < 1)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    bool stop = (body[0] & RPC_BATCH_STOP) != 0;
+    while (pos < len)
+    {
+        if (len - pos < 3 || len - pos - 3 < rpc_get_u16(&body[pos + 1]))
+        {
+            result = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        uint8_t op = body[pos];
+        size_t op_len = rpc_get_u16(&body[pos + 1]);
+        const uint8_t *op_body = &body[pos + 3];
+        pos += 3 + op_len;
+
+        if (cap - out < RPC_BATCH_OP_HEADER)
+        {
+            result = ESP_ERR_NO_MEM;
+            break;
+        }
+        size_t op_reply_len = cap - out - RPC_BATCH_OP_HEADER;
+        esp_err_t ret;
+        if (op == RPC_OP_BATCH || op == RPC_OP_REPL)
+        {
+            op_reply_len = 0;
+            ret = ESP_ERR_NOT_SUPPORTED;
+        }
+        else
+        {
+            ret = dispatch(config, stats, op, op_body, op_len, &reply[out + RPC_BATCH_OP_HEADER], &op_reply_len);
+        }
+        reply[out] = op;
+        rpc_put_i32(&reply[out + 1], ret);
+        rpc_put_u16(&reply[out + 5], (uint16_t)op_reply_len);
+        out += RPC_BATCH_OP_HEADER + op_reply_len;
+        if (ret != ESP_OK)
+        {
+            result = ESP_FAIL;
+            if (stop)
+            {
+                break;
+            }
+        }
+    }
+    *reply_len = out;
+    return result;
+}
+
+static esp_err_t serve(const rpc_server_config_t *config, rpc_server_stats_t *stats)
+{
+    size_t reply_len;
+
+    memset(stats, 0, sizeof(*stats));
+    rpc_decoder_init(&s_dec);
+    s_tx_len = 0;
+
+    // tells the client that binary mode is on; whatever the console printed before is text
+    reply_len = sizeof(s_reply);
+    hello(s_reply, &reply_len);
+    respond(config, stats, 0, RPC_OP_HELLO, ESP_OK, s_reply, reply_len);
+    if (tx_flush(config, stats) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+
+    for (;;)
+    {
+        int n = config->read(config->io, s_rx, sizeof(s_rx));
+        if (n <= 0)
+        {
+            stats->dropped = s_dec.dropped;
+            return ESP_FAIL;
+        }
+        stats->bytes_in += n;
+        for (int i = 0; i < n; i++)
+        {
+            rpc_msg_t req;
+            if (!rpc_decoder_push(&s_dec, s_rx[i], &req) || (req.op & RPC_OP_RESPONSE))
+            {
+                continue;
+            }
+            stats->requests++;
+            if (config->on_request)
+            {
+                config->on_request(config->ctx, req.op);
+            }
+            esp_err_t ret;
+            reply_len = sizeof(s_reply);
+            switch (req.op)
+            {
+            case RPC_OP_REPL:
+                // bytes after this request belong to the text console, they are dropped
+                respond(config, stats, req.id, req.op, ESP_OK, NULL, 0);
+                stats->dropped = s_dec.dropped;
+                return tx_flush(config, stats);
+            case RPC_OP_BATCH:
+                ret = batch(config, stats, req.body, req.len, s_reply, &reply_len);
+                break;
+            default:
+                ret = dispatch(config, stats, req.op, req.body, req.len, s_reply, &reply_len);
+                break;
+            }
+            if (respond(config, stats, req.id, req.op, ret, s_reply, reply_len) != ESP_OK)
+            {
+                return ESP_FAIL;
+            }
+        }
+        if (tx_flush(config, stats) != ESP_OK)
+        {
+            return ESP_FAIL;
+        }
+    }
+}
+
+esp_err_t rpc_server_run(const rpc_server_config_t *config, rpc_server_stats_t *stats)
+{
+    // log lines share the byte stream: the client drops them, but they cost the bandwidth
+    // and latency of the frames, the per-write INFO lines of the drivers most of all
+    esp_log_level_t level = esp_log_level_get("*");
+    esp_log_level_set("*", level < ESP_LOG_WARN ? level : ESP_LOG_WARN);
+    esp_err_t ret = serve(config, stats);
+    esp_log_level_set("*", level);
+    return ret;
+}
@@ -0,0 +1,73 @@
+// rpc_server.h
+// Binary RPC server loop on a byte stream (console UART / USB), opcode table dispatch
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "rpc_frame.h"
+
+    /**
+     * @brief Handler of one opcode.
+     *
+     * @param reply     Response body.
+     * @param reply_len In: size of reply. Out: bytes used.
+     * @return Status of the response.
+     */
+    typedef esp_err_t (*rpc_handler_t)(void *ctx, const uint8_t *body, size_t len, uint8_t *reply, size_t *reply_len);
+
+    typedef struct
+    {
+        uint8_t op;
+        rpc_handler_t handler;
+    } rpc_op_t;
+
+    typedef struct
+    {
+        // Blocking read of at least one byte, <= 0 ends the server (transport closed)
+        int (*read)(void *io, uint8_t *buf, size_t len);
+        // Write everything, < 0 on error
+        int (*write)(void *io, const uint8_t *buf, size_t len);
+        void *io;
+        const rpc_op_t *ops;
+        size_t n_ops;
+        void *ctx; // Passed to the handlers
+        // Optional: called for every valid request before it is handled (failsafe heartbeat)
+        void (*on_request)(void *ctx, uint8_t op);
+    } rpc_server_config_t;
+
+    typedef struct
+    {
+        uint32_t requests;
+        uint32_t unknown;    // Requests with an opcode without handler
+        uint32_t dropped;    // Bad frames and text between frames
+        uint32_t writes;     // Transport writes, responses are coalesced per read
+        uint32_t bytes_in;
+        uint32_t bytes_out;
+    } rpc_server_stats_t;
+
+    /**
+     * @brief Serve requests until RPC_OP_REPL or the transport closes.
+     *
+     * Sends an unsolicited HELLO (id 0) first. Requests are handled in arrival order; the
+     * responses of all requests that arrived in one read go out in one write, so a client
+     * that pipelines requests pays the transport latency once per batch of reads.
+     * HELLO, PING, BATCH and REPL are built in, BATCH runs the other opcodes of the table.
+     * One server at a time (static buffers). Logging is limited to warnings and errors
+     * for the session (esp_log_level_set("*")) and set back to the default level it had when it ends.
+     *
+     * @return ESP_OK after RPC_OP_REPL, ESP_FAIL when the transport closed or failed.
+     */
+    esp_err_t rpc_server_run(const rpc_server_config_t *config, rpc_server_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
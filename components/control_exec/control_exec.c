@@ -0,0 +1,309 @@
+/**
+ * @file control_exec.c
+ * @brief Fixed-period control executive.
+ *
+ * A general purpose timer raises an alarm every period; its interrupt only notes the time and
+ * notifies the control task. The task is pinned to its own core (core 1 on the P4, the
+ * console and the Wi-Fi/USB work stay on core 0) and creates the timer itself, so the
+ * interrupt lands on that core too. Every loop runs the registered callbacks on one
+ * actuator frame and commits the frame with actuator_apply(), which writes only what changed.
+ *
+ * The FreeRTOS tick (CONFIG_FREERTOS_HZ=100) is too coarse for a 1 kHz loop, hence the
+ * hardware alarm. The loop measures its own timing: period and jitter between loop starts,
+ * alarm-to-start latency, execution time, overruns and deadline misses.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "control_exec.h"
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "periodic_alarm.h"
+
+static const char *TAG = "control_exec";
+
+typedef struct
+{
+    control_fn_t fn;
+    void *arg;
+} callback_t;
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static callback_t s_callbacks[CONTROL_EXEC_MAX_CALLBACKS];
+static int s_n_callbacks;
+
+static control_exec_config_t s_cfg;
+static TaskHandle_t s_task;
+static gptimer_handle_t s_timer;
+static periodic_alarm_sync_t s_sync; // The task reports when its alarm started (or failed) and when it ends
+static volatile bool s_stop;
+static bool s_running;
+
+// shared with the timer interrupt and the readers, under s_mux
+static int64_t s_alarm_us;
+static actuator_frame_t s_frame;   // Last committed
+static actuator_frame_t s_request; // From control_exec_set_frame()
+static bool s_request_pending;
+static control_exec_stats_t s_stats;
+
+static bool IRAM_ATTR on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg)
+{
+    BaseType_t woken = pdFALSE;
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_ISR(&s_mux);
+    s_alarm_us = now;
+    portEXIT_CRITICAL_ISR(&s_mux);
+    vTaskNotifyGiveFromISR(s_task, &woken);
+    return woken == pdTRUE;
+}
+
+static int hist_bucket(uint32_t us)
+{
+    int bucket = 0;
+    while (us >= 2 && bucket < CONTROL_EXEC_HIST_BUCKETS - 1)
+    {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void run_loop(uint32_t ticks, int64_t *last_us, uint32_t seq)
+{
+    int64_t start = esp_timer_get_time();
+    callback_t callbacks[CONTROL_EXEC_MAX_CALLBACKS];
+    actuator_frame_t frame;
+
+    portENTER_CRITICAL(&s_mux);
+    int64_t alarm_us = s_alarm_us;
+    frame = s_request_pending ? s_request : s_frame;
+    s_request_pending = false;
+    int n = s_n_callbacks;
+    memcpy(callbacks, s_callbacks, n * sizeof(callbacks[0]));
+    portEXIT_CRITICAL(&s_mux);
+
+    control_tick_t tick = {
+        .seq = seq,
+        .t_us = start,
+        .dt_us = *last_us ? start - *last_us : s_cfg.period_us,
+        .period_us = s_cfg.period_us,
+    };
+    for (int i = 0; i < n; i++)
+    {
+        callbacks[i].fn(callbacks[i].arg, &tick, &frame);
+    }
+    int64_t commit = esp_timer_get_time();
+    esp_err_t ret = s_cfg.act ? actuator_apply(s_cfg.act, &frame, NULL) : ESP_OK;
+    int64_t end = esp_timer_get_time();
+
+    uint32_t exec_us = (uint32_t)(end - start);
+    uint32_t commit_us = (uint32_t)(end - commit);
+    uint32_t wake_us = alarm_us && start > alarm_us ? (uint32_t)(start - alarm_us) : 0;
+    portENTER_CRITICAL(&s_mux);
+    s_frame = frame;
+    control_exec_stats_t *st = &s_stats;
+    st->loops++;
+    st->overruns += ticks > 1 ? ticks - 1 : 0;
+    st->deadline_misses += exec_us > s_cfg.period_us ? 1 : 0;
+    st->commit_errors += ret != ESP_OK ? 1 : 0;
+    if (*last_us)
+    {
+        uint32_t period = (uint32_t)(start - *last_us);
+        uint32_t jitter = period > s_cfg.period_us ? period - s_cfg.period_us : s_cfg.period_us - period;
+        st->period_min_us = (st->period_min_us == 0 || period < st->period_min_us) ? period : st->period_min_us;
+        st->period_max_us = period > st->period_max_us ? period : st->period_max_us;
+        st->jitter_max_us = jitter > st->jitter_max_us ? jitter : st->jitter_max_us;
+        st->jitter_hist[hist_bucket(jitter)]++;
+    }
+    st->wake_max_us = wake_us > st->wake_max_us ? wake_us : st->wake_max_us;
+    st->exec_min_us = (st->exec_min_us == 0 || exec_us < st->exec_min_us) ? exec_us : st->exec_min_us;
+    st->exec_max_us = exec_us > st->exec_max_us ? exec_us : st->exec_max_us;
+    st->exec_total_us += exec_us;
+    st->commit_max_us = commit_us > st->commit_max_us ? commit_us : st->commit_max_us;
+    portEXIT_CRITICAL(&s_mux);
+    *last_us = start;
+}
+
+static void control_task(void *arg)
+{
+    int64_t last_us = 0;
+    uint32_t seq = 0;
+
+    esp_err_t ret = periodic_alarm_start(s_cfg.period_us, on_alarm, NULL, &s_timer);
+    periodic_alarm_sync_give(&s_sync, ret);
+    if (ret != ESP_OK)
+    {
+        vTaskDelete(NULL);
+        return;
+    }
+    while (!s_stop)
+    {
+        uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (s_stop)
+        {
+            break;
+        }
+        run_loop(ticks, &last_us, seq++);
+    }
+    periodic_alarm_stop(&s_timer);
+    periodic_alarm_sync_give(&s_sync, ESP_OK);
+    vTaskDelete(NULL);
+}
+
+esp_err_t control_exec_add(control_fn_t fn, void *arg)
+{
+    if (!fn)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    portENTER_CRITICAL(&s_mux);
+    if (s_n_callbacks < CONTROL_EXEC_MAX_CALLBACKS)
+    {
+        s_callbacks[s_n_callbacks].fn = fn;
+        s_callbacks[s_n_callbacks].arg = arg;
+        s_n_callbacks++;
+        ret = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return ret;
+}
+
+esp_err_t control_exec_remove(control_fn_t fn, void *arg)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    portENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < s_n_callbacks; i++)
+    {
+        if (s_callbacks[i].fn == fn && s_callbacks[i].arg == arg)
+        {
+            memmove(&s_callbacks[i], &s_callbacks[i + 1], (s_n_callbacks - i - 1) * sizeof(s_callbacks[0]));
+            s_n_callbacks--;
+            ret = ESP_OK;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return ret;
+}
+
+esp_err_t control_exec_start(const control_exec_config_t *config)
+{
+    if (!config || config->period_us < 100)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    periodic_alarm_sync_init(&s_sync);
+    s_cfg = *config;
+    s_stop = false;
+    portENTER_CRITICAL(&s_mux);
+    memset(&s_stats, 0, sizeof(s_stats));
+    memset(&s_frame, 0, sizeof(s_frame));
+    s_alarm_us = 0;
+    s_request_pending = false;
+    portEXIT_CRITICAL(&s_mux);
+    if (s_cfg.act)
+    {
+        actuator_get_frame(s_cfg.act, &s_frame); // start from what the devices have
+    }
+
+    if (xTaskCreatePinnedToCore(control_task, "control", 4096, NULL, s_cfg.task_priority, &s_task, s_cfg.core) !=
+        pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = periodic_alarm_sync_wait(&s_sync);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    s_running = true;
+    ESP_LOGI(TAG, "%" PRIu32 " us period on core %d", s_cfg.period_us, s_cfg.core);
+    return ESP_OK;
+}
+
+esp_err_t control_exec_stop(void)
+{
+    if (!s_running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_stop = true;
+    xTaskNotifyGive(s_task);
+    periodic_alarm_sync_wait(&s_sync);
+    s_running = false;
+    s_task = NULL;
+    return ESP_OK;
+}
+
+bool control_exec_running(void)
+{
+    return s_running;
+}
+
+void control_exec_set_frame(const actuator_frame_t *frame)
+{
+    portENTER_CRITICAL(&s_mux);
+    s_request = *frame;
+    s_request_pending = true;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void control_exec_get_frame(actuator_frame_t *frame)
+{
+    portENTER_CRITICAL(&s_mux);
+    *frame = s_request_pending ? s_request : s_frame;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void control_exec_get_stats(control_exec_stats_t *stats, bool reset)
+{
+    portENTER_CRITICAL(&s_mux);
+    if (stats)
+    {
+        *stats = s_stats;
+    }
+    if (reset)
+    {
+        memset(&s_stats, 0, sizeof(s_stats));
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void control_exec_print(FILE *out)
+{
+    control_exec_stats_t st;
+    if (!out)
+    {
+        return;
+    }
+    control_exec_get_stats(&st, false);
+    fprintf(out, "%s, period %" PRIu32 " us, core %d, %d callbacks\r\n", s_running ? "running" : "stopped",
+            s_cfg.period_us, s_cfg.core, s_n_callbacks);
+    fprintf(out, "loops %" PRIu32 ", overruns %" PRIu32 ", deadline misses %" PRIu32 ", commit errors %" PRIu32 "\r\n",
+            st.loops, st.overruns, st.deadline_misses, st.commit_errors);
+    fprintf(out, "period  min %6" PRIu32 " us  max %6" PRIu32 " us  jitter max %" PRIu32 " us\r\n", st.period_min_us,
+            st.period_max_us, st.jitter_max_us);
+    fprintf(out, "exec    min %6" PRIu32 " us  max %6" PRIu32 " us  avg %" PRIu32 " us  commit max %" PRIu32
+                 " us  wake max %" PRIu32 " us\r\n",
+            st.exec_min_us, st.exec_max_us, st.loops ? (uint32_t)(st.exec_total_us / st.loops) : 0, st.commit_max_us,
+            st.wake_max_us);
+    fprintf(out, "jitter ");
+    for (int i = 0; i < CONTROL_EXEC_HIST_BUCKETS; i++)
+    {
+        fprintf(out, " %s%u:%" PRIu32, i == CONTROL_EXEC_HIST_BUCKETS - 1 ? ">=" : "<",
+                i == CONTROL_EXEC_HIST_BUCKETS - 1 ? 1u << i : 2u << i, st.jitter_hist[i]);
+    }
+    fprintf(out, "\r\n");
+}
@@ -0,0 +1,102 @@
+// control_exec.h
+// Fixed-period control executive: timer-driven loop on its own core, callbacks, then one actuator frame
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "actuator.h"
+
+#define CONTROL_EXEC_MAX_CALLBACKS (8)
+#define CONTROL_EXEC_HIST_BUCKETS (8) // Jitter: [0] < 2 us, [1] < 4 us ... [7] >= 128 us
+
+    // Passed to every callback of one loop
+    typedef struct
+    {
+        uint32_t seq;   // Loop number since start
+        int64_t t_us;   // esp_timer time the loop started
+        int64_t dt_us;  // Since the previous loop (the nominal period for the first)
+        uint32_t period_us;
+    } control_tick_t;
+
+    /**
+     * @brief Control law. Reads its inputs, changes the fields of the frame it drives.
+     *
+     * The frame starts as the last committed one (or the one from control_exec_set_frame())
+     * and is committed after the last callback. Runs on the control task: no blocking.
+     */
+    typedef void (*control_fn_t)(void *arg, const control_tick_t *tick, actuator_frame_t *frame);
+
+    typedef struct
+    {
+        uint32_t period_us; // Loop period, 1000 for 1 kHz
+        int core;           // Core of the control task and of the timer interrupt
+        int task_priority;
+        actuator_t *act;    // Where the frame goes, NULL: callbacks only
+    } control_exec_config_t;
+
+#define CONTROL_EXEC_CONFIG_DEFAULT() {.period_us = 1000, .core = 1, .task_priority = 20, .act = NULL}
+
+    typedef struct
+    {
+        uint32_t loops;
+        uint32_t overruns;        // Timer ticks that found the previous loop still running (skipped)
+        uint32_t deadline_misses; // Loops that took longer than the period
+        uint32_t commit_errors;   // Frames the actuator could not write
+        uint32_t period_min_us;   // Between loop starts
+        uint32_t period_max_us;
+        uint32_t jitter_max_us;   // Largest |period - nominal|
+        uint32_t wake_max_us;     // Timer alarm to loop start
+        uint32_t exec_min_us;     // Callbacks and commit
+        uint32_t exec_max_us;
+        uint64_t exec_total_us;
+        uint32_t commit_max_us;   // The commit alone
+        uint32_t jitter_hist[CONTROL_EXEC_HIST_BUCKETS];
+    } control_exec_stats_t;
+
+    /**
+     * @brief Add a control callback. Callbacks run in the order they were added.
+     *
+     * @return ESP_OK, ESP_ERR_NO_MEM when the table is full.
+     */
+    esp_err_t control_exec_add(control_fn_t fn, void *arg);
+
+    // Remove a callback (fn and arg as added); takes effect from the next loop
+    esp_err_t control_exec_remove(control_fn_t fn, void *arg);
+
+    /**
+     * @brief Start the control task on config->core and a hardware timer alarm every period.
+     *
+     * The timer is created from the control task, so its interrupt is on the same core.
+     * Clears the statistics.
+     */
+    esp_err_t control_exec_start(const control_exec_config_t *config);
+
+    // Stop the timer and the task; waits for the loop that runs
+    esp_err_t control_exec_stop(void);
+
+    bool control_exec_running(void);
+
+    /**
+     * @brief Setpoint from outside the loop (console, RPC): the next loop starts from this frame.
+     */
+    void control_exec_set_frame(const actuator_frame_t *frame);
+
+    // The frame of the last commit
+    void control_exec_get_frame(actuator_frame_t *frame);
+
+    void control_exec_get_stats(control_exec_stats_t *stats, bool reset);
+
+    void control_exec_print(FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
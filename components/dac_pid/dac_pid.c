@@ -0,0 +1,213 @@
+/**
+ * @file dac_pid.c
+ * @brief Fixed-point PID/PI block on a GP8413 channel.
+ *
+ * Gains, integrator and output are Q16.16 millivolts, products are 64 bit, so one update is
+ * a handful of integer multiplies and no float is touched in the loop. The gains are scaled
+ * with the sample period once, at init: ki per sample, kd per sample of change.
+ *
+ * The output is clamped to [out_min, out_max] (at most the DAC output_range). Anti-windup by
+ * clamping the integrator: it integrates until the output reaches the clamp and not beyond
+ * in the direction of the error, and it is never outside the clamp itself, so the output
+ * leaves saturation on the first loop the error changes sign.
+ *
+ * The output is written only when its quantised value changes. dac_pid_step() writes through
+ * the driver (stage and flush of the one channel); dac_pid_control() puts it in the frame of
+ * the control executive, whose actuator skips unchanged values as well.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "dac_pid.h"
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include "esp_timer.h"
+
+#define ONE (1LL << DAC_PID_Q)
+#define TERM_LIMIT (1LL << 48) // P and D terms are cut here, far beyond any clamp: no overflow of the sum
+
+static bool to_q16(float value, int32_t *q)
+{
+    double scaled = (double)value * ONE;
+    if (!isfinite(scaled) || scaled > INT32_MAX || scaled < INT32_MIN)
+    {
+        return false;
+    }
+    *q = (int32_t)lround(scaled);
+    return true;
+}
+
+static int64_t clamp64(int64_t v, int64_t lo, int64_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+esp_err_t dac_pid_init(dac_pid_t *pid, const dac_pid_config_t *config, gp8413_handle_t *dac)
+{
+    if (!pid || !config || !dac || config->channel > 1 || config->period_us == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t range = (uint32_t)dac->output_range;
+    uint32_t out_max = (config->out_max_mv == 0 || config->out_max_mv > range) ? range : config->out_max_mv;
+    if (config->out_min_mv > out_max)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(pid, 0, sizeof(*pid));
+    float dt = (float)config->period_us / 1e6f;
+    if (!to_q16(config->kp, &pid->kp) || !to_q16(config->ki * dt, &pid->ki) || !to_q16(config->kd / dt, &pid->kd))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pid->dac = dac;
+    pid->channel = config->channel;
+    pid->feedback = config->feedback;
+    pid->feedback_ctx = config->feedback_ctx;
+    pid->out_min = (int64_t)config->out_min_mv * ONE;
+    pid->out_max = (int64_t)out_max * ONE;
+    dac_pid_reset(pid);
+    return ESP_OK;
+}
+
+void dac_pid_reset(dac_pid_t *pid)
+{
+    pid->integral = pid->out_min;
+    pid->primed = false;
+    pid->written = false;
+}
+
+void dac_pid_set_setpoint(dac_pid_t *pid, int32_t setpoint)
+{
+    pid->setpoint = setpoint;
+}
+
+int32_t dac_pid_update(dac_pid_t *pid, int32_t setpoint, int32_t measured)
+{
+    int64_t error = (int64_t)setpoint - measured;
+    int64_t p = clamp64(pid->kp * error, -TERM_LIMIT, TERM_LIMIT);
+    int64_t d = 0;
+    if (pid->primed)
+    {
+        d = clamp64(pid->kd * ((int64_t)pid->last_measured - measured), -TERM_LIMIT, TERM_LIMIT);
+    }
+    pid->last_measured = measured;
+    pid->primed = true;
+
+    // integrate up to where the output reaches the clamp, no further in the direction of the error
+    int64_t i = pid->integral + clamp64(pid->ki * error, -TERM_LIMIT, TERM_LIMIT);
+    int64_t headroom_hi = pid->out_max - p - d;
+    int64_t headroom_lo = pid->out_min - p - d;
+    if (error > 0 && i > headroom_hi)
+    {
+        i = pid->integral > headroom_hi ? pid->integral : headroom_hi;
+    }
+    else if (error < 0 && i < headroom_lo)
+    {
+        i = pid->integral < headroom_lo ? pid->integral : headroom_lo;
+    }
+    pid->integral = clamp64(i, pid->out_min, pid->out_max);
+    int64_t u = p + pid->integral + d;
+    if (u > pid->out_max || u < pid->out_min)
+    {
+        pid->stats.saturated++;
+    }
+    return (int32_t)clamp64(u, pid->out_min, pid->out_max);
+}
+
+// Feedback and update; true when the quantised output changed (or was never written)
+static bool loop(dac_pid_t *pid, bool *ok)
+{
+    int32_t measured;
+    *ok = true;
+    pid->stats.loops++;
+    if (!pid->feedback || pid->feedback(pid->feedback_ctx, &measured) != ESP_OK)
+    {
+        pid->stats.feedback_errors++;
+        *ok = false;
+        return false; // keep the last output
+    }
+    pid->measured = measured;
+    int32_t u = dac_pid_update(pid, pid->setpoint, measured);
+    uint32_t mv = (uint32_t)(((int64_t)u + ONE / 2) >> DAC_PID_Q);
+    bool changed = !pid->written || mv != pid->out_mv;
+    pid->out_mv = mv;
+    return changed;
+}
+
+static void account(dac_pid_t *pid, int64_t start)
+{
+    uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+    pid->stats.exec_max_us = us > pid->stats.exec_max_us ? us : pid->stats.exec_max_us;
+    pid->stats.exec_total_us += us;
+}
+
+esp_err_t dac_pid_step(dac_pid_t *pid)
+{
+    int64_t start = esp_timer_get_time();
+    bool ok;
+    esp_err_t ret = ESP_OK;
+
+    if (loop(pid, &ok))
+    {
+        ret = gp8413_stage_output_voltage(pid->dac, pid->out_mv, pid->channel);
+        if (ret == ESP_OK)
+        {
+            ret = gp8413_flush(pid->dac);
+        }
+        pid->written = ret == ESP_OK;
+        pid->stats.writes += ret == ESP_OK ? 1 : 0;
+        pid->stats.write_errors += ret != ESP_OK ? 1 : 0;
+    }
+    account(pid, start);
+    return ok ? ret : ESP_ERR_INVALID_STATE;
+}
+
+void dac_pid_control(void *arg, const control_tick_t *tick, actuator_frame_t *frame)
+{
+    dac_pid_t *pid = arg;
+    int64_t start = esp_timer_get_time();
+    bool ok;
+
+    if (loop(pid, &ok))
+    {
+        pid->stats.writes++;
+        pid->written = true; // the executive commits it; a failed commit is in its statistics
+    }
+    if (ok)
+    {
+        frame->dac_mv[pid->channel] = (uint16_t)pid->out_mv;
+    }
+    account(pid, start);
+}
+
+void dac_pid_get_stats(dac_pid_t *pid, dac_pid_stats_t *stats, bool reset)
+{
+    if (stats)
+    {
+        *stats = pid->stats;
+    }
+    if (reset)
+    {
+        memset(&pid->stats, 0, sizeof(pid->stats));
+    }
+}
+
+void dac_pid_print(const dac_pid_t *pid, FILE *out)
+{
+    const dac_pid_stats_t *st = &pid->stats;
+    if (!out)
+    {
+        return;
+    }
+    fprintf(out, "channel %" PRIu32 ": setpoint %" PRId32 ", measured %" PRId32 ", output %" PRIu32 " mV\r\n",
+            pid->channel, pid->setpoint, pid->measured, pid->out_mv);
+    fprintf(out, "loops %" PRIu32 ", writes %" PRIu32 ", saturated %" PRIu32 ", feedback errors %" PRIu32
+                 ", write errors %" PRIu32 "\r\n",
+            st->loops, st->writes, st->saturated, st->feedback_errors, st->write_errors);
+    fprintf(out, "exec    max %6" PRIu32 " us  avg %" PRIu32 " us\r\n", st->exec_max_us,
+            st->loops ? (uint32_t)(st->exec_total_us / st->loops) : 0);
+}
@@ -0,0 +1,123 @@
+// dac_pid.h
+// Fixed-point PID/PI block driving one GP8413 channel, with anti-windup and a pluggable feedback source
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "gp8413_sdc.h"
+#include "actuator.h"
+#include "control_exec.h"
+
+#define DAC_PID_Q (16) // Fractional bits of the gains, the integrator and the output (Q16.16)
+
+    /**
+     * @brief Feedback source: the measured value, in the units of the setpoint.
+     *
+     * Called once per loop; from a control_exec callback it runs on the control task, so it
+     * must not block (take the last ADC sample, not start a conversion and wait).
+     */
+    typedef esp_err_t (*dac_pid_feedback_t)(void *ctx, int32_t *value);
+
+    typedef struct
+    {
+        float kp;             // mV per unit of error
+        float ki;             // mV per unit of error per second, 0 for a P or PD controller
+        float kd;             // mV per unit per second of change of the measurement, 0 for PI
+        uint32_t period_us;   // Sample period; ki and kd are scaled with it once, at init
+        uint32_t out_min_mv;  // Output clamp
+        uint32_t out_max_mv;  // 0 or above the DAC output_range: the output_range
+        uint32_t channel;     // GP8413 channel driven
+        dac_pid_feedback_t feedback;
+        void *feedback_ctx;
+    } dac_pid_config_t;
+
+    typedef struct
+    {
+        uint32_t loops;
+        uint32_t writes;          // Loops where the quantised output changed
+        uint32_t saturated;       // Loops with the output at a clamp
+        uint32_t feedback_errors; // Loops skipped: the source had no value
+        uint32_t write_errors;    // Failed DAC writes (retried next loop)
+        uint32_t exec_max_us;     // Feedback, update and write of one loop
+        uint64_t exec_total_us;
+    } dac_pid_stats_t;
+
+    // Not locked: one task runs the loop; dac_pid_set_setpoint() may come from another one
+    typedef struct
+    {
+        gp8413_handle_t *dac;
+        uint32_t channel;
+        dac_pid_feedback_t feedback;
+        void *feedback_ctx;
+        int32_t kp;       // Q16.16 mV per unit
+        int32_t ki;       // Q16.16 mV per unit, per sample
+        int32_t kd;       // Q16.16 mV per unit of change, per sample
+        int64_t out_min;  // Q16.16 mV
+        int64_t out_max;
+        int64_t integral; // Q16.16 mV, kept within the output clamp
+        int32_t last_measured;
+        bool primed;      // last_measured is valid (no derivative kick on the first loop)
+        volatile int32_t setpoint;
+        int32_t measured; // Of the last loop
+        uint32_t out_mv;  // Quantised output of the last loop
+        bool written;     // out_mv is on the DAC
+        dac_pid_stats_t stats;
+    } dac_pid_t;
+
+    /**
+     * @brief Set up the block: gains to Q16.16 per sample, clamp to the DAC output_range.
+     *
+     * Floating point is used here only; the loop itself is integer arithmetic.
+     *
+     * @return ESP_OK, ESP_ERR_INVALID_ARG for a gain that does not fit Q16.16 or a bad clamp.
+     */
+    esp_err_t dac_pid_init(dac_pid_t *pid, const dac_pid_config_t *config, gp8413_handle_t *dac);
+
+    // Clear the integrator and the derivative history, the output starts from out_min
+    void dac_pid_reset(dac_pid_t *pid);
+
+    void dac_pid_set_setpoint(dac_pid_t *pid, int32_t setpoint);
+
+    /**
+     * @brief One controller update, no I/O.
+     *
+     * Derivative on the measurement (no kick on setpoint steps). Anti-windup: the integrator
+     * stops where the output reaches the clamp in the direction of the error, and is itself
+     * kept within the clamp.
+     *
+     * @return The clamped output, Q16.16 mV.
+     */
+    int32_t dac_pid_update(dac_pid_t *pid, int32_t setpoint, int32_t measured);
+
+    /**
+     * @brief One loop on its own: read the feedback, update, and write the channel through the
+     * DAC driver when the quantised output changed.
+     *
+     * The output is quantised to the driver setpoint step (1 mV). Every millivolt is a
+     * different DAC code, so an unchanged millivolt value is an unchanged code and no write.
+     */
+    esp_err_t dac_pid_step(dac_pid_t *pid);
+
+    /**
+     * @brief The same loop as a control_exec callback (arg is the dac_pid_t): the output
+     * goes into the frame, the executive commits it with the other outputs.
+     */
+    void dac_pid_control(void *arg, const control_tick_t *tick, actuator_frame_t *frame);
+
+    void dac_pid_get_stats(dac_pid_t *pid, dac_pid_stats_t *stats, bool reset);
+
+    // Setpoint, measurement, output and the loop counters
+    void dac_pid_print(const dac_pid_t *pid, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
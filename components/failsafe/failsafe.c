@@ -0,0 +1,435 @@
+/**
+ * @file failsafe.c
+ * @brief Heartbeat failsafe with a bounded time to the safe state.
+ *
+ * A general purpose timer checks the time since the last heartbeat every check_us. When the
+ * window has passed, its interrupt marks the trip and fires the scheduler standby of every
+ * port involved; no task has to be scheduled first. The standby runs on the scheduler task
+ * before anything queued (urgent frames of the control loop included) and waits only for
+ * the transaction that is on the bus, at most one chunk of a display flush.
+ *
+ * The standby holds the DAC and relay addresses first, so nothing queued behind it can undo
+ * the safe state, then writes both DAC channels 0 V in one transfer and the relay register 0
+ * (relays open, LEDs off), and reads the relay register back. The safe state is confirmed
+ * when the DAC write is acked and the relays read back open. Per trip the time from the
+ * end of the window to that confirmation is measured; the worst case is kept.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "failsafe.h"
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_bus.h"
+#include "i2c_sched.h"
+#include "periodic_alarm.h"
+
+static const char *TAG = "failsafe";
+
+#define PART_DAC (1 << 0)
+#define PART_RELAY (1 << 1)
+#define SAFE_TIMEOUT_MS (10) // Per safe write
+
+// Prepared before the trip: GP8413 channel 0 and 1 (0x02, 0x04) in one auto-increment write
+static const uint8_t s_dac_safe[] = {0x02, 0x00, 0x00, 0x00, 0x00};
+static const uint8_t s_relay_safe[] = {M54R_REG_RELAY, 0x00};
+
+typedef struct
+{
+    int port;
+    int parts; // PART_* on this port
+} standby_t;
+
+static failsafe_config_t s_cfg;
+static gptimer_handle_t s_timer;
+static standby_t s_standby[2];
+static int s_n_standby;
+static int s_parts; // PART_* of all standbys
+static bool s_running;
+
+// shared with the timer interrupt and the scheduler tasks, under s_mux
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static failsafe_state_t s_state;
+static int64_t s_last_feed_us;
+static int64_t s_deadline_us; // End of the window of the current trip
+static int s_pending;         // PART_* not confirmed yet
+static bool s_write_failed;
+static failsafe_stats_t s_stats;
+
+static const char *state_name(failsafe_state_t state)
+{
+    switch (state)
+    {
+    case FAILSAFE_OFF:
+        return "off";
+    case FAILSAFE_ARMED:
+        return "armed";
+    case FAILSAFE_TRIPPED:
+        return "tripped";
+    case FAILSAFE_SAFE:
+        return "safe";
+    case FAILSAFE_FAILED:
+        return "FAILED";
+    }
+    return "?";
+}
+
+// Under s_mux
+static void IRAM_ATTR enter_trip(int64_t deadline_us, int64_t now)
+{
+    uint32_t detect = now > deadline_us ? (uint32_t)(now - deadline_us) : 0;
+    s_state = FAILSAFE_TRIPPED;
+    s_deadline_us = deadline_us;
+    s_pending = s_parts;
+    s_write_failed = false;
+    s_stats.trips++;
+    s_stats.detect_last_us = detect;
+    s_stats.detect_max_us = detect > s_stats.detect_max_us ? detect : s_stats.detect_max_us;
+}
+
+static bool IRAM_ATTR on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg)
+{
+    bool woken = false;
+    bool trip = false;
+    int64_t now = esp_timer_get_time();
+    int64_t window_us = (int64_t)s_cfg.timeout_ms * 1000;
+
+    portENTER_CRITICAL_ISR(&s_mux);
+    if (s_state == FAILSAFE_ARMED && now - s_last_feed_us > window_us)
+    {
+        enter_trip(s_last_feed_us + window_us, now);
+        trip = true;
+    }
+    portEXIT_CRITICAL_ISR(&s_mux);
+    for (int i = 0; trip && i < s_n_standby; i++)
+    {
+        woken |= i2c_sched_fire_standby_from_isr(s_standby[i].port);
+    }
+    return woken;
+}
+
+static esp_err_t safe_dac(const i2c_regmap_t *map)
+{
+    i2c_master_dev_handle_t dev;
+    esp_err_t ret = i2c_bus_get_device(map->bus_handle, map->device_address, map->scl_speed_hz, &dev);
+    if (ret == ESP_OK)
+    {
+        ret = i2c_sched_transmit(dev, I2C_SCHED_PRIO_URGENT, s_dac_safe, sizeof(s_dac_safe), SAFE_TIMEOUT_MS);
+    }
+    return ret;
+}
+
+static esp_err_t safe_relay(const i2c_regmap_t *map)
+{
+    i2c_master_dev_handle_t dev;
+    uint8_t state = 0xff;
+    esp_err_t ret = i2c_bus_get_device(map->bus_handle, map->device_address, map->scl_speed_hz, &dev);
+    if (ret == ESP_OK)
+    {
+        ret = i2c_sched_transmit(dev, I2C_SCHED_PRIO_URGENT, s_relay_safe, sizeof(s_relay_safe), SAFE_TIMEOUT_MS);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = i2c_sched_transmit_receive(dev, I2C_SCHED_PRIO_URGENT, s_relay_safe, 1, &state, 1, SAFE_TIMEOUT_MS);
+    }
+    if (ret == ESP_OK && (state & 0x0f) != 0)
+    {
+        ret = ESP_ERR_INVALID_RESPONSE; // a relay is still closed
+    }
+    return ret;
+}
+
+static void hold(const standby_t *sb, bool on)
+{
+    if (sb->parts & PART_DAC)
+    {
+        i2c_sched_hold(sb->port, s_cfg.act->dac->regs.device_address, on);
+    }
+    if (sb->parts & PART_RELAY)
+    {
+        i2c_sched_hold(sb->port, s_cfg.act->relay->regs.device_address, on);
+    }
+}
+
+// Scheduler standby: runs on the scheduler task of its port, before anything queued
+static esp_err_t safe_exec(void *arg)
+{
+    const standby_t *sb = arg;
+    esp_err_t dac_ret = ESP_OK;
+    esp_err_t relay_ret = ESP_OK;
+    uint32_t errors = 0;
+
+    hold(sb, true);
+    for (int i = 0; (sb->parts & PART_DAC) && i < s_cfg.attempts; i++)
+    {
+        dac_ret = safe_dac(&s_cfg.act->dac->regs);
+        if (dac_ret == ESP_OK)
+        {
+            break;
+        }
+        errors++;
+    }
+    for (int i = 0; (sb->parts & PART_RELAY) && i < s_cfg.attempts; i++)
+    {
+        relay_ret = safe_relay(&s_cfg.act->relay->regs);
+        if (relay_ret == ESP_OK)
+        {
+            break;
+        }
+        errors++;
+    }
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_mux);
+    s_stats.write_errors += errors;
+    s_write_failed |= dac_ret != ESP_OK || relay_ret != ESP_OK;
+    s_pending &= ~sb->parts;
+    if (s_pending == 0 && s_state == FAILSAFE_TRIPPED)
+    {
+        s_state = s_write_failed ? FAILSAFE_FAILED : FAILSAFE_SAFE;
+        if (!s_write_failed)
+        {
+            uint32_t safe = (uint32_t)(now - s_deadline_us);
+            s_stats.confirmed++;
+            s_stats.safe_last_us = safe;
+            s_stats.safe_max_us = safe > s_stats.safe_max_us ? safe : s_stats.safe_max_us;
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return dac_ret != ESP_OK ? dac_ret : relay_ret;
+}
+
+static void standby_remove(void)
+{
+    for (int i = 0; i < s_n_standby; i++)
+    {
+        i2c_sched_set_standby(s_standby[i].port, NULL, NULL);
+    }
+}
+
+// After a trip: release the outputs and bring the driver shadows in line with the devices
+static esp_err_t release(void)
+{
+    actuator_t *act = s_cfg.act;
+    actuator_frame_t safe = {0};
+
+    for (int i = 0; i < s_n_standby; i++)
+    {
+        hold(&s_standby[i], false);
+    }
+    if (act->dac)
+    {
+        i2c_regmap_invalidate(&act->dac->regs);
+    }
+    if (act->relay)
+    {
+        i2c_regmap_invalidate(&act->relay->regs);
+    }
+    return actuator_apply(act, &safe, NULL);
+}
+
+// The standbys finish on their own, within attempts * timeout per write
+static failsafe_state_t wait_written(void)
+{
+    failsafe_state_t state;
+    while ((state = failsafe_get_state()) == FAILSAFE_TRIPPED)
+    {
+        vTaskDelay(1);
+    }
+    return state;
+}
+
+esp_err_t failsafe_start(const failsafe_config_t *config)
+{
+    if (!config || !config->act || config->timeout_ms == 0 || config->check_us < 100 || config->attempts < 1)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_cfg = *config;
+    const actuator_t *act = s_cfg.act;
+    int dac_port = act->dac ? i2c_bus_port_of(act->dac->bus_handle) : -1;
+    int relay_port = act->relay ? i2c_bus_port_of(act->relay->bus_handle) : -1;
+    if ((act->dac && dac_port < 0) || (act->relay && relay_port < 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_n_standby = 0;
+    if (act->dac)
+    {
+        s_standby[s_n_standby++] = (standby_t){.port = dac_port, .parts = PART_DAC};
+    }
+    if (act->relay && act->dac && relay_port == dac_port)
+    {
+        s_standby[0].parts |= PART_RELAY; // one standby writes both, back to back
+    }
+    else if (act->relay)
+    {
+        s_standby[s_n_standby++] = (standby_t){.port = relay_port, .parts = PART_RELAY};
+    }
+    s_parts = (act->dac ? PART_DAC : 0) | (act->relay ? PART_RELAY : 0);
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < s_n_standby && ret == ESP_OK; i++)
+    {
+        ret = i2c_sched_set_standby(s_standby[i].port, safe_exec, &s_standby[i]);
+    }
+    if (ret != ESP_OK)
+    {
+        standby_remove();
+        return ret;
+    }
+
+    portENTER_CRITICAL(&s_mux);
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_last_feed_us = esp_timer_get_time();
+    s_state = FAILSAFE_ARMED;
+    portEXIT_CRITICAL(&s_mux);
+
+    ret = periodic_alarm_start(s_cfg.check_us, on_alarm, NULL, &s_timer);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "timer: %s", esp_err_to_name(ret));
+        s_state = FAILSAFE_OFF;
+        standby_remove();
+        return ret;
+    }
+    s_running = true;
+    ESP_LOGI(TAG, "armed, %" PRIu32 " ms window, checked every %" PRIu32 " us", s_cfg.timeout_ms, s_cfg.check_us);
+    return ESP_OK;
+}
+
+esp_err_t failsafe_stop(void)
+{
+    if (!s_running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    periodic_alarm_stop(&s_timer);
+    failsafe_state_t state = wait_written();
+    standby_remove();
+    esp_err_t ret = ESP_OK;
+    if (state != FAILSAFE_ARMED)
+    {
+        ret = release();
+    }
+    portENTER_CRITICAL(&s_mux);
+    s_state = FAILSAFE_OFF;
+    portEXIT_CRITICAL(&s_mux);
+    s_running = false;
+    return ret;
+}
+
+bool failsafe_running(void)
+{
+    return s_running;
+}
+
+void failsafe_feed(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_mux);
+    if (s_state == FAILSAFE_ARMED)
+    {
+        uint32_t gap = (uint32_t)(now - s_last_feed_us);
+        s_stats.gap_max_us = gap > s_stats.gap_max_us ? gap : s_stats.gap_max_us;
+        s_stats.feeds++;
+        s_last_feed_us = now;
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+esp_err_t failsafe_trip(void)
+{
+    bool trip = false;
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_mux);
+    if (s_state == FAILSAFE_ARMED)
+    {
+        enter_trip(now, now);
+        trip = true;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    if (!trip)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < s_n_standby; i++)
+    {
+        i2c_sched_fire_standby(s_standby[i].port);
+    }
+    return ESP_OK;
+}
+
+esp_err_t failsafe_clear(void)
+{
+    failsafe_state_t state = failsafe_get_state();
+    if (state != FAILSAFE_SAFE && state != FAILSAFE_FAILED)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = release();
+    portENTER_CRITICAL(&s_mux);
+    s_last_feed_us = esp_timer_get_time();
+    s_state = FAILSAFE_ARMED;
+    portEXIT_CRITICAL(&s_mux);
+    return ret;
+}
+
+failsafe_state_t failsafe_get_state(void)
+{
+    portENTER_CRITICAL(&s_mux);
+    failsafe_state_t state = s_state;
+    portEXIT_CRITICAL(&s_mux);
+    return state;
+}
+
+void failsafe_get_stats(failsafe_stats_t *stats, bool reset)
+{
+    portENTER_CRITICAL(&s_mux);
+    if (stats)
+    {
+        *stats = s_stats;
+    }
+    if (reset)
+    {
+        memset(&s_stats, 0, sizeof(s_stats));
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void failsafe_print(FILE *out)
+{
+    failsafe_stats_t st;
+    if (!out)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&s_mux);
+    st = s_stats;
+    failsafe_state_t state = s_state;
+    int64_t since_us = esp_timer_get_time() - s_last_feed_us;
+    portEXIT_CRITICAL(&s_mux);
+
+    fprintf(out, "%s, window %" PRIu32 " ms, checked every %" PRIu32 " us", state_name(state), s_cfg.timeout_ms,
+            s_cfg.check_us);
+    if (state == FAILSAFE_ARMED)
+    {
+        fprintf(out, ", last heartbeat %" PRId64 " ms ago", since_us / 1000);
+    }
+    fprintf(out, "\r\n");
+    fprintf(out, "heartbeats %" PRIu32 ", gap max %" PRIu32 " us\r\n", st.feeds, st.gap_max_us);
+    fprintf(out, "trips %" PRIu32 ", confirmed %" PRIu32 ", write errors %" PRIu32 "\r\n", st.trips, st.confirmed,
+            st.write_errors);
+    fprintf(out, "detect   last %6" PRIu32 " us  max %6" PRIu32 " us\r\n", st.detect_last_us, st.detect_max_us);
+    fprintf(out, "to safe  last %6" PRIu32 " us  max %6" PRIu32 " us\r\n", st.safe_last_us, st.safe_max_us);
+}
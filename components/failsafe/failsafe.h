@@ -0,0 +1,94 @@
+// failsafe.h
+// Heartbeat failsafe: no heartbeat within the window puts the DAC at 0 V and opens all relays
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "actuator.h"
+
+    typedef enum
+    {
+        FAILSAFE_OFF = 0, // Not armed
+        FAILSAFE_ARMED,   // Waiting for heartbeats
+        FAILSAFE_TRIPPED, // Safe writes on their way
+        FAILSAFE_SAFE,    // Safe state confirmed, outputs held until failsafe_clear()
+        FAILSAFE_FAILED,  // Safe writes failed after all attempts, outputs held
+    } failsafe_state_t;
+
+    typedef struct
+    {
+        uint32_t timeout_ms; // Window without heartbeat before the trip
+        uint32_t check_us;   // Watchdog period, adds at most this much to the detection
+        int attempts;        // Bus attempts per safe write
+        actuator_t *act;     // DAC and relay board to make safe
+    } failsafe_config_t;
+
+#define FAILSAFE_CONFIG_DEFAULT() {.timeout_ms = 500, .check_us = 1000, .attempts = 3, .act = NULL}
+
+    typedef struct
+    {
+        uint32_t feeds;          // Heartbeats while armed
+        uint32_t gap_max_us;     // Longest time between two heartbeats
+        uint32_t trips;          // Time-outs and failsafe_trip() calls
+        uint32_t confirmed;      // Trips that reached the confirmed safe state
+        uint32_t write_errors;   // Failed bus attempts of the safe writes
+        uint32_t detect_last_us; // Time-out to the watchdog noticing it
+        uint32_t detect_max_us;
+        uint32_t safe_last_us;   // Time-out to the confirmed safe state (writes acked, relays read back)
+        uint32_t safe_max_us;
+    } failsafe_stats_t;
+
+    /**
+     * @brief Arm the failsafe: from now on failsafe_feed() must be called within every window.
+     *
+     * The safe writes (both DAC channels 0 V in one transfer, relay register 0) are set up as
+     * scheduler standbys now. A timer interrupt checks the heartbeat every check_us and fires
+     * them directly: they run before anything queued on the bus. From the first safe write on
+     * the DAC and relay addresses are held, nobody else can write them until failsafe_clear().
+     *
+     * @return ESP_OK, ESP_ERR_INVALID_STATE when the scheduler does not run or already armed.
+     */
+    esp_err_t failsafe_start(const failsafe_config_t *config);
+
+    /**
+     * @brief Disarm. After a trip the outputs are released as with failsafe_clear().
+     */
+    esp_err_t failsafe_stop(void);
+
+    bool failsafe_running(void);
+
+    // Heartbeat; cheap enough for every host command. Ignored after a trip.
+    void failsafe_feed(void);
+
+    // Trip now (emergency stop), the window does not matter
+    esp_err_t failsafe_trip(void);
+
+    /**
+     * @brief Release the outputs after a trip and arm again.
+     *
+     * The safe writes went around the drivers; their shadows are forgotten and the safe frame
+     * is applied through the actuator, so the shadows match the devices again. Nobody else
+     * may apply frames meanwhile (stop the control loop first).
+     *
+     * @return ESP_OK, ESP_ERR_INVALID_STATE when not tripped (or still writing).
+     */
+    esp_err_t failsafe_clear(void);
+
+    failsafe_state_t failsafe_get_state(void);
+
+    void failsafe_get_stats(failsafe_stats_t *stats, bool reset);
+
+    void failsafe_print(FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
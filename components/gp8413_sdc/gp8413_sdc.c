@@ -10,13 +10,15 @@
 #include "gp8413_sdc.h"
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include "esp_log.h"
+#include "i2c_sched.h"
 
 #define TAG "GP8413_SDC"
 #define GP8413_CHANNEL_MAX 1 /* 0 and 1 are valid */
 
 #define I2C_TOOL_TIMEOUT_VALUE_MS (50)
-static uint32_t i2c_frequency = 100 * 1000;
+static uint32_t i2c_frequency = 100 * 1000; // default, a speed tuned with i2ctune overrides it in the registry
 
 // PRIVATE Device definitions
 typedef enum
@@ -55,28 +57,48 @@ typedef enum
             return ESP_ERR_INVALID_ARG;                                      \
     } while (0)
 
-// Write data to the GP8413 device over I2C.
-// This function creates a temporary I2C device handle for the transaction,
-// sends the provided data buffer, and then removes the device handle.
-// Returns ESP_OK on success, or an error code on failure.
-static esp_err_t write_data_i2c(const gp8413_handle_t *handle, uint8_t *data, size_t size)
+// Register map. The chip cannot be read, so the shadow is the only copy of its state.
+// The range is written on its own, the two voltage words are consecutive and go out in
+// one auto-increment transfer when both changed.
+static const i2c_regmap_reg_t s_gp8413_regs[] = {
+    {GP8413_REG_RANGE, 1, I2C_REGMAP_WRITE_ONLY | I2C_REGMAP_SEPARATE},
+    {GP8413_REG_CH0_VOLTAGE, 2, I2C_REGMAP_WRITE_ONLY},
+    {GP8413_REG_CH1_VOLTAGE, 2, I2C_REGMAP_WRITE_ONLY},
+};
+
+// Setpoints go through the bus scheduler with urgent priority, so they do not wait
+// behind a display flush
+static const i2c_regmap_desc_t s_gp8413_regmap = {
+    .regs = s_gp8413_regs,
+    .n_regs = sizeof(s_gp8413_regs) / sizeof(s_gp8413_regs[0]),
+    .prio = I2C_SCHED_PRIO_URGENT,
+    .timeout_ms = I2C_TOOL_TIMEOUT_VALUE_MS,
+};
+
+// Convert millivolts to the 15-bit output word (0-32767), clamped to the range
+static uint16_t voltage_to_word(const gp8413_handle_t *handle, uint32_t *voltage)
 {
-    i2c_device_config_t i2c_dev_conf = {
-        .scl_speed_hz = i2c_frequency,
-        .device_address = handle->device_addr,
-    };
-
-    i2c_master_dev_handle_t dev_handle;
+    uint32_t max_mv = (uint32_t)handle->output_range;
+    if (*voltage > max_mv)
+        *voltage = max_mv;
+    return (uint16_t)(32767 * *voltage / max_mv);
+}
 
-    if (i2c_master_bus_add_device(handle->bus_handle, &i2c_dev_conf, &dev_handle) != ESP_OK)
+// Write the staged registers to the GP8413 device over I2C.
+// The regmap takes the device handle from the shared registry (i2c_bus) for every
+// transfer, so a rebuilt bus or a speed tuned with i2ctune is used right away.
+// Returns ESP_OK on success, or an error code on failure.
+static esp_err_t write_data_i2c(gp8413_handle_t *handle)
+{
+    uint32_t transfers = handle->regs.transfers;
+    esp_err_t ret = i2c_regmap_flush(&handle->regs);
+    if (ret == ESP_OK && transfers == handle->regs.transfers)
     {
-        return ESP_FAIL;
+        ESP_LOGD(TAG, "Nothing to write");
     }
-
-    esp_err_t ret = i2c_master_transmit(dev_handle, data, size, I2C_TOOL_TIMEOUT_VALUE_MS);
-    if (ret == ESP_OK)
+    else if (ret == ESP_OK)
     {
-        ESP_LOGI(TAG, "Write OK");
+        ESP_LOGD(TAG, "Write OK"); // every setpoint of a control loop passes here
     }
     else if (ret == ESP_ERR_TIMEOUT)
     {
@@ -86,12 +108,7 @@ static esp_err_t write_data_i2c(const gp8413_handle_t *handle, uint8_t *data, si
     {
         ESP_LOGW(TAG, "Write Failed");
     }
-
-    if (i2c_master_bus_rm_device(dev_handle) != ESP_OK)
-    {
-        return ESP_FAIL;
-    }
-    return ESP_OK;
+    return ret;
 }
 
 // Initialize the GP8413 device and return a handle
@@ -124,7 +141,11 @@ gp8413_handle_t *gp8413_init(const gp8413_config_t *config)
     handle->bus_handle = bus_handle;
     handle->device_addr = device_addr;
     handle->output_range = output_range;
-    esp_err_t ret = gp8413_set_output_range(handle, output_range);
+    esp_err_t ret = i2c_regmap_init(&handle->regs, &s_gp8413_regmap, bus_handle, device_addr, i2c_frequency);
+    if (ret == ESP_OK)
+    {
+        ret = gp8413_set_output_range(handle, output_range);
+    }
     if (ret != ESP_OK)
     {
         // If setting voltages fails, free the handle and return NULL
@@ -187,8 +208,7 @@ esp_err_t gp8413_set_output_range(gp8413_handle_t *handle, gp8413_output_range_t
     // Update the output range in the handle
 
     handle->output_range = range;
-    uint8_t reg = GP8413_REG_RANGE; // register address for output range
-    uint8_t range_code = 0x00;      // default range code
+    uint8_t range_code = 0x00; // default range code
 
     if (handle->output_range == GP8413_OUTPUT_RANGE_5V)
     {
@@ -206,10 +226,10 @@ esp_err_t gp8413_set_output_range(gp8413_handle_t *handle, gp8413_output_range_t
         return ESP_ERR_INVALID_ARG;
     }
 
-    uint8_t data[2] = {reg, (uint8_t)range_code};
-    ESP_LOGI(TAG, "Data to write: %02x %02x", data[0], data[1]);
+    ESP_LOGI(TAG, "Data to write: %02x %02x", GP8413_REG_RANGE, range_code);
 
-    esp_err_t err = write_data_i2c(handle, data, sizeof(data));
+    i2c_regmap_write(&handle->regs, GP8413_REG_RANGE, range_code);
+    esp_err_t err = write_data_i2c(handle);
     if (err != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to set output range");
@@ -223,7 +243,7 @@ esp_err_t gp8413_set_output_range(gp8413_handle_t *handle, gp8413_output_range_t
     return ESP_OK;
 }
 
-esp_err_t gp8413_set_output_voltage(gp8413_handle_t *handle, uint32_t voltage, uint32_t channel)
+esp_err_t gp8413_stage_output_voltage(gp8413_handle_t *handle, uint32_t voltage, uint32_t channel)
 {
     CHECK_HANDLE(handle);
     CHECK_CHANNEL(channel);
@@ -234,62 +254,72 @@ esp_err_t gp8413_set_output_voltage(gp8413_handle_t *handle, uint32_t voltage, u
         return ESP_ERR_INVALID_STATE; // Output range not set
     }
 
-    // Clamp voltage to range
-    uint32_t max_mv = (uint32_t)handle->output_range;
-    if (voltage > max_mv)
-        voltage = max_mv;
-
-    // Select register address for channel 0 or 1
+    // Convert voltage to 16-bit word (0-32767), stored low byte first by the regmap
+    uint16_t word = voltage_to_word(handle, &voltage);
     uint8_t data_addr = (channel == 0) ? GP8413_REG_CH0_VOLTAGE : GP8413_REG_CH1_VOLTAGE;
 
-    // Convert voltage to 16-bit word (0-32767)
-    uint16_t word = (uint16_t)(32767 * voltage / max_mv);
-
-    uint8_t data[3] = {
-        data_addr,
-        (uint8_t)(word & 0xFF),       // low byte
-        (uint8_t)((word >> 8) & 0xFF) // high byte
-    };
+    // remember the setpoint, used to restore the outputs after a bus rebuild
+    if (channel == 0)
+        handle->current_voltage_ch0 = voltage;
+    else
+        handle->current_voltage_ch1 = voltage;
+    return i2c_regmap_write(&handle->regs, data_addr, word);
+}
 
-    ESP_LOGI(TAG, "Set output voltage to %d mV on channel %d", voltage, channel);
-    ESP_LOGI(TAG, "Data to write: %02x %02x %02x", data[0], data[1], data[2]);
+esp_err_t gp8413_flush(gp8413_handle_t *handle)
+{
+    CHECK_HANDLE(handle);
+    return write_data_i2c(handle);
+}
 
-    return write_data_i2c(handle, data, sizeof(data));
+esp_err_t gp8413_set_output_voltage(gp8413_handle_t *handle, uint32_t voltage, uint32_t channel)
+{
+    esp_err_t ret = gp8413_stage_output_voltage(handle, voltage, channel);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ESP_LOGI(TAG, "Set output voltage to %" PRIu32 " mV on channel %" PRIu32,
+             channel == 0 ? handle->current_voltage_ch0 : handle->current_voltage_ch1, channel);
+    return write_data_i2c(handle);
 }
 
 esp_err_t gp8413_set_output_voltage_dual(gp8413_handle_t *handle, uint32_t voltage_ch0, uint32_t voltage_ch1)
 {
-    CHECK_HANDLE(handle);
-    // check if output range is set
-    if (handle->output_range == 0)
+    // both words staged, the flush sends them as one 5-byte transfer starting at CH0
+    esp_err_t ret = gp8413_stage_output_voltage(handle, voltage_ch0, 0);
+    if (ret == ESP_OK)
     {
-        ESP_LOGE(TAG, "Output range not set, please set it first");
-        return ESP_ERR_INVALID_STATE; // Output range not set
+        ret = gp8413_stage_output_voltage(handle, voltage_ch1, 1);
     }
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ESP_LOGI(TAG, "Set output voltage to %" PRIu32 " mV on channel 0 and %" PRIu32 " mV on channel 1",
+             handle->current_voltage_ch0, handle->current_voltage_ch1);
+    return write_data_i2c(handle);
+}
 
-    // Clamp voltages
-    uint32_t max_mv = (uint32_t)handle->output_range;
-    if (voltage_ch0 > max_mv)
-        voltage_ch0 = max_mv;
-    if (voltage_ch1 > max_mv)
-        voltage_ch1 = max_mv;
-
-    // Convert voltages to 15-bit words (0-32767)
-    int data_addr = GP8413_REG_CH0_VOLTAGE; // register start for 0 and 1 channel (16 bits each)
-
-    uint16_t word0 = 32767 * voltage_ch0 / max_mv;
-    uint16_t word1 = 32767 * voltage_ch1 / max_mv;
-
-    uint8_t data[5] = {
-        data_addr,
-        (uint8_t)(word0 & 0xFF) /*low0 */, (uint8_t)(word0 >> 8) /*high0 */,
-        (uint8_t)(word1 & 0xFF) /* low1 */, (uint8_t)(word1 >> 8) /* high1 */
-    };
+esp_err_t gp8413_restore(gp8413_handle_t *handle, i2c_master_bus_handle_t bus_handle)
+{
+    CHECK_HANDLE(handle);
+    CHECK_RANGE(handle->output_range);
 
-    ESP_LOGI(TAG, "Set output voltage to %d mV on channel 0 and %d mV on channel 1", voltage_ch0, voltage_ch1);
-    ESP_LOGI(TAG, "Data to write: %02x %02x %02x %02x %02x", data[0], data[1], data[2], data[3], data[4]);
+    if (bus_handle)
+    {
+        handle->bus_handle = bus_handle;
+        handle->regs.bus_handle = bus_handle;
+    }
 
-    return write_data_i2c(handle, data, sizeof(data));
+    // the chip may have been power cycled: write every known register again, the range
+    // on its own and then both outputs in one transfer
+    esp_err_t ret = i2c_regmap_sync(&handle->regs);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to restore the outputs");
+    }
+    return ret;
 }
 
 esp_err_t gp8413_store_settings(gp8413_handle_t *handle)
@@ -16,6 +16,7 @@ extern "C"
 
 #include "driver/i2c_master.h"
 #include "esp_err.h"
+#include "i2c_regmap.h"
 
 // Default I2C address for the GP8413 device
 #define GP8413_I2C_ADDRESS (0x59) // Default I2C address for GP8413
@@ -39,9 +40,10 @@ extern "C"
         i2c_master_bus_handle_t bus_handle;
         uint8_t device_addr; // I2C device address (0x59)
         gp8413_output_range_t output_range;
-        uint32_t current_voltage_ch0; // Current voltage for channel 0 in millivolts
-        uint32_t current_voltage_ch1; // Current voltage for channel 1 in millivolts
+        uint32_t current_voltage_ch0; // Setpoint for channel 0 in millivolts (staged or applied)
+        uint32_t current_voltage_ch1; // Setpoint for channel 1 in millivolts (staged or applied)
         bool initialized;             // Flag to track if the device is properly initialized
+        i2c_regmap_t regs;            // Shadow of the range and voltage registers
     } gp8413_handle_t;
 
     // Configuration struct for GP8413 initialization
@@ -108,6 +110,38 @@ extern "C"
      */
     esp_err_t gp8413_set_output_voltage_dual(gp8413_handle_t *handle, uint32_t voltage_ch0, uint32_t voltage_ch1);
 
+    /**
+     * @brief Stage the output voltage of a channel without writing it.
+     *
+     * Staged values are sent by gp8413_flush(); both channels staged together go out in
+     * one transfer, an unchanged value is not sent at all.
+     *
+     * @param handle  Pointer to the GP8413 handle.
+     * @param voltage Output voltage in millivolts.
+     * @param channel Channel number (0 or 1).
+     * @return esp_err_t
+     */
+    esp_err_t gp8413_stage_output_voltage(gp8413_handle_t *handle, uint32_t voltage, uint32_t channel);
+
+    /**
+     * @brief Write the staged registers to the device.
+     *
+     * @param handle Pointer to the GP8413 handle.
+     * @return esp_err_t
+     */
+    esp_err_t gp8413_flush(gp8413_handle_t *handle);
+
+    /**
+     * @brief Write the range and the last applied voltages to the device again.
+     *
+     * Used after a bus recovery or a brown-out of the DAC.
+     *
+     * @param handle     Pointer to the GP8413 handle.
+     * @param bus_handle New bus to use, or NULL to keep the current one.
+     * @return esp_err_t
+     */
+    esp_err_t gp8413_restore(gp8413_handle_t *handle, i2c_master_bus_handle_t bus_handle);
+
     /**
      * @brief Store the current settings to the GP8413 EEPROM.
      *
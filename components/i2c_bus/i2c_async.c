@@ -0,0 +1,486 @@
+/**
+ * @file i2c_async.c
+ * @brief Interrupt-driven, non-blocking I2C transfers.
+ *
+ * A bus created with a transaction queue puts the i2c_master driver in asynchronous mode:
+ * i2c_master_transmit() and friends queue the transfer and return at once, completion is
+ * reported from the I2C interrupt through the on_trans_done callback of the device.
+ *
+ * Per device the outstanding requests are kept in a small ring in submit order. The
+ * driver completes the transfers of one bus in order, so the callback pops the head of the
+ * ring, stores the result and notifies the submitting task. A request that does not finish
+ * in time is not simply forgotten, the driver would still use its buffers: the bus is
+ * reset and the wait goes on until the driver has completed or dropped it.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_async.h"
+#include <string.h>
+#include <freertos/semphr.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_bus.h"
+#include "i2c_sched.h"
+#include "i2c_capture.h"
+
+static const char *TAG = "i2c_async";
+
+#define I2C_ASYNC_DEFAULT_TIMEOUT_MS (1000)
+#define I2C_ASYNC_PROBE_SPEED_HZ (100000) // As i2c_master_probe()
+
+typedef struct
+{
+    i2c_master_dev_handle_t dev_handle;          // NULL = slot free
+    i2c_async_req_t *ring[I2C_ASYNC_QUEUE_DEPTH]; // Outstanding requests in submit order
+    uint8_t head;
+    uint8_t count;
+} async_dev_t;
+
+static async_dev_t s_devs[I2C_BUS_MAX_DEVICES];
+static bool s_async_port[I2C_BUS_MAX_PORTS];
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_submit_lock; // Keeps ring order equal to driver queue order
+static StaticSemaphore_t s_submit_lock_buf;
+
+static IRAM_ATTR bool on_trans_done(i2c_master_dev_handle_t dev_handle, const i2c_master_event_data_t *evt, void *arg)
+{
+    async_dev_t *d = (async_dev_t *)arg;
+    BaseType_t woken = pdFALSE;
+    esp_err_t result;
+
+    switch (evt->event)
+    {
+    case I2C_EVENT_DONE:
+        result = ESP_OK;
+        break;
+    case I2C_EVENT_NACK:
+        result = ESP_ERR_INVALID_RESPONSE;
+        break;
+    case I2C_EVENT_TIMEOUT:
+        result = ESP_ERR_TIMEOUT;
+        break;
+    default:
+        return false; // still running
+    }
+
+    i2c_async_req_t *req = NULL;
+    portENTER_CRITICAL_ISR(&s_mux);
+    if (d->count)
+    {
+        req = d->ring[d->head];
+        d->head = (d->head + 1) % I2C_ASYNC_QUEUE_DEPTH;
+        d->count--;
+    }
+    portEXIT_CRITICAL_ISR(&s_mux);
+
+    if (req)
+    {
+        // the waiter may return as soon as done is set, take the task handle first
+        TaskHandle_t task = req->task;
+        req->result = result;
+        req->done = true;
+        if (task)
+        {
+            vTaskNotifyGiveFromISR(task, &woken);
+        }
+    }
+    return woken == pdTRUE;
+}
+
+static void submit_lock(void)
+{
+    if (s_submit_lock == NULL)
+    {
+        portENTER_CRITICAL(&s_mux);
+        if (s_submit_lock == NULL)
+        {
+            s_submit_lock = xSemaphoreCreateMutexStatic(&s_submit_lock_buf);
+        }
+        portEXIT_CRITICAL(&s_mux);
+    }
+    xSemaphoreTake(s_submit_lock, portMAX_DELAY);
+}
+
+static void submit_unlock(void)
+{
+    xSemaphoreGive(s_submit_lock);
+}
+
+// Slot of a device, registering the completion callback on first use. Submit lock held.
+static async_dev_t *get_dev(i2c_master_dev_handle_t dev_handle)
+{
+    async_dev_t *free_slot = NULL;
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++)
+    {
+        if (s_devs[i].dev_handle == dev_handle)
+        {
+            return &s_devs[i];
+        }
+        if (s_devs[i].dev_handle == NULL && free_slot == NULL)
+        {
+            free_slot = &s_devs[i];
+        }
+    }
+    if (free_slot == NULL)
+    {
+        return NULL;
+    }
+
+    memset(free_slot, 0, sizeof(*free_slot));
+    const i2c_master_event_callbacks_t cbs = {
+        .on_trans_done = on_trans_done,
+    };
+    esp_err_t ret = i2c_master_register_event_callbacks(dev_handle, &cbs, free_slot);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to register I2C callbacks: %s", esp_err_to_name(ret));
+        return NULL;
+    }
+    free_slot->dev_handle = dev_handle;
+    return free_slot;
+}
+
+esp_err_t i2c_async_new_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle)
+{
+    if (!bus_config || !ret_bus_handle || bus_config->i2c_port < 0 || bus_config->i2c_port >= I2C_BUS_MAX_PORTS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    i2c_master_bus_config_t config = *bus_config;
+    config.trans_queue_depth = I2C_ASYNC_QUEUE_DEPTH;
+    esp_err_t ret = i2c_new_master_bus(&config, ret_bus_handle);
+    if (ret == ESP_OK)
+    {
+        s_async_port[config.i2c_port] = true;
+    }
+    return ret;
+}
+
+void i2c_async_forget_bus(i2c_master_bus_handle_t bus_handle)
+{
+    int port = i2c_bus_port_of(bus_handle);
+    if (port >= 0 && port < I2C_BUS_MAX_PORTS)
+    {
+        s_async_port[port] = false;
+    }
+}
+
+void i2c_async_forget_device(i2c_master_dev_handle_t dev_handle)
+{
+    TaskHandle_t waiters[I2C_ASYNC_QUEUE_DEPTH];
+    int n_waiters = 0;
+
+    if (dev_handle == NULL)
+    {
+        return;
+    }
+    submit_lock();
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++)
+    {
+        async_dev_t *d = &s_devs[i];
+        if (d->dev_handle != dev_handle)
+        {
+            continue;
+        }
+        // the transfers die with the device, wake whoever still waits for them
+        portENTER_CRITICAL(&s_mux);
+        while (d->count)
+        {
+            i2c_async_req_t *req = d->ring[d->head];
+            d->head = (d->head + 1) % I2C_ASYNC_QUEUE_DEPTH;
+            d->count--;
+            if (req)
+            {
+                waiters[n_waiters++] = req->task;
+                req->result = ESP_ERR_INVALID_STATE;
+                req->done = true;
+            }
+        }
+        d->dev_handle = NULL;
+        portEXIT_CRITICAL(&s_mux);
+    }
+    submit_unlock();
+
+    for (int i = 0; i < n_waiters; i++)
+    {
+        if (waiters[i])
+        {
+            xTaskNotifyGive(waiters[i]);
+        }
+    }
+}
+
+bool i2c_async_port_is_async(int port)
+{
+    return port >= 0 && port < I2C_BUS_MAX_PORTS && s_async_port[port];
+}
+
+// Synchronous bus: run the transfer through the scheduler, done on return
+static esp_err_t submit_sync(i2c_master_dev_handle_t dev_handle, i2c_async_req_t *req, int timeout_ms)
+{
+    esp_err_t ret;
+    if (req->read_len)
+    {
+        ret = i2c_sched_transmit_receive(dev_handle, I2C_SCHED_PRIO_NORMAL, req->write_buf, req->write_len,
+                                         req->read_buf, req->read_len, timeout_ms);
+    }
+    else
+    {
+        ret = i2c_sched_transmit(dev_handle, I2C_SCHED_PRIO_NORMAL, req->write_buf, req->write_len, timeout_ms);
+    }
+    req->result = ret;
+    req->done = true;
+    return ESP_OK;
+}
+
+static void req_start(i2c_master_dev_handle_t dev_handle, i2c_async_req_t *req)
+{
+    req->done = false;
+    req->result = ESP_ERR_TIMEOUT;
+    req->task = xTaskGetCurrentTaskHandle();
+    req->dev_handle = dev_handle;
+}
+
+// Asynchronous bus: put the request in the ring of the device and queue it in the driver
+static esp_err_t submit_async(i2c_master_dev_handle_t dev_handle, i2c_async_req_t *req, int timeout_ms)
+{
+    submit_lock();
+    async_dev_t *d = get_dev(dev_handle);
+    if (d == NULL)
+    {
+        submit_unlock();
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&s_mux);
+    bool full = (d->count >= I2C_ASYNC_QUEUE_DEPTH);
+    if (!full)
+    {
+        d->ring[(d->head + d->count) % I2C_ASYNC_QUEUE_DEPTH] = req;
+        d->count++;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    if (full)
+    {
+        submit_unlock();
+        return ESP_ERR_NO_MEM;
+    }
+
+    // asynchronous mode: these only queue the transfer (they block while the bus queue is full)
+    esp_err_t ret;
+    if (req->read_len && req->write_len)
+    {
+        ret = i2c_master_transmit_receive(dev_handle, req->write_buf, req->write_len, req->read_buf, req->read_len, timeout_ms);
+    }
+    else if (req->read_len)
+    {
+        ret = i2c_master_receive(dev_handle, req->read_buf, req->read_len, timeout_ms);
+    }
+    else
+    {
+        ret = i2c_master_transmit(dev_handle, req->write_buf, req->write_len, timeout_ms);
+    }
+
+    if (ret != ESP_OK)
+    {
+        // not queued: take it back off the tail, the interrupt only touches the head
+        portENTER_CRITICAL(&s_mux);
+        int tail = (d->head + d->count - 1) % I2C_ASYNC_QUEUE_DEPTH;
+        if (d->count && d->ring[tail] == req)
+        {
+            d->count--;
+        }
+        portEXIT_CRITICAL(&s_mux);
+    }
+    submit_unlock();
+    return ret;
+}
+
+static esp_err_t submit(i2c_master_dev_handle_t dev_handle, i2c_async_req_t *req)
+{
+    if (!dev_handle || !req || (!req->write_len && !req->read_len))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int timeout_ms = req->timeout_ms ? req->timeout_ms : I2C_ASYNC_DEFAULT_TIMEOUT_MS;
+    req_start(dev_handle, req);
+
+    if (!i2c_async_port_is_async(i2c_bus_device_port(dev_handle)))
+    {
+        return submit_sync(dev_handle, req, timeout_ms);
+    }
+    return submit_async(dev_handle, req, timeout_ms);
+}
+
+esp_err_t i2c_async_submit(i2c_master_dev_handle_t dev_handle, i2c_async_req_t *req)
+{
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = submit(dev_handle, req);
+    int port = i2c_bus_device_port(dev_handle);
+    if (i2c_async_port_is_async(port))
+    {
+        // on a synchronous port the scheduler recorded the transfer itself
+        i2c_capture_record(port, dev_handle, req->write_buf, req->write_len, NULL, req->read_len, ret, start_us,
+                           I2C_CAPTURE_F_QUEUED);
+    }
+    return ret;
+}
+
+// Finish every request left in the rings of a port's devices. Submit lock held.
+static void drop_port(int port, esp_err_t result)
+{
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++)
+    {
+        async_dev_t *d = &s_devs[i];
+        TaskHandle_t waiters[I2C_ASYNC_QUEUE_DEPTH];
+        int n_waiters = 0;
+        if (d->dev_handle == NULL || i2c_bus_device_port(d->dev_handle) != port)
+        {
+            continue;
+        }
+        portENTER_CRITICAL(&s_mux);
+        while (d->count)
+        {
+            i2c_async_req_t *req = d->ring[d->head];
+            d->head = (d->head + 1) % I2C_ASYNC_QUEUE_DEPTH;
+            d->count--;
+            if (req)
+            {
+                waiters[n_waiters++] = req->task;
+                req->result = result;
+                req->done = true;
+            }
+        }
+        portEXIT_CRITICAL(&s_mux);
+        for (int w = 0; w < n_waiters; w++)
+        {
+            if (waiters[w])
+            {
+                xTaskNotifyGive(waiters[w]);
+            }
+        }
+    }
+}
+
+// A request that is late is still in the driver. Reset the bus to end the transfer on the
+// wire, then wait until the request completed or the driver queue is empty; what the reset
+// dropped without a callback is finished here.
+static void abort_transfer(int port, i2c_async_req_t *req)
+{
+    i2c_master_bus_handle_t bus = NULL;
+
+    submit_lock(); // nothing new is queued meanwhile
+    if (!req->done && port >= 0 && i2c_master_get_bus_handle(port, &bus) == ESP_OK)
+    {
+        ESP_LOGW(TAG, "Transfer on bus %d not done in time, resetting the bus", port);
+        i2c_master_bus_reset(bus);
+        while (!req->done && i2c_master_bus_wait_all_done(bus, I2C_ASYNC_DEFAULT_TIMEOUT_MS) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Bus %d does not finish its queue", port);
+        }
+    }
+    if (!req->done)
+    {
+        // the driver queue is empty (or the bus is gone): nothing refers to these any more
+        drop_port(port, ESP_ERR_TIMEOUT);
+    }
+    submit_unlock();
+}
+
+static esp_err_t wait_done(int port, i2c_async_req_t *req, int timeout_ms)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t limit = (timeout_ms < 0) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+
+    while (!req->done)
+    {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (limit != portMAX_DELAY && elapsed >= limit)
+        {
+            break;
+        }
+        // a notification may belong to another request of this task, done decides
+        ulTaskNotifyTake(pdTRUE, (limit == portMAX_DELAY) ? portMAX_DELAY : limit - elapsed);
+    }
+    if (!req->done)
+    {
+        abort_transfer(port, req);
+    }
+    return req->result;
+}
+
+esp_err_t i2c_async_wait(i2c_async_req_t *req, int timeout_ms)
+{
+    if (!req)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return wait_done(i2c_bus_device_port(req->dev_handle), req, timeout_ms);
+}
+
+esp_err_t i2c_async_transfer(i2c_master_dev_handle_t dev_handle, const uint8_t *write_buf, size_t write_len,
+                             uint8_t *read_buf, size_t read_len, int timeout_ms)
+{
+    i2c_async_req_t req = {
+        .write_buf = write_buf,
+        .write_len = write_len,
+        .read_buf = read_buf,
+        .read_len = read_len,
+        .timeout_ms = timeout_ms,
+    };
+    esp_err_t ret = submit(dev_handle, &req); // the scheduler records the transfer when it is done
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    if (timeout_ms <= 0)
+    {
+        timeout_ms = I2C_ASYNC_DEFAULT_TIMEOUT_MS;
+    }
+    return i2c_async_wait(&req, timeout_ms * (I2C_ASYNC_QUEUE_DEPTH + 1));
+}
+
+esp_err_t i2c_async_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int timeout_ms)
+{
+    int port = i2c_bus_port_of(bus_handle);
+    if (port < 0 || address > 0x7f)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!i2c_async_port_is_async(port))
+    {
+        return i2c_master_probe(bus_handle, address, timeout_ms);
+    }
+
+    // a device of its own, outside the registry: the probe is no transfer of a driver
+    const i2c_device_config_t dev_config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = address,
+        .scl_speed_hz = I2C_ASYNC_PROBE_SPEED_HZ,
+    };
+    i2c_master_dev_handle_t dev_handle;
+    esp_err_t ret = i2c_master_bus_add_device(bus_handle, &dev_config, &dev_handle);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    uint8_t byte;
+    i2c_async_req_t req = {
+        .read_buf = &byte,
+        .read_len = 1,
+        .timeout_ms = timeout_ms,
+    };
+    req_start(dev_handle, &req);
+    ret = submit_async(dev_handle, &req, timeout_ms);
+    if (ret == ESP_OK)
+    {
+        ret = wait_done(port, &req, timeout_ms);
+    }
+    // finishes the request when the bus reset dropped it, drop_port() only knows registry devices
+    i2c_async_forget_device(dev_handle);
+    i2c_master_bus_rm_device(dev_handle);
+    return ret == ESP_ERR_INVALID_RESPONSE ? ESP_ERR_NOT_FOUND : ret;
+}
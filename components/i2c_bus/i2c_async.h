@@ -0,0 +1,111 @@
+// i2c_async.h
+// Non-blocking I2C transfers with completion notification (I2C master event callbacks)
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+#define I2C_ASYNC_QUEUE_DEPTH (16) // Outstanding transfers per bus (driver queue) and per device
+
+    // One non-blocking transfer. The request and its buffers must stay valid until done.
+    typedef struct
+    {
+        const uint8_t *write_buf; // Data to write (may be NULL)
+        size_t write_len;
+        uint8_t *read_buf; // Data to read after the write (may be NULL)
+        size_t read_len;
+        int timeout_ms; // Bus timeout of the transfer, 0 = 1000 ms
+        // Set by i2c_async
+        volatile bool done;
+        esp_err_t result;
+        TaskHandle_t task; // Notified on completion
+        i2c_master_dev_handle_t dev_handle;
+    } i2c_async_req_t;
+
+    /**
+     * @brief Create an I2C master bus in asynchronous mode (trans_queue_depth set).
+     *
+     * All transfers on this bus complete through the event callback: transfers queued by
+     * i2c_sched on this port wait for their completion, i2c_async_submit() does not.
+     * i2c_master_probe() does not work on an asynchronous bus, i2c_async_probe() does.
+     */
+    esp_err_t i2c_async_new_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle);
+
+    /**
+     * @brief Forget an asynchronous bus and its devices. Call before i2c_del_master_bus().
+     */
+    void i2c_async_forget_bus(i2c_master_bus_handle_t bus_handle);
+
+    /**
+     * @brief Forget a device before it is removed from the bus. Called by the registry.
+     *
+     * Its outstanding requests complete with ESP_ERR_INVALID_STATE.
+     */
+    void i2c_async_forget_device(i2c_master_dev_handle_t dev_handle);
+
+    /**
+     * @brief Is this port driven in asynchronous mode.
+     */
+    bool i2c_async_port_is_async(int port);
+
+    /**
+     * @brief Start a transfer and return immediately.
+     *
+     * Several requests per device may be outstanding; they complete in submit order. On
+     * completion req->done is set and the submitting task gets a task notification. On a
+     * synchronous bus the transfer runs through the scheduler and is done on return.
+     *
+     * @return ESP_OK when queued (or done), ESP_ERR_NO_MEM when the device queue is full,
+     *         or the error of the driver.
+     */
+    esp_err_t i2c_async_submit(i2c_master_dev_handle_t dev_handle, i2c_async_req_t *req);
+
+    /**
+     * @brief Wait until a request is done.
+     *
+     * When it is not done after timeout_ms the driver still reads or fills its buffers, so
+     * the bus is reset and the call waits until the driver has let go of the request: it
+     * completed after all, or the driver queue of the bus is empty. Only then it returns;
+     * the request and its buffers may always be reused afterwards.
+     *
+     * @return Result of the transfer; ESP_ERR_TIMEOUT when the bus reset dropped it.
+     */
+    esp_err_t i2c_async_wait(i2c_async_req_t *req, int timeout_ms);
+
+    /**
+     * @brief Submit and wait: a blocking transfer over the asynchronous path.
+     *
+     * Used by the scheduler on asynchronous ports. The wait allows for a full bus queue
+     * ahead of the transfer, each with its own timeout.
+     */
+    esp_err_t i2c_async_transfer(i2c_master_dev_handle_t dev_handle, const uint8_t *write_buf, size_t write_len,
+                                 uint8_t *read_buf, size_t read_len, int timeout_ms);
+
+    /**
+     * @brief Check whether a device acknowledges its address, on any bus.
+     *
+     * On an asynchronous bus this reads one byte through a temporary device and waits for
+     * the completion; a NACK means nobody answered. On a synchronous bus it is
+     * i2c_master_probe(). Blocks, call it from the scheduler task of the port
+     * (i2c_sched_run) so it does not interleave with queued transfers.
+     *
+     * @return ESP_OK when acknowledged, ESP_ERR_NOT_FOUND on a NACK, ESP_ERR_TIMEOUT when the
+     *         bus did not finish in time, ESP_ERR_INVALID_ARG.
+     */
+    esp_err_t i2c_async_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,398 @@
+/**
+ * @file i2c_batch.c
+ * @brief Transaction scripts for bring-up and test.
+ *
+ * A script is compiled once into a flat step list: numbers parsed, bytes stored in one
+ * pool, device handles fetched from the registry. Running it is then a tight loop of
+ * scheduler calls without parsing, allocation or handle management, each step timed.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_batch.h"
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "i2c_bus.h"
+#include "i2c_sched.h"
+
+typedef struct
+{
+    const char *p;
+    int line;
+    char *err;
+    size_t err_size;
+} parser_t;
+
+static esp_err_t parse_error(parser_t *ps, const char *msg)
+{
+    if (ps->err && ps->err_size)
+    {
+        snprintf(ps->err, ps->err_size, "line %d: %s", ps->line, msg);
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+// Skip blanks and comments, not the end of a step
+static void skip_blank(parser_t *ps)
+{
+    for (;;)
+    {
+        while (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\r')
+        {
+            ps->p++;
+        }
+        if (*ps->p != '#')
+        {
+            return;
+        }
+        while (*ps->p && *ps->p != '\n')
+        {
+            ps->p++;
+        }
+    }
+}
+
+static bool end_of_step(parser_t *ps)
+{
+    skip_blank(ps);
+    return *ps->p == '\0' || *ps->p == '\n' || *ps->p == ';';
+}
+
+static bool parse_number(parser_t *ps, uint32_t max, uint32_t *value)
+{
+    skip_blank(ps);
+    char *end;
+    unsigned long v = strtoul(ps->p, &end, 0);
+    if (end == ps->p || v > max || (*end && !isspace((unsigned char)*end) && *end != ';' && *end != '#' && *end != '='))
+    {
+        return false;
+    }
+    ps->p = end;
+    *value = (uint32_t)v;
+    return true;
+}
+
+// Bytes up to the end of the step or '=', appended to the pool
+static esp_err_t parse_bytes(parser_t *ps, i2c_batch_t *batch, uint8_t *count)
+{
+    uint32_t v;
+    *count = 0;
+    while (!end_of_step(ps) && *ps->p != '=')
+    {
+        if (!parse_number(ps, 0xff, &v))
+        {
+            return parse_error(ps, "bad byte");
+        }
+        if (*count >= I2C_BATCH_MAX_XFER || batch->data_used >= I2C_BATCH_MAX_DATA)
+        {
+            return parse_error(ps, "too many bytes");
+        }
+        batch->data[batch->data_used++] = (uint8_t)v;
+        (*count)++;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_step(parser_t *ps, i2c_batch_t *batch, int *port, uint32_t scl_speed_hz)
+{
+    char op[4] = {0};
+    int n = 0;
+    while (isalpha((unsigned char)*ps->p) && n < 3)
+    {
+        op[n++] = *ps->p++;
+    }
+    uint32_t v;
+
+    if (strcmp(op, "bus") == 0)
+    {
+        if (!parse_number(ps, 0xff, &v) || !end_of_step(ps))
+        {
+            return parse_error(ps, "usage: bus PORT");
+        }
+        *port = (int)v;
+        return ESP_OK;
+    }
+    if (batch->n_steps >= I2C_BATCH_MAX_STEPS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    i2c_batch_step_t *s = &batch->steps[batch->n_steps];
+    memset(s, 0, sizeof(*s));
+    s->line = ps->line;
+    s->port = (uint8_t)*port;
+    s->data = batch->data_used;
+
+    if (strcmp(op, "d") == 0)
+    {
+        if (!parse_number(ps, 60000, &v) || !end_of_step(ps))
+        {
+            return parse_error(ps, "usage: d MS");
+        }
+        s->op = I2C_BATCH_DELAY;
+        s->delay_ms = v;
+        batch->n_steps++;
+        return ESP_OK;
+    }
+
+    if (strcmp(op, "w") == 0)
+    {
+        s->op = I2C_BATCH_WRITE;
+    }
+    else if (strcmp(op, "r") == 0)
+    {
+        s->op = I2C_BATCH_READ;
+    }
+    else if (strcmp(op, "c") == 0)
+    {
+        s->op = I2C_BATCH_CHECK;
+    }
+    else
+    {
+        return parse_error(ps, "unknown step, use bus, w, r, c or d");
+    }
+
+    if (!parse_number(ps, 0x7f, &v))
+    {
+        return parse_error(ps, "bad address");
+    }
+    s->addr = (uint8_t)v;
+
+    esp_err_t ret;
+    if (s->op == I2C_BATCH_READ)
+    {
+        if (!parse_number(ps, I2C_BATCH_MAX_XFER, &v) || v == 0)
+        {
+            return parse_error(ps, "usage: r ADDR N [BYTES]");
+        }
+        s->read_len = (uint8_t)v;
+    }
+    ret = parse_bytes(ps, batch, &s->write_len);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    if (s->op == I2C_BATCH_CHECK)
+    {
+        skip_blank(ps);
+        if (*ps->p != '=')
+        {
+            return parse_error(ps, "usage: c ADDR BYTES = EXPECTED");
+        }
+        ps->p++;
+        ret = parse_bytes(ps, batch, &s->read_len);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        if (s->read_len == 0)
+        {
+            return parse_error(ps, "no expected bytes");
+        }
+    }
+    else if (!end_of_step(ps))
+    {
+        return parse_error(ps, "unexpected text");
+    }
+    if (s->op == I2C_BATCH_WRITE && s->write_len == 0)
+    {
+        return parse_error(ps, "nothing to write");
+    }
+
+    // room for the bytes read back
+    if (s->op != I2C_BATCH_WRITE)
+    {
+        if (batch->data_used + s->read_len > I2C_BATCH_MAX_DATA)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        batch->data_used += s->read_len;
+    }
+
+    i2c_master_bus_handle_t bus_handle;
+    if (i2c_master_get_bus_handle(s->port, &bus_handle) != ESP_OK || bus_handle == NULL)
+    {
+        parse_error(ps, "bus not installed");
+        return ESP_ERR_INVALID_STATE;
+    }
+    ret = i2c_bus_get_device(bus_handle, s->addr, scl_speed_hz, &s->dev_handle);
+    if (ret != ESP_OK)
+    {
+        parse_error(ps, "cannot add device");
+        return ret;
+    }
+    batch->n_steps++;
+    return ESP_OK;
+}
+
+esp_err_t i2c_batch_compile(const char *text, uint32_t scl_speed_hz, i2c_batch_t *batch, char *err, size_t err_size)
+{
+    if (!text || !batch)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(batch, 0, sizeof(*batch));
+    batch->generation = i2c_bus_generation();
+
+    parser_t ps = {.p = text, .line = 1, .err = err, .err_size = err_size};
+    int port = 0;
+    while (*ps.p)
+    {
+        skip_blank(&ps);
+        if (*ps.p == '\n' || *ps.p == ';')
+        {
+            ps.line += (*ps.p == '\n');
+            ps.p++;
+            continue;
+        }
+        if (*ps.p == '\0')
+        {
+            break;
+        }
+        esp_err_t ret = parse_step(&ps, batch, &port, scl_speed_hz);
+        if (ret == ESP_ERR_NO_MEM)
+        {
+            parse_error(&ps, "script too large");
+        }
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_batch_run(i2c_batch_t *batch, bool stop_on_fail)
+{
+    if (!batch)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (batch->generation != i2c_bus_generation())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    batch->passed = 0;
+    batch->failed = 0;
+    for (int i = 0; i < batch->n_steps; i++)
+    {
+        batch->steps[i].result = ESP_ERR_NOT_FINISHED; // not run (yet)
+        batch->steps[i].pass = false;
+        batch->steps[i].us = 0;
+    }
+    int64_t run_start = esp_timer_get_time();
+    for (int i = 0; i < batch->n_steps; i++)
+    {
+        i2c_batch_step_t *s = &batch->steps[i];
+        const uint8_t *wbuf = &batch->data[s->data];
+        uint8_t *rbuf = &batch->data[s->data + s->write_len + (s->op == I2C_BATCH_CHECK ? s->read_len : 0)];
+        int64_t start = esp_timer_get_time();
+
+        switch (s->op)
+        {
+        case I2C_BATCH_DELAY:
+            if (s->delay_ms >= portTICK_PERIOD_MS)
+            {
+                vTaskDelay(pdMS_TO_TICKS(s->delay_ms));
+            }
+            else
+            {
+                esp_rom_delay_us(s->delay_ms * 1000); // shorter than a tick
+            }
+            s->result = ESP_OK;
+            break;
+        case I2C_BATCH_WRITE:
+            s->result = i2c_sched_transmit(s->dev_handle, I2C_SCHED_PRIO_NORMAL, wbuf, s->write_len, I2C_BATCH_TIMEOUT_MS);
+            break;
+        default:
+            // without write bytes this is a plain read
+            s->result = i2c_sched_transmit_receive(s->dev_handle, I2C_SCHED_PRIO_NORMAL, wbuf, s->write_len,
+                                                   rbuf, s->read_len, I2C_BATCH_TIMEOUT_MS);
+            break;
+        }
+        s->us = (uint32_t)(esp_timer_get_time() - start);
+        s->pass = (s->result == ESP_OK) &&
+                  (s->op != I2C_BATCH_CHECK || memcmp(rbuf, wbuf + s->write_len, s->read_len) == 0);
+        if (s->pass)
+        {
+            batch->passed++;
+        }
+        else
+        {
+            batch->failed++;
+            if (stop_on_fail)
+            {
+                break;
+            }
+        }
+    }
+    batch->total_us = (uint32_t)(esp_timer_get_time() - run_start);
+    return batch->failed ? ESP_FAIL : ESP_OK;
+}
+
+static void print_bytes(FILE *out, const uint8_t *data, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        fprintf(out, " %02x", data[i]);
+    }
+}
+
+void i2c_batch_print(const i2c_batch_t *batch, FILE *out, bool summary_only)
+{
+    static const char *op_names[] = {"w", "r", "c", "d"};
+    if (!batch || !out)
+    {
+        return;
+    }
+
+    for (int i = 0; i < batch->n_steps && !summary_only; i++)
+    {
+        const i2c_batch_step_t *s = &batch->steps[i];
+        const uint8_t *wbuf = &batch->data[s->data];
+        const uint8_t *rbuf = &batch->data[s->data + s->write_len + (s->op == I2C_BATCH_CHECK ? s->read_len : 0)];
+        if (s->result == ESP_ERR_NOT_FINISHED)
+        {
+            fprintf(out, "%3d  line %-3u skipped\r\n", i, s->line);
+            continue;
+        }
+        fprintf(out, "%3d  line %-3u %s ", i, s->line, op_names[s->op]);
+        if (s->op == I2C_BATCH_DELAY)
+        {
+            fprintf(out, "%" PRIu32 " ms", s->delay_ms);
+        }
+        else
+        {
+            fprintf(out, "%d:0x%02x", s->port, s->addr);
+            print_bytes(out, wbuf, s->write_len);
+            if (s->op != I2C_BATCH_WRITE && s->result == ESP_OK)
+            {
+                fprintf(out, " ->");
+                print_bytes(out, rbuf, s->read_len);
+            }
+        }
+        fprintf(out, "  %s %" PRIu32 " us", s->pass ? "ok" : "FAIL", s->us);
+        if (s->result != ESP_OK)
+        {
+            fprintf(out, " (%s)", esp_err_to_name(s->result));
+        }
+        else if (!s->pass)
+        {
+            fprintf(out, " (expected");
+            print_bytes(out, wbuf + s->write_len, s->read_len);
+            fprintf(out, ")");
+        }
+        fprintf(out, "\r\n");
+    }
+    fprintf(out, "%d steps: %d passed, %d failed, %" PRIu32 " us\r\n",
+            batch->n_steps, batch->passed, batch->failed, batch->total_us);
+}
@@ -0,0 +1,100 @@
+// i2c_batch.h
+// Transaction scripts for i2cbatch: compile once, run back to back on cached device handles
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+#define I2C_BATCH_MAX_STEPS (64)  // Steps per script
+#define I2C_BATCH_MAX_DATA (512)  // Bytes for write data, expected values and read results
+#define I2C_BATCH_MAX_XFER (32)   // Bytes written or read in one step
+#define I2C_BATCH_TIMEOUT_MS (50) // Timeout per step
+
+    /*
+     * Script syntax, one step per line or separated by ';', '#' starts a comment.
+     * Numbers are C style: 0x3c, 60, 074.
+     *
+     *   bus P               use I2C port P for the following steps (default 0)
+     *   w ADDR B...         write bytes
+     *   r ADDR N [B...]     write B... (e.g. register address), then read N bytes
+     *   c ADDR B... = E...  write B..., read as many bytes as E... and compare
+     *   d MS                delay
+     */
+
+    typedef enum
+    {
+        I2C_BATCH_WRITE = 0,
+        I2C_BATCH_READ,
+        I2C_BATCH_CHECK,
+        I2C_BATCH_DELAY,
+    } i2c_batch_op_t;
+
+    typedef struct
+    {
+        uint8_t op;        // i2c_batch_op_t
+        uint8_t port;
+        uint8_t addr;
+        uint8_t write_len;
+        uint8_t read_len;
+        uint16_t data;     // Offset in the data pool: write bytes, expected bytes, read bytes
+        uint16_t line;     // Script line, for messages
+        uint32_t delay_ms;
+        i2c_master_dev_handle_t dev_handle; // Resolved at compile time
+        // Result of the last run
+        esp_err_t result;
+        uint32_t us;
+        bool pass;
+    } i2c_batch_step_t;
+
+    typedef struct
+    {
+        i2c_batch_step_t steps[I2C_BATCH_MAX_STEPS];
+        int n_steps;
+        uint8_t data[I2C_BATCH_MAX_DATA];
+        uint16_t data_used;
+        uint32_t generation; // Registry generation of the handles
+        // Summary of the last run
+        int passed;
+        int failed;
+        uint32_t total_us;
+    } i2c_batch_t;
+
+    /**
+     * @brief Compile a script: parse it and get the device handles from the registry.
+     *
+     * @param text         Script text.
+     * @param scl_speed_hz Device speed asked from the registry (a tuned speed wins).
+     * @param batch        Output program.
+     * @param err          Optional message buffer for a syntax error.
+     * @return ESP_OK, ESP_ERR_INVALID_ARG on a syntax error, ESP_ERR_NO_MEM when the script is
+     *         too large, ESP_ERR_INVALID_STATE when a bus is not installed.
+     */
+    esp_err_t i2c_batch_compile(const char *text, uint32_t scl_speed_hz, i2c_batch_t *batch, char *err, size_t err_size);
+
+    /**
+     * @brief Run a compiled script through the scheduler, step after step.
+     *
+     * @param stop_on_fail Stop at the first failing step.
+     * @return ESP_OK when all steps passed, ESP_FAIL when one failed, ESP_ERR_INVALID_STATE
+     *         when the handles are outdated (bus rebuilt, compile again).
+     */
+    esp_err_t i2c_batch_run(i2c_batch_t *batch, bool stop_on_fail);
+
+    /**
+     * @brief Print the per-step results and the summary of the last run.
+     */
+    void i2c_batch_print(const i2c_batch_t *batch, FILE *out, bool summary_only);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,317 @@
+/**
+ * @file i2c_bus.c
+ * @brief Registry of shared I2C device handles.
+ *
+ * Adding and removing a device handle for every transaction is expensive compared to the
+ * transaction itself. This registry keeps one i2c_master_dev_handle_t per
+ * (bus, address, SCL speed) and hands it out to every user: console commands and drivers.
+ * When a bus is rebuilt (i2cconfig) all its handles are released in one go and the
+ * generation counter is incremented. A tuned speed per (port, address) overrides the
+ * speed the driver asks for.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_bus.h"
+#include <string.h>
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "esp_log.h"
+#include "i2c_async.h"
+
+static const char *TAG = "i2c_bus";
+
+typedef struct
+{
+    i2c_master_bus_handle_t bus_handle; // NULL = free slot
+    i2c_master_dev_handle_t dev_handle;
+    uint16_t device_address;
+    uint32_t scl_speed_hz;
+    int8_t port; // I2C port of bus_handle, selects the scheduler lane
+} i2c_bus_entry_t;
+
+static i2c_bus_entry_t s_entries[I2C_BUS_MAX_DEVICES];
+static uint32_t s_generation;
+static uint32_t s_device_speed[I2C_BUS_MAX_PORTS][128]; // Tuned SCL speed, 0 = not set
+
+static StaticSemaphore_t s_lock_buf;
+static SemaphoreHandle_t s_lock;
+static portMUX_TYPE s_lock_init_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void registry_lock(void)
+{
+    if (s_lock == NULL)
+    {
+        // first use, create the mutex exactly once
+        portENTER_CRITICAL(&s_lock_init_mux);
+        if (s_lock == NULL)
+        {
+            s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+        }
+        portEXIT_CRITICAL(&s_lock_init_mux);
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+}
+
+static void registry_unlock(void)
+{
+    xSemaphoreGive(s_lock);
+}
+
+int i2c_bus_port_of(i2c_master_bus_handle_t bus_handle)
+{
+    for (int port = 0; port < I2C_BUS_MAX_PORTS && bus_handle != NULL; port++)
+    {
+        i2c_master_bus_handle_t handle;
+        if (i2c_master_get_bus_handle(port, &handle) == ESP_OK && handle == bus_handle)
+        {
+            return port;
+        }
+    }
+    return -1;
+}
+
+esp_err_t i2c_bus_get_device(i2c_master_bus_handle_t bus_handle, uint16_t device_address,
+                             uint32_t scl_speed_hz, i2c_master_dev_handle_t *dev_handle)
+{
+    if (!bus_handle || !dev_handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    registry_lock();
+    int port = i2c_bus_port_of(bus_handle);
+    if (port >= 0 && device_address < 128 && s_device_speed[port][device_address])
+    {
+        scl_speed_hz = s_device_speed[port][device_address];
+    }
+
+    i2c_bus_entry_t *free_slot = NULL;
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++)
+    {
+        i2c_bus_entry_t *e = &s_entries[i];
+        if (e->bus_handle == NULL)
+        {
+            if (free_slot == NULL)
+            {
+                free_slot = e;
+            }
+            continue;
+        }
+        if (e->bus_handle == bus_handle && e->device_address == device_address && e->scl_speed_hz == scl_speed_hz)
+        {
+            *dev_handle = e->dev_handle; // cache hit, the common case
+            registry_unlock();
+            return (e->dev_handle != NULL) ? ESP_OK : ESP_ERR_INVALID_STATE; // NULL: detached, bus being rebuilt
+        }
+    }
+
+    if (free_slot == NULL)
+    {
+        registry_unlock();
+        ESP_LOGE(TAG, "Device cache full, cannot add 0x%02x", device_address);
+        return ESP_ERR_NO_MEM;
+    }
+
+    i2c_device_config_t i2c_dev_conf = {
+        .scl_speed_hz = scl_speed_hz,
+        .device_address = device_address,
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+    };
+    esp_err_t ret = i2c_master_bus_add_device(bus_handle, &i2c_dev_conf, &free_slot->dev_handle);
+    if (ret == ESP_OK)
+    {
+        free_slot->bus_handle = bus_handle;
+        free_slot->device_address = device_address;
+        free_slot->scl_speed_hz = scl_speed_hz;
+        free_slot->port = port;
+        *dev_handle = free_slot->dev_handle;
+        ESP_LOGD(TAG, "Cached handle for 0x%02x @ %" PRIu32 " Hz", device_address, scl_speed_hz);
+    }
+    else
+    {
+        free_slot->dev_handle = NULL;
+        ESP_LOGE(TAG, "Failed to add I2C device 0x%02x: %s", device_address, esp_err_to_name(ret));
+    }
+    registry_unlock();
+    return ret;
+}
+
+esp_err_t i2c_bus_release_all(i2c_master_bus_handle_t bus_handle)
+{
+    esp_err_t first_err = ESP_OK;
+
+    registry_lock();
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++)
+    {
+        i2c_bus_entry_t *e = &s_entries[i];
+        if (e->bus_handle == NULL || e->bus_handle != bus_handle)
+        {
+            continue;
+        }
+        i2c_async_forget_device(e->dev_handle);
+        esp_err_t ret = e->dev_handle ? i2c_master_bus_rm_device(e->dev_handle) : ESP_OK;
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to remove I2C device 0x%02x: %s", e->device_address, esp_err_to_name(ret));
+            if (first_err == ESP_OK)
+            {
+                first_err = ret;
+            }
+        }
+        memset(e, 0, sizeof(*e));
+    }
+    int port = i2c_bus_port_of(bus_handle);
+    if (port >= 0)
+    {
+        memset(s_device_speed[port], 0, sizeof(s_device_speed[port])); // new bus, maybe other wiring
+    }
+    s_generation++;
+    registry_unlock();
+    return first_err;
+}
+
+esp_err_t i2c_bus_set_device_speed(i2c_master_bus_handle_t bus_handle, uint16_t device_address, uint32_t scl_speed_hz)
+{
+    int port = i2c_bus_port_of(bus_handle);
+    if (port < 0 || device_address > 0x7f)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+    bool dropped = false;
+    registry_lock();
+    s_device_speed[port][device_address] = scl_speed_hz;
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++)
+    {
+        i2c_bus_entry_t *e = &s_entries[i];
+        if (e->bus_handle != bus_handle || e->device_address != device_address || e->scl_speed_hz == scl_speed_hz)
+        {
+            continue;
+        }
+        // handle with the old speed, the next i2c_bus_get_device() adds the device again
+        i2c_async_forget_device(e->dev_handle);
+        esp_err_t err = e->dev_handle ? i2c_master_bus_rm_device(e->dev_handle) : ESP_OK;
+        if (err != ESP_OK && ret == ESP_OK)
+        {
+            ret = err;
+        }
+        memset(e, 0, sizeof(*e));
+        dropped = true;
+    }
+    if (dropped)
+    {
+        s_generation++;
+    }
+    registry_unlock();
+    return ret;
+}
+
+uint32_t i2c_bus_get_device_speed(i2c_master_bus_handle_t bus_handle, uint16_t device_address)
+{
+    int port = i2c_bus_port_of(bus_handle);
+    if (port < 0 || device_address > 0x7f)
+    {
+        return 0;
+    }
+    return s_device_speed[port][device_address];
+}
+
+esp_err_t i2c_bus_detach_all(i2c_master_bus_handle_t bus_handle)
+{
+    esp_err_t first_err = ESP_OK;
+
+    registry_lock();
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++)
+    {
+        i2c_bus_entry_t *e = &s_entries[i];
+        if (e->bus_handle == NULL || e->bus_handle != bus_handle || e->dev_handle == NULL)
+        {
+            continue;
+        }
+        i2c_async_forget_device(e->dev_handle);
+        esp_err_t ret = i2c_master_bus_rm_device(e->dev_handle);
+        if (ret != ESP_OK && first_err == ESP_OK)
+        {
+            first_err = ret;
+        }
+        e->dev_handle = NULL; // keep address and speed for the reattach
+    }
+    registry_unlock();
+    return first_err;
+}
+
+esp_err_t i2c_bus_reattach_all(i2c_master_bus_handle_t old_bus, i2c_master_bus_handle_t new_bus)
+{
+    esp_err_t first_err = ESP_OK;
+
+    if (!new_bus)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    registry_lock();
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++)
+    {
+        i2c_bus_entry_t *e = &s_entries[i];
+        if (e->bus_handle == NULL || e->bus_handle != old_bus || e->dev_handle != NULL)
+        {
+            continue;
+        }
+        i2c_device_config_t i2c_dev_conf = {
+            .scl_speed_hz = e->scl_speed_hz,
+            .device_address = e->device_address,
+            .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        };
+        esp_err_t ret = i2c_master_bus_add_device(new_bus, &i2c_dev_conf, &e->dev_handle);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to reattach I2C device 0x%02x: %s", e->device_address, esp_err_to_name(ret));
+            memset(e, 0, sizeof(*e)); // next i2c_bus_get_device() tries again
+            if (first_err == ESP_OK)
+            {
+                first_err = ret;
+            }
+            continue;
+        }
+        e->bus_handle = new_bus;
+        e->port = i2c_bus_port_of(new_bus);
+    }
+    s_generation++;
+    registry_unlock();
+    return first_err;
+}
+
+uint32_t i2c_bus_generation(void)
+{
+    return s_generation;
+}
+
+int i2c_bus_device_address(i2c_master_dev_handle_t dev_handle)
+{
+    // no lock: slots only change in get_device/release_all, and a stale answer only
+    // attributes one transaction to the wrong counter
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++)
+    {
+        if (s_entries[i].dev_handle == dev_handle && s_entries[i].bus_handle != NULL)
+        {
+            return s_entries[i].device_address;
+        }
+    }
+    return -1;
+}
+
+int i2c_bus_device_port(i2c_master_dev_handle_t dev_handle)
+{
+    for (int i = 0; i < I2C_BUS_MAX_DEVICES; i++)
+    {
+        if (s_entries[i].dev_handle == dev_handle && s_entries[i].bus_handle != NULL)
+        {
+            return s_entries[i].port;
+        }
+    }
+    return -1;
+}
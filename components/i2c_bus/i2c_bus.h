@@ -0,0 +1,113 @@
+// i2c_bus.h
+// Shared I2C device-handle registry for the console tools and the drivers
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+#define I2C_BUS_MAX_DEVICES (16) // Maximum number of cached device handles (all buses together)
+#define I2C_BUS_MAX_PORTS (2)    // I2C controllers in use (SOC_HP_I2C_NUM on the ESP32-P4)
+
+    /**
+     * @brief Get a shared device handle for (bus, address, SCL speed).
+     *
+     * The first call adds the device to the bus; later calls return the cached handle.
+     * When a speed was set for the device (i2c_bus_set_device_speed, i2ctune) that speed
+     * is used instead of scl_speed_hz.
+     * The handle is owned by the registry: do NOT call i2c_master_bus_rm_device() on it.
+     *
+     * @param bus_handle     I2C bus the device is attached to.
+     * @param device_address 7-bit I2C address.
+     * @param scl_speed_hz   SCL clock for this device.
+     * @param dev_handle     Output: the shared device handle.
+     * @return ESP_OK, ESP_ERR_INVALID_ARG, ESP_ERR_NO_MEM when the cache is full, or the add_device error.
+     */
+    esp_err_t i2c_bus_get_device(i2c_master_bus_handle_t bus_handle, uint16_t device_address,
+                                 uint32_t scl_speed_hz, i2c_master_dev_handle_t *dev_handle);
+
+    /**
+     * @brief Remove all cached device handles of a bus.
+     *
+     * Must be called before i2c_del_master_bus(). Increments the registry generation so
+     * holders of a handle can see that it is no longer valid.
+     *
+     * @param bus_handle I2C bus whose devices are released.
+     * @return ESP_OK, or the first i2c_master_bus_rm_device() error.
+     */
+    esp_err_t i2c_bus_release_all(i2c_master_bus_handle_t bus_handle);
+
+    /**
+     * @brief Set the SCL speed of a device, overriding the speed its driver asks for.
+     *
+     * A cached handle with another speed is removed and the generation incremented, so the
+     * holders fetch a new handle. The setting is kept over a bus recovery and cleared by
+     * i2c_bus_release_all().
+     *
+     * @param scl_speed_hz New speed, 0 = back to the speed of the driver.
+     */
+    esp_err_t i2c_bus_set_device_speed(i2c_master_bus_handle_t bus_handle, uint16_t device_address, uint32_t scl_speed_hz);
+
+    /**
+     * @brief Speed set with i2c_bus_set_device_speed(), 0 when none.
+     */
+    uint32_t i2c_bus_get_device_speed(i2c_master_bus_handle_t bus_handle, uint16_t device_address);
+
+    /**
+     * @brief Remove the device handles of a bus but remember the devices.
+     *
+     * First half of a bus rebuild (stuck-bus recovery): after this the bus can be deleted,
+     * and i2c_bus_reattach_all() adds the same devices to its replacement.
+     */
+    esp_err_t i2c_bus_detach_all(i2c_master_bus_handle_t bus_handle);
+
+    /**
+     * @brief Add all devices detached from old_bus to new_bus.
+     *
+     * Increments the registry generation, the new handles replace the old ones.
+     *
+     * @return ESP_OK, or the first i2c_master_bus_add_device() error.
+     */
+    esp_err_t i2c_bus_reattach_all(i2c_master_bus_handle_t old_bus, i2c_master_bus_handle_t new_bus);
+
+    /**
+     * @brief Current registry generation.
+     *
+     * Changes every time handles are released. A context that stored a handle together with
+     * the generation must re-fetch it when the generation differs.
+     */
+    uint32_t i2c_bus_generation(void);
+
+    /**
+     * @brief Reverse lookup: I2C address of a cached device handle.
+     *
+     * Lock-free, meant for instrumentation on the transaction path.
+     *
+     * @return 7-bit address, or -1 when the handle is not in the registry.
+     */
+    int i2c_bus_device_address(i2c_master_dev_handle_t dev_handle);
+
+    /**
+     * @brief Reverse lookup: I2C port of the bus a cached device handle is attached to.
+     *
+     * @return Port number, or -1 when the handle is not in the registry.
+     */
+    int i2c_bus_device_port(i2c_master_dev_handle_t dev_handle);
+
+    /**
+     * @brief I2C port of an installed bus.
+     *
+     * @return Port number, or -1 when the handle is not an installed bus.
+     */
+    int i2c_bus_port_of(i2c_master_bus_handle_t bus_handle);
+
+#ifdef __cplusplus
+}
+#endif
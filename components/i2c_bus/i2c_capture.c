@@ -0,0 +1,438 @@
+/**
+ * @file i2c_capture.c
+ * @brief I2C traffic capture into a ring buffer.
+ *
+ * Records are packed back to back in one byte ring: a fixed i2c_capture_rec_t followed by
+ * the stored write and read bytes, wrapping at the end of the buffer. In overwrite mode the
+ * oldest records are evicted to make room, in stop-when-full mode the new one is refused.
+ * Records are numbered; a reader cursor holds the number and ring offset of the next
+ * record, and when that record was evicted meanwhile it restarts at the oldest one.
+ *
+ * All ring access happens under a spinlock. Recording is a header plus at most
+ * 2 * I2C_CAPTURE_MAX_DATA bytes of memcpy; when the capture is off it is one atomic load.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_capture.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_bus.h"
+
+static const char *TAG = "i2c_capture";
+
+static uint8_t *s_ring;
+static size_t s_size;
+static bool s_psram;
+static size_t s_head;        // Write offset
+static size_t s_tail;        // Offset of the oldest record
+static size_t s_used;        // Bytes in use
+static uint32_t s_seq_first; // Number of the oldest record
+static uint32_t s_seq_next;  // Number of the next record
+static uint32_t s_dropped;
+static bool s_stop_when_full;
+static int64_t s_start_us;
+static atomic_bool s_active;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void ring_put(size_t pos, const void *src, size_t len)
+{
+    size_t first = s_size - pos;
+    if (len <= first)
+    {
+        memcpy(s_ring + pos, src, len);
+    }
+    else
+    {
+        memcpy(s_ring + pos, src, first);
+        memcpy(s_ring, (const uint8_t *)src + first, len - first);
+    }
+}
+
+static void ring_get(size_t pos, void *dst, size_t len)
+{
+    size_t first = s_size - pos;
+    if (len <= first)
+    {
+        memcpy(dst, s_ring + pos, len);
+    }
+    else
+    {
+        memcpy(dst, s_ring + pos, first);
+        memcpy((uint8_t *)dst + first, s_ring, len - first);
+    }
+}
+
+static size_t rec_size(const i2c_capture_rec_t *rec)
+{
+    return sizeof(*rec) + i2c_capture_write_stored(rec) + i2c_capture_read_stored(rec);
+}
+
+esp_err_t i2c_capture_start(size_t size, bool stop_when_full)
+{
+    if (size == 0)
+    {
+        size = I2C_CAPTURE_DEFAULT_SIZE;
+    }
+    if (size < sizeof(i2c_capture_rec_t) + 2 * I2C_CAPTURE_MAX_DATA)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // recorders test the flag again under the lock, after this no one touches the ring
+    portENTER_CRITICAL(&s_mux);
+    atomic_store(&s_active, false);
+    portEXIT_CRITICAL(&s_mux);
+
+    if (s_ring == NULL || s_size != size)
+    {
+        heap_caps_free(s_ring);
+        s_ring = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        s_psram = (s_ring != NULL);
+        if (s_ring == NULL)
+        {
+            s_ring = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+        }
+        s_size = s_ring ? size : 0;
+        if (s_ring == NULL)
+        {
+            ESP_LOGE(TAG, "No memory for a %u byte capture ring", (unsigned)size);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    portENTER_CRITICAL(&s_mux);
+    s_head = s_tail = s_used = 0;
+    s_seq_first = s_seq_next = 0;
+    s_dropped = 0;
+    s_stop_when_full = stop_when_full;
+    s_start_us = esp_timer_get_time();
+    atomic_store(&s_active, true);
+    portEXIT_CRITICAL(&s_mux);
+
+    ESP_LOGI(TAG, "Capturing into %u bytes of %s RAM%s", (unsigned)size, s_psram ? "PSRAM" : "internal",
+             stop_when_full ? ", stop when full" : "");
+    return ESP_OK;
+}
+
+void i2c_capture_stop(void)
+{
+    portENTER_CRITICAL(&s_mux);
+    atomic_store(&s_active, false);
+    portEXIT_CRITICAL(&s_mux);
+}
+
+bool i2c_capture_active(void)
+{
+    return atomic_load_explicit(&s_active, memory_order_relaxed);
+}
+
+void i2c_capture_get_status(i2c_capture_status_t *status)
+{
+    portENTER_CRITICAL(&s_mux);
+    status->active = atomic_load(&s_active);
+    status->stop_when_full = s_stop_when_full;
+    status->size = s_size;
+    status->used = s_used;
+    status->records = s_seq_next - s_seq_first;
+    status->total = s_seq_next + (s_stop_when_full ? s_dropped : 0);
+    status->dropped = s_dropped;
+    status->psram = s_psram;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void i2c_capture_record(int port, i2c_master_dev_handle_t dev_handle, const uint8_t *write_buf, size_t write_len,
+                        const uint8_t *read_buf, size_t read_len, esp_err_t result, int64_t start_us, uint8_t flags)
+{
+    if (!atomic_load_explicit(&s_active, memory_order_relaxed))
+    {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    int addr = i2c_bus_device_address(dev_handle);
+
+    i2c_capture_rec_t rec = {
+        .dur_us = (uint32_t)(now - start_us),
+        .result = result,
+        .port = (uint8_t)port,
+        .addr = (uint8_t)(addr < 0 ? 0xff : addr),
+        .flags = flags,
+        .write_len = (uint16_t)(write_len > UINT16_MAX ? UINT16_MAX : write_len),
+        .read_len = (uint16_t)(read_len > UINT16_MAX ? UINT16_MAX : read_len),
+    };
+    size_t ws = i2c_capture_write_stored(&rec);
+    size_t rs = i2c_capture_read_stored(&rec);
+    if (ws < write_len || (rs && rs < read_len))
+    {
+        rec.flags |= I2C_CAPTURE_F_TRUNCATED;
+    }
+    size_t need = sizeof(rec) + ws + rs;
+
+    portENTER_CRITICAL(&s_mux);
+    if (!atomic_load(&s_active))
+    {
+        portEXIT_CRITICAL(&s_mux);
+        return;
+    }
+    rec.t_us = (uint32_t)(start_us - s_start_us);
+    if (s_size - s_used < need && s_stop_when_full)
+    {
+        s_dropped++;
+        portEXIT_CRITICAL(&s_mux);
+        return;
+    }
+    while (s_size - s_used < need)
+    {
+        // evict the oldest record
+        i2c_capture_rec_t old;
+        ring_get(s_tail, &old, sizeof(old));
+        size_t len = rec_size(&old);
+        s_tail = (s_tail + len) % s_size;
+        s_used -= len;
+        s_seq_first++;
+        s_dropped++;
+    }
+    rec.seq = s_seq_next++;
+    ring_put(s_head, &rec, sizeof(rec));
+    if (ws)
+    {
+        ring_put((s_head + sizeof(rec)) % s_size, write_buf, ws);
+    }
+    if (rs)
+    {
+        ring_put((s_head + sizeof(rec) + ws) % s_size, read_buf, rs);
+    }
+    s_head = (s_head + need) % s_size;
+    s_used += need;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+bool i2c_capture_next(i2c_capture_cursor_t *cursor, i2c_capture_rec_t *rec, uint8_t *data, size_t data_size)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_mux);
+    if (s_ring)
+    {
+        if (!cursor->valid || cursor->seq < s_seq_first)
+        {
+            cursor->seq = s_seq_first;
+            cursor->pos = s_tail;
+            cursor->valid = true;
+        }
+        if (cursor->seq < s_seq_next)
+        {
+            ring_get(cursor->pos, rec, sizeof(*rec));
+            size_t n = i2c_capture_write_stored(rec) + i2c_capture_read_stored(rec);
+            ring_get((cursor->pos + sizeof(*rec)) % s_size, data, n < data_size ? n : data_size);
+            cursor->pos = (cursor->pos + sizeof(*rec) + n) % s_size;
+            cursor->seq++;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return found;
+}
+
+// Append "TAG:LEN[:HEX] " to the line
+static size_t put_payload(char *line, size_t pos, size_t line_size, char tag, unsigned len, const uint8_t *data,
+                          size_t stored)
+{
+    static const char hex[] = "0123456789abcdef";
+    if (pos < line_size)
+    {
+        pos += snprintf(line + pos, line_size - pos, "%c:%u%s", tag, len, stored ? ":" : "");
+    }
+    for (size_t i = 0; i < stored && pos + 2 < line_size; i++)
+    {
+        line[pos++] = hex[data[i] >> 4];
+        line[pos++] = hex[data[i] & 0x0f];
+    }
+    if (pos + 1 < line_size)
+    {
+        line[pos++] = ' ';
+        line[pos] = '\0';
+    }
+    return pos;
+}
+
+void i2c_capture_format(const i2c_capture_rec_t *rec, const uint8_t *data, char *line, size_t line_size)
+{
+    size_t ws = i2c_capture_write_stored(rec);
+    size_t rs = i2c_capture_read_stored(rec);
+
+    const char *flags = "-";
+    switch (rec->flags & (I2C_CAPTURE_F_QUEUED | I2C_CAPTURE_F_TRUNCATED))
+    {
+    case I2C_CAPTURE_F_QUEUED:
+        flags = "q";
+        break;
+    case I2C_CAPTURE_F_TRUNCATED:
+        flags = "t";
+        break;
+    case I2C_CAPTURE_F_QUEUED | I2C_CAPTURE_F_TRUNCATED:
+        flags = "qt";
+        break;
+    }
+
+    size_t pos = snprintf(line, line_size, "%lu %lu %u 0x%02x %s ", (unsigned long)rec->t_us,
+                          (unsigned long)rec->dur_us, rec->port, rec->addr, flags);
+    pos = put_payload(line, pos, line_size, 'w', rec->write_len, data, ws);
+    pos = put_payload(line, pos, line_size, 'r', rec->read_len, data + ws, rs);
+    if (pos < line_size)
+    {
+        snprintf(line + pos, line_size - pos, "0x%x%s%s", (unsigned)rec->result, rec->result == ESP_OK ? "" : " # ",
+                 rec->result == ESP_OK ? "" : esp_err_to_name(rec->result));
+    }
+}
+
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// "w:LEN[:HEX]" / "r:LEN[:HEX]"; returns the position after it, NULL when malformed
+static const char *parse_payload(const char *p, char tag, uint16_t *len, uint8_t *data, size_t *stored)
+{
+    while (*p == ' ' || *p == '\t')
+    {
+        p++;
+    }
+    if (p[0] != tag || p[1] != ':')
+    {
+        return NULL;
+    }
+    char *end;
+    unsigned long n = strtoul(p + 2, &end, 10);
+    if (end == p + 2 || n > UINT16_MAX)
+    {
+        return NULL;
+    }
+    *len = (uint16_t)n;
+    *stored = 0;
+    p = end;
+    if (*p == ':')
+    {
+        p++;
+        int hi, lo;
+        while ((hi = hex_nibble(p[0])) >= 0 && (lo = hex_nibble(p[1])) >= 0)
+        {
+            if (*stored >= I2C_CAPTURE_MAX_DATA)
+            {
+                return NULL;
+            }
+            data[(*stored)++] = (uint8_t)(hi << 4 | lo);
+            p += 2;
+        }
+    }
+    return p;
+}
+
+esp_err_t i2c_capture_parse_line(const char *line, i2c_capture_rec_t *rec, uint8_t *data)
+{
+    while (*line == ' ' || *line == '\t')
+    {
+        line++;
+    }
+    if (*line == '#' || *line == '\0' || *line == '\r' || *line == '\n')
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    unsigned long t_us, dur_us;
+    unsigned port, addr;
+    char flags[4];
+    int used = 0;
+    if (sscanf(line, "%lu %lu %u %x %3s%n", &t_us, &dur_us, &port, &addr, flags, &used) != 5 || addr > 0xff)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(rec, 0, sizeof(*rec));
+    rec->t_us = (uint32_t)t_us;
+    rec->dur_us = (uint32_t)dur_us;
+    rec->port = (uint8_t)port;
+    rec->addr = (uint8_t)addr;
+    for (const char *f = flags; *f; f++)
+    {
+        if (*f == 'q')
+        {
+            rec->flags |= I2C_CAPTURE_F_QUEUED;
+        }
+        else if (*f == 't')
+        {
+            rec->flags |= I2C_CAPTURE_F_TRUNCATED;
+        }
+        else if (*f != '-')
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    size_t ws, rs = 0;
+    const char *p = parse_payload(line + used, 'w', &rec->write_len, data, &ws);
+    if (p)
+    {
+        p = parse_payload(p, 'r', &rec->read_len, data + ws, &rs);
+    }
+    if (p == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char *end;
+    rec->result = (esp_err_t)strtol(p, &end, 0);
+    // the stored bytes must be exactly what a record like this keeps
+    if (end == p || ws != i2c_capture_write_stored(rec) || rs != i2c_capture_read_stored(rec))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+uint32_t i2c_capture_dump(FILE *out, uint32_t last)
+{
+    // console use only: static so a dump does not need 1.6 KB of task stack
+    static char line[I2C_CAPTURE_MAX_LINE];
+    static uint8_t data[2 * I2C_CAPTURE_MAX_DATA];
+    i2c_capture_status_t st;
+    i2c_capture_cursor_t cursor = {0};
+    i2c_capture_rec_t rec;
+    uint32_t written = 0;
+
+    i2c_capture_get_status(&st);
+    fprintf(out, "# i2c capture: %lu transactions, %lu dropped, ring %u bytes %s%s\n", (unsigned long)st.records,
+            (unsigned long)st.dropped, (unsigned)st.size, st.psram ? "psram" : "internal",
+            st.active ? ", running" : "");
+    fprintf(out, "# t_us dur_us port addr flags write read result\n");
+
+    uint32_t skip = (last && st.records > last) ? st.records - last : 0;
+    while (i2c_capture_next(&cursor, &rec, data, sizeof(data)))
+    {
+        if (skip)
+        {
+            skip--;
+            continue;
+        }
+        i2c_capture_format(&rec, data, line, sizeof(line));
+        fprintf(out, "%s\n", line);
+        written++;
+    }
+    return written;
+}
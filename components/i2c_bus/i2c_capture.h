@@ -0,0 +1,149 @@
+// i2c_capture.h
+// I2C traffic capture: every scheduler transaction into a (PSRAM) ring, dump as text
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "driver/i2c_master.h"
+
+#define I2C_CAPTURE_MAX_DATA (256)          // Payload bytes kept per direction, longer is truncated
+#define I2C_CAPTURE_DEFAULT_SIZE (64 * 1024) // Ring size when none is given
+#define I2C_CAPTURE_MAX_LINE (2 * 2 * I2C_CAPTURE_MAX_DATA + 96) // Longest text line of a dump
+
+#define I2C_CAPTURE_F_QUEUED (0x01)    // Asynchronous transfer, recorded when queued: no read data, result of the queueing
+#define I2C_CAPTURE_F_TRUNCATED (0x02) // Payload longer than I2C_CAPTURE_MAX_DATA, not replayable
+
+    // One transaction; in the ring it is followed by the write bytes and then the read bytes
+    typedef struct
+    {
+        uint32_t seq;       // Transaction number since the capture started
+        uint32_t t_us;      // Start, since the capture started (wraps after 71 minutes)
+        uint32_t dur_us;    // Time the transfer took
+        esp_err_t result;   // Result of the i2c_master call
+        uint8_t port;       // I2C port
+        uint8_t addr;       // 7-bit address
+        uint8_t flags;      // I2C_CAPTURE_F_*
+        uint8_t reserved;
+        uint16_t write_len; // Bytes written
+        uint16_t read_len;  // Bytes read
+    } i2c_capture_rec_t;
+
+    // Payload bytes kept of a record: queued and failed transfers have no read data
+    static inline size_t i2c_capture_write_stored(const i2c_capture_rec_t *rec)
+    {
+        return rec->write_len < I2C_CAPTURE_MAX_DATA ? rec->write_len : I2C_CAPTURE_MAX_DATA;
+    }
+
+    static inline size_t i2c_capture_read_stored(const i2c_capture_rec_t *rec)
+    {
+        if ((rec->flags & I2C_CAPTURE_F_QUEUED) || rec->result != ESP_OK)
+        {
+            return 0;
+        }
+        return rec->read_len < I2C_CAPTURE_MAX_DATA ? rec->read_len : I2C_CAPTURE_MAX_DATA;
+    }
+
+    // Read position in the ring; zero-initialise to start at the oldest record
+    typedef struct
+    {
+        uint32_t seq;
+        size_t pos;
+        bool valid;
+    } i2c_capture_cursor_t;
+
+    typedef struct
+    {
+        bool active;
+        bool stop_when_full;
+        size_t size;      // Ring size in bytes
+        size_t used;      // Bytes in use
+        uint32_t records; // Records in the ring
+        uint32_t total;   // Transactions recorded since the start
+        uint32_t dropped; // Overwritten (ring) or refused (stop when full)
+        bool psram;       // Ring is in PSRAM
+    } i2c_capture_status_t;
+
+    /**
+     * @brief Start capturing, the ring is cleared.
+     *
+     * The ring is allocated in PSRAM when there is PSRAM, else in internal RAM, and kept
+     * after a stop so the capture can be dumped and replayed. A different size reallocates.
+     *
+     * @param size           Ring size in bytes, 0 = I2C_CAPTURE_DEFAULT_SIZE.
+     * @param stop_when_full Keep the first transactions and refuse new ones when full,
+     *                       instead of overwriting the oldest (flight recorder).
+     * @return ESP_OK, ESP_ERR_NO_MEM.
+     */
+    esp_err_t i2c_capture_start(size_t size, bool stop_when_full);
+
+    /**
+     * @brief Stop capturing, the ring keeps its contents.
+     */
+    void i2c_capture_stop(void);
+
+    bool i2c_capture_active(void);
+
+    void i2c_capture_get_status(i2c_capture_status_t *status);
+
+    /**
+     * @brief Record one transaction. Returns at once when the capture is not active.
+     *
+     * Called by the scheduler for every transfer and by i2c_async_submit() for queued ones.
+     *
+     * @param start_us esp_timer time the transfer started.
+     */
+    void i2c_capture_record(int port, i2c_master_dev_handle_t dev_handle, const uint8_t *write_buf, size_t write_len,
+                            const uint8_t *read_buf, size_t read_len, esp_err_t result, int64_t start_us, uint8_t flags);
+
+    /**
+     * @brief Copy the record at the cursor and advance it.
+     *
+     * A cursor that fell behind the overwritten part of the ring continues at the oldest record.
+     *
+     * @param data      Receives the stored write bytes followed by the stored read bytes.
+     * @param data_size Size of data, 2 * I2C_CAPTURE_MAX_DATA holds every record.
+     * @return true when a record was copied, false at the end of the capture.
+     */
+    bool i2c_capture_next(i2c_capture_cursor_t *cursor, i2c_capture_rec_t *rec, uint8_t *data, size_t data_size);
+
+    /**
+     * @brief Format one record as a dump line (without newline).
+     *
+     * Columns: t_us dur_us port addr flags w:LEN[:HEX] r:LEN[:HEX] result, e.g.
+     * "1520 312 0 0x59 - w:3:02e803 r:0 0x0". flags is '-' or a combination of
+     * 'q' (queued) and 't' (truncated), HEX holds the stored bytes. A failed
+     * transfer gets its error name as a comment. i2c_capture_parse_line() reads it back.
+     *
+     * @param line Buffer of I2C_CAPTURE_MAX_LINE bytes.
+     */
+    void i2c_capture_format(const i2c_capture_rec_t *rec, const uint8_t *data, char *line, size_t line_size);
+
+    /**
+     * @brief Parse a dump line. Comment ('#') and empty lines return ESP_ERR_NOT_FOUND.
+     *
+     * @param data Receives write bytes then read bytes, 2 * I2C_CAPTURE_MAX_DATA bytes.
+     * @return ESP_OK, ESP_ERR_NOT_FOUND, ESP_ERR_INVALID_ARG on a malformed line.
+     */
+    esp_err_t i2c_capture_parse_line(const char *line, i2c_capture_rec_t *rec, uint8_t *data);
+
+    /**
+     * @brief Write the ring as text: a comment header and one line per transaction.
+     *
+     * @param last Only the last N records, 0 = all.
+     * @return Records written.
+     */
+    uint32_t i2c_capture_dump(FILE *out, uint32_t last);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,311 @@
+/**
+ * @file i2c_dump.c
+ * @brief Register dump engine with auto-increment burst reads.
+ *
+ * Most register-mapped chips auto-increment the register pointer, so a whole 256-byte
+ * map can be read in a few chunked transactions instead of one transaction per register.
+ * The first dump of a device checks this with a few extra single-register reads; a device
+ * that does not auto-increment is remembered and dumped register by register. One
+ * differing register (a counter, a status flag) does not decide: the majority does, and
+ * an undecided check is repeated on the next dump.
+ *
+ * Output is formatted into a line buffer and written in blocks, not per byte.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_dump.h"
+#include <string.h>
+#include "esp_log.h"
+#include "i2c_sched.h"
+
+static const char *TAG = "i2c_dump";
+
+static uint32_t s_autoinc_checked[4]; // one bit per 7-bit address
+static uint32_t s_no_autoinc[4];
+
+static inline bool map_get(const uint32_t *map, uint8_t addr)
+{
+    return (map[(addr >> 5) & 3] >> (addr & 31)) & 1;
+}
+
+static inline void map_set(uint32_t *map, uint8_t addr, bool value)
+{
+    if (value)
+        map[(addr >> 5) & 3] |= 1u << (addr & 31);
+    else
+        map[(addr >> 5) & 3] &= ~(1u << (addr & 31));
+}
+
+void i2c_dump_forget(uint8_t device_address)
+{
+    if (device_address == 0xff)
+    {
+        memset(s_autoinc_checked, 0, sizeof(s_autoinc_checked));
+        memset(s_no_autoinc, 0, sizeof(s_no_autoinc));
+        return;
+    }
+    map_set(s_autoinc_checked, device_address, false);
+    map_set(s_no_autoinc, device_address, false);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Buffered hex formatter
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    FILE *out;
+    int addr_digits;  // 2 or 4
+    uint32_t row;     // address of the row being collected
+    int16_t cells[16]; // -1 = read failed, -2 = outside the dumped range
+    size_t used;
+    char buf[1024];
+} hex_writer_t;
+
+static void hw_flush(hex_writer_t *hw)
+{
+    if (hw->used)
+    {
+        fwrite(hw->buf, 1, hw->used, hw->out);
+        hw->used = 0;
+    }
+}
+
+static void hw_emit_row(hex_writer_t *hw)
+{
+    // "xxxx: " + 16 * "xx " + "   " + 16 ascii + "\r\n"
+    if (hw->used + 96 > sizeof(hw->buf))
+    {
+        hw_flush(hw);
+    }
+    static const char hex[] = "0123456789abcdef";
+    char *p = hw->buf + hw->used;
+
+    for (int shift = (hw->addr_digits - 1) * 4; shift >= 0; shift -= 4)
+    {
+        *p++ = hex[(hw->row >> shift) & 0xf];
+    }
+    *p++ = ':';
+    *p++ = ' ';
+    for (int i = 0; i < 16; i++)
+    {
+        int16_t v = hw->cells[i];
+        if (v >= 0)
+        {
+            *p++ = hex[v >> 4];
+            *p++ = hex[v & 0xf];
+        }
+        else
+        {
+            *p++ = (v == -1) ? 'X' : ' ';
+            *p++ = (v == -1) ? 'X' : ' ';
+        }
+        *p++ = ' ';
+    }
+    *p++ = ' ';
+    *p++ = ' ';
+    *p++ = ' ';
+    for (int i = 0; i < 16; i++)
+    {
+        int16_t v = hw->cells[i];
+        if (v == -1)
+            *p++ = 'X';
+        else if (v == -2)
+            *p++ = ' ';
+        else if (v == 0x00 || v == 0xff)
+            *p++ = '.';
+        else if (v < 32 || v >= 127)
+            *p++ = '?';
+        else
+            *p++ = (char)v;
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+    hw->used = p - hw->buf;
+
+    for (int i = 0; i < 16; i++)
+    {
+        hw->cells[i] = -2;
+    }
+    hw->row += 16;
+}
+
+static void hw_put(hex_writer_t *hw, uint32_t reg, int16_t value)
+{
+    hw->cells[reg & 0xf] = value;
+    if ((reg & 0xf) == 0xf)
+    {
+        hw_emit_row(hw);
+    }
+}
+
+static void hw_header(hex_writer_t *hw)
+{
+    const char *pad = (hw->addr_digits == 4) ? "  " : "";
+    hw->used += snprintf(hw->buf + hw->used, sizeof(hw->buf) - hw->used,
+                         "%s     0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f    0123456789abcdef\r\n", pad);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Bus access
+////////////////////////////////////////////////////////////////////////////////
+
+static esp_err_t read_regs(i2c_master_dev_handle_t dev_handle, const i2c_dump_config_t *cfg,
+                           uint32_t reg, uint8_t *buf, size_t len, i2c_dump_stats_t *st)
+{
+    uint8_t addr[2];
+    size_t addr_len;
+    if (cfg->reg_addr_len == 2)
+    {
+        addr[0] = (uint8_t)(reg >> 8); // MSB first, as used by 24Cxx EEPROMs
+        addr[1] = (uint8_t)reg;
+        addr_len = 2;
+    }
+    else
+    {
+        addr[0] = (uint8_t)reg;
+        addr_len = 1;
+    }
+    st->transactions++;
+    return i2c_sched_transmit_receive(dev_handle, I2C_SCHED_PRIO_NORMAL, addr, addr_len, buf, len, cfg->timeout_ms);
+}
+
+// Does a single read of reg+1.. match the burst? Returns 1 (auto-increments), -1 (does not,
+// most registers differ) or 0 (undecided: some differ or a read failed, check again later)
+static int check_autoinc(i2c_master_dev_handle_t dev_handle, const i2c_dump_config_t *cfg, uint32_t reg,
+                         const uint8_t *burst, size_t n, i2c_dump_stats_t *st)
+{
+    size_t probes = (n - 1 < I2C_DUMP_AUTOINC_PROBES) ? n - 1 : I2C_DUMP_AUTOINC_PROBES;
+    size_t differ = 0;
+    for (size_t k = 1; k <= probes; k++)
+    {
+        uint8_t check;
+        if (read_regs(dev_handle, cfg, reg + k, &check, 1, st) != ESP_OK)
+        {
+            return 0;
+        }
+        differ += (check != burst[k]);
+    }
+    if (differ * 2 > probes)
+    {
+        return -1;
+    }
+    return differ ? 0 : 1;
+}
+
+// Per-register reads of access_size bytes, for chips without auto-increment
+static void dump_fallback(i2c_master_dev_handle_t dev_handle, const i2c_dump_config_t *cfg,
+                          uint32_t reg, uint32_t end, hex_writer_t *hw, i2c_dump_stats_t *st)
+{
+    uint8_t data[4];
+    while (reg < end)
+    {
+        size_t n = cfg->access_size;
+        if (n > end - reg)
+        {
+            n = end - reg;
+        }
+        esp_err_t ret = read_regs(dev_handle, cfg, reg, data, n, st);
+        for (size_t k = 0; k < n; k++)
+        {
+            if (ret != ESP_OK)
+            {
+                st->failed++;
+            }
+            hw_put(hw, reg + k, (ret == ESP_OK) ? data[k] : -1);
+        }
+        reg += n;
+    }
+}
+
+esp_err_t i2c_dump(i2c_master_dev_handle_t dev_handle, const i2c_dump_config_t *config, FILE *out, i2c_dump_stats_t *stats)
+{
+    i2c_dump_stats_t local_stats;
+    i2c_dump_stats_t *st = stats ? stats : &local_stats;
+    memset(st, 0, sizeof(*st));
+
+    if (!dev_handle || !config || !out)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t space = (config->reg_addr_len == 2) ? I2C_DUMP_MAX_LENGTH : 256;
+    if ((config->reg_addr_len != 1 && config->reg_addr_len != 2) ||
+        config->length == 0 || config->start >= space || config->length > space - config->start ||
+        config->burst > I2C_DUMP_MAX_BURST ||
+        (config->access_size != 1 && config->access_size != 2 && config->access_size != 4))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    static hex_writer_t hw; // 1 KB line buffer, console use only
+    hw.out = out;
+    hw.addr_digits = (config->reg_addr_len == 2) ? 4 : 2;
+    hw.row = config->start & ~0xfu;
+    hw.used = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        hw.cells[i] = -2;
+    }
+    hw_header(&hw);
+
+    uint8_t addr7 = config->device_address & 0x7f;
+    bool fallback = config->no_autoinc || config->burst <= 1 || map_get(s_no_autoinc, addr7);
+    uint32_t reg = config->start;
+    uint32_t end = config->start + config->length;
+    uint8_t data[I2C_DUMP_MAX_BURST];
+
+    // a burst is read a chunk per transaction, an urgent write waits for one chunk at most
+    size_t step = config->chunk_size ? config->chunk_size : I2C_DUMP_DEFAULT_CHUNK;
+    if (step > config->burst)
+    {
+        step = config->burst;
+    }
+
+    while (reg < end && !fallback)
+    {
+        size_t n = step;
+        if (n > end - reg)
+        {
+            n = end - reg;
+        }
+        esp_err_t ret = read_regs(dev_handle, config, reg, data, n, st);
+
+        if (ret == ESP_OK && n > 1 && !map_get(s_autoinc_checked, addr7))
+        {
+            int verdict = check_autoinc(dev_handle, config, reg, data, n, st);
+            if (verdict < 0)
+            {
+                ESP_LOGW(TAG, "Device 0x%02x does not auto-increment, using per-register reads", addr7);
+                map_set(s_no_autoinc, addr7, true);
+                fallback = true;
+                break; // redo this burst register by register
+            }
+            map_set(s_autoinc_checked, addr7, verdict > 0);
+        }
+
+        for (size_t k = 0; k < n; k++)
+        {
+            if (ret != ESP_OK)
+            {
+                st->failed++;
+            }
+            hw_put(&hw, reg + k, (ret == ESP_OK) ? data[k] : -1);
+        }
+        reg += n;
+    }
+
+    if (fallback && reg < end)
+    {
+        st->fallback = true;
+        dump_fallback(dev_handle, config, reg, end, &hw, st);
+    }
+
+    if (end & 0xf)
+    {
+        hw_emit_row(&hw); // partial last row
+    }
+    hw_flush(&hw);
+    return ESP_OK;
+}
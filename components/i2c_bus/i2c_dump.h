@@ -0,0 +1,70 @@
+// i2c_dump.h
+// Block-read register dump engine for i2cdump (8 and 16-bit register addresses)
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+#define I2C_DUMP_MAX_BURST (256)   // Largest auto-increment read in one transaction
+#define I2C_DUMP_MAX_LENGTH (65536) // Full 16-bit register space (EEPROMs)
+#define I2C_DUMP_DEFAULT_CHUNK (32)  // Bytes per transaction of a burst, about 3 ms at 100 kHz
+#define I2C_DUMP_AUTOINC_PROBES (4)  // Single-register reads of the auto-increment check
+
+    // What to dump and how to read it
+    typedef struct
+    {
+        uint8_t device_address; // 7-bit address, used for the per-device auto-increment flag
+        uint8_t reg_addr_len;   // 1 or 2 bytes (16-bit is sent MSB first)
+        uint32_t start;         // First register
+        uint32_t length;        // Number of bytes, start + length <= 256 (8-bit) or 65536 (16-bit)
+        size_t burst;           // Bytes per auto-increment read, max I2C_DUMP_MAX_BURST
+        size_t chunk_size;      // Bytes per bus transaction of a burst, 0 = I2C_DUMP_DEFAULT_CHUNK
+        size_t access_size;     // Bytes per register read in fallback mode: 1, 2 or 4
+        bool no_autoinc;        // Force the per-register fallback for this dump
+        int timeout_ms;         // Timeout per transaction
+    } i2c_dump_config_t;
+
+    // Counters of the last dump
+    typedef struct
+    {
+        uint32_t transactions; // Bus transactions used
+        uint32_t failed;       // Bytes that could not be read
+        bool fallback;         // Per-register mode was used
+    } i2c_dump_stats_t;
+
+    /**
+     * @brief Dump a register range as a hex table with ASCII column.
+     *
+     * Reads in auto-increment bursts, each split in transactions of chunk_size bytes so
+     * urgent writes get the bus in between. When the device turns out not to auto-increment
+     * (checked once per address, see i2c_dump_forget), it is remembered and later dumps use
+     * per-register reads.
+     *
+     * @param dev_handle Device from the registry.
+     * @param config     What to dump.
+     * @param out        Output stream (stdout for the console).
+     * @param stats      Optional counters, may be NULL.
+     * @return ESP_OK, ESP_ERR_INVALID_ARG for a bad range.
+     */
+    esp_err_t i2c_dump(i2c_master_dev_handle_t dev_handle, const i2c_dump_config_t *config, FILE *out, i2c_dump_stats_t *stats);
+
+    /**
+     * @brief Forget the auto-increment knowledge of a device (or all with 0xff).
+     *
+     * The next dump checks the device again.
+     */
+    void i2c_dump_forget(uint8_t device_address);
+
+#ifdef __cplusplus
+}
+#endif
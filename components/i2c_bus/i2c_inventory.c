@@ -0,0 +1,294 @@
+/**
+ * @file i2c_inventory.c
+ * @brief Boot inventory of the expected I2C devices.
+ *
+ * Each device in the table gets one identity transaction with a short timeout: an ACK
+ * pattern for write-only devices, a register read with an expected value for the others.
+ * The buses are checked in parallel (the caller takes the first bus, a task per other bus),
+ * so the whole inventory takes about one transaction per device on the busiest bus. An
+ * absent device costs a NACK, not a timeout. The table stays published for the firmware.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_inventory.h"
+#include <string.h>
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_sched.h"
+
+static const char *TAG = "i2c_inventory";
+
+static i2c_inventory_device_t *s_table;
+static int s_n_devices;
+static i2c_inventory_summary_t s_summary;
+
+static const char *state_name(i2c_inventory_state_t state)
+{
+    switch (state)
+    {
+    case I2C_INVENTORY_OK:
+        return "ok";
+    case I2C_INVENTORY_ABSENT:
+        return "absent";
+    case I2C_INVENTORY_WRONG_ID:
+        return "wrong id";
+    case I2C_INVENTORY_BUS_ERROR:
+        return "bus error";
+    default:
+        return "-";
+    }
+}
+
+static void check_device(i2c_master_bus_handle_t bus_handle, i2c_inventory_device_t *d, uint32_t scl_speed_hz)
+{
+    uint8_t id[I2C_INVENTORY_MAX_ID] = {0};
+    i2c_master_dev_handle_t dev_handle;
+    int64_t start = esp_timer_get_time();
+
+    esp_err_t ret = i2c_bus_get_device(bus_handle, d->device_address, scl_speed_hz, &dev_handle);
+    if (ret != ESP_OK)
+    {
+        d->state = I2C_INVENTORY_BUS_ERROR;
+    }
+    else
+    {
+        if (d->id_read_len)
+        {
+            ret = i2c_sched_transmit_receive(dev_handle, I2C_SCHED_PRIO_NORMAL, d->id_write, d->id_write_len,
+                                             id, d->id_read_len, I2C_INVENTORY_TIMEOUT_MS);
+        }
+        else
+        {
+            ret = i2c_sched_transmit(dev_handle, I2C_SCHED_PRIO_NORMAL, d->id_write, d->id_write_len,
+                                     I2C_INVENTORY_TIMEOUT_MS);
+        }
+
+        if (ret == ESP_ERR_TIMEOUT)
+        {
+            d->state = I2C_INVENTORY_BUS_ERROR;
+        }
+        else if (ret != ESP_OK)
+        {
+            d->state = I2C_INVENTORY_ABSENT;
+        }
+        else
+        {
+            d->state = I2C_INVENTORY_OK;
+            for (int i = 0; i < d->id_read_len; i++)
+            {
+                if ((id[i] & d->id_mask[i]) != d->id_value[i])
+                {
+                    d->state = I2C_INVENTORY_WRONG_ID;
+                }
+            }
+        }
+    }
+    d->err = ret;
+    d->us = (uint32_t)(esp_timer_get_time() - start);
+}
+
+typedef struct
+{
+    i2c_inventory_device_t *devices;
+    int n_devices;
+    int port;
+    uint32_t scl_speed_hz;
+    uint32_t us;
+    SemaphoreHandle_t done;
+} inventory_job_t;
+
+static void check_port(inventory_job_t *job)
+{
+    int64_t start = esp_timer_get_time();
+    i2c_master_bus_handle_t bus_handle = NULL;
+    bool bus_ok = i2c_master_get_bus_handle(job->port, &bus_handle) == ESP_OK && bus_handle != NULL;
+
+    for (int i = 0; i < job->n_devices; i++)
+    {
+        i2c_inventory_device_t *d = &job->devices[i];
+        if (d->port != job->port)
+        {
+            continue;
+        }
+        if (!bus_ok)
+        {
+            // no bus, or it stopped answering: do not spend a timeout per device
+            d->state = I2C_INVENTORY_BUS_ERROR;
+            d->err = ESP_ERR_INVALID_STATE;
+            d->us = 0;
+            continue;
+        }
+        check_device(bus_handle, d, job->scl_speed_hz);
+        bus_ok = (d->state != I2C_INVENTORY_BUS_ERROR);
+    }
+    job->us = (uint32_t)(esp_timer_get_time() - start);
+}
+
+static void inventory_task(void *arg)
+{
+    inventory_job_t *job = (inventory_job_t *)arg;
+    check_port(job);
+    xSemaphoreGive(job->done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t i2c_inventory_run(i2c_inventory_device_t *devices, int n_devices, uint32_t scl_speed_hz)
+{
+    inventory_job_t jobs[I2C_BUS_MAX_PORTS] = {0};
+    StaticSemaphore_t done_buf[I2C_BUS_MAX_PORTS];
+    bool used[I2C_BUS_MAX_PORTS] = {false};
+    int local_port = -1;
+    esp_err_t err = ESP_OK;
+
+    if (!devices || n_devices < 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < n_devices; i++)
+    {
+        devices[i].state = I2C_INVENTORY_NOT_CHECKED;
+        if (devices[i].port < I2C_BUS_MAX_PORTS)
+        {
+            used[devices[i].port] = true;
+        }
+        else
+        {
+            devices[i].state = I2C_INVENTORY_BUS_ERROR;
+            devices[i].err = ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    for (int port = 0; port < I2C_BUS_MAX_PORTS; port++)
+    {
+        if (!used[port])
+        {
+            continue;
+        }
+        jobs[port] = (inventory_job_t){.devices = devices, .n_devices = n_devices, .port = port, .scl_speed_hz = scl_speed_hz};
+        if (local_port < 0)
+        {
+            local_port = port; // the first bus is checked by the caller itself
+            continue;
+        }
+        jobs[port].done = xSemaphoreCreateBinaryStatic(&done_buf[port]);
+        if (xTaskCreate(inventory_task, "i2c_inv", 3072, &jobs[port], uxTaskPriorityGet(NULL), NULL) != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to start inventory task for port %d", port);
+            vSemaphoreDelete(jobs[port].done);
+            jobs[port].done = NULL;
+            check_port(&jobs[port]); // serially then
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (local_port >= 0)
+    {
+        check_port(&jobs[local_port]);
+    }
+    for (int port = 0; port < I2C_BUS_MAX_PORTS; port++)
+    {
+        if (jobs[port].done)
+        {
+            xSemaphoreTake(jobs[port].done, portMAX_DELAY);
+            vSemaphoreDelete(jobs[port].done);
+        }
+    }
+
+    memset(&s_summary, 0, sizeof(s_summary));
+    for (int port = 0; port < I2C_BUS_MAX_PORTS; port++)
+    {
+        s_summary.port_us[port] = jobs[port].us;
+    }
+    for (int i = 0; i < n_devices; i++)
+    {
+        if (devices[i].state == I2C_INVENTORY_OK)
+        {
+            s_summary.ok++;
+        }
+        else if (devices[i].optional)
+        {
+            s_summary.optional++;
+        }
+        else
+        {
+            s_summary.missing++;
+            ESP_LOGW(TAG, "%s (bus %d, 0x%02x): %s", devices[i].name, devices[i].port, devices[i].device_address,
+                     state_name(devices[i].state));
+        }
+    }
+    s_summary.total_us = (uint32_t)(esp_timer_get_time() - start);
+    s_table = devices;
+    s_n_devices = n_devices;
+    ESP_LOGI(TAG, "%d devices: %d ok, %d missing, %d optional absent, %" PRIu32 " us",
+             n_devices, s_summary.ok, s_summary.missing, s_summary.optional, s_summary.total_us);
+
+    if (err == ESP_OK && s_summary.missing)
+    {
+        err = ESP_ERR_NOT_FOUND;
+    }
+    return err;
+}
+
+const i2c_inventory_device_t *i2c_inventory_table(int *n_devices, i2c_inventory_summary_t *summary)
+{
+    if (n_devices)
+    {
+        *n_devices = s_n_devices;
+    }
+    if (summary)
+    {
+        *summary = s_summary;
+    }
+    return s_table;
+}
+
+const i2c_inventory_device_t *i2c_inventory_find(const char *name)
+{
+    for (int i = 0; s_table && name && i < s_n_devices; i++)
+    {
+        if (strcmp(s_table[i].name, name) == 0)
+        {
+            return &s_table[i];
+        }
+    }
+    return NULL;
+}
+
+bool i2c_inventory_present(const char *name)
+{
+    const i2c_inventory_device_t *d = i2c_inventory_find(name);
+    return d && d->state == I2C_INVENTORY_OK;
+}
+
+void i2c_inventory_print(FILE *out)
+{
+    if (!out)
+    {
+        return;
+    }
+    if (!s_table)
+    {
+        fprintf(out, "no inventory yet\r\n");
+        return;
+    }
+    fprintf(out, "device     bus  addr  state        us\r\n");
+    for (int i = 0; i < s_n_devices; i++)
+    {
+        const i2c_inventory_device_t *d = &s_table[i];
+        fprintf(out, "%-9s  %3d  0x%02x  %-9s %5" PRIu32 "%s\r\n", d->name, d->port, d->device_address,
+                state_name(d->state), d->us, (d->state != I2C_INVENTORY_OK && d->optional) ? "  (optional)" : "");
+    }
+    for (int port = 0; port < I2C_BUS_MAX_PORTS; port++)
+    {
+        fprintf(out, "bus %d: %" PRIu32 " us\r\n", port, s_summary.port_us[port]);
+    }
+    fprintf(out, "%d ok, %d missing, %d optional absent, total %" PRIu32 " us\r\n",
+            s_summary.ok, s_summary.missing, s_summary.optional, s_summary.total_us);
+}
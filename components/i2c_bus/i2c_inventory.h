@@ -0,0 +1,97 @@
+// i2c_inventory.h
+// Boot inventory: check the expected devices on all buses at once and publish the device table
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "i2c_bus.h"
+
+#define I2C_INVENTORY_TIMEOUT_MS (5) // Per transaction, a present device answers in well under 1 ms
+#define I2C_INVENTORY_MAX_ID (2)     // Identity bytes written / read
+
+    typedef enum
+    {
+        I2C_INVENTORY_NOT_CHECKED = 0,
+        I2C_INVENTORY_OK,        // Answered and identity matched
+        I2C_INVENTORY_ABSENT,    // No ACK
+        I2C_INVENTORY_WRONG_ID,  // Answered, but the identity bytes did not match
+        I2C_INVENTORY_BUS_ERROR, // Timeout or no bus: the other devices on the bus are skipped
+    } i2c_inventory_state_t;
+
+    /*
+     * One expected device. The identity check writes id_write (a register pointer, or a
+     * pattern the device must ACK without side effects); with id_read_len > 0 it then reads
+     * that many bytes and requires (byte & id_mask) == id_value for each.
+     */
+    typedef struct
+    {
+        const char *name;
+        uint8_t port;           // I2C port
+        uint8_t device_address; // 7-bit address
+        bool optional;          // Absence is not an error
+        uint8_t id_write[I2C_INVENTORY_MAX_ID];
+        uint8_t id_write_len;
+        uint8_t id_read_len;
+        uint8_t id_mask[I2C_INVENTORY_MAX_ID];
+        uint8_t id_value[I2C_INVENTORY_MAX_ID];
+        // Result of the last run
+        i2c_inventory_state_t state;
+        esp_err_t err;
+        uint32_t us; // Time of the check
+    } i2c_inventory_device_t;
+
+    typedef struct
+    {
+        uint32_t port_us[I2C_BUS_MAX_PORTS]; // Time spent on each bus
+        uint32_t total_us;                   // Wall time of the whole run
+        int ok;
+        int missing;  // Required devices not OK
+        int optional; // Optional devices not OK
+    } i2c_inventory_summary_t;
+
+    /**
+     * @brief Check all devices, one task per bus so the buses are probed in parallel.
+     *
+     * The table is published: i2c_inventory_find() and i2c_inventory_table() return it until
+     * the next run.
+     *
+     * @param devices      Table, results are written into it. Must stay valid.
+     * @param n_devices    Entries in the table.
+     * @param scl_speed_hz Device speed asked from the registry (a tuned speed wins).
+     * @return ESP_OK, ESP_ERR_NOT_FOUND when a required device is not OK, ESP_ERR_NO_MEM when
+     *         a bus task could not be started.
+     */
+    esp_err_t i2c_inventory_run(i2c_inventory_device_t *devices, int n_devices, uint32_t scl_speed_hz);
+
+    /**
+     * @brief Published device table and summary of the last run (NULL before the first run).
+     */
+    const i2c_inventory_device_t *i2c_inventory_table(int *n_devices, i2c_inventory_summary_t *summary);
+
+    /**
+     * @brief Look up a device of the published table by name.
+     */
+    const i2c_inventory_device_t *i2c_inventory_find(const char *name);
+
+    /**
+     * @brief True when the named device passed its check in the last run.
+     */
+    bool i2c_inventory_present(const char *name);
+
+    /**
+     * @brief Print the published table and summary.
+     */
+    void i2c_inventory_print(FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,449 @@
+/**
+ * @file i2c_recover.c
+ * @brief Bus health monitor with stuck-bus recovery.
+ *
+ * A slave that loses power or gets reset in the middle of a read can keep SDA low
+ * forever; every later transaction then burns its full timeout. The monitor detects this
+ * in two ways: a run of consecutive timeouts reported by the scheduler, and a periodic
+ * check that samples SDA and SCL on the idle bus.
+ *
+ * Recovery runs on the scheduler task, so no transaction is in flight: the cached device
+ * handles are detached, the bus is deleted, the pins are bit-banged with up to 9 clocks
+ * and a STOP, the bus is created again (asynchronous again when it was) and the devices
+ * are reattached. Finally the on_recovered callback replays the last known actuator
+ * state. The whole sequence is bounded by I2C_RECOVER_ROUNDS * (I2C_RECOVER_CLOCKS + 2)
+ * clock periods plus the bus rebuild; the time from detection to replayed state is logged
+ * and kept in the stats.
+ *
+ * When the bus cannot be created again the devices stay detached and the monitor tries
+ * again every check period. After I2C_RECOVER_REBUILD_TRIES failed rebuilds it gives up
+ * with stats.bus_down set; i2c_recover_now() or a new bus from i2cconfig ends that.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_recover.h"
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "i2c_bus.h"
+#include "i2c_sched.h"
+#include "i2c_scan.h"
+#include "i2c_async.h"
+
+static const char *TAG = "i2c_recover";
+
+typedef struct
+{
+    i2c_recover_reason_t reason;
+    int64_t detect_us;
+} recover_req_t;
+
+static i2c_recover_config_t s_cfg;
+static TaskHandle_t s_task = NULL;
+static atomic_uint s_consecutive_timeouts;
+static atomic_bool s_simulated_fault;
+static int64_t s_last_recovery_us;
+static i2c_recover_stats_t s_stats;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// A recovery whose bus rebuild failed, finished by the monitor. Scheduler task only.
+static struct
+{
+    int tries;                         // Failed rebuilds so far, 0 = nothing pending
+    recover_req_t req;                 // The recovery it belongs to
+    int clocks;
+    bool async;                        // The bus was asynchronous
+    i2c_master_bus_handle_t old_bus;   // Its devices wait to be reattached (handle already freed)
+} s_rebuild;
+
+const char *i2c_recover_reason_name(i2c_recover_reason_t reason)
+{
+    switch (reason)
+    {
+    case I2C_RECOVER_REASON_TIMEOUTS:
+        return "timeouts";
+    case I2C_RECOVER_REASON_SDA_LOW:
+        return "bus held low";
+    case I2C_RECOVER_REASON_MANUAL:
+        return "manual";
+    default:
+        return "none";
+    }
+}
+
+static void half_period(void)
+{
+    esp_rom_delay_us(I2C_RECOVER_HALF_PERIOD_US);
+}
+
+static void scl_release(gpio_num_t scl)
+{
+    gpio_set_level(scl, 1);
+    // honour clock stretching, but never longer than 1 ms
+    for (int i = 0; i < 100 && !gpio_get_level(scl); i++)
+    {
+        esp_rom_delay_us(10);
+    }
+    half_period();
+}
+
+// Clock a slave out of an unfinished byte: pulse SCL until it releases SDA, then a STOP.
+// Returns the number of clock pulses used, or -1 when the bus is still held low.
+static int unstick(gpio_num_t sda, gpio_num_t scl)
+{
+    gpio_config_t io_conf = {
+        .pin_bit_mask = (1ULL << sda) | (1ULL << scl),
+        .mode = GPIO_MODE_INPUT_OUTPUT_OD,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    gpio_config(&io_conf);
+    gpio_set_level(sda, 1);
+    scl_release(scl);
+
+    int clocks = 0;
+    for (int round = 0; round < I2C_RECOVER_ROUNDS; round++)
+    {
+        for (int i = 0; i < I2C_RECOVER_CLOCKS && !gpio_get_level(sda); i++)
+        {
+            gpio_set_level(scl, 0);
+            half_period();
+            scl_release(scl);
+            clocks++;
+        }
+
+        // STOP: SDA goes high while SCL is high
+        gpio_set_level(scl, 0);
+        half_period();
+        gpio_set_level(sda, 0);
+        half_period();
+        scl_release(scl);
+        gpio_set_level(sda, 1);
+        half_period();
+
+        if (gpio_get_level(sda) && gpio_get_level(scl))
+        {
+            return clocks;
+        }
+    }
+    return -1;
+}
+
+static void count_failure(void)
+{
+    portENTER_CRITICAL(&s_mux);
+    s_stats.failures++;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+// Create the bus again, reattach the devices and replay the state. Scheduler task.
+static esp_err_t rebuild_bus(void)
+{
+    const recover_req_t *req = &s_rebuild.req;
+    int clocks = s_rebuild.clocks;
+    esp_err_t ret = s_rebuild.async ? i2c_async_new_bus(&s_cfg.bus_config, s_cfg.bus_handle)
+                                    : i2c_new_master_bus(&s_cfg.bus_config, s_cfg.bus_handle);
+    if (ret != ESP_OK)
+    {
+        *s_cfg.bus_handle = NULL;
+        s_rebuild.tries++;
+        count_failure();
+        if (s_rebuild.tries < I2C_RECOVER_REBUILD_TRIES)
+        {
+            ESP_LOGE(TAG, "Failed to create I2C bus: %s, try %d of %d", esp_err_to_name(ret), s_rebuild.tries,
+                     I2C_RECOVER_REBUILD_TRIES);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Failed to create I2C bus: %s, giving up: bus %d stays down until a manual recovery",
+                     esp_err_to_name(ret), s_cfg.bus_config.i2c_port);
+            portENTER_CRITICAL(&s_mux);
+            s_stats.bus_down = true;
+            portEXIT_CRITICAL(&s_mux);
+        }
+        return ret;
+    }
+    if (s_rebuild.old_bus != NULL)
+    {
+        i2c_bus_reattach_all(s_rebuild.old_bus, *s_cfg.bus_handle);
+    }
+    s_rebuild.tries = 0;
+    s_rebuild.old_bus = NULL;
+    i2c_scan_invalidate();
+    atomic_store(&s_consecutive_timeouts, 0);
+
+    if (s_cfg.on_recovered)
+    {
+        s_cfg.on_recovered(*s_cfg.bus_handle, s_cfg.cb_arg);
+    }
+
+    int64_t now = esp_timer_get_time();
+    uint32_t took_us = (uint32_t)(now - req->detect_us);
+    portENTER_CRITICAL(&s_mux);
+    s_last_recovery_us = now;
+    if (clocks < 0)
+    {
+        s_stats.failures++;
+    }
+    else
+    {
+        s_stats.recoveries++;
+    }
+    s_stats.bus_down = false;
+    s_stats.last_us = took_us;
+    if (took_us > s_stats.max_us)
+    {
+        s_stats.max_us = took_us;
+    }
+    s_stats.last_clocks = (clocks < 0) ? 0 : (uint32_t)clocks;
+    s_stats.last_reason = req->reason;
+    portEXIT_CRITICAL(&s_mux);
+
+    ESP_LOGW(TAG, "I2C bus recovered in %" PRIu32 " us (%d clocks)", took_us, clocks);
+    return (clocks < 0) ? ESP_FAIL : ESP_OK;
+}
+
+// Runs on the scheduler task: nothing else uses the bus meanwhile
+static esp_err_t recover_bus(const recover_req_t *req)
+{
+    i2c_master_bus_handle_t old_bus = *s_cfg.bus_handle;
+    gpio_num_t sda = s_cfg.bus_config.sda_io_num;
+    gpio_num_t scl = s_cfg.bus_config.scl_io_num;
+
+    ESP_LOGW(TAG, "Recovering I2C bus (%s)", i2c_recover_reason_name(req->reason));
+
+    if (old_bus != NULL)
+    {
+        // not i2c_async_forget_bus(): the port stays asynchronous, the bus comes back the same way
+        bool async = i2c_async_port_is_async(s_cfg.bus_config.i2c_port);
+        i2c_bus_detach_all(old_bus);
+        esp_err_t err = i2c_del_master_bus(old_bus);
+        if (err != ESP_OK)
+        {
+            // cannot take the pins away from the driver, keep the old bus
+            ESP_LOGE(TAG, "Failed to delete I2C bus: %s", esp_err_to_name(err));
+            i2c_bus_reattach_all(old_bus, old_bus);
+            count_failure();
+            return err;
+        }
+        *s_cfg.bus_handle = NULL;
+        s_rebuild.async = async;
+        s_rebuild.old_bus = old_bus;
+    }
+    // else: a rebuild that failed before, its devices are still detached from s_rebuild.old_bus
+
+    int clocks = unstick(sda, scl);
+    gpio_reset_pin(sda);
+    gpio_reset_pin(scl);
+    if (clocks < 0)
+    {
+        ESP_LOGE(TAG, "Bus still held low after %d rounds of %d clocks", I2C_RECOVER_ROUNDS, I2C_RECOVER_CLOCKS);
+    }
+
+    s_rebuild.tries = 0;
+    s_rebuild.req = *req;
+    s_rebuild.clocks = clocks;
+    return rebuild_bus();
+}
+
+// The monitor tries a failed rebuild again, on the scheduler task
+static esp_err_t rebuild_exec(void *arg)
+{
+    (void)arg;
+    if (*s_cfg.bus_handle != NULL)
+    {
+        // i2cconfig created a new bus meanwhile: the detached devices go, they are added
+        // to the new bus on their next use
+        if (s_rebuild.old_bus != NULL)
+        {
+            i2c_bus_release_all(s_rebuild.old_bus);
+        }
+        s_rebuild.tries = 0;
+        s_rebuild.old_bus = NULL;
+        portENTER_CRITICAL(&s_mux);
+        s_stats.bus_down = false;
+        portEXIT_CRITICAL(&s_mux);
+        return ESP_OK;
+    }
+    if (s_rebuild.tries == 0 || s_rebuild.tries >= I2C_RECOVER_REBUILD_TRIES)
+    {
+        return ESP_ERR_INVALID_STATE; // nothing pending, or given up
+    }
+    return rebuild_bus();
+}
+
+static esp_err_t recover_exec(void *arg)
+{
+    return recover_bus((const recover_req_t *)arg);
+}
+
+// Idle-bus check, runs on the scheduler task between transactions
+static esp_err_t check_exec(void *arg)
+{
+    recover_req_t *req = (recover_req_t *)arg;
+    gpio_num_t sda = s_cfg.bus_config.sda_io_num;
+    gpio_num_t scl = s_cfg.bus_config.scl_io_num;
+
+    bool stuck = atomic_exchange(&s_simulated_fault, false);
+    if (!stuck)
+    {
+        // an idle bus is high; low on every sample is not a glitch
+        stuck = true;
+        for (int i = 0; i < 4 && stuck; i++)
+        {
+            stuck = !gpio_get_level(sda) || !gpio_get_level(scl);
+            esp_rom_delay_us(25);
+        }
+    }
+    if (!stuck)
+    {
+        return ESP_OK;
+    }
+    req->reason = I2C_RECOVER_REASON_SDA_LOW;
+    req->detect_us = esp_timer_get_time();
+    return recover_bus(req);
+}
+
+static bool holdoff_passed(void)
+{
+    portENTER_CRITICAL(&s_mux);
+    int64_t last = s_last_recovery_us;
+    portEXIT_CRITICAL(&s_mux);
+    return last == 0 || esp_timer_get_time() - last >= (int64_t)s_cfg.holdoff_ms * 1000;
+}
+
+static void monitor_task(void *arg)
+{
+    for (;;)
+    {
+        // woken early by a timeout run or a simulated fault, otherwise a periodic check
+        bool notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(s_cfg.check_period_ms)) > 0;
+        if (*s_cfg.bus_handle == NULL)
+        {
+            // a recovery could not create the bus again: try once per period
+            i2c_sched_run(s_cfg.bus_config.i2c_port, I2C_SCHED_PRIO_URGENT, rebuild_exec, NULL);
+            continue;
+        }
+        if (!holdoff_passed())
+        {
+            continue;
+        }
+
+        recover_req_t req = {
+            .reason = I2C_RECOVER_REASON_TIMEOUTS,
+            .detect_us = esp_timer_get_time(),
+        };
+        if (notified && atomic_load(&s_consecutive_timeouts) >= s_cfg.timeout_threshold)
+        {
+            i2c_sched_run(s_cfg.bus_config.i2c_port, I2C_SCHED_PRIO_URGENT, recover_exec, &req);
+        }
+        else
+        {
+            i2c_sched_run(s_cfg.bus_config.i2c_port, I2C_SCHED_PRIO_BULK, check_exec, &req);
+        }
+    }
+}
+
+esp_err_t i2c_recover_start(const i2c_recover_config_t *config)
+{
+    if (!config || !config->bus_handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_task != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_cfg = *config;
+    if (s_cfg.timeout_threshold == 0)
+    {
+        s_cfg.timeout_threshold = I2C_RECOVER_DEFAULT_TIMEOUTS;
+    }
+    if (s_cfg.check_period_ms == 0)
+    {
+        s_cfg.check_period_ms = I2C_RECOVER_DEFAULT_CHECK_MS;
+    }
+    if (s_cfg.holdoff_ms == 0)
+    {
+        s_cfg.holdoff_ms = I2C_RECOVER_DEFAULT_HOLDOFF_MS;
+    }
+
+    if (xTaskCreate(monitor_task, "i2c_recover", 3072, NULL, s_cfg.task_priority, &s_task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create monitor task");
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Bus monitor started, recovery after %" PRIu32 " timeouts, check every %" PRIu32 " ms",
+             s_cfg.timeout_threshold, s_cfg.check_period_ms);
+    return ESP_OK;
+}
+
+void i2c_recover_set_bus_config(const i2c_master_bus_config_t *bus_config)
+{
+    if (bus_config)
+    {
+        portENTER_CRITICAL(&s_mux);
+        s_cfg.bus_config = *bus_config;
+        portEXIT_CRITICAL(&s_mux);
+    }
+}
+
+void i2c_recover_note_result(int port, esp_err_t result)
+{
+    if (s_task == NULL || port != s_cfg.bus_config.i2c_port)
+    {
+        return; // not the monitored bus
+    }
+    if (result != ESP_ERR_TIMEOUT)
+    {
+        atomic_store_explicit(&s_consecutive_timeouts, 0, memory_order_relaxed);
+        return;
+    }
+    unsigned n = atomic_fetch_add_explicit(&s_consecutive_timeouts, 1, memory_order_relaxed) + 1;
+    if (n == s_cfg.timeout_threshold)
+    {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+esp_err_t i2c_recover_now(void)
+{
+    if (s_cfg.bus_handle == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    recover_req_t req = {
+        .reason = I2C_RECOVER_REASON_MANUAL,
+        .detect_us = esp_timer_get_time(),
+    };
+    return i2c_sched_run(s_cfg.bus_config.i2c_port, I2C_SCHED_PRIO_URGENT, recover_exec, &req);
+}
+
+void i2c_recover_simulate_fault(void)
+{
+    atomic_store(&s_simulated_fault, true);
+    if (s_task != NULL)
+    {
+        xTaskNotifyGive(s_task); // check right away instead of at the next period
+    }
+}
+
+void i2c_recover_get_stats(i2c_recover_stats_t *stats)
+{
+    if (stats)
+    {
+        portENTER_CRITICAL(&s_mux);
+        *stats = s_stats;
+        portEXIT_CRITICAL(&s_mux);
+    }
+}
@@ -0,0 +1,101 @@
+// i2c_recover.h
+// Stuck-bus detection and recovery: 9 clocks + STOP, bus rebuild, device reattach
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+#define I2C_RECOVER_DEFAULT_TIMEOUTS (3)        // Consecutive timeouts that trigger a recovery
+#define I2C_RECOVER_DEFAULT_CHECK_MS (1000)     // Idle-bus SDA/SCL check period
+#define I2C_RECOVER_DEFAULT_HOLDOFF_MS (1000)   // Minimum time between two recoveries
+#define I2C_RECOVER_CLOCKS (9)                  // Clock pulses per unstick round
+#define I2C_RECOVER_ROUNDS (3)                  // Unstick rounds before giving up
+#define I2C_RECOVER_HALF_PERIOD_US (5)          // 100 kHz bit-bang clock
+#define I2C_RECOVER_REBUILD_TRIES (5)           // Bus rebuilds, one per check period, before giving up
+
+    typedef enum
+    {
+        I2C_RECOVER_REASON_NONE = 0,
+        I2C_RECOVER_REASON_TIMEOUTS,  // Repeated transaction timeouts
+        I2C_RECOVER_REASON_SDA_LOW,   // SDA (or SCL) held low on an idle bus
+        I2C_RECOVER_REASON_MANUAL,    // i2c_recover_now()
+    } i2c_recover_reason_t;
+
+    /**
+     * @brief Called on the scheduler task after the bus was rebuilt and the cached devices
+     * were reattached. Replay the last known actuator state here; transactions run directly.
+     * Runs on the scheduler task, not on the tasks that own the driver contexts: do not
+     * change a context another task may be using (hand the restore over instead).
+     */
+    typedef void (*i2c_recover_cb_t)(i2c_master_bus_handle_t new_bus, void *arg);
+
+    typedef struct
+    {
+        i2c_master_bus_config_t bus_config; // Used to rebuild the bus (pins, port, pull-ups)
+        i2c_master_bus_handle_t *bus_handle; // Replaced in place, e.g. &tool_bus_handles[0]
+        uint32_t timeout_threshold;         // 0 = I2C_RECOVER_DEFAULT_TIMEOUTS
+        uint32_t check_period_ms;           // 0 = I2C_RECOVER_DEFAULT_CHECK_MS
+        uint32_t holdoff_ms;                // 0 = I2C_RECOVER_DEFAULT_HOLDOFF_MS
+        i2c_recover_cb_t on_recovered;      // Optional
+        void *cb_arg;
+        int task_priority;
+    } i2c_recover_config_t;
+
+    typedef struct
+    {
+        uint32_t recoveries;              // Completed recoveries
+        uint32_t failures;                // SDA still low after all rounds, or rebuild failed
+        bool bus_down;                    // No bus after I2C_RECOVER_REBUILD_TRIES rebuilds, until i2c_recover_now()
+        uint32_t last_us;                 // Time to recover, detection to replayed state
+        uint32_t max_us;
+        uint32_t last_clocks;             // Clock pulses needed to release SDA
+        i2c_recover_reason_t last_reason;
+    } i2c_recover_stats_t;
+
+    /**
+     * @brief Start the bus health monitor task. Needs the scheduler (i2c_sched_start).
+     *
+     * Watches the bus of bus_config.i2c_port (the control bus); other ports are ignored.
+     */
+    esp_err_t i2c_recover_start(const i2c_recover_config_t *config);
+
+    /**
+     * @brief Tell the monitor the bus was rebuilt with a different configuration (i2cconfig).
+     */
+    void i2c_recover_set_bus_config(const i2c_master_bus_config_t *bus_config);
+
+    /**
+     * @brief Feed the result of a bus transaction. Called by the scheduler for every transfer.
+     */
+    void i2c_recover_note_result(int port, esp_err_t result);
+
+    /**
+     * @brief Recover the bus now and wait until done. Ignores the hold-off time.
+     *
+     * Also the way back after the monitor gave up rebuilding the bus (stats.bus_down).
+     */
+    esp_err_t i2c_recover_now(void);
+
+    /**
+     * @brief Simulated fault: the next idle-bus check sees SDA stuck low.
+     *
+     * Exercises the whole detection and recovery path without touching the hardware.
+     */
+    void i2c_recover_simulate_fault(void);
+
+    void i2c_recover_get_stats(i2c_recover_stats_t *stats);
+
+    const char *i2c_recover_reason_name(i2c_recover_reason_t reason);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,274 @@
+/**
+ * @file i2c_regmap.c
+ * @brief Shadow-register cache for register-mapped I2C devices.
+ *
+ * The driver describes its registers once (address, width, flags). Writes update the
+ * shadow and mark the register dirty; a flush sends every run of dirty registers with
+ * consecutive addresses as one auto-increment transaction, and skips registers the device
+ * already holds. Reads of cached registers never touch the bus. After the device lost its
+ * state, i2c_regmap_sync() writes the whole known state back in the fewest transactions.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_regmap.h"
+#include <string.h>
+#include "esp_log.h"
+#include "i2c_bus.h"
+
+static const char *TAG = "i2c_regmap";
+
+static int find_reg(const i2c_regmap_t *map, uint8_t reg)
+{
+    for (int i = 0; i < map->desc->n_regs; i++)
+    {
+        if (map->desc->regs[i].reg == reg)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Can register i+1 follow register i in one auto-increment transfer
+static bool can_combine(const i2c_regmap_t *map, int i)
+{
+    const i2c_regmap_reg_t *a = &map->desc->regs[i];
+    const i2c_regmap_reg_t *b = &map->desc->regs[i + 1];
+    return !map->desc->no_auto_increment && a->reg + a->width == b->reg &&
+           !(a->flags & I2C_REGMAP_SEPARATE) && !(b->flags & I2C_REGMAP_SEPARATE);
+}
+
+static esp_err_t get_dev(const i2c_regmap_t *map, i2c_master_dev_handle_t *dev_handle)
+{
+    return i2c_bus_get_device(map->bus_handle, map->device_address, map->scl_speed_hz, dev_handle);
+}
+
+// Read registers first..last (consecutive addresses) in one transfer
+static esp_err_t read_run(i2c_regmap_t *map, int first, int last)
+{
+    const i2c_regmap_reg_t *regs = map->desc->regs;
+    uint8_t buf[I2C_REGMAP_MAX_REGS * I2C_REGMAP_MAX_WIDTH];
+    size_t len = 0;
+    for (int i = first; i <= last; i++)
+    {
+        len += regs[i].width;
+    }
+
+    i2c_master_dev_handle_t dev_handle;
+    esp_err_t ret = get_dev(map, &dev_handle);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = i2c_sched_transmit_receive(dev_handle, map->desc->prio, &regs[first].reg, 1, buf, len, map->desc->timeout_ms);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    const uint8_t *p = buf;
+    for (int i = first; i <= last; i++)
+    {
+        uint32_t v = 0;
+        for (int b = 0; b < regs[i].width; b++)
+        {
+            v |= (uint32_t)*p++ << (8 * b);
+        }
+        map->value[i] = v;
+        map->valid |= (1u << i);
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_regmap_init(i2c_regmap_t *map, const i2c_regmap_desc_t *desc, i2c_master_bus_handle_t bus_handle,
+                          uint16_t device_address, uint32_t scl_speed_hz)
+{
+    if (!map || !desc || !desc->regs || desc->n_regs < 1 || desc->n_regs > I2C_REGMAP_MAX_REGS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < desc->n_regs; i++)
+    {
+        if (desc->regs[i].width < 1 || desc->regs[i].width > I2C_REGMAP_MAX_WIDTH)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    memset(map, 0, sizeof(*map));
+    map->desc = desc;
+    map->bus_handle = bus_handle;
+    map->device_address = device_address;
+    map->scl_speed_hz = scl_speed_hz;
+    return ESP_OK;
+}
+
+esp_err_t i2c_regmap_read(i2c_regmap_t *map, uint8_t reg, uint32_t *value)
+{
+    int i = find_reg(map, reg);
+    if (i < 0 || !value)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint8_t flags = map->desc->regs[i].flags;
+    bool cached = (map->valid | map->dirty) & (1u << i);
+
+    if (flags & I2C_REGMAP_WRITE_ONLY)
+    {
+        if (!cached)
+        {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+    }
+    else if (!cached || ((flags & I2C_REGMAP_VOLATILE) && !(map->dirty & (1u << i))))
+    {
+        esp_err_t ret = read_run(map, i, i);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+    *value = map->value[i];
+    return ESP_OK;
+}
+
+esp_err_t i2c_regmap_write(i2c_regmap_t *map, uint8_t reg, uint32_t value)
+{
+    int i = find_reg(map, reg);
+    if (i < 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    int width = map->desc->regs[i].width;
+    if (width < 4)
+    {
+        value &= (1u << (8 * width)) - 1;
+    }
+
+    map->writes++;
+    bool volatile_reg = map->desc->regs[i].flags & I2C_REGMAP_VOLATILE;
+    if (!volatile_reg && (map->valid & (1u << i)) && map->value[i] == value)
+    {
+        map->dirty &= ~(1u << i); // back to what the device has
+        map->skipped++;
+        return ESP_OK;
+    }
+    map->value[i] = value;
+    map->valid &= ~(1u << i);
+    map->dirty |= (1u << i);
+    return ESP_OK;
+}
+
+esp_err_t i2c_regmap_update_bits(i2c_regmap_t *map, uint8_t reg, uint32_t mask, uint32_t value)
+{
+    uint32_t old = 0;
+    esp_err_t ret = i2c_regmap_read(map, reg, &old);
+    if (ret == ESP_ERR_NOT_SUPPORTED)
+    {
+        old = 0; // write-only and never written: the other bits start at zero
+    }
+    else if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    return i2c_regmap_write(map, reg, (old & ~mask) | (value & mask));
+}
+
+esp_err_t i2c_regmap_flush(i2c_regmap_t *map)
+{
+    const i2c_regmap_reg_t *regs = map->desc->regs;
+    esp_err_t first_err = ESP_OK;
+
+    for (int i = 0; i < map->desc->n_regs; i++)
+    {
+        if (!(map->dirty & (1u << i)))
+        {
+            continue;
+        }
+        // collect the run of dirty registers that can go in one transfer
+        uint8_t buf[1 + I2C_REGMAP_MAX_REGS * I2C_REGMAP_MAX_WIDTH];
+        size_t len = 0;
+        int last = i;
+        buf[len++] = regs[i].reg;
+        for (;;)
+        {
+            for (int b = 0; b < regs[last].width; b++)
+            {
+                buf[len++] = (uint8_t)(map->value[last] >> (8 * b));
+            }
+            if (last + 1 < map->desc->n_regs && (map->dirty & (1u << (last + 1))) && can_combine(map, last))
+            {
+                last++;
+                continue;
+            }
+            break;
+        }
+
+        i2c_master_dev_handle_t dev_handle;
+        esp_err_t ret = get_dev(map, &dev_handle);
+        if (ret == ESP_OK)
+        {
+            ret = i2c_sched_transmit(dev_handle, map->desc->prio, buf, len, map->desc->timeout_ms);
+            map->transfers++;
+        }
+        if (ret == ESP_OK)
+        {
+            for (int r = i; r <= last; r++)
+            {
+                map->dirty &= ~(1u << r);
+                map->valid |= (1u << r);
+            }
+        }
+        else
+        {
+            ESP_LOGD(TAG, "0x%02x: write of reg 0x%02x failed: %s", map->device_address, regs[i].reg, esp_err_to_name(ret));
+            if (first_err == ESP_OK)
+            {
+                first_err = ret;
+            }
+        }
+        i = last;
+    }
+    return first_err;
+}
+
+esp_err_t i2c_regmap_refresh(i2c_regmap_t *map)
+{
+    const i2c_regmap_reg_t *regs = map->desc->regs;
+    const uint8_t skip = I2C_REGMAP_WRITE_ONLY | I2C_REGMAP_VOLATILE;
+
+    for (int i = 0; i < map->desc->n_regs; i++)
+    {
+        if ((regs[i].flags & skip) || (map->dirty & (1u << i)))
+        {
+            continue;
+        }
+        int last = i;
+        while (last + 1 < map->desc->n_regs && !(regs[last + 1].flags & skip) &&
+               !(map->dirty & (1u << (last + 1))) && can_combine(map, last))
+        {
+            last++;
+        }
+        esp_err_t ret = read_run(map, i, last);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        i = last;
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_regmap_sync(i2c_regmap_t *map)
+{
+    // every register with a known value becomes dirty, the flush combines them
+    map->dirty |= map->valid;
+    map->valid = 0;
+    return i2c_regmap_flush(map);
+}
+
+void i2c_regmap_invalidate(i2c_regmap_t *map)
+{
+    map->valid = 0;
+}
@@ -0,0 +1,112 @@
+// i2c_regmap.h
+// Shadow-register cache for register-mapped I2C devices, with write combining on flush
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+#include "i2c_sched.h"
+
+#define I2C_REGMAP_MAX_REGS (16) // Registers per device
+#define I2C_REGMAP_MAX_WIDTH (4) // Bytes per register
+
+// Register flags
+#define I2C_REGMAP_VOLATILE (1 << 0)   // Changed by the device itself: reads always go to the bus
+#define I2C_REGMAP_WRITE_ONLY (1 << 1) // Cannot be read back: reads are served from the shadow only
+#define I2C_REGMAP_SEPARATE (1 << 2)   // Always written in its own transaction, never combined
+
+    // One register. Multi-byte values are sent low byte first.
+    typedef struct
+    {
+        uint8_t reg;   // Register address
+        uint8_t width; // Bytes, 1..I2C_REGMAP_MAX_WIDTH
+        uint8_t flags; // I2C_REGMAP_*
+    } i2c_regmap_reg_t;
+
+    // Register map of a device type, usually a static const table in the driver
+    typedef struct
+    {
+        const i2c_regmap_reg_t *regs; // Sorted by address
+        int n_regs;
+        bool no_auto_increment;       // Device does not auto-increment: never combine
+        i2c_sched_prio_t prio;        // Scheduler priority of the transfers
+        int timeout_ms;
+    } i2c_regmap_desc_t;
+
+    // Shadow of one device. Not locked: owned by one driver context.
+    typedef struct
+    {
+        const i2c_regmap_desc_t *desc;
+        i2c_master_bus_handle_t bus_handle; // The handle is taken from the registry per transfer,
+        uint16_t device_address;            // so a rebuilt bus or a tuned speed is picked up
+        uint32_t scl_speed_hz;
+        uint32_t value[I2C_REGMAP_MAX_REGS];
+        uint16_t valid; // Bit per register: shadow equals the device
+        uint16_t dirty; // Bit per register: written locally, not flushed yet
+        // Counters
+        uint32_t writes;    // Register writes staged
+        uint32_t skipped;   // Writes dropped because the device already had the value
+        uint32_t transfers; // Bus transactions used by flushes
+    } i2c_regmap_t;
+
+    /**
+     * @brief Set up an empty shadow (nothing valid) for one device.
+     */
+    esp_err_t i2c_regmap_init(i2c_regmap_t *map, const i2c_regmap_desc_t *desc, i2c_master_bus_handle_t bus_handle,
+                              uint16_t device_address, uint32_t scl_speed_hz);
+
+    /**
+     * @brief Read a register: from the shadow when valid, otherwise (and for volatile
+     * registers always) from the device.
+     *
+     * @return ESP_OK, ESP_ERR_NOT_FOUND for an unknown register, ESP_ERR_NOT_SUPPORTED for a
+     *         write-only register that was never written, or the bus error.
+     */
+    esp_err_t i2c_regmap_read(i2c_regmap_t *map, uint8_t reg, uint32_t *value);
+
+    /**
+     * @brief Stage a register write. Nothing goes to the bus until i2c_regmap_flush().
+     *
+     * A write of the value the device already has is dropped.
+     */
+    esp_err_t i2c_regmap_write(i2c_regmap_t *map, uint8_t reg, uint32_t value);
+
+    /**
+     * @brief Stage a read-modify-write of the bits in mask (read from the device if needed).
+     */
+    esp_err_t i2c_regmap_update_bits(i2c_regmap_t *map, uint8_t reg, uint32_t mask, uint32_t value);
+
+    /**
+     * @brief Write all staged registers. Runs of dirty registers with consecutive addresses
+     * are combined into one auto-increment transaction.
+     *
+     * @return ESP_OK, or the first bus error (the failed registers stay dirty).
+     */
+    esp_err_t i2c_regmap_flush(i2c_regmap_t *map);
+
+    /**
+     * @brief Read all readable, non-volatile registers from the device into the shadow.
+     */
+    esp_err_t i2c_regmap_refresh(i2c_regmap_t *map);
+
+    /**
+     * @brief Write every known register again (device lost its state: power cycle, bus recovery).
+     */
+    esp_err_t i2c_regmap_sync(i2c_regmap_t *map);
+
+    /**
+     * @brief Forget the shadow: the next read goes to the device, the next write is not dropped.
+     */
+    void i2c_regmap_invalidate(i2c_regmap_t *map);
+
+#ifdef __cplusplus
+}
+#endif
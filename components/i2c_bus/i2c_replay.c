@@ -0,0 +1,206 @@
+/**
+ * @file i2c_replay.c
+ * @brief Replay of captured I2C traffic.
+ *
+ * The transactions of a capture (the ring or a text dump) are re-run in order through the
+ * bus scheduler. Timing is kept relative: every transaction starts at its captured offset
+ * from the first one, so a slow transfer does not push the rest of the schedule out. The
+ * wait sleeps whole ticks and spins on esp_timer for the last one.
+ *
+ * Against the simulated bus of the host build this turns a capture from the board into a
+ * regression test for the drivers and the device models.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_replay.h"
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/i2c_master.h"
+#include "i2c_bus.h"
+#include "i2c_sched.h"
+#include "i2c_capture.h"
+
+static const char *TAG = "i2c_replay";
+
+// Supplies the next record: ESP_OK, ESP_ERR_NOT_FOUND at the end, ESP_ERR_INVALID_ARG to skip one
+typedef esp_err_t (*replay_next_fn)(void *ctx, i2c_capture_rec_t *rec, uint8_t *data);
+
+// One replay at a time, the buffers are too large for a console task stack
+static uint8_t s_data[2 * I2C_CAPTURE_MAX_DATA];
+static uint8_t s_read[I2C_CAPTURE_MAX_DATA];
+static char s_line[I2C_CAPTURE_MAX_LINE + 32];
+
+static void wait_until(int64_t target_us)
+{
+    int64_t left = target_us - esp_timer_get_time();
+    if (left > (int64_t)portTICK_PERIOD_MS * 2000)
+    {
+        // sleep all but the last tick, the tick boundary is not aligned with the target
+        vTaskDelay(pdMS_TO_TICKS(left / 1000) - 1);
+    }
+    while (esp_timer_get_time() < target_us)
+    {
+    }
+}
+
+static void replay_one(const i2c_capture_rec_t *rec, const uint8_t *data, const i2c_replay_config_t *config,
+                       i2c_replay_stats_t *stats)
+{
+    i2c_master_bus_handle_t bus_handle;
+    i2c_master_dev_handle_t dev_handle;
+
+    if ((rec->flags & I2C_CAPTURE_F_TRUNCATED) || rec->addr > 0x7f || rec->read_len > I2C_CAPTURE_MAX_DATA ||
+        (!rec->write_len && !rec->read_len))
+    {
+        stats->skipped++;
+        return;
+    }
+    if (i2c_master_get_bus_handle(rec->port, &bus_handle) != ESP_OK || bus_handle == NULL ||
+        i2c_bus_get_device(bus_handle, rec->addr, config->scl_speed_hz, &dev_handle) != ESP_OK)
+    {
+        stats->skipped++;
+        return;
+    }
+
+    esp_err_t ret;
+    if (rec->read_len)
+    {
+        ret = i2c_sched_transmit_receive(dev_handle, I2C_SCHED_PRIO_NORMAL, data, rec->write_len, s_read,
+                                         rec->read_len, I2C_REPLAY_TIMEOUT_MS);
+    }
+    else
+    {
+        ret = i2c_sched_transmit(dev_handle, I2C_SCHED_PRIO_NORMAL, data, rec->write_len, I2C_REPLAY_TIMEOUT_MS);
+    }
+    stats->transactions++;
+
+    if (rec->flags & I2C_CAPTURE_F_QUEUED)
+    {
+        return; // captured result is that of the queueing, no read data
+    }
+    if (ret != rec->result)
+    {
+        stats->result_mismatch++;
+        ESP_LOGD(TAG, "t=%lu 0x%02x: %s, captured %s", (unsigned long)rec->t_us, rec->addr, esp_err_to_name(ret),
+                 esp_err_to_name(rec->result));
+    }
+    else if (config->check_reads && ret == ESP_OK && rec->read_len &&
+             memcmp(s_read, data + rec->write_len, rec->read_len) != 0)
+    {
+        stats->data_mismatch++;
+        ESP_LOGD(TAG, "t=%lu 0x%02x: read data differs", (unsigned long)rec->t_us, rec->addr);
+    }
+}
+
+static esp_err_t replay_run(replay_next_fn next, void *ctx, const i2c_replay_config_t *config,
+                            i2c_replay_stats_t *stats)
+{
+    i2c_capture_rec_t rec;
+    uint64_t offset_us = 0; // Captured start relative to the first transaction
+    uint32_t prev_t_us = 0;
+    bool first = true;
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t ret;
+
+    memset(stats, 0, sizeof(*stats));
+    while ((ret = next(ctx, &rec, s_data)) != ESP_ERR_NOT_FOUND)
+    {
+        if (ret != ESP_OK)
+        {
+            stats->skipped++;
+            continue;
+        }
+        if (first)
+        {
+            first = false;
+            start_us = esp_timer_get_time();
+        }
+        else
+        {
+            offset_us += (uint32_t)(rec.t_us - prev_t_us); // unsigned: survives the 71 minute wrap
+        }
+        prev_t_us = rec.t_us;
+
+        int64_t target_us = start_us + (int64_t)(offset_us * config->time_scale / 100);
+        wait_until(target_us);
+        int64_t late_us = esp_timer_get_time() - target_us;
+        if (config->time_scale && late_us > I2C_REPLAY_LATE_US)
+        {
+            stats->late++;
+        }
+        if (config->time_scale && late_us > (int64_t)stats->max_late_us)
+        {
+            stats->max_late_us = (uint32_t)late_us;
+        }
+        replay_one(&rec, s_data, config, stats);
+    }
+    stats->capture_us = (uint32_t)offset_us;
+    stats->total_us = first ? 0 : (uint32_t)(esp_timer_get_time() - start_us);
+
+    if (first)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return (stats->result_mismatch || stats->data_mismatch) ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t next_from_ring(void *ctx, i2c_capture_rec_t *rec, uint8_t *data)
+{
+    return i2c_capture_next((i2c_capture_cursor_t *)ctx, rec, data, 2 * I2C_CAPTURE_MAX_DATA) ? ESP_OK
+                                                                                              : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t i2c_replay_capture(const i2c_replay_config_t *config, i2c_replay_stats_t *stats)
+{
+    if (!config || !stats)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (i2c_capture_active())
+    {
+        return ESP_ERR_INVALID_STATE; // the replay would chase its own records
+    }
+    i2c_capture_cursor_t cursor = {0};
+    return replay_run(next_from_ring, &cursor, config, stats);
+}
+
+static esp_err_t next_from_file(void *ctx, i2c_capture_rec_t *rec, uint8_t *data)
+{
+    FILE *in = (FILE *)ctx;
+    while (fgets(s_line, sizeof(s_line), in))
+    {
+        esp_err_t ret = i2c_capture_parse_line(s_line, rec, data);
+        if (ret != ESP_ERR_NOT_FOUND)
+        {
+            if (ret != ESP_OK)
+            {
+                ESP_LOGW(TAG, "Bad capture line: %.40s", s_line);
+            }
+            return ret;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t i2c_replay_file(FILE *in, const i2c_replay_config_t *config, i2c_replay_stats_t *stats)
+{
+    if (!in || !config || !stats)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return replay_run(next_from_file, in, config, stats);
+}
+
+void i2c_replay_print(const i2c_replay_stats_t *stats, FILE *out)
+{
+    fprintf(out, "replayed %lu transactions in %lu us (captured %lu us)\n", (unsigned long)stats->transactions,
+            (unsigned long)stats->total_us, (unsigned long)stats->capture_us);
+    fprintf(out, "  result mismatch %lu, data mismatch %lu, skipped %lu\n", (unsigned long)stats->result_mismatch,
+            (unsigned long)stats->data_mismatch, (unsigned long)stats->skipped);
+    fprintf(out, "  late %lu, max late %lu us\n", (unsigned long)stats->late, (unsigned long)stats->max_late_us);
+}
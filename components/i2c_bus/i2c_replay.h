@@ -0,0 +1,70 @@
+// i2c_replay.h
+// Replay an I2C capture with its original timing, on the real bus or a simulated one
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+
+#define I2C_REPLAY_TIMEOUT_MS (50) // Timeout per transaction
+#define I2C_REPLAY_LATE_US (200)   // A transaction starting later than this behind schedule is late
+
+    typedef struct
+    {
+        uint32_t scl_speed_hz; // Device speed asked from the registry (a tuned speed wins)
+        uint16_t time_scale;   // Percent of the original spacing: 100 = original timing, 0 = back to back
+        bool check_reads;      // Compare read data with the capture
+    } i2c_replay_config_t;
+
+#define I2C_REPLAY_CONFIG_DEFAULT() \
+    {                               \
+        .scl_speed_hz = 100000,     \
+        .time_scale = 100,          \
+        .check_reads = true,        \
+    }
+
+    typedef struct
+    {
+        uint32_t transactions;    // Replayed
+        uint32_t result_mismatch; // Result differs from the capture
+        uint32_t data_mismatch;   // Read data differs from the capture
+        uint32_t skipped;         // Truncated, unknown address, no bus or malformed line
+        uint32_t late;            // Started more than I2C_REPLAY_LATE_US behind schedule
+        uint32_t max_late_us;
+        uint32_t capture_us;      // Span of the capture, first to last transaction start
+        uint32_t total_us;        // Span of the replay
+    } i2c_replay_stats_t;
+
+    /**
+     * @brief Replay the capture ring.
+     *
+     * Each transaction runs through the scheduler on the device of the same port and address,
+     * started at its original offset from the first one (scaled). Queued asynchronous
+     * transfers are replayed synchronously and their result is not compared.
+     * Not reentrant: one replay at a time.
+     *
+     * @return ESP_OK when every result and read matched, ESP_FAIL on a mismatch,
+     *         ESP_ERR_INVALID_STATE while the capture is running, ESP_ERR_NOT_FOUND when empty.
+     */
+    esp_err_t i2c_replay_capture(const i2c_replay_config_t *config, i2c_replay_stats_t *stats);
+
+    /**
+     * @brief Replay a capture dump written by i2c_capture_dump().
+     *
+     * @return As i2c_replay_capture(); malformed lines are counted as skipped.
+     */
+    esp_err_t i2c_replay_file(FILE *in, const i2c_replay_config_t *config, i2c_replay_stats_t *stats);
+
+    void i2c_replay_print(const i2c_replay_stats_t *stats, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
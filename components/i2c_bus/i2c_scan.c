@@ -0,0 +1,290 @@
+/**
+ * @file i2c_scan.c
+ * @brief Fast I2C bus scanner with a timestamped result cache.
+ *
+ * The scan stores one bit per address instead of printing while probing, so the table
+ * is rendered once at the end. Reserved addresses are skipped by default, the probe
+ * timeout is configurable and a bus that keeps timing out is declared stuck instead of
+ * burning the full timeout on all 128 addresses. An asynchronous bus is probed with a
+ * one-byte read (i2c_async_probe). The probes run on the scheduler lane of the port, so
+ * they never overlap a transaction or a bus recovery. The HP ports can be scanned in
+ * parallel, one task per port.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_scan.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_bus.h"
+#include "i2c_async.h"
+#include "i2c_sched.h"
+#include "i2c_recover.h"
+
+static const char *TAG = "i2c_scan";
+
+#define I2C_SCAN_CACHE_SLOTS (I2C_SCAN_MAX_PORTS)
+
+static i2c_scan_result_t s_cache[I2C_SCAN_CACHE_SLOTS];
+static portMUX_TYPE s_cache_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static inline void set_bit(uint32_t *map, uint8_t addr)
+{
+    map[addr >> 5] |= 1u << (addr & 31);
+}
+
+static bool is_reserved(uint8_t addr)
+{
+    return addr < 0x08 || addr > 0x77; // general call, CBUS, HS-mode, 10-bit prefixes
+}
+
+static void cache_store(const i2c_scan_result_t *result)
+{
+    portENTER_CRITICAL(&s_cache_mux);
+    i2c_scan_result_t *slot = &s_cache[0];
+    for (int i = 0; i < I2C_SCAN_CACHE_SLOTS; i++)
+    {
+        if (s_cache[i].bus_handle == result->bus_handle)
+        {
+            slot = &s_cache[i];
+            break;
+        }
+        if (s_cache[i].timestamp_us < slot->timestamp_us)
+        {
+            slot = &s_cache[i]; // oldest (or empty) slot
+        }
+    }
+    *slot = *result;
+    portEXIT_CRITICAL(&s_cache_mux);
+}
+
+typedef struct
+{
+    int port;
+    const i2c_scan_config_t *config;
+    i2c_scan_result_t *result;
+} scan_exec_t;
+
+// Runs on the lane of the port: no transaction, recovery or idle-bus check in between
+static esp_err_t scan_exec(void *arg)
+{
+    scan_exec_t *job = (scan_exec_t *)arg;
+    const i2c_scan_config_t *config = job->config;
+    i2c_scan_result_t *result = job->result;
+
+    // a recovery queued before us may have replaced the bus of the caller
+    i2c_master_bus_handle_t bus_handle = NULL;
+    if (i2c_master_get_bus_handle(job->port, &bus_handle) != ESP_OK || bus_handle == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->bus_handle = bus_handle;
+    result->generation = i2c_bus_generation();
+
+    int64_t start = esp_timer_get_time();
+    int timeouts_in_row = 0;
+    for (int addr = config->first_addr; addr <= config->last_addr; addr++)
+    {
+        if (!config->include_reserved && is_reserved(addr))
+        {
+            continue;
+        }
+        set_bit(result->probed, addr);
+        esp_err_t ret = i2c_async_probe(bus_handle, addr, config->probe_timeout_ms);
+        i2c_recover_note_result(job->port, ret);
+        if (ret == ESP_OK)
+        {
+            set_bit(result->present, addr);
+            timeouts_in_row = 0;
+        }
+        else if (ret == ESP_ERR_TIMEOUT)
+        {
+            set_bit(result->busy, addr);
+            if (config->max_timeouts && ++timeouts_in_row >= config->max_timeouts)
+            {
+                ESP_LOGW(TAG, "Bus stuck, scan stopped at 0x%02x", addr);
+                result->stuck = true;
+                break;
+            }
+        }
+        else
+        {
+            timeouts_in_row = 0;
+        }
+    }
+    result->timestamp_us = esp_timer_get_time();
+    result->duration_us = (uint32_t)(result->timestamp_us - start);
+    return ESP_OK;
+}
+
+esp_err_t i2c_scan_bus(i2c_master_bus_handle_t bus_handle, const i2c_scan_config_t *config, i2c_scan_result_t *result)
+{
+    const i2c_scan_config_t defaults = I2C_SCAN_CONFIG_DEFAULT();
+    if (!bus_handle || !result)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!config)
+    {
+        config = &defaults;
+    }
+    if (config->last_addr > 0x7f || config->first_addr > config->last_addr)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int port = i2c_bus_port_of(bus_handle);
+    if (port < 0)
+    {
+        return ESP_ERR_INVALID_ARG; // not an installed bus
+    }
+    scan_exec_t job = {
+        .port = port,
+        .config = config,
+        .result = result,
+    };
+    esp_err_t err = i2c_sched_run(port, I2C_SCHED_PRIO_NORMAL, scan_exec, &job);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    cache_store(result);
+    return ESP_OK;
+}
+
+typedef struct
+{
+    i2c_master_bus_handle_t bus_handle;
+    const i2c_scan_config_t *config;
+    i2c_scan_result_t *result;
+    SemaphoreHandle_t done;
+} scan_job_t;
+
+static void scan_task(void *arg)
+{
+    scan_job_t *job = (scan_job_t *)arg;
+    i2c_scan_bus(job->bus_handle, job->config, job->result);
+    xSemaphoreGive(job->done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t i2c_scan_all_ports(const i2c_scan_config_t *config, i2c_scan_result_t results[I2C_SCAN_MAX_PORTS])
+{
+    scan_job_t jobs[I2C_SCAN_MAX_PORTS] = {0};
+    StaticSemaphore_t done_buf[I2C_SCAN_MAX_PORTS];
+    int local_port = -1;
+    esp_err_t err = ESP_OK;
+
+    for (int port = 0; port < I2C_SCAN_MAX_PORTS; port++)
+    {
+        memset(&results[port], 0, sizeof(results[port]));
+        i2c_master_bus_handle_t bus_handle = NULL;
+        if (i2c_master_get_bus_handle(port, &bus_handle) != ESP_OK || bus_handle == NULL)
+        {
+            continue; // port not in use
+        }
+        jobs[port].bus_handle = bus_handle;
+        jobs[port].config = config;
+        jobs[port].result = &results[port];
+        if (local_port < 0)
+        {
+            local_port = port; // the first bus is scanned by the caller itself
+            continue;
+        }
+        jobs[port].done = xSemaphoreCreateBinaryStatic(&done_buf[port]);
+        if (xTaskCreate(scan_task, "i2c_scan", 3072, &jobs[port], uxTaskPriorityGet(NULL), NULL) != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to start scan task for port %d", port);
+            vSemaphoreDelete(jobs[port].done);
+            jobs[port].done = NULL;
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (local_port >= 0)
+    {
+        i2c_scan_bus(jobs[local_port].bus_handle, config, &results[local_port]);
+    }
+
+    for (int port = 0; port < I2C_SCAN_MAX_PORTS; port++)
+    {
+        if (jobs[port].done)
+        {
+            xSemaphoreTake(jobs[port].done, portMAX_DELAY);
+            vSemaphoreDelete(jobs[port].done);
+        }
+    }
+    return err;
+}
+
+bool i2c_scan_get_cached(i2c_master_bus_handle_t bus_handle, uint32_t max_age_ms, i2c_scan_result_t *result)
+{
+    bool found = false;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_cache_mux);
+    for (int i = 0; i < I2C_SCAN_CACHE_SLOTS; i++)
+    {
+        const i2c_scan_result_t *c = &s_cache[i];
+        if (c->bus_handle == bus_handle && c->bus_handle != NULL &&
+            c->generation == i2c_bus_generation() &&
+            (now - c->timestamp_us) <= (int64_t)max_age_ms * 1000)
+        {
+            *result = *c;
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_cache_mux);
+    return found;
+}
+
+void i2c_scan_invalidate(void)
+{
+    portENTER_CRITICAL(&s_cache_mux);
+    memset(s_cache, 0, sizeof(s_cache));
+    portEXIT_CRITICAL(&s_cache_mux);
+}
+
+void i2c_scan_print(const i2c_scan_result_t *result)
+{
+    // header + 8 rows of "xx: " + 16 * "xx " + "\r\n"
+    char buf[64 + 8 * (4 + 16 * 3 + 2) + 1];
+    char *p = buf;
+
+    p += sprintf(p, "     0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f\r\n");
+    for (int row = 0; row < 128; row += 16)
+    {
+        p += sprintf(p, "%02x: ", row);
+        for (int col = 0; col < 16; col++)
+        {
+            uint8_t addr = row + col;
+            if (i2c_scan_bit(result->present, addr))
+            {
+                p += sprintf(p, "%02x ", addr);
+            }
+            else if (i2c_scan_bit(result->busy, addr) || (result->stuck && !i2c_scan_bit(result->probed, addr)))
+            {
+                p = stpcpy(p, "UU ");
+            }
+            else if (i2c_scan_bit(result->probed, addr))
+            {
+                p = stpcpy(p, "-- ");
+            }
+            else
+            {
+                p = stpcpy(p, "   "); // not probed (reserved or outside range)
+            }
+        }
+        p = stpcpy(p, "\r\n");
+    }
+    fputs(buf, stdout);
+}
@@ -0,0 +1,110 @@
+// i2c_scan.h
+// Fast I2C bus scanner with result cache (used by i2cdetect and the boot inventory)
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+#define I2C_SCAN_DEFAULT_TIMEOUT_MS (10)  // Probe timeout, a present device answers in well under 1 ms
+#define I2C_SCAN_DEFAULT_MAX_TIMEOUTS (4) // Consecutive bus timeouts before the bus is declared stuck
+#define I2C_SCAN_CACHE_MAX_AGE_MS (5000)  // Default age limit when reusing a cached result
+#define I2C_SCAN_MAX_PORTS (2)            // HP I2C ports of the ESP32-P4
+
+    // Scan parameters
+    typedef struct
+    {
+        int probe_timeout_ms;  // Timeout of one probe
+        uint8_t first_addr;    // First address to probe
+        uint8_t last_addr;     // Last address to probe (inclusive, max 0x7f)
+        bool include_reserved; // Also probe 0x00-0x07 and 0x78-0x7f
+        int max_timeouts;      // Stop after this many consecutive timeouts, 0 = never stop
+    } i2c_scan_config_t;
+
+#define I2C_SCAN_CONFIG_DEFAULT()                         \
+    {                                                     \
+        .probe_timeout_ms = I2C_SCAN_DEFAULT_TIMEOUT_MS,  \
+        .first_addr = 0x00,                               \
+        .last_addr = 0x7f,                                \
+        .include_reserved = false,                        \
+        .max_timeouts = I2C_SCAN_DEFAULT_MAX_TIMEOUTS,    \
+    }
+
+    // Result of one scan, one bit per 7-bit address
+    typedef struct
+    {
+        i2c_master_bus_handle_t bus_handle; // Bus that was scanned
+        uint32_t present[4];                // Device acknowledged
+        uint32_t busy[4];                   // Probe timed out (bus busy or stuck)
+        uint32_t probed[4];                 // Address was probed at all
+        int64_t timestamp_us;               // esp_timer time at the end of the scan
+        uint32_t duration_us;               // Time the scan took
+        uint32_t generation;                // Registry generation at scan time (i2c_bus_generation)
+        bool stuck;                         // Scan aborted after max_timeouts
+    } i2c_scan_result_t;
+
+    static inline bool i2c_scan_bit(const uint32_t *map, uint8_t addr)
+    {
+        return (map[addr >> 5] >> (addr & 31)) & 1;
+    }
+
+    /**
+     * @brief Probe a range of addresses on one bus and store the result in the cache.
+     *
+     * Works on synchronous and asynchronous buses (i2c_async_probe). The probes run as one job
+     * on the scheduler lane of the port (i2c_sched_run, normal priority) and their results
+     * feed the bus health monitor, like any other transfer. Urgent transactions wait for it.
+     * result->bus_handle is the bus that was scanned, the current one of the port when a
+     * recovery replaced bus_handle meanwhile.
+     *
+     * @param bus_handle Bus to scan.
+     * @param config     Scan parameters, NULL for defaults.
+     * @param result     Output bitmap.
+     * @return ESP_OK (also when the bus is stuck, see result->stuck), ESP_ERR_INVALID_ARG,
+     *         ESP_ERR_INVALID_STATE when the bus was deleted before the scan started.
+     */
+    esp_err_t i2c_scan_bus(i2c_master_bus_handle_t bus_handle, const i2c_scan_config_t *config, i2c_scan_result_t *result);
+
+    /**
+     * @brief Scan the HP I2C ports in parallel, one task per port.
+     *
+     * Ports that have no master bus installed are skipped (their result has bus_handle NULL).
+     * An asynchronous bus is scanned too, see i2c_async_probe().
+     *
+     * @param config  Scan parameters, NULL for defaults.
+     * @param results Array of I2C_SCAN_MAX_PORTS results, indexed by port number.
+     * @return ESP_OK, or ESP_ERR_NO_MEM when a scan task could not be started.
+     */
+    esp_err_t i2c_scan_all_ports(const i2c_scan_config_t *config, i2c_scan_result_t results[I2C_SCAN_MAX_PORTS]);
+
+    /**
+     * @brief Get the last scan result of a bus if it is recent enough.
+     *
+     * @param bus_handle Bus of interest.
+     * @param max_age_ms Maximum age of the result.
+     * @param result     Output copy of the cached result.
+     * @return true when a valid result was copied.
+     */
+    bool i2c_scan_get_cached(i2c_master_bus_handle_t bus_handle, uint32_t max_age_ms, i2c_scan_result_t *result);
+
+    /**
+     * @brief Drop all cached scan results (e.g. after re-wiring).
+     */
+    void i2c_scan_invalidate(void);
+
+    /**
+     * @brief Print the i2cdetect table of a result in one write.
+     */
+    void i2c_scan_print(const i2c_scan_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,521 @@
+/**
+ * @file i2c_sched.c
+ * @brief Priority-aware I2C transaction scheduler.
+ *
+ * One task per I2C port (a lane) owns the bus traffic of all drivers on that bus, so
+ * devices on different controllers run in parallel. Callers submit a transaction with a
+ * priority and an optional deadline and block until it is done. The task always serves
+ * the most urgent queue first, and within a queue the earliest deadline. Large bulk
+ * writes (display flushes) are sent one chunk at a time, so a DAC or relay write waits
+ * for at most one chunk instead of a full 1 KB frame.
+ *
+ * Requests live on the stack of the submitting task, nothing is allocated per call.
+ *
+ * A lane can have a standby function (the failsafe writes) that is fired without waiting,
+ * also from an interrupt. The lane runs it before its next pick, and held device addresses
+ * refuse every other transfer until they are released.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_sched.h"
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_bus.h"
+#include "i2c_stats.h"
+#include "i2c_recover.h"
+#include "i2c_async.h"
+#include "i2c_capture.h"
+
+static const char *TAG = "i2c_sched";
+
+typedef struct i2c_sched_req
+{
+    struct i2c_sched_req *next;
+    i2c_sched_txn_t txn;
+    size_t offset;       // Progress of a split write
+    int64_t submit_us;   // Time of submit
+    uint32_t generation; // Registry generation at submit
+    bool started;        // First bus access done
+    esp_err_t result;
+    SemaphoreHandle_t done;
+} i2c_sched_req_t;
+
+// One lane per I2C port
+typedef struct
+{
+    i2c_sched_req_t *queue[I2C_SCHED_PRIO_MAX]; // Singly linked, in submit order
+    i2c_sched_stats_t stats[I2C_SCHED_PRIO_MAX];
+    TaskHandle_t task;
+    esp_err_t (*standby)(void *arg);
+    void *standby_arg;
+    volatile bool standby_fired;
+    bool in_standby;  // The lane runs the standby function
+    uint32_t held[4]; // Bit per 7-bit address
+} i2c_sched_lane_t;
+
+static i2c_sched_lane_t s_lanes[I2C_BUS_MAX_PORTS];
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool s_started = false;
+static volatile i2c_sched_write_tap_t s_write_tap;
+
+// Every bus access of the drivers and console tools passes here: record it
+static void sched_record(const i2c_sched_txn_t *t, int port, size_t bytes, esp_err_t ret, int64_t start_us)
+{
+    int addr = i2c_bus_device_address(t->dev_handle);
+    if (addr >= 0)
+    {
+        i2c_stats_record(port, (uint8_t)addr, bytes, ret, (uint32_t)(esp_timer_get_time() - start_us));
+    }
+    i2c_recover_note_result(port, ret);
+}
+
+// One bus transfer; on an asynchronous port it is queued and this lane waits for the interrupt.
+// That wait may eat a submit notification, harmless: the lane always picks before it sleeps.
+static esp_err_t sched_bus_xfer(int port, i2c_master_dev_handle_t dev_handle, const uint8_t *write_buf,
+                                size_t write_len, uint8_t *read_buf, size_t read_len, int timeout_ms)
+{
+    if (i2c_async_port_is_async(port))
+    {
+        return i2c_async_transfer(dev_handle, write_buf, write_len, read_buf, read_len, timeout_ms);
+    }
+    if (read_len && write_len)
+    {
+        return i2c_master_transmit_receive(dev_handle, write_buf, write_len, read_buf, read_len, timeout_ms);
+    }
+    if (read_len)
+    {
+        return i2c_master_receive(dev_handle, read_buf, read_len, timeout_ms);
+    }
+    return i2c_master_transmit(dev_handle, write_buf, write_len, timeout_ms);
+}
+
+static esp_err_t sched_xfer(int port, i2c_master_dev_handle_t dev_handle, const uint8_t *write_buf, size_t write_len,
+                            uint8_t *read_buf, size_t read_len, int timeout_ms)
+{
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = sched_bus_xfer(port, dev_handle, write_buf, write_len, read_buf, read_len, timeout_ms);
+    i2c_capture_record(port, dev_handle, write_buf, write_len, read_buf, read_len, ret, start_us, 0);
+    i2c_sched_write_tap_t tap = s_write_tap;
+    if (tap && ret == ESP_OK && write_len > 1 && read_len == 0)
+    {
+        int addr = i2c_bus_device_address(dev_handle);
+        if (addr >= 0)
+        {
+            tap(port, (uint16_t)addr, write_buf, write_len, s_lanes[port].in_standby, esp_timer_get_time());
+        }
+    }
+    return ret;
+}
+
+static bool sched_held(const i2c_sched_lane_t *lane, int addr)
+{
+    return addr >= 0 && addr < 128 && (lane->held[addr >> 5] & (1u << (addr & 31))) != 0;
+}
+
+// Run one bus transaction of a request: the whole request, or one chunk of a split write
+static esp_err_t sched_step(i2c_sched_req_t *req, int port, bool *finished)
+{
+    const i2c_sched_txn_t *t = &req->txn;
+    esp_err_t ret;
+    int64_t start_us = esp_timer_get_time();
+
+    if (t->exec)
+    {
+        *finished = true;
+        return t->exec(t->exec_arg);
+    }
+    const i2c_sched_lane_t *lane = &s_lanes[port];
+    if ((lane->held[0] | lane->held[1] | lane->held[2] | lane->held[3]) && !lane->in_standby &&
+        sched_held(lane, i2c_bus_device_address(t->dev_handle)))
+    {
+        // the failsafe owns this device, also for requests queued before it fired
+        *finished = true;
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (req->generation != i2c_bus_generation() && i2c_bus_device_address(t->dev_handle) < 0)
+    {
+        // the bus was rebuilt while this request was queued, its handle is gone
+        *finished = true;
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (t->chunk_size == 0)
+    {
+        ret = sched_xfer(port, t->dev_handle, t->write_buf, t->write_len, t->read_buf, t->read_len, t->timeout_ms);
+        sched_record(t, port, t->write_len + t->read_len, ret, start_us);
+        *finished = true;
+        return ret;
+    }
+
+    uint8_t buf[I2C_SCHED_MAX_CHUNK + 1];
+    size_t n = t->write_len - req->offset;
+    if (n > t->chunk_size)
+    {
+        n = t->chunk_size;
+    }
+    buf[0] = t->chunk_prefix;
+    memcpy(buf + 1, t->write_buf + req->offset, n);
+    ret = sched_xfer(port, t->dev_handle, buf, n + 1, NULL, 0, t->timeout_ms);
+    sched_record(t, port, n + 1, ret, start_us);
+    req->offset += n;
+    *finished = (ret != ESP_OK) || (req->offset >= t->write_len);
+    return ret;
+}
+
+// Execute a request completely in the calling task (scheduler not running)
+static esp_err_t sched_run_direct(i2c_sched_req_t *req, int port)
+{
+    bool finished = false;
+    esp_err_t ret = ESP_OK;
+    while (!finished)
+    {
+        ret = sched_step(req, port, &finished);
+    }
+    return ret;
+}
+
+// Pick the next request: most urgent queue first, earliest deadline within the queue
+static i2c_sched_req_t *sched_pick(i2c_sched_lane_t *lane, i2c_sched_prio_t *prio)
+{
+    i2c_sched_req_t *best = NULL;
+
+    portENTER_CRITICAL(&s_mux);
+    for (int p = 0; p < I2C_SCHED_PRIO_MAX && best == NULL; p++)
+    {
+        for (i2c_sched_req_t *r = lane->queue[p]; r != NULL; r = r->next)
+        {
+            if (best == NULL)
+            {
+                best = r;
+            }
+            else if (r->txn.deadline_us != 0 &&
+                     (best->txn.deadline_us == 0 || r->txn.deadline_us < best->txn.deadline_us))
+            {
+                best = r;
+            }
+        }
+        *prio = p;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return best;
+}
+
+static void sched_remove(i2c_sched_lane_t *lane, i2c_sched_req_t *req, i2c_sched_prio_t prio)
+{
+    portENTER_CRITICAL(&s_mux);
+    for (i2c_sched_req_t **pp = &lane->queue[prio]; *pp != NULL; pp = &(*pp)->next)
+    {
+        if (*pp == req)
+        {
+            *pp = req->next;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+static bool sched_more_urgent_waiting(i2c_sched_lane_t *lane, i2c_sched_prio_t prio)
+{
+    bool waiting = false;
+    portENTER_CRITICAL(&s_mux);
+    for (int p = 0; p < prio; p++)
+    {
+        waiting |= (lane->queue[p] != NULL);
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return waiting;
+}
+
+static void sched_task(void *arg)
+{
+    int port = (int)(intptr_t)arg;
+    i2c_sched_lane_t *lane = &s_lanes[port];
+
+    for (;;)
+    {
+        if (lane->standby_fired)
+        {
+            portENTER_CRITICAL(&s_mux);
+            esp_err_t (*standby)(void *arg) = lane->standby;
+            void *standby_arg = lane->standby_arg;
+            lane->standby_fired = false;
+            portEXIT_CRITICAL(&s_mux);
+            if (standby)
+            {
+                lane->in_standby = true;
+                standby(standby_arg);
+                lane->in_standby = false;
+            }
+        }
+
+        i2c_sched_prio_t prio;
+        i2c_sched_req_t *req = sched_pick(lane, &prio);
+        if (req == NULL)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // sleep until the next submit
+            continue;
+        }
+
+        int64_t now = esp_timer_get_time();
+        i2c_sched_stats_t *st = &lane->stats[prio];
+        bool finished = true;
+
+        if (!req->started)
+        {
+            if (req->txn.deadline_us != 0 && now > req->txn.deadline_us)
+            {
+                // too late, do not occupy the bus for a stale setpoint
+                st->deadline_misses++;
+                sched_remove(lane, req, prio);
+                req->result = ESP_ERR_TIMEOUT;
+                xSemaphoreGive(req->done);
+                continue;
+            }
+            uint32_t wait_us = (uint32_t)(now - req->submit_us);
+            st->wait_total_us += wait_us;
+            if (wait_us > st->wait_max_us)
+            {
+                st->wait_max_us = wait_us;
+            }
+            req->started = true;
+        }
+
+        req->result = sched_step(req, port, &finished);
+        st->chunks++;
+
+        if (finished)
+        {
+            st->transactions++;
+            sched_remove(lane, req, prio);
+            xSemaphoreGive(req->done);
+        }
+        else if (sched_more_urgent_waiting(lane, prio))
+        {
+            st->preemptions++; // next pick serves the urgent one, then we continue here
+        }
+    }
+}
+
+esp_err_t i2c_sched_start(int task_priority)
+{
+    if (s_started)
+    {
+        return ESP_OK;
+    }
+    for (int port = 0; port < I2C_BUS_MAX_PORTS; port++)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "i2c_sched%d", port);
+        if (xTaskCreate(sched_task, name, 4096, (void *)(intptr_t)port, task_priority, &s_lanes[port].task) != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to create scheduler task for port %d", port);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    s_started = true;
+    ESP_LOGI(TAG, "I2C scheduler started, %d lanes, priority %d", I2C_BUS_MAX_PORTS, task_priority);
+    return ESP_OK;
+}
+
+esp_err_t i2c_sched_submit(const i2c_sched_txn_t *txn)
+{
+    if (!txn || (!txn->dev_handle && !txn->exec) || txn->prio >= I2C_SCHED_PRIO_MAX || txn->chunk_size > I2C_SCHED_MAX_CHUNK)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (txn->chunk_size && txn->read_len)
+    {
+        return ESP_ERR_INVALID_ARG; // only writes can be split
+    }
+
+    int port = txn->exec ? txn->port : i2c_bus_device_port(txn->dev_handle);
+    if (port < 0 || port >= I2C_BUS_MAX_PORTS)
+    {
+        port = 0; // handle from outside the registry, serialise it with port 0
+    }
+
+    i2c_sched_req_t req = {
+        .next = NULL,
+        .txn = *txn,
+        .offset = 0,
+        .submit_us = esp_timer_get_time(),
+        .generation = i2c_bus_generation(),
+        .started = false,
+        .result = ESP_OK,
+    };
+
+    i2c_sched_lane_t *lane = &s_lanes[port];
+    if (!s_started || xTaskGetCurrentTaskHandle() == lane->task)
+    {
+        return sched_run_direct(&req, port);
+    }
+
+    StaticSemaphore_t done_buf;
+    req.done = xSemaphoreCreateBinaryStatic(&done_buf);
+
+    portENTER_CRITICAL(&s_mux);
+    i2c_sched_req_t **pp = &lane->queue[txn->prio];
+    while (*pp != NULL)
+    {
+        pp = &(*pp)->next;
+    }
+    *pp = &req;
+    portEXIT_CRITICAL(&s_mux);
+
+    xTaskNotifyGive(lane->task);
+    xSemaphoreTake(req.done, portMAX_DELAY);
+    vSemaphoreDelete(req.done);
+    return req.result;
+}
+
+esp_err_t i2c_sched_transmit(i2c_master_dev_handle_t dev_handle, i2c_sched_prio_t prio,
+                             const uint8_t *data, size_t len, int timeout_ms)
+{
+    i2c_sched_txn_t txn = {
+        .dev_handle = dev_handle,
+        .prio = prio,
+        .write_buf = data,
+        .write_len = len,
+        .timeout_ms = timeout_ms,
+    };
+    return i2c_sched_submit(&txn);
+}
+
+esp_err_t i2c_sched_transmit_receive(i2c_master_dev_handle_t dev_handle, i2c_sched_prio_t prio,
+                                     const uint8_t *write_buf, size_t write_len,
+                                     uint8_t *read_buf, size_t read_len, int timeout_ms)
+{
+    i2c_sched_txn_t txn = {
+        .dev_handle = dev_handle,
+        .prio = prio,
+        .write_buf = write_buf,
+        .write_len = write_len,
+        .read_buf = read_buf,
+        .read_len = read_len,
+        .timeout_ms = timeout_ms,
+    };
+    return i2c_sched_submit(&txn);
+}
+
+esp_err_t i2c_sched_run(int port, i2c_sched_prio_t prio, esp_err_t (*fn)(void *arg), void *arg)
+{
+    i2c_sched_txn_t txn = {
+        .port = port,
+        .prio = prio,
+        .exec = fn,
+        .exec_arg = arg,
+    };
+    return i2c_sched_submit(&txn);
+}
+
+esp_err_t i2c_sched_set_standby(int port, esp_err_t (*fn)(void *arg), void *arg)
+{
+    if (port < 0 || port >= I2C_BUS_MAX_PORTS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_started)
+    {
+        return ESP_ERR_INVALID_STATE; // nothing to run it on
+    }
+    portENTER_CRITICAL(&s_mux);
+    s_lanes[port].standby = fn;
+    s_lanes[port].standby_arg = arg;
+    s_lanes[port].standby_fired = false;
+    portEXIT_CRITICAL(&s_mux);
+    return ESP_OK;
+}
+
+esp_err_t i2c_sched_fire_standby(int port)
+{
+    if (port < 0 || port >= I2C_BUS_MAX_PORTS || !s_started || !s_lanes[port].standby)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_lanes[port].standby_fired = true;
+    xTaskNotifyGive(s_lanes[port].task);
+    return ESP_OK;
+}
+
+bool IRAM_ATTR i2c_sched_fire_standby_from_isr(int port)
+{
+    BaseType_t woken = pdFALSE;
+    if (port < 0 || port >= I2C_BUS_MAX_PORTS || !s_started || !s_lanes[port].standby)
+    {
+        return false;
+    }
+    s_lanes[port].standby_fired = true;
+    vTaskNotifyGiveFromISR(s_lanes[port].task, &woken);
+    return woken == pdTRUE;
+}
+
+esp_err_t i2c_sched_hold(int port, uint16_t device_address, bool hold)
+{
+    if (port < 0 || port >= I2C_BUS_MAX_PORTS || device_address >= 128)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t bit = 1u << (device_address & 31);
+    portENTER_CRITICAL(&s_mux);
+    if (hold)
+    {
+        s_lanes[port].held[device_address >> 5] |= bit;
+    }
+    else
+    {
+        s_lanes[port].held[device_address >> 5] &= ~bit;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return ESP_OK;
+}
+
+bool i2c_sched_is_held(int port, uint16_t device_address)
+{
+    if (port < 0 || port >= I2C_BUS_MAX_PORTS)
+    {
+        return false;
+    }
+    return sched_held(&s_lanes[port], device_address);
+}
+
+void i2c_sched_set_write_tap(i2c_sched_write_tap_t tap)
+{
+    s_write_tap = tap;
+}
+
+void i2c_sched_get_stats(i2c_sched_prio_t prio, i2c_sched_stats_t *stats, bool reset)
+{
+    if (prio >= I2C_SCHED_PRIO_MAX || !stats)
+    {
+        return;
+    }
+    // sum of all lanes
+    memset(stats, 0, sizeof(*stats));
+    portENTER_CRITICAL(&s_mux);
+    for (int port = 0; port < I2C_BUS_MAX_PORTS; port++)
+    {
+        i2c_sched_stats_t *st = &s_lanes[port].stats[prio];
+        stats->transactions += st->transactions;
+        stats->chunks += st->chunks;
+        stats->preemptions += st->preemptions;
+        stats->deadline_misses += st->deadline_misses;
+        stats->wait_total_us += st->wait_total_us;
+        if (st->wait_max_us > stats->wait_max_us)
+        {
+            stats->wait_max_us = st->wait_max_us;
+        }
+        if (reset)
+        {
+            memset(st, 0, sizeof(*st));
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
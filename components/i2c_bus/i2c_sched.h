@@ -0,0 +1,154 @@
+// i2c_sched.h
+// Priority-aware I2C transaction scheduler shared by all drivers
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+#define I2C_SCHED_MAX_CHUNK (64) // Largest chunk of a split transfer (excluding the prefix byte)
+
+    // Transaction priorities, lower value is served first
+    typedef enum
+    {
+        I2C_SCHED_PRIO_URGENT = 0, // Actuators: DAC setpoints, relays
+        I2C_SCHED_PRIO_NORMAL,     // Console tools, register reads
+        I2C_SCHED_PRIO_BULK,       // Large transfers such as display flushes, split in chunks
+        I2C_SCHED_PRIO_MAX
+    } i2c_sched_prio_t;
+
+    // One transaction as submitted by a driver
+    typedef struct
+    {
+        i2c_master_dev_handle_t dev_handle; // Device from the registry (i2c_bus_get_device)
+        i2c_sched_prio_t prio;              // Queue to use
+        int64_t deadline_us;                // Absolute esp_timer time, 0 = no deadline
+        const uint8_t *write_buf;           // Data to write (may be NULL)
+        size_t write_len;
+        uint8_t *read_buf; // Data to read after the write (may be NULL)
+        size_t read_len;
+        int timeout_ms;       // Timeout per bus transaction
+        size_t chunk_size;    // Split the write in chunks of this size, 0 = do not split
+        uint8_t chunk_prefix; // Byte sent in front of every chunk (e.g. 0x40 for SSD1306 data)
+        esp_err_t (*exec)(void *arg); // Instead of a transfer: run this with the bus to itself
+        void *exec_arg;
+        int port; // Lane of an exec, transfers use the port of dev_handle
+    } i2c_sched_txn_t;
+
+    // Queueing statistics of one priority level
+    typedef struct
+    {
+        uint32_t transactions;    // Completed transactions
+        uint32_t chunks;          // Bus transactions used (more than transactions when split)
+        uint32_t preemptions;     // Split transfers interrupted by a more urgent transaction
+        uint32_t deadline_misses; // Dropped because the deadline passed while queued
+        uint64_t wait_total_us;   // Sum of time between submit and first bus access
+        uint32_t wait_max_us;     // Worst case of the above
+    } i2c_sched_stats_t;
+
+    /**
+     * @brief Start one scheduler task per I2C port. Before this call transactions run directly
+     * in the caller.
+     *
+     * @param task_priority FreeRTOS priority of the scheduler task.
+     * @return ESP_OK, or ESP_ERR_NO_MEM when the task could not be created.
+     */
+    esp_err_t i2c_sched_start(int task_priority);
+
+    /**
+     * @brief Submit a transaction and wait until it is done.
+     *
+     * @param txn Transaction description, only needs to be valid during the call.
+     * @return Result of the bus transaction, ESP_ERR_TIMEOUT when the deadline was missed.
+     */
+    esp_err_t i2c_sched_submit(const i2c_sched_txn_t *txn);
+
+    /**
+     * @brief Shorthand for a plain write without deadline.
+     */
+    esp_err_t i2c_sched_transmit(i2c_master_dev_handle_t dev_handle, i2c_sched_prio_t prio,
+                                 const uint8_t *data, size_t len, int timeout_ms);
+
+    /**
+     * @brief Shorthand for a write followed by a read (repeated start), without deadline.
+     */
+    esp_err_t i2c_sched_transmit_receive(i2c_master_dev_handle_t dev_handle, i2c_sched_prio_t prio,
+                                         const uint8_t *write_buf, size_t write_len,
+                                         uint8_t *read_buf, size_t read_len, int timeout_ms);
+
+    /**
+     * @brief Run a function on the scheduler task, between two bus transactions.
+     *
+     * Nothing else touches the bus while it runs, used for bus recovery and health checks.
+     * Transactions submitted from inside the function run directly.
+     */
+    esp_err_t i2c_sched_run(int port, i2c_sched_prio_t prio, esp_err_t (*fn)(void *arg), void *arg);
+
+    /**
+     * @brief Prepare a standby function for a port, to be fired later without waiting.
+     *
+     * Used for the failsafe: the writes that make the machine safe are set up ahead of time,
+     * so firing them is one flag and a notification. A fired standby runs on the scheduler
+     * task before anything queued, including urgent transactions; it waits only for the
+     * transaction (or the chunk of a split write) that is on the bus.
+     *
+     * @param fn  NULL removes the standby.
+     * @return ESP_OK, ESP_ERR_INVALID_STATE when the scheduler does not run.
+     */
+    esp_err_t i2c_sched_set_standby(int port, esp_err_t (*fn)(void *arg), void *arg);
+
+    /**
+     * @brief Fire the standby of a port. Does not wait for it.
+     */
+    esp_err_t i2c_sched_fire_standby(int port);
+
+    /**
+     * @brief Fire the standby of a port from an interrupt.
+     *
+     * @return true when a higher priority task was woken (for portYIELD_FROM_ISR).
+     */
+    bool i2c_sched_fire_standby_from_isr(int port);
+
+    /**
+     * @brief Hold (or release) a device: transfers to it fail with ESP_ERR_INVALID_STATE,
+     * also those queued before the hold, except the ones of the standby function.
+     *
+     * Keeps a device in the state the standby put it in until the hold is released.
+     */
+    esp_err_t i2c_sched_hold(int port, uint16_t device_address, bool hold);
+
+    bool i2c_sched_is_held(int port, uint16_t device_address);
+
+    /**
+     * @brief Observer of the writes that reached a device.
+     *
+     * Called on the scheduler task after every successful transfer that only writes (a
+     * register address and data), so also for the writes of a standby function. Must be
+     * short: the bus waits for it.
+     *
+     * @param standby The write came from the standby function (the failsafe).
+     * @param t_us    esp_timer time the transfer completed.
+     */
+    typedef void (*i2c_sched_write_tap_t)(int port, uint16_t device_address, const uint8_t *data, size_t len,
+                                          bool standby, int64_t t_us);
+
+    // One tap at a time, NULL removes it
+    void i2c_sched_set_write_tap(i2c_sched_write_tap_t tap);
+
+    /**
+     * @brief Copy the statistics of one priority level (all ports), optionally clear them.
+     */
+    void i2c_sched_get_stats(i2c_sched_prio_t prio, i2c_sched_stats_t *stats, bool reset);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,242 @@
+/**
+ * @file i2c_stats.c
+ * @brief Low-overhead I2C instrumentation.
+ *
+ * Every transaction that passes the bus scheduler is recorded here: per (port, address)
+ * counters, a log2 latency histogram and the bus time, and per port a sliding window for
+ * the utilisation. All counters are relaxed 32-bit atomics, so recording never blocks and
+ * costs a handful of instructions. Device slots are claimed on first use with a
+ * compare-and-swap.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_stats.h"
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_timer.h"
+
+typedef struct
+{
+    atomic_uint transactions;
+    atomic_uint bytes;
+    atomic_uint nacks;
+    atomic_uint timeouts;
+    atomic_uint errors;
+    atomic_uint busy_us;
+    atomic_uint hist[I2C_STATS_HIST_BUCKETS];
+} dev_counters_t;
+
+static atomic_uchar s_slot_of[I2C_STATS_MAX_PORTS][128]; // (port, address) -> slot + 1, 0 = not tracked yet
+static atomic_uchar s_slot_port[I2C_STATS_MAX_DEVICES];
+static atomic_uchar s_slot_addr[I2C_STATS_MAX_DEVICES];
+static atomic_uint s_slots_used;
+static dev_counters_t s_dev[I2C_STATS_MAX_DEVICES];
+
+// sliding window of bus time per port, one slot per I2C_STATS_SLOT_US
+static atomic_uint s_window_busy[I2C_STATS_MAX_PORTS][I2C_STATS_WINDOW_SLOTS];
+static atomic_uint s_window_epoch[I2C_STATS_MAX_PORTS][I2C_STATS_WINDOW_SLOTS];
+
+#define ADD(counter, value) atomic_fetch_add_explicit(&(counter), (value), memory_order_relaxed)
+#define LOAD(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+
+static dev_counters_t *get_slot(int port, uint8_t addr)
+{
+    addr &= 0x7f;
+    unsigned slot = LOAD(s_slot_of[port][addr]);
+    if (slot)
+    {
+        return &s_dev[slot - 1];
+    }
+
+    // claim a new slot; two tasks racing for the same device may both claim one,
+    // the loser's slot is simply left unused
+    unsigned idx = ADD(s_slots_used, 1);
+    if (idx >= I2C_STATS_MAX_DEVICES)
+    {
+        return NULL; // table full, address is not tracked
+    }
+    atomic_store_explicit(&s_slot_port[idx], (unsigned char)port, memory_order_relaxed);
+    atomic_store_explicit(&s_slot_addr[idx], addr, memory_order_relaxed);
+    unsigned char expected = 0;
+    if (!atomic_compare_exchange_strong(&s_slot_of[port][addr], &expected, (unsigned char)(idx + 1)))
+    {
+        atomic_store_explicit(&s_slot_addr[idx], 0xff, memory_order_relaxed);
+        return &s_dev[expected - 1];
+    }
+    return &s_dev[idx];
+}
+
+static int latency_bucket(uint32_t us)
+{
+    // [0] < 2 us, [1] < 4 us, ... [15] >= 32768 us
+    int bucket = (us < 2) ? 0 : (31 - __builtin_clz(us));
+    return (bucket >= I2C_STATS_HIST_BUCKETS) ? I2C_STATS_HIST_BUCKETS - 1 : bucket;
+}
+
+void i2c_stats_record(int port, uint8_t device_address, size_t bytes, esp_err_t result, uint32_t duration_us)
+{
+    if (port < 0 || port >= I2C_STATS_MAX_PORTS)
+    {
+        return;
+    }
+    dev_counters_t *d = get_slot(port, device_address);
+    if (d)
+    {
+        ADD(d->transactions, 1);
+        ADD(d->bytes, (unsigned)bytes);
+        ADD(d->busy_us, duration_us);
+        ADD(d->hist[latency_bucket(duration_us)], 1);
+        if (result == ESP_ERR_TIMEOUT)
+        {
+            ADD(d->timeouts, 1);
+        }
+        else if (result == ESP_ERR_INVALID_RESPONSE || result == ESP_ERR_INVALID_STATE || result == ESP_ERR_NOT_FOUND)
+        {
+            ADD(d->nacks, 1); // the i2c_master driver reports a NACK with one of these
+        }
+        else if (result != ESP_OK)
+        {
+            ADD(d->errors, 1);
+        }
+    }
+
+    uint32_t epoch = (uint32_t)(esp_timer_get_time() / I2C_STATS_SLOT_US);
+    int w = epoch % I2C_STATS_WINDOW_SLOTS;
+    unsigned old_epoch = LOAD(s_window_epoch[port][w]);
+    if (old_epoch != epoch &&
+        atomic_compare_exchange_strong(&s_window_epoch[port][w], &old_epoch, epoch))
+    {
+        atomic_store_explicit(&s_window_busy[port][w], 0, memory_order_relaxed); // slot reused for a new period
+    }
+    ADD(s_window_busy[port][w], duration_us);
+}
+
+int i2c_stats_get_all(i2c_stats_dev_t *out)
+{
+    unsigned used = LOAD(s_slots_used);
+    int n = 0;
+    if (used > I2C_STATS_MAX_DEVICES)
+    {
+        used = I2C_STATS_MAX_DEVICES;
+    }
+    for (unsigned i = 0; i < used; i++)
+    {
+        unsigned char addr = LOAD(s_slot_addr[i]);
+        if (addr > 0x7f)
+        {
+            continue; // lost a claim race
+        }
+        dev_counters_t *d = &s_dev[i];
+        i2c_stats_dev_t *o = &out[n++];
+        o->port = LOAD(s_slot_port[i]);
+        o->device_address = addr;
+        o->transactions = LOAD(d->transactions);
+        o->bytes = LOAD(d->bytes);
+        o->nacks = LOAD(d->nacks);
+        o->timeouts = LOAD(d->timeouts);
+        o->errors = LOAD(d->errors);
+        o->busy_us = LOAD(d->busy_us);
+        for (int b = 0; b < I2C_STATS_HIST_BUCKETS; b++)
+        {
+            o->hist[b] = LOAD(d->hist[b]);
+        }
+    }
+    return n;
+}
+
+uint32_t i2c_stats_utilisation_permille(int port)
+{
+    if (port < 0 || port >= I2C_STATS_MAX_PORTS)
+    {
+        return 0;
+    }
+    uint32_t epoch = (uint32_t)(esp_timer_get_time() / I2C_STATS_SLOT_US);
+    uint64_t busy = 0;
+    for (int w = 0; w < I2C_STATS_WINDOW_SLOTS; w++)
+    {
+        uint32_t e = LOAD(s_window_epoch[port][w]);
+        if (epoch - e < I2C_STATS_WINDOW_SLOTS)
+        {
+            busy += LOAD(s_window_busy[port][w]);
+        }
+    }
+    return (uint32_t)(busy * 1000 / ((uint64_t)I2C_STATS_WINDOW_SLOTS * I2C_STATS_SLOT_US));
+}
+
+void i2c_stats_reset(void)
+{
+    // counters only, the device to slot mapping stays
+    for (int i = 0; i < I2C_STATS_MAX_DEVICES; i++)
+    {
+        dev_counters_t *d = &s_dev[i];
+        atomic_store(&d->transactions, 0);
+        atomic_store(&d->bytes, 0);
+        atomic_store(&d->nacks, 0);
+        atomic_store(&d->timeouts, 0);
+        atomic_store(&d->errors, 0);
+        atomic_store(&d->busy_us, 0);
+        for (int b = 0; b < I2C_STATS_HIST_BUCKETS; b++)
+        {
+            atomic_store(&d->hist[b], 0);
+        }
+    }
+    for (int port = 0; port < I2C_STATS_MAX_PORTS; port++)
+    {
+        for (int w = 0; w < I2C_STATS_WINDOW_SLOTS; w++)
+        {
+            atomic_store(&s_window_busy[port][w], 0);
+        }
+    }
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+size_t i2c_stats_export(uint8_t *buf, size_t size)
+{
+    static i2c_stats_dev_t devs[I2C_STATS_MAX_DEVICES];
+    int n = i2c_stats_get_all(devs);
+    size_t per_dev = 2 + 4 * (6 + I2C_STATS_HIST_BUCKETS);
+    size_t total = 8 + 2 * I2C_STATS_MAX_PORTS + n * per_dev;
+    if (!buf || size < total)
+    {
+        return 0;
+    }
+
+    uint8_t *p = put_u32(buf, I2C_STATS_EXPORT_MAGIC);
+    *p++ = I2C_STATS_EXPORT_VERSION;
+    *p++ = (uint8_t)n;
+    *p++ = I2C_STATS_HIST_BUCKETS;
+    *p++ = I2C_STATS_MAX_PORTS;
+    for (int port = 0; port < I2C_STATS_MAX_PORTS; port++)
+    {
+        uint32_t util = i2c_stats_utilisation_permille(port);
+        *p++ = (uint8_t)util;
+        *p++ = (uint8_t)(util >> 8);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        const i2c_stats_dev_t *d = &devs[i];
+        *p++ = d->port;
+        *p++ = d->device_address;
+        p = put_u32(p, d->transactions);
+        p = put_u32(p, d->bytes);
+        p = put_u32(p, d->nacks);
+        p = put_u32(p, d->timeouts);
+        p = put_u32(p, d->errors);
+        p = put_u32(p, d->busy_us);
+        for (int b = 0; b < I2C_STATS_HIST_BUCKETS; b++)
+        {
+            p = put_u32(p, d->hist[b]);
+        }
+    }
+    return p - buf;
+}
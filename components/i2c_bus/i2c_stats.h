@@ -0,0 +1,88 @@
+// i2c_stats.h
+// Per-device I2C counters, latency histograms and bus utilisation per port
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+
+#define I2C_STATS_MAX_DEVICES (16)  // (port, address) pairs tracked, first come first served
+#define I2C_STATS_MAX_PORTS (2)     // HP I2C ports of the ESP32-P4
+#define I2C_STATS_HIST_BUCKETS (16) // log2 latency buckets: [0] < 2 us ... [15] >= 32 ms
+#define I2C_STATS_WINDOW_SLOTS (10) // Utilisation window: 10 slots ...
+#define I2C_STATS_SLOT_US (100000)  // ... of 100 ms = 1 s sliding window
+
+#define I2C_STATS_EXPORT_MAGIC (0x53433249) // "I2CS" little endian
+#define I2C_STATS_EXPORT_VERSION (2)
+// Largest export: header, utilisation per port, all devices
+#define I2C_STATS_EXPORT_MAX_SIZE \
+    (8 + 2 * I2C_STATS_MAX_PORTS + I2C_STATS_MAX_DEVICES * (2 + 4 * (6 + I2C_STATS_HIST_BUCKETS)))
+
+    // Snapshot of one device
+    typedef struct
+    {
+        uint8_t port;
+        uint8_t device_address;
+        uint32_t transactions;
+        uint32_t bytes;
+        uint32_t nacks;
+        uint32_t timeouts;
+        uint32_t errors;  // Other failures
+        uint32_t busy_us; // Total bus time (wraps after 71 minutes)
+        uint32_t hist[I2C_STATS_HIST_BUCKETS];
+    } i2c_stats_dev_t;
+
+    /**
+     * @brief Record one finished bus transaction. Lock-free, safe from any task.
+     *
+     * The same address on two ports is two devices; each port has its own utilisation.
+     *
+     * @param port           I2C port the transaction ran on, others are ignored.
+     * @param device_address 7-bit address.
+     * @param bytes          Bytes written plus read.
+     * @param result         Result of the i2c_master call.
+     * @param duration_us    Time the call took.
+     */
+    void i2c_stats_record(int port, uint8_t device_address, size_t bytes, esp_err_t result, uint32_t duration_us);
+
+    /**
+     * @brief Copy the counters of all tracked devices.
+     *
+     * @param out   Array of at least I2C_STATS_MAX_DEVICES entries.
+     * @return Number of devices copied.
+     */
+    int i2c_stats_get_all(i2c_stats_dev_t *out);
+
+    /**
+     * @brief Utilisation of one bus over the sliding window, in permille.
+     */
+    uint32_t i2c_stats_utilisation_permille(int port);
+
+    /**
+     * @brief Clear all counters.
+     */
+    void i2c_stats_reset(void);
+
+    /**
+     * @brief Compact binary export, little endian.
+     *
+     * Layout: u32 magic, u8 version, u8 devices, u8 buckets, u8 ports, per port a u16
+     * utilisation (permille), then per device: u8 port, u8 address followed by 6 + buckets
+     * u32 counters in the order of i2c_stats_dev_t.
+     *
+     * @param buf  Output buffer.
+     * @param size Size of the buffer, I2C_STATS_EXPORT_MAX_SIZE is always enough.
+     * @return Bytes written, 0 when the buffer is too small.
+     */
+    size_t i2c_stats_export(uint8_t *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @file i2c_tune.c
+ * @brief Per-device SCL speed auto-tuning.
+ *
+ * The registry is switched to each candidate speed in turn and the device is checked a
+ * number of times: readable devices by reading back a register, write-only devices by a
+ * pattern they must ACK. The first failing speed ends the search; the highest passing
+ * speed minus a safety margin is stored in the registry, so every later
+ * i2c_bus_get_device() for this device uses it.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "i2c_tune.h"
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_bus.h"
+#include "i2c_sched.h"
+
+static const char *TAG = "i2c_tune";
+
+static const uint32_t s_default_speeds[] = {100000, 200000, 400000, 600000, 800000, 1000000};
+
+esp_err_t i2c_tune_check_ack(i2c_master_dev_handle_t dev_handle, void *arg)
+{
+    const i2c_tune_ack_t *ack = (const i2c_tune_ack_t *)arg;
+    return i2c_sched_transmit(dev_handle, I2C_SCHED_PRIO_NORMAL, ack->data, ack->len, I2C_TUNE_TIMEOUT_MS);
+}
+
+esp_err_t i2c_tune_check_readback(i2c_master_dev_handle_t dev_handle, void *arg)
+{
+    i2c_tune_readback_t *rb = (i2c_tune_readback_t *)arg;
+    uint8_t buf[1 + sizeof(rb->value)];
+    esp_err_t ret;
+
+    if (rb->len == 0 || rb->len > sizeof(rb->value))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (rb->write)
+    {
+        buf[0] = rb->reg;
+        memcpy(buf + 1, rb->value, rb->len);
+        ret = i2c_sched_transmit(dev_handle, I2C_SCHED_PRIO_NORMAL, buf, 1 + rb->len, I2C_TUNE_TIMEOUT_MS);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        rb->have_value = true;
+    }
+
+    ret = i2c_sched_transmit_receive(dev_handle, I2C_SCHED_PRIO_NORMAL, &rb->reg, 1, buf, rb->len, I2C_TUNE_TIMEOUT_MS);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    if (!rb->have_value)
+    {
+        memcpy(rb->value, buf, rb->len); // reference, read at the lowest speed
+        rb->have_value = true;
+        return ESP_OK;
+    }
+    return (memcmp(buf, rb->value, rb->len) == 0) ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+esp_err_t i2c_tune_device(i2c_master_bus_handle_t bus_handle, uint16_t device_address,
+                          i2c_tune_check_t check, void *arg,
+                          const i2c_tune_config_t *config, i2c_tune_result_t *result)
+{
+    const i2c_tune_config_t defaults = {0};
+    if (!bus_handle || device_address > 0x7f || !check || !result)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!config)
+    {
+        config = &defaults;
+    }
+    const uint32_t *speeds = config->speeds ? config->speeds : s_default_speeds;
+    int n_speeds = config->speeds ? config->n_speeds : sizeof(s_default_speeds) / sizeof(s_default_speeds[0]);
+    int iterations = config->iterations ? config->iterations : I2C_TUNE_DEFAULT_ITERATIONS;
+    int margin_pct = config->margin_pct ? config->margin_pct : I2C_TUNE_DEFAULT_MARGIN_PCT;
+    if (n_speeds < 1 || n_speeds > I2C_TUNE_MAX_SPEEDS || margin_pct >= 100)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->device_address = device_address;
+
+    for (int s = 0; s < n_speeds; s++)
+    {
+        uint32_t speed = speeds[s];
+        result->speed_hz[s] = speed;
+        result->best_us[s] = UINT32_MAX;
+        result->n_speeds = s + 1;
+
+        i2c_master_dev_handle_t dev_handle;
+        i2c_bus_set_device_speed(bus_handle, device_address, speed);
+        if (i2c_bus_get_device(bus_handle, device_address, speed, &dev_handle) != ESP_OK)
+        {
+            result->failures[s]++;
+            break;
+        }
+
+        for (int i = 0; i < iterations; i++)
+        {
+            int64_t start = esp_timer_get_time();
+            esp_err_t ret = check(dev_handle, arg);
+            uint32_t took = (uint32_t)(esp_timer_get_time() - start);
+            if (ret != ESP_OK)
+            {
+                ESP_LOGD(TAG, "0x%02x @ %" PRIu32 " Hz: check %d failed: %s", device_address, speed, i, esp_err_to_name(ret));
+                result->failures[s]++;
+                break; // one failure disqualifies the speed, no need to keep hammering the bus
+            }
+            result->best_us[s] = (took < result->best_us[s]) ? took : result->best_us[s];
+        }
+        if (result->failures[s])
+        {
+            break;
+        }
+        result->max_ok_hz = speed;
+    }
+
+    if (result->max_ok_hz == 0)
+    {
+        i2c_bus_set_device_speed(bus_handle, device_address, 0);
+        ESP_LOGW(TAG, "0x%02x: no reliable speed, setting cleared", device_address);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t tuned = result->max_ok_hz;
+    if (margin_pct > 0)
+    {
+        tuned = (uint32_t)((uint64_t)tuned * (100 - margin_pct) / 100);
+        tuned -= tuned % 1000;
+    }
+    if (tuned < speeds[0])
+    {
+        tuned = speeds[0]; // the lowest speed passed, use it as is
+    }
+    result->tuned_hz = tuned;
+    i2c_bus_set_device_speed(bus_handle, device_address, tuned);
+    ESP_LOGI(TAG, "0x%02x: reliable up to %" PRIu32 " Hz, using %" PRIu32 " Hz", device_address, result->max_ok_hz, tuned);
+    return ESP_OK;
+}
@@ -0,0 +1,93 @@
+// i2c_tune.h
+// Per-device SCL speed auto-tuning: step through candidate speeds, keep the highest reliable one
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+#define I2C_TUNE_MAX_SPEEDS (8)
+#define I2C_TUNE_DEFAULT_ITERATIONS (32) // Checks per candidate speed, all must pass
+#define I2C_TUNE_DEFAULT_MARGIN_PCT (20) // Stored speed = highest passing speed - margin
+#define I2C_TUNE_TIMEOUT_MS (20)
+
+    /**
+     * @brief One integrity check of a device, run through the scheduler at the candidate speed.
+     *
+     * @return ESP_OK when the device answered correctly.
+     */
+    typedef esp_err_t (*i2c_tune_check_t)(i2c_master_dev_handle_t dev_handle, void *arg);
+
+    // Argument of i2c_tune_check_ack(): bytes the device must ACK, without side effects
+    typedef struct
+    {
+        const uint8_t *data;
+        size_t len;
+    } i2c_tune_ack_t;
+
+    // Argument of i2c_tune_check_readback(): register read back and compared
+    typedef struct
+    {
+        uint8_t reg;       // Register address
+        uint8_t len;       // Bytes to read, 1..8
+        bool write;        // Write value first (must be the current content), else compare with
+                           // the first read at the lowest speed
+        uint8_t value[8];  // Expected content
+        bool have_value;   // Set by the check after the first read
+    } i2c_tune_readback_t;
+
+    typedef struct
+    {
+        const uint32_t *speeds; // Candidate speeds, ascending; NULL = 100k..1M default list
+        int n_speeds;
+        int iterations;         // 0 = I2C_TUNE_DEFAULT_ITERATIONS
+        int margin_pct;         // 0 = I2C_TUNE_DEFAULT_MARGIN_PCT, < 0 = no margin
+    } i2c_tune_config_t;
+
+    typedef struct
+    {
+        uint16_t device_address;
+        int n_speeds;
+        uint32_t speed_hz[I2C_TUNE_MAX_SPEEDS]; // Tried speeds
+        uint16_t failures[I2C_TUNE_MAX_SPEEDS]; // Failed checks per speed
+        uint32_t best_us[I2C_TUNE_MAX_SPEEDS];  // Fastest check per speed
+        uint32_t max_ok_hz;                     // Highest speed without failures
+        uint32_t tuned_hz;                      // Stored in the registry, 0 = none
+    } i2c_tune_result_t;
+
+    /**
+     * @brief Tune one device and store the result in the registry (i2c_bus_set_device_speed).
+     *
+     * Speeds are tried in ascending order until one fails a check. The previous device
+     * speed is overridden while tuning, device handles held by drivers are replaced
+     * (registry generation). The bus traffic goes through the scheduler at normal priority.
+     *
+     * @return ESP_OK, ESP_ERR_NOT_FOUND when even the lowest speed failed (setting cleared),
+     *         ESP_ERR_INVALID_ARG.
+     */
+    esp_err_t i2c_tune_device(i2c_master_bus_handle_t bus_handle, uint16_t device_address,
+                              i2c_tune_check_t check, void *arg,
+                              const i2c_tune_config_t *config, i2c_tune_result_t *result);
+
+    /**
+     * @brief Check for write-only devices: the device must ACK every byte of the pattern.
+     */
+    esp_err_t i2c_tune_check_ack(i2c_master_dev_handle_t dev_handle, void *arg);
+
+    /**
+     * @brief Check for readable devices: (write and) read back a register, compare the content.
+     */
+    esp_err_t i2c_tune_check_readback(i2c_master_dev_handle_t dev_handle, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -34,76 +34,62 @@
 #include "esp_err.h"           // ESP-IDF error codes
 #include "esp_log.h"           // Logging functionality
 #include "driver/i2c_master.h" // I2C master configuration and communication
+#include "i2c_bus.h"           // Shared device-handle registry
+#include "i2c_sched.h"         // Bus scheduler (priorities)
+#include "i2c_regmap.h"        // Shadow-registers
 // Logging tag for ESP-IDF
 static const char *TAG = "M5-4Relay";
+
+#define M54R_RELAY_MASK (0x0F) // bit0..bit3: relais
+#define M54R_LED_MASK (0xF0)   // bit4..bit7: LEDs
+
+// Registermap: MODE en RELAY liggen naast elkaar en het board telt het adres zelf op,
+// dus beide gaan samen in één transactie (lezen bij init, schrijven bij restore).
+static const i2c_regmap_reg_t s_m54_regs[] = {
+    {M54R_REG_MODE, 1, 0},
+    {M54R_REG_RELAY, 1, 0},
+};
+
+static const i2c_regmap_desc_t s_m54_regmap = {
+    .regs = s_m54_regs,
+    .n_regs = sizeof(s_m54_regs) / sizeof(s_m54_regs[0]),
+    .prio = I2C_SCHED_PRIO_URGENT, // relais gaan voor op display-verkeer
+    .timeout_ms = 100,
+};
 ////////////////////////////////////////////////////////////////////////////////
-// Intern: I2C-write helper
+// Intern: register helper
 ////////////////////////////////////////////////////////////////////////////////
 /**
- * @brief  Schrijf één register (1 byte) met één databyte via I2C.
- * @param  handle       Pointer naar het M5-4Relay device-descriptor
- * @param  reg_addr     Registeradres (bijv. M54R_REG_RELAY)
- * @param  value        De waarde die naar dat register geschreven moet worden
- * @return ESP_OK       als de write slaagt, anders foutcode.
+ * @brief  Pas bits in een register aan en schrijf het resultaat direct.
+ *         De shadow slaat de write over als het board de waarde al heeft.
+ * @param  handle   Pointer naar het M5-4Relay device-descriptor
+ * @param  reg_addr Registeradres (bijv. M54R_REG_RELAY)
+ * @param  mask     Bits die veranderen
+ * @param  value    Nieuwe waarde van die bits
+ * @return ESP_OK   als de write slaagt, anders foutcode.
  */
-static esp_err_t m54_i2c_write_byte(m54_ctx_t *handle, uint8_t reg_addr, uint8_t value)
+static esp_err_t m54_update(m54_ctx_t *handle, uint8_t reg_addr, uint8_t mask, uint8_t value)
 {
-    if (!handle)
+    if (!handle || !handle->initialized)
     {
-        return ESP_ERR_INVALID_ARG;
+        return ESP_ERR_INVALID_STATE;
     }
-
-    // Data-buffer: eerst registeradres, dan de waarde
-    uint8_t data[2] = {reg_addr, value};
-
-    return i2c_master_transmit(
-        handle->dev_handle,  // al aangemaakte I2C-device-handle
-        data,                // pointer naar [reg_addr, value]
-        sizeof(data),        // lengte = 2 bytes
-        pdMS_TO_TICKS(100)); // timeout = 100 ms
-}
-
-static esp_err_t m54_i2c_read_registers(m54_ctx_t *handle, uint8_t *modeval, uint8_t *relvalue)
-{
-    if (!handle)
-    {
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    // send-buffer: registeradres, dan de waarde
-    uint8_t data_addr[] = {M54R_REG_MODE}; // We lezen het mode-register
-    uint8_t result[2] = {0, 0};            // Buffer voor de ontvangen data
-    // result[0] is mode
-    // result[1] is LED + RELAY status
-    esp_err_t ret = i2c_master_transmit_receive(handle->dev_handle, data_addr, sizeof(data_addr), result, sizeof(result), pdMS_TO_TICKS(100));
+    esp_err_t ret = i2c_regmap_update_bits(&handle->regs, reg_addr, mask, value);
     if (ret != ESP_OK)
     {
-        ESP_LOGE(TAG, "Failed to read register 0x%02X: %s", data_addr[0], esp_err_to_name(ret));
-        return ret; // Return the error code
+        return ret;
     }
-    // We verwachten 2 bytes: mode en relay+led status
-    ESP_LOGI(TAG, "Read mode: 0x%02X, relay+led status: 0x%02X", result[0], result[1]);
-    // Zet de mode en relay+led status in de output pointer
-    if (modeval && relvalue)
-    {
-        *modeval = result[0];  // Mode is de eerste byte
-        *relvalue = result[1]; // Relay+LED status is de tweede byte
-    }
-    else if (modeval) // Alleen mode gevraagd
-    {
-        *modeval = result[0];
-    }
-    else if (relvalue) // Alleen relay+led status gevraagd
-    {
-        *relvalue = result[1];
-    }
-    else
-    {
-        ESP_LOGE(TAG, "Output pointer is NULL");
-        return ESP_ERR_INVALID_ARG; // Return error if output pointer is NULL
-    }
-    return ESP_OK; // Return success
+    return i2c_regmap_flush(&handle->regs);
 }
+
+// Lees een register uit de shadow (wordt bij init in één keer van het board gelezen)
+static uint8_t m54_shadow(m54_ctx_t *handle, uint8_t reg_addr)
+{
+    uint32_t value = 0;
+    i2c_regmap_read(&handle->regs, reg_addr, &value);
+    return (uint8_t)value;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // m54r_init & m54r_deinit
 ////////////////////////////////////////////////////////////////////////////////
@@ -128,64 +114,51 @@ esp_err_t m54_init(m54_ctx_t *dev)
         ESP_LOGI(TAG, "M5-4Relay device already initialized");
         return ESP_OK; // Device is already initialized
     }
-    // attach the I2C device handle
-    i2c_device_config_t i2c_dev_conf = {
-        .scl_speed_hz = dev->scl_speed_hz,     // Set the I2C clock frequency
-        .device_address = dev->device_address, // Set the device address
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7, // Use 7-bit addressing
-    };
-    // Add the device to the I2C bus
-    esp_err_t ret = i2c_master_bus_add_device(dev->bus_handle, &i2c_dev_conf, &dev->dev_handle);
+    // haal de gedeelde I2C-device-handle op uit de registry (wordt alleen de eerste keer aangemaakt)
+    esp_err_t ret = i2c_bus_get_device(dev->bus_handle, dev->device_address, dev->scl_speed_hz, &dev->dev_handle);
     if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to add I2C device: %s", esp_err_to_name(ret));
         return ESP_FAIL; // Return error if device addition fails
     }
+    ret = i2c_regmap_init(&dev->regs, &s_m54_regmap, dev->bus_handle, dev->device_address, dev->scl_speed_hz);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to set up the register map: %s", esp_err_to_name(ret));
+        dev->dev_handle = NULL; // van de registry, niet verwijderen
+        return ret;
+    }
 
     // Set the initialized flag to true
     dev->initialized = true;
     ESP_LOGI(TAG, "M5-4Relay device initialized at address 0x%02X", dev->device_address);
-    // 3) Zet de initiële relay- en LED-status op 0 (uit).
-    dev->relay_state = 0x00; // Alle relais uit
-    dev->led_state = 0x00;   // Alle LEDs uit
-    dev->mode = 0x01;        // Standaard modus is sync (0x01)
-
-    ESP_LOGI(TAG, "M5-4Relay device initialized successfully");
-    uint8_t initial_mode = 0;
-    uint8_t initial_led_relay = 0;
-    ret = m54_i2c_read_registers(dev, &initial_mode, &initial_led_relay); // Lees de initiële status van het device
+
+    // Lees de initiële status van het device: MODE en RELAY in één transactie naar de shadow
+    ret = i2c_regmap_refresh(&dev->regs);
     if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to read initial status: %s", esp_err_to_name(ret));
         return ret; // Return the error code if reading fails
     }
-    // Zet de mode en relay+led status in de context
-    dev->mode = (initial_mode ? 0x01 : 0x00);      // Mode: 0x01 = sync, 0x00 = async
-    dev->relay_state = (initial_led_relay & 0x0F); // Bit0..Bit3 zijn de relais
-    dev->led_state = (initial_led_relay & 0xF0);   // Bit4..Bit7 zijn de LEDs
-    ESP_LOGI(TAG, "Initial mode: 0x%02X, relay state: 0x%02X, led state: 0x%02X", dev->mode, dev->relay_state, dev->led_state);
+    uint8_t led_relay = m54_shadow(dev, M54R_REG_RELAY);
+    ESP_LOGI(TAG, "Initial mode: 0x%02X, relay state: 0x%02X, led state: 0x%02X", m54_shadow(dev, M54R_REG_MODE),
+             led_relay & M54R_RELAY_MASK, led_relay & M54R_LED_MASK);
     return ESP_OK;
 }
 
 /**
- * @brief  De- initialiseert het M5-4Relay board: verwijder de I2C-device en maak struct leeg.
+ * @brief  De- initialiseert het M5-4Relay board: laat de gedeelde I2C-device los en maak struct leeg.
  * @param  dev  Pointer naar eerder geïnitialiseerd m54_ctx_t
  */
 void m54_deinit(m54_ctx_t *dev)
 {
     assert(dev != NULL);
 
-    // Free the device handle if needed (not shown here)
-    if (i2c_master_bus_rm_device(dev->dev_handle) != ESP_OK)
-    {
-        ESP_LOGE(TAG, "Failed to remove M5-4Relay I2C device");
-    }
+    // De device-handle is van de registry (i2c_bus), die wordt hier niet verwijderd
     // Reset the device context
     dev->dev_handle = NULL;  // Set the device handle to NULL
-    dev->initialized = 0;    // Mark as uninitialized
-    dev->relay_state = 0x00; // Reset relay state
-    dev->led_state = 0x00;   // Reset LED state
-    dev->mode = 0;           // Reset mode
+    dev->initialized = 0;   // Mark as uninitialized
+    memset(&dev->regs, 0, sizeof(dev->regs)); // Reset relay, LED and mode shadow
                              // Note: We do not free the m54_ctx_t struct itself, as it is expected to be allocated by the caller.
                              // Optionally, you can log the deinitialization
     ESP_LOGI(TAG, "M5-4Relay device deinitialized");
@@ -208,44 +181,92 @@ esp_err_t m54_relay_set(m54_ctx_t *handle, uint8_t number, uint8_t state)
     }
 
     // Relay-register (één byte) bestaat uit bit-mask: bit0 = relay0, bit1 = relay1, etc.
-    // Lees eerst de huidige waarde (optioneel), of houd lokaal bij wat je hebt gezet.
-    // Hier doen we simpel: we lezen niet; we maken een klein bitmask en schrijven het hele register.
-    uint32_t s = handle->relay_state; // Huidige relay-status
-    if (state == 0)
+    // De andere bits (LED's in bit4..bit7) komen uit de shadow, er wordt niet eerst gelezen.
+    uint8_t bit = 0x01 << number;
+    return m54_update(handle, M54R_REG_RELAY, bit, state ? bit : 0x00);
+}
+
+/**
+ * @brief  Schakel alle relais tegelijk aan/uit.
+ * @param  handle   Pointer naar geïnitialiseerd m54_ctx_t.
+ * @param  state    true = alle aan, false = alle uit.
+ */
+esp_err_t m54_relay_set_all(m54_ctx_t *handle, uint8_t state)
+{
+    if (!handle)
     {
-        s &= ~(0x01 << number);
+        return ESP_ERR_INVALID_ARG;
     }
-    else
+
+    // bit0..bit3 high = alle 4 relais aan, de LED's in bit4..bit7 blijven staan
+    return m54_update(handle, M54R_REG_RELAY, M54R_RELAY_MASK, state ? M54R_RELAY_MASK : 0x00);
+}
+
+/**
+ * @brief  Schakel een deel van de relais tegelijk, in één schrijfactie.
+ * @param  handle   Pointer naar geïnitialiseerd m54_ctx_t.
+ * @param  mask     Relais die geschakeld worden (bit0 = relay0 .. bit3 = relay3).
+ * @param  state    Nieuwe stand van die relais, zelfde bitindeling.
+ */
+esp_err_t m54_relay_set_mask(m54_ctx_t *handle, uint8_t mask, uint8_t state)
+{
+    if (!handle || (mask & ~M54R_RELAY_MASK))
     {
-        s |= (0x01 << number);
+        return ESP_ERR_INVALID_ARG;
     }
-    handle->relay_state = s;
+    return m54_update(handle, M54R_REG_RELAY, mask, state & mask);
+}
 
-    // Schrijf naar register M54R_REG_RELAY
-    return m54_i2c_write_byte(handle, M54R_REG_RELAY, handle->led_state | handle->relay_state); // LED's in bit4..bit7, relais in bit0..bit3
+/**
+ * @brief  Geef de stand van alle relais (bit0..bit3) uit de shadow, zonder bus-verkeer.
+ * @param  handle   Pointer naar geïnitialiseerd m54_ctx_t.
+ * @param  state    Uitvoer: bitmasker van de relais.
+ */
+esp_err_t m54_relay_get_all(m54_ctx_t *handle, uint32_t *state)
+{
+    if (!handle || !state)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!handle->initialized)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    *state = m54_shadow(handle, M54R_REG_RELAY) & M54R_RELAY_MASK;
+    return ESP_OK;
 }
 
 /**
- * @brief  Schakel alle relais tegelijk aan/uit.
+ * @brief  Zet de stand van alle relais en LEDs klaar zonder te schrijven.
+ *         m54_flush() stuurt het RELAY-register; een ongewijzigde waarde gaat niet de bus op.
  * @param  handle   Pointer naar geïnitialiseerd m54_ctx_t.
- * @param  state    true = alle aan, false = alle uit.
+ * @param  relays   Relais, bit0..bit3.
+ * @param  leds     LEDs, bit0..bit3 (komen in bit4..bit7 van het register).
  */
-esp_err_t m54_relay_set_all(m54_ctx_t *handle, uint8_t state)
+esp_err_t m54_stage_outputs(m54_ctx_t *handle, uint8_t relays, uint8_t leds)
 {
-    if (!handle)
+    if (!handle || (relays & ~M54R_RELAY_MASK) || (leds & ~M54R_RELAY_MASK))
     {
         return ESP_ERR_INVALID_ARG;
     }
+    if (!handle->initialized)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return i2c_regmap_write(&handle->regs, M54R_REG_RELAY, relays | (leds << 4));
+}
 
-    uint8_t mask = state ? 0x0F : 0x00; // bit0..bit3 high = alle 4 relais aan
-    // TODO: Als je de huidige status wilt behouden, lees dan eerst het register:
-    // uint8_t current_state = 0;
-    // m54_i2c_read_byte(handle, M54R_REG_RELAY, &current_state);
-    handle->relay_state = mask; // Bewaar de nieuwe relay-status in de context
-    // Schrijf naar register M54R_REG_RELAY
-    // LED's in bit4..bit7, relais in bit0..bit3
-    return m54_i2c_write_byte(handle, M54R_REG_RELAY, handle->led_state | mask); // LED's in bit4..bit7, relais in bit0..bit3
-    //     return m54_i2c_write_byte(handle, M54R_REG_RELAY, mask);
+/**
+ * @brief  Schrijf de klaargezette registers naar het board.
+ * @param  handle   Pointer naar geïnitialiseerd m54_ctx_t.
+ */
+esp_err_t m54_flush(m54_ctx_t *handle)
+{
+    if (!handle || !handle->initialized)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return i2c_regmap_flush(&handle->regs);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -264,22 +285,13 @@ esp_err_t m54_led_set(m54_ctx_t *handle, uint8_t number, uint8_t state)
         return ESP_ERR_INVALID_ARG;
     }
 
-    uint32_t s = handle->led_state; // Huidige relay-status
-    if (state == 0)
-    {
-        s &= ~(0x10 << number);
-    }
-    else
-    {
-        s |= (0x10 << number);
-    }
-    handle->led_state = s;
-    if (handle->mode == 0x01) // Als we in sync mode zijn, dan gaan de LEDs niet reageren
+    if (m54_shadow(handle, M54R_REG_MODE) == 0x01) // Als we in sync mode zijn, dan gaan de LEDs niet reageren
     {
         ESP_LOGI(TAG, "LED %d set to %s (no effect in Sync mode)", number, state ? "ON" : "OFF");
     }
-    // Schrijf naar register M54R_REG_RELAY
-    return m54_i2c_write_byte(handle, M54R_REG_RELAY, handle->led_state | handle->relay_state); // LED's in bit4..bit7, relais in bit0..bit3
+    // Schrijf naar register M54R_REG_RELAY, LED's in bit4..bit7
+    uint8_t bit = 0x10 << number;
+    return m54_update(handle, M54R_REG_RELAY, bit, state ? bit : 0x00);
 }
 
 esp_err_t m54_led_get(m54_ctx_t *handle, uint8_t number, uint8_t *state)
@@ -289,7 +301,7 @@ esp_err_t m54_led_get(m54_ctx_t *handle, uint8_t number, uint8_t *state)
         return ESP_ERR_INVALID_ARG;
     }
 
-    uint32_t mystate = handle->led_state;  // Huidige led-status, we moeten deze uit het device halen: TODO: m54_i2c_read_byte(handle, M54R_REG_RELAY, &mystate);
+    uint32_t mystate = m54_shadow(handle, M54R_REG_RELAY); // Huidige led-status uit de shadow
     if ((mystate & (0x10 << number)) == 0) // check
     {
         *state = 0; // LED is uit
@@ -309,7 +321,7 @@ esp_err_t m54_relay_get(m54_ctx_t *handle, uint8_t number, uint8_t *state)
         return ESP_ERR_INVALID_ARG;
     }
 
-    uint32_t mystate = handle->relay_state; // Huidige relay-state, we moeten deze uit het device halen: TODO
+    uint32_t mystate = m54_shadow(handle, M54R_REG_RELAY); // Huidige relay-state uit de shadow
     if ((mystate & (0x1 << number)) == 0)   // check
     {
         *state = 0; // relay is uit
@@ -332,8 +344,27 @@ esp_err_t m54_led_set_all(m54_ctx_t *handle, uint8_t state)
         return ESP_ERR_INVALID_ARG;
     }
 
-    handle->led_state = state ? 0xF0 : 0x00;                                                    // bit4..bit7 high = alle 4 LEDs aan
-    return m54_i2c_write_byte(handle, M54R_REG_RELAY, handle->led_state | handle->relay_state); // LED's in bit4..bit7, relais in bit0..bit3
+    // bit4..bit7 high = alle 4 LEDs aan, de relais in bit0..bit3 blijven staan
+    return m54_update(handle, M54R_REG_RELAY, M54R_LED_MASK, state ? M54R_LED_MASK : 0x00);
+}
+
+/**
+ * @brief  Geef de stand van alle LEDs (bit0..bit3) uit de shadow, zonder bus-verkeer.
+ * @param  handle   Pointer naar geïnitialiseerd m54_ctx_t.
+ * @param  state    Uitvoer: bitmasker van de LEDs.
+ */
+esp_err_t m54_led_get_all(m54_ctx_t *handle, uint32_t *state)
+{
+    if (!handle || !state)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!handle->initialized)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    *state = (m54_shadow(handle, M54R_REG_RELAY) & M54R_LED_MASK) >> 4;
+    return ESP_OK;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -354,9 +385,40 @@ esp_err_t m54_mode_set(m54_ctx_t *handle, uint8_t mode)
     // Zet de modus van het board: bit0 in register M54R_REG_MODE.
     // Dit bepaalt of de leds automatisch aan/uit gaan bij het inschakelen van de relais.
     // In deze template zetten we bit0=mode, zonder eerst te lezen (alle andere bits gaan dan naar 0).
+    return m54_update(handle, M54R_REG_MODE, 0xFF, mode ? 0x01 : 0x00);
+}
+
+/**
+ * @brief  Lees de modus (uit de shadow).
+ * @param  handle   Pointer naar geïnitialiseerd m54_ctx_t.
+ * @param  mode     1 = modus Automatisch, 0 = modus Handmatig.
+ */
+esp_err_t m54_mode_get(m54_ctx_t *handle, uint8_t *mode)
+{
+    if (!handle || !mode)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *mode = m54_shadow(handle, M54R_REG_MODE) ? 0x01 : 0x00;
+    return ESP_OK;
+}
+
+/**
+ * @brief  Schrijf de laatst bekende modus, relais en LED's opnieuw naar het board.
+ *         Bedoeld na een bus-herstel of brown-out van het board.
+ * @param  handle   Pointer naar geïnitialiseerd m54_ctx_t.
+ */
+esp_err_t m54_restore(m54_ctx_t *handle)
+{
+    if (!handle || !handle->initialized)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    uint8_t reg_value = (mode ? 0x01 : 0x00);
-    return m54_i2c_write_byte(handle, M54R_REG_MODE, reg_value);
+    // de bus kan vervangen zijn; MODE en RELAY gaan samen in één transactie
+    handle->regs.bus_handle = handle->bus_handle;
+    handle->regs.scl_speed_hz = handle->scl_speed_hz;
+    return i2c_regmap_sync(&handle->regs);
 }
 
 // end
\ No newline at end of file
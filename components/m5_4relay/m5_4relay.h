@@ -11,6 +11,7 @@ extern "C"
 #endif
 
 #include "driver/i2c_master.h"
+#include "i2c_regmap.h"
 
 #define M54R_ADDR (0X26)
 #define M54R_REG_MODE (0X10)
@@ -24,9 +25,7 @@ extern "C"
         i2c_master_dev_handle_t dev_handle; // I2C device handle (assumed pointer, 4 bytes)
         uint32_t scl_speed_hz;              // I2C clock frequency (4 bytes)
         uint8_t initialized;                // Initialization flag (1 byte)
-        uint8_t relay_state;                // Relay state (1 byte, bitmask for 4 relays)
-        uint8_t led_state;                  // LED state (1 byte, bitmask for 4 LEDs)
-        uint8_t mode;                       // Mode (1 byte, true = async, false = sync)
+        i2c_regmap_t regs;                  // Shadow van MODE en RELAY (bit0..3 relais, bit4..7 LEDs)
         // Additional fields can be added as needed
     } m54_ctx_t;
 
@@ -40,6 +39,11 @@ extern "C"
     // bulk relay commands
     esp_err_t m54_relay_set_all(m54_ctx_t *dev, uint8_t state);
     esp_err_t m54_relay_get_all(m54_ctx_t *dev, uint32_t *state);
+    // Switch the relays in mask (bit0..3) to the bits in state, one register write
+    esp_err_t m54_relay_set_mask(m54_ctx_t *dev, uint8_t mask, uint8_t state);
+    // Stage relays (bit0..3) and LEDs (bit0..3) without writing; m54_flush() sends what changed
+    esp_err_t m54_stage_outputs(m54_ctx_t *dev, uint8_t relays, uint8_t leds);
+    esp_err_t m54_flush(m54_ctx_t *dev);
     // LED commands
     esp_err_t m54_led_set(m54_ctx_t *dev, uint8_t number, uint8_t state);
     esp_err_t m54_led_get(m54_ctx_t *dev, uint8_t number, uint8_t *state);
@@ -50,6 +54,8 @@ extern "C"
     // Set the mode of the device (e.g., AutoLed or ManualLed)
     esp_err_t m54_mode_set(m54_ctx_t *dev, uint8_t mode);
     esp_err_t m54_mode_get(m54_ctx_t *dev, uint8_t *mode);
+    // Write the last known mode, relay and LED state again (after a bus recovery)
+    esp_err_t m54_restore(m54_ctx_t *dev);
 
 #ifdef __cplusplus
 }
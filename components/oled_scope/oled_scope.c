@@ -0,0 +1,275 @@
+/**
+ * @file oled_scope.c
+ * @brief Scope view of the GP8413 outputs on the SSD1306.
+ *
+ * A general purpose timer alarm notifies the scope task once per sample. The task takes the
+ * two DAC words from the source, draws column x into the frame buffer of the display and
+ * clears column x + 1, then writes just those two columns. The trace sweeps from left to
+ * right and wraps, like a scope in roll mode with a gap at the write position: the column
+ * index is a ring, the panel RAM is never scrolled or redrawn.
+ *
+ * The hardware scroll of the SSD1306 was not used: it moves the image on its own clock
+ * (a step every 2 to 256 panel frames), not one column per sample, and scrolled RAM would
+ * no longer match the buffer.
+ *
+ * A column transfer is 29 bytes at bulk priority, so DAC and relay writes pass it at the
+ * next transaction. The scope measures its own write time; the display bus occupancy comes
+ * from the per-device bus time of i2c_stats.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "oled_scope.h"
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_bus.h"
+#include "i2c_stats.h"
+#include "periodic_alarm.h"
+
+static const char *TAG = "oled_scope";
+
+#define GRID_EVERY (4) // Columns between the dots of the mid-scale line
+
+static oled_scope_config_t s_cfg;
+static TaskHandle_t s_task;
+static gptimer_handle_t s_timer;
+static periodic_alarm_sync_t s_sync; // The task reports when its alarm started (or failed) and when it ends
+static volatile bool s_stop;
+static bool s_running;
+
+// drawing state, scope task only
+static uint8_t s_x;         // Column of the next sample
+static uint8_t s_prev[2];   // Row of the previous sample per channel
+static bool s_prev_valid;
+
+// read by the console, under s_mux
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static oled_scope_stats_t s_stats;
+static int64_t s_start_us;
+static int64_t s_stop_us;
+static uint32_t s_busy_start_us;
+
+static bool IRAM_ATTR on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg)
+{
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(s_task, &woken);
+    return woken == pdTRUE;
+}
+
+// Bus time of the display so far; i2c_stats keeps it per port and address
+static uint32_t display_busy_us(void)
+{
+    static i2c_stats_dev_t devs[I2C_STATS_MAX_DEVICES]; // console and start only, too big for a stack
+    int port = i2c_bus_port_of(s_cfg.display->bus_handle);
+    int n = i2c_stats_get_all(devs);
+    for (int i = 0; i < n; i++)
+    {
+        if (devs[i].port == port && devs[i].device_address == s_cfg.display->device_address)
+        {
+            return devs[i].busy_us;
+        }
+    }
+    return 0;
+}
+
+// Row of a DAC word within a pane, 0 at the top
+static uint8_t row_of(uint16_t code, int rows)
+{
+    uint32_t c = code > OLED_SCOPE_FULL_SCALE ? OLED_SCOPE_FULL_SCALE : code;
+    return (uint8_t)(rows - 1 - (int)(c * (uint32_t)rows / (OLED_SCOPE_FULL_SCALE + 1)));
+}
+
+// Column x: channel 0 in the upper pane, channel 1 in the lower one; column x + 1 cleared
+static void draw_column(ssd1306_handle_t *dev, uint8_t x, const uint16_t code[2], bool valid)
+{
+    int pane_pages = dev->pages / 2; // at most 4: a pane fits in 32 bits
+    int rows = pane_pages * 8;
+    for (int ch = 0; ch < 2; ch++)
+    {
+        uint32_t mask = 0;
+        if (valid)
+        {
+            uint8_t y = row_of(code[ch], rows);
+            uint8_t from = s_prev_valid ? s_prev[ch] : y;
+            uint8_t lo = from < y ? from : y;
+            uint8_t hi = from < y ? y : from;
+            mask = ((2u << hi) - 1) & ~((1u << lo) - 1); // rows lo..hi: the step is drawn
+            s_prev[ch] = y;
+        }
+        if (x % GRID_EVERY == 0)
+        {
+            mask |= 1u << (rows / 2);
+        }
+        for (int p = 0; p < pane_pages; p++)
+        {
+            dev->buffer[(ch * pane_pages + p) * SSD1306_MAX_WIDTH + x] = (uint8_t)(mask >> (8 * p));
+            if (x + 1 < dev->width)
+            {
+                dev->buffer[(ch * pane_pages + p) * SSD1306_MAX_WIDTH + x + 1] = 0;
+            }
+        }
+    }
+    s_prev_valid = valid;
+}
+
+static void sample_once(void)
+{
+    ssd1306_handle_t *dev = s_cfg.display;
+    uint8_t x = s_x;
+    uint8_t x1 = x + 1 < dev->width ? x + 1 : x; // no gap at the right edge: column 0 is next
+    uint16_t code[2] = {0};
+    bool valid = s_cfg.sample(s_cfg.sample_ctx, code) == ESP_OK;
+    draw_column(dev, x, code, valid);
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = ssd1306_show_columns(dev, x, x1);
+    uint32_t write_us = (uint32_t)(esp_timer_get_time() - start);
+    s_x = x1 > x ? x1 : 0;
+
+    portENTER_CRITICAL(&s_mux);
+    s_stats.samples++;
+    s_stats.sample_errors += valid ? 0 : 1;
+    s_stats.write_errors += ret == ESP_OK ? 0 : 1;
+    s_stats.bytes += ssd1306_window_bytes(x1 - x + 1, dev->pages);
+    s_stats.write_total_us += write_us;
+    if (write_us > s_stats.write_max_us)
+    {
+        s_stats.write_max_us = write_us;
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+static void scope_task(void *arg)
+{
+    esp_err_t ret = periodic_alarm_start(1000000 / s_cfg.rate_hz, on_alarm, NULL, &s_timer);
+    periodic_alarm_sync_give(&s_sync, ret);
+    if (ret != ESP_OK)
+    {
+        vTaskDelete(NULL);
+        return;
+    }
+    while (!s_stop)
+    {
+        uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (s_stop)
+        {
+            break;
+        }
+        if (ticks > 1)
+        {
+            portENTER_CRITICAL(&s_mux);
+            s_stats.missed += ticks - 1; // those samples are lost, the sweep does not skip a column
+            portEXIT_CRITICAL(&s_mux);
+        }
+        sample_once();
+    }
+    periodic_alarm_stop(&s_timer);
+    periodic_alarm_sync_give(&s_sync, ESP_OK);
+    vTaskDelete(NULL);
+}
+
+esp_err_t oled_scope_start(const oled_scope_config_t *config)
+{
+    if (!config || !config->display || !config->display->dev_handle || !config->sample || config->rate_hz < 1 ||
+        config->rate_hz > 1000)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    periodic_alarm_sync_init(&s_sync);
+    s_cfg = *config;
+    s_stop = false;
+    s_x = 0;
+    s_prev_valid = false;
+
+    // one full frame to start from a blank screen, then columns only
+    ssd1306_fill(s_cfg.display, 0x00);
+    ssd1306_show(s_cfg.display);
+
+    portENTER_CRITICAL(&s_mux);
+    memset(&s_stats, 0, sizeof(s_stats));
+    portEXIT_CRITICAL(&s_mux);
+    s_busy_start_us = display_busy_us();
+    s_start_us = esp_timer_get_time();
+
+    if (xTaskCreate(scope_task, "scope", 3072, NULL, s_cfg.task_priority, &s_task) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = periodic_alarm_sync_wait(&s_sync);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    s_running = true;
+    ESP_LOGI(TAG, "%" PRIu32 " samples/s", s_cfg.rate_hz);
+    return ESP_OK;
+}
+
+esp_err_t oled_scope_stop(void)
+{
+    if (!s_running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_stop = true;
+    xTaskNotifyGive(s_task);
+    periodic_alarm_sync_wait(&s_sync);
+    s_stop_us = esp_timer_get_time();
+    s_running = false;
+    s_task = NULL;
+    return ESP_OK;
+}
+
+bool oled_scope_running(void)
+{
+    return s_running;
+}
+
+void oled_scope_get_stats(oled_scope_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_mux);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_mux);
+    if (s_cfg.display == NULL)
+    {
+        return; // never started
+    }
+    stats->display_bus_us = display_busy_us() - s_busy_start_us;
+    stats->elapsed_us = (s_running ? esp_timer_get_time() : s_stop_us) - s_start_us;
+}
+
+void oled_scope_print(FILE *out)
+{
+    oled_scope_stats_t st;
+    oled_scope_get_stats(&st);
+    if (st.elapsed_us <= 0)
+    {
+        fprintf(out, "scope: not started\r\n");
+        return;
+    }
+    uint32_t ms = (uint32_t)(st.elapsed_us / 1000);
+    fprintf(out, "scope %s, %" PRIu32 " Hz: %" PRIu32 " columns in %" PRIu32 " ms (%" PRIu32 "/s), %" PRIu32
+                 " missed, %" PRIu32 " without sample, %" PRIu32 " write errors\r\n",
+            s_running ? "running" : "stopped", s_cfg.rate_hz, st.samples, ms,
+            (uint32_t)((uint64_t)st.samples * 1000000 / st.elapsed_us), st.missed, st.sample_errors,
+            st.write_errors);
+    if (st.samples)
+    {
+        fprintf(out, "per column %" PRIu32 " bytes, write avg %" PRIu32 " us, max %" PRIu32 " us\r\n",
+                st.bytes / st.samples, (uint32_t)(st.write_total_us / st.samples), st.write_max_us);
+    }
+    uint32_t permille = (uint32_t)((uint64_t)st.display_bus_us * 1000 / st.elapsed_us);
+    fprintf(out, "display bus time %" PRIu32 " us/s, %" PRIu32 ".%" PRIu32 " %% of its bus\r\n",
+            (uint32_t)((uint64_t)st.display_bus_us * 1000000 / st.elapsed_us), permille / 10, permille % 10);
+}
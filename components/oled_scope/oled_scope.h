@@ -0,0 +1,77 @@
+// oled_scope.h
+// Scope view of the two GP8413 channels on the SSD1306: one column per sample, written on its own
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "ssd1306.h"
+
+#define OLED_SCOPE_FULL_SCALE (32767) // DAC word of the top row (GP8413: 15 bits)
+
+    /**
+     * @brief Sample source: the DAC words of channel 0 and 1.
+     *
+     * Called from the scope task once per sample; must not wait on the bus.
+     */
+    typedef esp_err_t (*oled_scope_sample_t)(void *ctx, uint16_t code[2]);
+
+    typedef struct
+    {
+        ssd1306_handle_t *display; // Initialised; the scope draws into its buffer
+        oled_scope_sample_t sample;
+        void *sample_ctx;
+        uint32_t rate_hz; // Samples (columns) per second
+        int task_priority;
+    } oled_scope_config_t;
+
+#define OLED_SCOPE_CONFIG_DEFAULT() {.display = NULL, .sample = NULL, .sample_ctx = NULL, .rate_hz = 100, .task_priority = 3}
+
+    typedef struct
+    {
+        uint32_t samples;       // Columns drawn
+        uint32_t missed;        // Timer alarms that found the previous column still on the bus
+        uint32_t sample_errors; // Columns drawn without a trace: the source had no value
+        uint32_t write_errors;
+        uint32_t bytes;          // Written for the columns, window commands included
+        uint32_t write_max_us;   // One column: queueing behind other traffic and the transfer
+        uint64_t write_total_us;
+        uint32_t display_bus_us; // Bus time of all display transfers since the start (i2c_stats)
+        int64_t elapsed_us;      // Since the start
+    } oled_scope_stats_t;
+
+    /**
+     * @brief Clear the display and start sampling.
+     *
+     * Channel 0 is plotted in the upper half, channel 1 in the lower half. Column x of a
+     * sample gets a vertical segment from the previous value to this one, so steps stay
+     * connected; column x + 1 is cleared as the sweep gap. Only those two columns go out
+     * (ssd1306_show_columns(), 29 bytes), no frame: at 400 kHz about 0.7 ms of bus time
+     * per sample against 24 ms for the 1 KB frame. A hardware timer alarm paces the samples.
+     *
+     * @return ESP_OK, ESP_ERR_INVALID_ARG (no display or source, rate not 1..1000 Hz),
+     *         ESP_ERR_INVALID_STATE when running, or the error of the timer.
+     */
+    esp_err_t oled_scope_start(const oled_scope_config_t *config);
+
+    // Stop sampling; the display keeps the last sweep
+    esp_err_t oled_scope_stop(void);
+
+    bool oled_scope_running(void);
+
+    void oled_scope_get_stats(oled_scope_stats_t *stats);
+
+    // Rate, columns, misses and the display bus occupancy
+    void oled_scope_print(FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
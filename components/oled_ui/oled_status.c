@@ -0,0 +1,49 @@
+/**
+ * @file oled_status.c
+ * @brief Status screen: the layout of the widgets and one update per refresh.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "oled_status.h"
+
+#define COL_RIGHT (66) // Left edge of the brake column
+#define BAR_WIDTH (60)
+
+esp_err_t oled_status_init(oled_status_t *st, ssd1306_handle_t *display, int32_t full_scale_mv)
+{
+    if (!st || !display || full_scale_mv <= 0 || display->width < SSD1306_MAX_WIDTH ||
+        display->pages < SSD1306_MAX_PAGES)
+    {
+        return ESP_ERR_INVALID_ARG; // laid out for 128x64
+    }
+    oled_ui_t *ui = &st->ui;
+    oled_ui_init(ui, display);
+    oled_ui_add_label(ui, 0, 0, OLED_UI_FONT_6X8, 5, "speed");
+    oled_ui_add_label(ui, COL_RIGHT, 0, OLED_UI_FONT_6X8, 5, "brake");
+    st->speed = oled_ui_add_number(ui, 0, 1, OLED_UI_FONT_8X16, 5, "mV");
+    st->brake = oled_ui_add_number(ui, COL_RIGHT, 1, OLED_UI_FONT_8X16, 5, "mV");
+    st->speed_bar = oled_ui_add_bar(ui, 0, 3, BAR_WIDTH, 1, 0, full_scale_mv);
+    st->brake_bar = oled_ui_add_bar(ui, COL_RIGHT, 3, BAR_WIDTH, 1, 0, full_scale_mv);
+    oled_ui_add_label(ui, 0, 5, OLED_UI_FONT_6X8, 6, "relays");
+    st->relays = oled_ui_add_relays(ui, 40, 5, 4);
+    st->link = oled_ui_add_label(ui, 0, 7, OLED_UI_FONT_6X8, OLED_UI_MAX_CELLS, "");
+    if (st->speed < 0 || st->brake < 0 || st->speed_bar < 0 || st->brake_bar < 0 || st->relays < 0 || st->link < 0)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t oled_status_update(oled_status_t *st, const oled_status_values_t *values)
+{
+    oled_ui_t *ui = &st->ui;
+    oled_ui_set_value(ui, st->speed, values->speed_mv);
+    oled_ui_set_value(ui, st->brake, values->brake_mv);
+    oled_ui_set_value(ui, st->speed_bar, values->speed_mv);
+    oled_ui_set_value(ui, st->brake_bar, values->brake_mv);
+    oled_ui_set_value(ui, st->relays, values->relays);
+    oled_ui_set_text(ui, st->link, values->link);
+    return oled_ui_render(ui);
+}
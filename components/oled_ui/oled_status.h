@@ -0,0 +1,44 @@
+// oled_status.h
+// Status screen on the SSD1306 built from oled_ui widgets: both DAC outputs, the relays and the host link
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "oled_ui.h"
+
+    typedef struct
+    {
+        int32_t speed_mv; // DAC channel 0
+        int32_t brake_mv; // DAC channel 1
+        uint8_t relays;   // Bit i: relay i + 1 on
+        const char *link; // Host link, e.g. "link ok"
+    } oled_status_values_t;
+
+    typedef struct
+    {
+        oled_ui_t ui;
+        int speed, brake;         // Numbers, 8x16
+        int speed_bar, brake_bar; // Bars, 0..full scale
+        int relays;
+        int link;
+    } oled_status_t;
+
+    /**
+     * @brief Lay out the screen: names on page 0, values in mV on pages 1-2, bars on page 3,
+     * relay icons on page 5, the link on page 7. The first oled_status_update() draws it all.
+     */
+    esp_err_t oled_status_init(oled_status_t *st, ssd1306_handle_t *display, int32_t full_scale_mv);
+
+    // Set the values and flush what changed
+    esp_err_t oled_status_update(oled_status_t *st, const oled_status_values_t *values);
+
+#ifdef __cplusplus
+}
+#endif
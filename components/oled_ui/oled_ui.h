@@ -0,0 +1,131 @@
+// oled_ui.h
+// Retained widgets on the SSD1306: labels, numbers, bar gauges and relay icons that redraw and flush only what changed
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "ssd1306.h"
+
+#define OLED_UI_MAX_WIDGETS (16)
+#define OLED_UI_MAX_CELLS (21) // Characters of a text widget: a 6x8 line
+
+    typedef enum
+    {
+        OLED_UI_FONT_6X8 = 0, // 6 columns, one page
+        OLED_UI_FONT_8X16,    // 8 columns, two pages
+    } oled_ui_font_t;
+
+    typedef enum
+    {
+        OLED_UI_LABEL = 0,
+        OLED_UI_NUMBER,
+        OLED_UI_BAR,
+        OLED_UI_RELAYS,
+    } oled_ui_kind_t;
+
+    /**
+     * @brief One widget: its box in columns and whole pages, and what is drawn in it.
+     *
+     * Text widgets keep the characters on the panel; a change marks only the cells that
+     * differ. A bar marks the columns between the old and the new fill, relay icons the
+     * icons that toggled.
+     */
+    typedef struct
+    {
+        oled_ui_kind_t kind;
+        uint8_t x, page;       // Top left
+        uint8_t w, pages;      // Size
+        oled_ui_font_t font;   // Text widgets
+        uint8_t n_cells;       // Text widgets: characters in the box
+        uint8_t digits;        // Number: cells of the value, the suffix follows
+        char cells[OLED_UI_MAX_CELLS];
+        int32_t value;         // Number, bar, relays (bit mask)
+        int32_t min, max;      // Bar
+        uint8_t fill;          // Bar: filled columns on the panel
+        bool dirty;
+        uint8_t dirty_x0, dirty_x1; // Columns to redraw and flush, absolute
+    } oled_ui_widget_t;
+
+    typedef struct
+    {
+        uint32_t renders;    // oled_ui_render() calls
+        uint32_t idle;       // Renders with nothing to flush
+        uint32_t frames;     // Full frames (the first render, after oled_ui_invalidate_all())
+        uint32_t windows;    // Windows flushed
+        uint32_t bytes;      // Written for them, window commands included
+        uint32_t errors;     // Failed flushes (the widget stays dirty)
+        uint32_t render_max_us;
+    } oled_ui_stats_t;
+
+    // Not locked: one task sets the values and renders
+    typedef struct
+    {
+        ssd1306_handle_t *display;
+        oled_ui_widget_t widgets[OLED_UI_MAX_WIDGETS];
+        uint8_t n_widgets;
+        bool full; // Next render clears the buffer and sends the whole frame
+        oled_ui_stats_t stats;
+    } oled_ui_t;
+
+    // Forget all widgets; the next render clears the display
+    void oled_ui_init(oled_ui_t *ui, ssd1306_handle_t *display);
+
+    /**
+     * @brief Add a text label of max_cells characters.
+     *
+     * @return Widget id, -1 when the table is full or the box is off the display.
+     */
+    int oled_ui_add_label(oled_ui_t *ui, uint8_t x, uint8_t page, oled_ui_font_t font, uint8_t max_cells,
+                          const char *text);
+
+    /**
+     * @brief Add a number: digits cells for the value (sign included, right aligned), then the
+     * suffix (e.g. "mV"). A value that does not fit shows as '#'.
+     */
+    int oled_ui_add_number(oled_ui_t *ui, uint8_t x, uint8_t page, oled_ui_font_t font, uint8_t digits,
+                           const char *suffix);
+
+    // Horizontal bar gauge with an outline; the fill is (value - min) / (max - min) of the inside
+    int oled_ui_add_bar(oled_ui_t *ui, uint8_t x, uint8_t page, uint8_t w, uint8_t pages, int32_t min, int32_t max);
+
+    // Row of count relay icons (8x8, 10 columns apart), filled when the bit of the value is set
+    int oled_ui_add_relays(oled_ui_t *ui, uint8_t x, uint8_t page, uint8_t count);
+
+    /**
+     * @brief Set the value of a number, bar or relay row; only what it changes on the panel is
+     * marked for the next render.
+     */
+    esp_err_t oled_ui_set_value(oled_ui_t *ui, int id, int32_t value);
+
+    // Set the text of a label (cut to its cells, padded with spaces)
+    esp_err_t oled_ui_set_text(oled_ui_t *ui, int id, const char *text);
+
+    // Clear and draw everything on the next render, e.g. after something else drew on the display
+    void oled_ui_invalidate_all(oled_ui_t *ui);
+
+    /**
+     * @brief Redraw the marked parts into the frame buffer and flush each as a column and page
+     * window (ssd1306_show_window()). No allocation, no formatting through the C library.
+     *
+     * @return ESP_OK, or the first flush error (those parts stay marked).
+     */
+    esp_err_t oled_ui_render(oled_ui_t *ui);
+
+    /**
+     * @brief Decimal of value right aligned in n cells, without snprintf: '-' for negatives,
+     * spaces in front, all '#' when it does not fit.
+     */
+    void oled_ui_format_int(int32_t value, char *cells, uint8_t n);
+
+#ifdef __cplusplus
+}
+#endif
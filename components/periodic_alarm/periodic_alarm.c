@@ -0,0 +1,100 @@
+/**
+ * @file periodic_alarm.c
+ * @brief Periodic general purpose timer alarm for the control loop, the failsafe and the scope.
+ *
+ * Each of them runs a microsecond timer whose alarm reloads itself. Setting one up takes
+ * five gptimer calls, each of which can fail and must undo the ones before. The loop and the
+ * scope create the timer from their own task, so the interrupt lands on the core of that
+ * task; periodic_alarm_sync_t is the start and stop handshake with such a task.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "periodic_alarm.h"
+
+esp_err_t periodic_alarm_start(uint32_t period_us, gptimer_alarm_cb_t on_alarm, void *arg,
+                               gptimer_handle_t *ret_timer)
+{
+    if (!on_alarm || !ret_timer || period_us == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gptimer_config_t config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000, // 1 us per count
+    };
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = on_alarm,
+    };
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = period_us,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+
+    gptimer_handle_t timer = NULL;
+    *ret_timer = NULL;
+    esp_err_t ret = gptimer_new_timer(&config, &timer);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = gptimer_register_event_callbacks(timer, &cbs, arg);
+    if (ret == ESP_OK)
+    {
+        ret = gptimer_set_alarm_action(timer, &alarm);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = gptimer_enable(timer);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = gptimer_start(timer);
+        if (ret != ESP_OK)
+        {
+            gptimer_disable(timer);
+        }
+    }
+    if (ret != ESP_OK)
+    {
+        gptimer_del_timer(timer);
+        return ret;
+    }
+    *ret_timer = timer;
+    return ESP_OK;
+}
+
+void periodic_alarm_stop(gptimer_handle_t *timer)
+{
+    if (!timer || !*timer)
+    {
+        return;
+    }
+    gptimer_stop(*timer);
+    gptimer_disable(*timer);
+    gptimer_del_timer(*timer);
+    *timer = NULL;
+}
+
+void periodic_alarm_sync_init(periodic_alarm_sync_t *sync)
+{
+    if (!sync->done)
+    {
+        sync->done = xSemaphoreCreateBinaryStatic(&sync->buf);
+    }
+}
+
+void periodic_alarm_sync_give(periodic_alarm_sync_t *sync, esp_err_t result)
+{
+    sync->result = result;
+    xSemaphoreGive(sync->done);
+}
+
+esp_err_t periodic_alarm_sync_wait(periodic_alarm_sync_t *sync)
+{
+    xSemaphoreTake(sync->done, portMAX_DELAY);
+    return sync->result;
+}
@@ -0,0 +1,70 @@
+// periodic_alarm.h
+// Periodic general purpose timer alarm, and the start/stop handshake of the task that owns it
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "driver/gptimer.h"
+#include "esp_err.h"
+
+    /**
+     * @brief Start a timer that calls on_alarm every period_us.
+     *
+     * The timer counts in microseconds and reloads on the alarm. Its interrupt is allocated
+     * on the core of the calling task.
+     *
+     * @param period_us Alarm period.
+     * @param on_alarm  Interrupt callback (IRAM_ATTR); returns true when it woke a higher
+     *                  priority task.
+     * @param arg       Passed to on_alarm.
+     * @param ret_timer Output: the running timer, for periodic_alarm_stop(). NULL on error.
+     * @return ESP_OK, ESP_ERR_INVALID_ARG, or the gptimer error (nothing is left allocated).
+     */
+    esp_err_t periodic_alarm_start(uint32_t period_us, gptimer_alarm_cb_t on_alarm, void *arg,
+                                   gptimer_handle_t *ret_timer);
+
+    /**
+     * @brief Stop and delete a timer of periodic_alarm_start(). Sets *timer to NULL.
+     */
+    void periodic_alarm_stop(gptimer_handle_t *timer);
+
+    /**
+     * Handshake with a task that starts its own alarm, so the interrupt lands on the core of
+     * that task: the task reports once when the alarm runs (or failed to start) and once when
+     * it ends, the starting and stopping caller waits for it.
+     */
+    typedef struct
+    {
+        StaticSemaphore_t buf;
+        SemaphoreHandle_t done;
+        esp_err_t result;
+    } periodic_alarm_sync_t;
+
+    /**
+     * @brief Create the semaphore on first use; later calls do nothing.
+     */
+    void periodic_alarm_sync_init(periodic_alarm_sync_t *sync);
+
+    /**
+     * @brief Task side: the alarm started with this result, or the task ends (ESP_OK).
+     */
+    void periodic_alarm_sync_give(periodic_alarm_sync_t *sync, esp_err_t result);
+
+    /**
+     * @brief Caller side: wait for the task to report.
+     *
+     * @return The result the task gave.
+     */
+    esp_err_t periodic_alarm_sync_wait(periodic_alarm_sync_t *sync);
+
+#ifdef __cplusplus
+}
+#endif
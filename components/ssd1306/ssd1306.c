@@ -11,9 +11,9 @@
 #include "esp_log.h"           // Logging functionality
 #include "driver/i2c_master.h" // I2C master configuration and communication
 #include "ssd1306.h"           // SSD1306 OLED display driver
-#include <ssd1306_fonts.h>
-
-#include "font_petme128_8x8.h"
+#include "i2c_bus.h"           // Shared device-handle registry
+#include "i2c_sched.h"         // Bus scheduler (display traffic is bulk priority)
+#include "ssd1306_font.h"      // Glyph tables of the print functions
 // Logging tag for ESP-IDF
 static const char *TAG = "SSD1306";
 
@@ -47,7 +47,7 @@ static void ssd1306_write_cmd(ssd1306_handle_t *handle, uint8_t cmd)
     uint8_t data[2];
     data[0] = 0x80; // Indicate we're sending a command
     data[1] = cmd;
-    esp_err_t ret = i2c_master_transmit(handle->dev_handle, data, sizeof(data), pdMS_TO_TICKS(1000));
+    esp_err_t ret = i2c_sched_transmit(handle->dev_handle, I2C_SCHED_PRIO_BULK, data, sizeof(data), pdMS_TO_TICKS(1000));
 
     if (ret != ESP_OK)
     {
@@ -57,36 +57,24 @@ static void ssd1306_write_cmd(ssd1306_handle_t *handle, uint8_t cmd)
 
 #define MAX_CHUNK_SIZE 32 // Maximum size of each data chunk
 
-static esp_err_t write_data_chunk(ssd1306_handle_t *handle, const uint8_t *data, size_t chunk_size)
-{
-    uint8_t buf[MAX_CHUNK_SIZE + 1];   // 32 bytes of data + 1 byte for the control byte
-    buf[0] = 0x40;                     // Indicate we're sending data
-    memcpy(buf + 1, data, chunk_size); // Copy chunk data into buffer
-
-    // Transmit data over I2C
-    return i2c_master_transmit(handle->dev_handle, buf, chunk_size + 1, pdMS_TO_TICKS(1000));
-}
-
+// The scheduler splits the data in chunks of MAX_CHUNK_SIZE, each sent with the 0x40
+// control byte. Between chunks more urgent traffic (DAC, relays) can use the bus.
 static void ssd1306_write_data(ssd1306_handle_t *handle, const uint8_t *data, size_t length)
 {
-    size_t remaining_length = length; // Number of bytes left to write
-    size_t written = 0;
+    i2c_sched_txn_t txn = {
+        .dev_handle = handle->dev_handle,
+        .prio = I2C_SCHED_PRIO_BULK,
+        .write_buf = data,
+        .write_len = length,
+        .timeout_ms = pdMS_TO_TICKS(1000),
+        .chunk_size = MAX_CHUNK_SIZE,
+        .chunk_prefix = 0x40, // Indicate we're sending data
+    };
 
-    while (remaining_length > 0)
+    esp_err_t ret = i2c_sched_submit(&txn);
+    if (ret != ESP_OK)
     {
-        size_t chunk_size = (remaining_length > MAX_CHUNK_SIZE) ? MAX_CHUNK_SIZE : remaining_length;
-
-        // Write the current chunk
-        esp_err_t ret = write_data_chunk(handle, data + written, chunk_size);
-        //   ESP_LOGE(TAG, "Writing chunk of size %d, remaining %d bytes", chunk_size, remaining_length);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGE(TAG, "Error writing data block");
-            break;
-        }
-
-        written += chunk_size;
-        remaining_length -= chunk_size;
+        ESP_LOGE(TAG, "Error writing data block");
     }
 }
 
@@ -101,17 +89,12 @@ void ssd1306_init(ssd1306_handle_t *dev, uint8_t width, uint8_t height, uint8_t
 
     dev->external_vcc = external_vcc;
 
-    // attach the I2C device handle
-    i2c_device_config_t i2c_dev_conf = {
-        .scl_speed_hz = dev->scl_speed_hz,     // Set the I2C clock frequency
-        .device_address = dev->device_address, // Set the device address
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7, // Use 7-bit addressing
-    };
-    // Add the device to the I2C bus
-    esp_err_t ret = i2c_master_bus_add_device(dev->bus_handle, &i2c_dev_conf, &dev->dev_handle);
+    // get the shared I2C device handle from the registry (created on first use only)
+    esp_err_t ret = i2c_bus_get_device(dev->bus_handle, dev->device_address, dev->scl_speed_hz, &dev->dev_handle);
     if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to add I2C device: %s", esp_err_to_name(ret));
+        dev->dev_handle = NULL;
         return;
     }
     // Initialize the buffer to zero
@@ -163,15 +146,13 @@ void ssd1306_init(ssd1306_handle_t *dev, uint8_t width, uint8_t height, uint8_t
 void ssd1306_deinit(ssd1306_handle_t *dev)
 {
     assert(dev != NULL);
+    ssd1306_wait(dev, 1000); // the bus may still read the staging buffers
     // Power off the display
     // ssd1306_poweroff(dev);
     // Clear the buffer
     memset(dev->buffer, 0, sizeof(dev->buffer));
-    // Free the device handle if needed (not shown here)
-    if (i2c_master_bus_rm_device(dev->dev_handle) != ESP_OK)
-    {
-        ESP_LOGE(TAG, "Failed to remove I2C device");
-    }
+    // The device handle belongs to the registry (i2c_bus), just forget it
+    dev->dev_handle = NULL;
     ESP_LOGI(TAG, "SSD1306 deinitialized");
 }
 
@@ -245,93 +226,163 @@ void ssd1306_show(ssd1306_handle_t *dev)
     ssd1306_write_data(dev, dev->buffer, sizeof(dev->buffer)); // full buffer copy 1KByte data over i2c
 }
 
-// FONTS
+// Asynchronous flush: the frame is copied to the staging buffers and queued as one command
+// transfer plus one transfer per page. The I2C interrupt sends them back to back while the
+// caller draws the next frame.
+esp_err_t ssd1306_show_async(ssd1306_handle_t *dev)
+{
+    assert(dev != NULL);
 
-#define FONT_CHAR_START 32
-#define FONT_CHAR_OFFSET 4
+    if (!i2c_async_port_is_async(i2c_bus_device_port(dev->dev_handle)))
+    {
+        ssd1306_show(dev); // synchronous bus: chunked through the scheduler
+        return ESP_OK;
+    }
 
-static void draw_character(ssd1306_handle_t *dev, uint32_t xpos, uint32_t ypos, uint32_t color,
-                           const uint8_t *char_data, uint32_t height, uint32_t width)
-{
-    for (uint32_t x_offset = 0; x_offset < width; x_offset++)
+    // staging buffers still in use by the last flush; the wait returns only when the driver
+    // let go of them, also after a timeout (bus reset), so they can be filled again
+    esp_err_t ret = ssd1306_wait(dev, 1000);
+    if (ret != ESP_OK)
     {
-        uint32_t column_data = (height > 8)
-                                   ? (char_data[x_offset] | (char_data[x_offset + 8] << 8))
-                                   : char_data[x_offset];
-        uint32_t inverted_column = color ? column_data : ~column_data;
+        ESP_LOGW(TAG, "Previous flush: %s", esp_err_to_name(ret));
+    }
 
-        for (uint32_t bit = 0; bit < height; bit++)
+    uint8_t width = (dev->width > SSD1306_MAX_WIDTH) ? SSD1306_MAX_WIDTH : dev->width;
+    uint8_t pages = (dev->pages > SSD1306_MAX_PAGES) ? SSD1306_MAX_PAGES : dev->pages;
+
+    // Co=0, D/C#=0: all following bytes are commands
+    const uint8_t cmd[sizeof(dev->tx_cmd)] = {0x00, SET_COL_ADDR, 0, width - 1, SET_PAGE_ADDR, 0, pages - 1};
+    memcpy(dev->tx_cmd, cmd, sizeof(cmd));
+    dev->tx_req[0] = (i2c_async_req_t){
+        .write_buf = dev->tx_cmd,
+        .write_len = sizeof(dev->tx_cmd),
+    };
+    for (int p = 0; p < pages; p++)
+    {
+        dev->tx_frame[p][0] = 0x40; // Indicate we're sending data
+        memcpy(&dev->tx_frame[p][1], &dev->buffer[p * SSD1306_MAX_WIDTH], width);
+        dev->tx_req[1 + p] = (i2c_async_req_t){
+            .write_buf = dev->tx_frame[p],
+            .write_len = 1 + width,
+        };
+    }
+
+    dev->tx_pending = 0;
+    for (int i = 0; i < 1 + pages; i++)
+    {
+        ret = i2c_async_submit(dev->dev_handle, &dev->tx_req[i]);
+        if (ret != ESP_OK)
         {
-            ssd1306_set_pixel(dev, xpos + x_offset, ypos + bit, (inverted_column >> bit) & 1);
+            ESP_LOGE(TAG, "Error queueing flush: %s", esp_err_to_name(ret));
+            break;
         }
+        dev->tx_pending++;
     }
+    return ret;
 }
 
-uint8_t ssd1306_printFixed6(ssd1306_handle_t *dev, uint8_t xpos, uint8_t ypos, uint8_t color, const char *str)
+esp_err_t ssd1306_wait(ssd1306_handle_t *dev, int timeout_ms)
 {
-    size_t str_len = strlen(str);  // Avoid recomputing strlen in the loop
-    const uint32_t fontwidth = 6;  // 6 bytes per character
-    const uint32_t fontheight = 8; // 8 bits per column
-    for (size_t i = 0; i < str_len; i++)
+    assert(dev != NULL);
+
+    esp_err_t first_err = ESP_OK;
+    for (int i = 0; i < dev->tx_pending; i++)
     {
-        char current_char = str[i];
-        int32_t font_table_index = FONT_CHAR_OFFSET + (current_char - FONT_CHAR_START) * fontwidth;
-        draw_character(dev, xpos + (i * fontwidth), ypos, color, &ssd1306xled_font6x8[font_table_index], fontheight, fontwidth);
+        esp_err_t ret = i2c_async_wait(&dev->tx_req[i], timeout_ms);
+        if (ret != ESP_OK && first_err == ESP_OK)
+        {
+            first_err = ret;
+        }
     }
-    return 0;
+    dev->tx_pending = 0;
+    return first_err;
 }
 
-uint8_t ssd1306_printFixed16(ssd1306_handle_t *dev, uint8_t xpos, uint8_t ypos, uint8_t color, const char *str)
+// Window flush: Co=1 control bytes put the column and page window in the same transfer
+// as the data, so the address pointer cannot be moved by another write in between. The
+// window wraps horizontally within its columns, one page after the other.
+#define WINDOW_HEADER (13)
+
+static uint8_t window_pages_per_transfer(uint8_t width)
 {
-    size_t str_len = strlen(str);   // Avoid recomputing strlen in the loop
-    const uint32_t fontwidth = 8;   // 8 bits per column
-    const uint32_t fontheight = 16; // 16 bits per row, 16 bytes per character
-    for (size_t i = 0; i < str_len; i++)
+    return width >= SSD1306_WINDOW_DATA ? 1 : SSD1306_WINDOW_DATA / width;
+}
+
+size_t ssd1306_window_bytes(uint8_t width, uint8_t pages)
+{
+    if (width == 0 || pages == 0)
     {
-        char current_char = str[i];
-        int32_t font_table_index = FONT_CHAR_OFFSET + (current_char - FONT_CHAR_START) * fontheight;
-        draw_character(dev, xpos + (i * fontwidth), ypos, color, &ssd1306xled_font8x16[font_table_index], fontheight, fontwidth);
+        return 0;
     }
-    return 0;
+    uint8_t per = window_pages_per_transfer(width);
+    return (size_t)((pages + per - 1) / per) * WINDOW_HEADER + (size_t)width * pages;
 }
 
-uint8_t ssd1306_printFixed8(ssd1306_handle_t *dev, uint8_t xpos, uint8_t ypos, uint8_t color, const char *str)
+esp_err_t ssd1306_show_window(ssd1306_handle_t *dev, uint8_t x0, uint8_t x1, uint8_t page0, uint8_t page1)
 {
-    const uint32_t fontwidth = 8;
-    const uint32_t fontheight = 8;
-
-    const int FONT_CHAR_MAX = 127; // Assuming ASCII
-    int x_offset = xpos;
+    assert(dev != NULL);
 
-    size_t str_len = strlen(str);
-    if (!str || str_len == 0)
+    uint8_t pages = (dev->pages > SSD1306_MAX_PAGES) ? SSD1306_MAX_PAGES : dev->pages;
+    if (x1 < x0 || x1 >= dev->width || x1 >= SSD1306_MAX_WIDTH || page1 < page0 || page1 >= pages)
     {
-        return -1; // Error: Invalid input
+        return ESP_ERR_INVALID_ARG;
     }
-
-    for (size_t i = 0; i < str_len; i++)
+    uint8_t width = x1 - x0 + 1;
+    uint8_t per = window_pages_per_transfer(width);
+    uint8_t tx[WINDOW_HEADER + SSD1306_MAX_WIDTH];
+    for (int first = page0; first <= page1; first += per)
     {
-        char current_char = str[i];
-
-        // Validate character is in valid range
-        if (current_char < FONT_CHAR_START || current_char > FONT_CHAR_MAX)
+        uint8_t last = (first + per - 1 < page1) ? first + per - 1 : page1;
+        const uint8_t header[WINDOW_HEADER] = {
+            0x80, SET_COL_ADDR, 0x80, x0, 0x80, x1,
+            0x80, SET_PAGE_ADDR, 0x80, (uint8_t)first, 0x80, last,
+            0x40, // the rest is data
+        };
+        memcpy(tx, header, sizeof(header));
+        size_t len = WINDOW_HEADER;
+        for (int p = first; p <= last; p++)
         {
-            continue; // Skip invalid characters
+            memcpy(&tx[len], &dev->buffer[p * SSD1306_MAX_WIDTH + x0], width);
+            len += width;
         }
-
-        int32_t font_table_index = (current_char - FONT_CHAR_START) * fontheight;
-        // Validate font table index
-        if (font_table_index < 0 || font_table_index >= (sizeof(font_petme128_8x8)/sizeof(font_petme128_8x8[0])))
+        esp_err_t ret = i2c_sched_transmit(dev->dev_handle, I2C_SCHED_PRIO_BULK, tx, len, 1000);
+        if (ret != ESP_OK)
         {
-            continue; // Skip if index out of bounds
+            ESP_LOGE(TAG, "Error writing window %u..%u, pages %d..%u", x0, x1, first, last);
+            return ret;
         }
+    }
+    return ESP_OK;
+}
 
-        draw_character(dev, x_offset, ypos, color,
-                       &font_petme128_8x8[font_table_index],
-                       fontheight, fontwidth);
+esp_err_t ssd1306_show_columns(ssd1306_handle_t *dev, uint8_t x0, uint8_t x1)
+{
+    assert(dev != NULL);
+    return ssd1306_show_window(dev, x0, x1, 0, dev->pages - 1);
+}
 
-        x_offset += fontwidth; // Increment x position more efficiently
+// FONTS: the fixed-width print functions draw through the glyph tables of ssd1306_font.c, so
+// a byte outside ' '..'~' (or a UTF-8 sequence) shows as '?' instead of reading past the table.
+
+uint8_t ssd1306_printFixed6(ssd1306_handle_t *dev, uint8_t xpos, uint8_t y, uint8_t color, const char *str)
+{
+    ssd1306_print(dev, &ssd1306_font_6x8, xpos, y, color, str);
+    return 0;
+}
+
+uint8_t ssd1306_printFixed16(ssd1306_handle_t *dev, uint8_t xpos, uint8_t ypos, uint8_t color, const char *str)
+{
+    ssd1306_print(dev, &ssd1306_font_8x16, xpos, ypos, color, str);
+    return 0;
+}
+
+uint8_t ssd1306_printFixed8(ssd1306_handle_t *dev, uint8_t xpos, uint8_t ypos, uint8_t color, const char *str)
+{
+    if (!str || str[0] == '\0')
+    {
+        return -1; // Error: Invalid input
     }
+    ssd1306_print(dev, &ssd1306_font_petme8, xpos, ypos, color, str);
     return 0;
 }
 
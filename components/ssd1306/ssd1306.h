@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #ifdef __cplusplus
 extern "C"
 {
@@ -18,7 +19,11 @@ extern "C"
 // #define BUILD_BUG_ON_ZERO(e) (sizeof(struct { int : (-!!(e)); }))
 
 #include "driver/i2c_master.h"
+#include "i2c_async.h"
 #define SSD1306_I2C_ADDRESS (0x3c) // Default I2C address
+#define SSD1306_MAX_PAGES (8)      // 64 rows
+#define SSD1306_MAX_WIDTH (128)    // Columns, also the row stride of the buffer
+#define SSD1306_WINDOW_DATA (128)  // Data bytes per transfer of a window flush
 
     // SSD1306 device descriptor
     typedef struct
@@ -35,6 +40,11 @@ extern "C"
         uint8_t external_vcc;  // External VCC flag (1 byte)
 
         uint8_t buffer[1024]; // Pixel buffer (1024 bytes)
+        // Asynchronous flush (ssd1306_show_async): staged copy of the frame, in flight on the bus
+        uint8_t tx_cmd[7];                                       // Column and page address commands
+        uint8_t tx_frame[SSD1306_MAX_PAGES][1 + SSD1306_MAX_WIDTH]; // Control byte 0x40 + one page
+        i2c_async_req_t tx_req[1 + SSD1306_MAX_PAGES];
+        uint8_t tx_pending; // Requests of the last flush, 0 = none
     } ssd1306_handle_t;
 
     // Initialization/free function
@@ -53,6 +63,20 @@ extern "C"
 
     // Copy bitmap from buffer to device (blit)
     void ssd1306_show(ssd1306_handle_t *dev);
+    // Start a flush and return at once; the buffer may be drawn again right away.
+    // Needs an asynchronous bus (i2c_async_new_bus), otherwise it is ssd1306_show().
+    esp_err_t ssd1306_show_async(ssd1306_handle_t *dev);
+    // Wait until the last asynchronous flush is on the display; after timeout_ms the bus is
+    // reset (i2c_async_wait). The staging buffers are free again on return, also on an error.
+    esp_err_t ssd1306_wait(ssd1306_handle_t *dev, int timeout_ms);
+    // Copy a window of the buffer, columns x0..x1 of pages page0..page1, instead of the 1 KB
+    // frame. Every transfer carries its own address window (13 bytes) and whole pages of the
+    // window, up to SSD1306_WINDOW_DATA bytes. ESP_ERR_INVALID_ARG for a window off the display.
+    esp_err_t ssd1306_show_window(ssd1306_handle_t *dev, uint8_t x0, uint8_t x1, uint8_t page0, uint8_t page1);
+    // Columns x0..x1 of all pages: 13 + 8 bytes per column, one transfer up to 16 columns
+    esp_err_t ssd1306_show_columns(ssd1306_handle_t *dev, uint8_t x0, uint8_t x1);
+    // Bytes ssd1306_show_window() writes for a window of this size
+    size_t ssd1306_window_bytes(uint8_t width, uint8_t pages);
     uint8_t ssd1306_printFixed6(ssd1306_handle_t *dev, uint8_t xpos, uint8_t y, uint8_t color, const char *str);
     uint8_t ssd1306_printFixed8(ssd1306_handle_t *dev, uint8_t xpos, uint8_t ypos, uint8_t color, const char *str);
     uint8_t ssd1306_printFixed16(ssd1306_handle_t *dev, uint8_t xpos, uint8_t ypos, uint8_t color, const char *str);
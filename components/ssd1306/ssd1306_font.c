@@ -0,0 +1,222 @@
+// ssd1306_font.c
+// Glyph lookup, UTF-8 decoding, text width and drawing for ssd1306_font_t
+// Edwin vd Oetelaar, juni 2025
+
+#include "ssd1306_font.h"
+#include <stddef.h>
+#include "ssd1306_fonts.h"
+#include "font_petme128_8x8.h"
+
+#define FIXED_HEADER (4) // Type, width, height, first character of the ssd1306xled tables
+#define GLYPH_QUESTION ('?' - SSD1306_FONT_ASCII_FIRST)
+
+static const ssd1306_font_range_t ascii_only[1] = {
+    {SSD1306_FONT_ASCII_FIRST, SSD1306_FONT_ASCII_COUNT, 0},
+};
+
+// The fixed fonts as they were: glyph i at i * width * pages, ASCII only
+const ssd1306_font_t ssd1306_font_6x8 = {
+    .pages = 1,
+    .spacing = 0, // the glyphs have their own blank column
+    .fixed_width = 6,
+    .fallback = GLYPH_QUESTION,
+    .bitmap = &ssd1306xled_font6x8[FIXED_HEADER],
+    .ranges = ascii_only,
+    .n_ranges = 1,
+};
+
+const ssd1306_font_t ssd1306_font_8x16 = {
+    .pages = 2,
+    .spacing = 0,
+    .fixed_width = 8,
+    .fallback = GLYPH_QUESTION,
+    .bitmap = &ssd1306xled_font8x16[FIXED_HEADER],
+    .ranges = ascii_only,
+    .n_ranges = 1,
+};
+
+const ssd1306_font_t ssd1306_font_petme8 = {
+    .pages = 1,
+    .spacing = 0,
+    .fixed_width = 8,
+    .fallback = GLYPH_QUESTION,
+    .bitmap = font_petme128_8x8,
+    .ranges = ascii_only,
+    .n_ranges = 1,
+};
+
+uint32_t ssd1306_utf8_next(const char **s)
+{
+    const uint8_t *p = (const uint8_t *)*s;
+    uint32_t cp = p[0];
+    uint32_t min;
+    int n;
+    if (cp == 0)
+    {
+        return 0;
+    }
+    if (cp < 0x80)
+    {
+        *s += 1;
+        return cp;
+    }
+    if ((cp & 0xE0) == 0xC0)
+    {
+        n = 1;
+        cp &= 0x1F;
+        min = 0x80;
+    }
+    else if ((cp & 0xF0) == 0xE0)
+    {
+        n = 2;
+        cp &= 0x0F;
+        min = 0x800;
+    }
+    else if ((cp & 0xF8) == 0xF0)
+    {
+        n = 3;
+        cp &= 0x07;
+        min = 0x10000;
+    }
+    else
+    {
+        *s += 1; // a continuation byte without a lead, or 0xF8..0xFF
+        return SSD1306_UTF8_REPLACEMENT;
+    }
+    for (int i = 1; i <= n; i++)
+    {
+        if ((p[i] & 0xC0) != 0x80) // also the end of the string
+        {
+            *s += 1;
+            return SSD1306_UTF8_REPLACEMENT;
+        }
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+    {
+        *s += 1;
+        return SSD1306_UTF8_REPLACEMENT;
+    }
+    *s += n + 1;
+    return cp;
+}
+
+uint16_t ssd1306_font_glyph(const ssd1306_font_t *font, uint32_t cp)
+{
+    uint32_t i = cp - SSD1306_FONT_ASCII_FIRST; // wraps below ' '
+    if (i < SSD1306_FONT_ASCII_COUNT)
+    {
+        return (uint16_t)i;
+    }
+    int lo = 1, hi = font->n_ranges - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        const ssd1306_font_range_t *r = &font->ranges[mid];
+        if (cp < r->first)
+        {
+            hi = mid - 1;
+        }
+        else if (cp - r->first >= r->count)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            return (uint16_t)(r->glyph + (cp - r->first));
+        }
+    }
+    return font->fallback;
+}
+
+const uint8_t *ssd1306_font_bitmap(const ssd1306_font_t *font, uint16_t glyph, uint8_t *width)
+{
+    if (font->fixed_width)
+    {
+        *width = font->fixed_width;
+        return &font->bitmap[(size_t)glyph * font->fixed_width * font->pages];
+    }
+    *width = font->width[glyph];
+    return &font->bitmap[font->offset[glyph]];
+}
+
+uint16_t ssd1306_text_width(const ssd1306_font_t *font, const char *utf8)
+{
+    uint32_t total = 0;
+    uint32_t cp;
+    bool first = true;
+    while ((cp = ssd1306_utf8_next(&utf8)) != 0)
+    {
+        total += (first ? 0 : font->spacing) +
+                 (font->fixed_width ? font->fixed_width : font->width[ssd1306_font_glyph(font, cp)]);
+        first = false;
+    }
+    return total > UINT16_MAX ? UINT16_MAX : (uint16_t)total;
+}
+
+// Columns of a glyph (NULL: blank) at x, y; page aligned a byte at a time, else per pixel
+static void draw_columns(ssd1306_handle_t *dev, const uint8_t *g, uint8_t w, uint8_t pages, int x, int y,
+                         uint8_t color)
+{
+    int rows = dev->pages * 8;
+    for (int c = 0; c < w; c++)
+    {
+        int col = x + c;
+        if (col < 0 || col >= dev->width)
+        {
+            continue;
+        }
+        for (int p = 0; p < pages; p++)
+        {
+            uint8_t b = g ? g[p * w + c] : 0;
+            b = color ? b : (uint8_t)~b;
+            int top = y + p * 8;
+            if ((top & 7) == 0)
+            {
+                if (top >= 0 && top < rows)
+                {
+                    dev->buffer[(top / 8) * SSD1306_MAX_WIDTH + col] = b;
+                }
+                continue;
+            }
+            for (int bit = 0; bit < 8; bit++)
+            {
+                int row = top + bit;
+                if (row < 0 || row >= rows)
+                {
+                    continue;
+                }
+                uint8_t *dst = &dev->buffer[(row / 8) * SSD1306_MAX_WIDTH + col];
+                uint8_t mask = 1u << (row & 7);
+                *dst = (b >> bit & 1) ? (*dst | mask) : (*dst & ~mask);
+            }
+        }
+    }
+}
+
+int ssd1306_print(ssd1306_handle_t *dev, const ssd1306_font_t *font, int x, int y, uint8_t color,
+                  const char *utf8)
+{
+    uint32_t cp;
+    bool first = true;
+    while ((cp = ssd1306_utf8_next(&utf8)) != 0)
+    {
+        if (!first && font->spacing)
+        {
+            draw_columns(dev, NULL, font->spacing, font->pages, x, y, color);
+            x += font->spacing;
+        }
+        first = false;
+        uint8_t w;
+        const uint8_t *g = ssd1306_font_bitmap(font, ssd1306_font_glyph(font, cp), &w);
+        draw_columns(dev, g, w, font->pages, x, y, color);
+        x += w;
+        if (x >= dev->width)
+        {
+            // clipped from here on; the column after the text is still counted
+            x += ssd1306_text_width(font, utf8) + (*utf8 ? font->spacing : 0);
+            break;
+        }
+    }
+    return x;
+}
@@ -0,0 +1,86 @@
+// ssd1306_font.h
+// Fonts with a glyph table for the SSD1306: fixed or proportional, ASCII and beyond, UTF-8 text
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ssd1306.h"
+
+#define SSD1306_FONT_ASCII_FIRST (0x20) // ' ', glyph 0 of every font
+#define SSD1306_FONT_ASCII_COUNT (95)   // ' '..'~'
+#define SSD1306_UTF8_REPLACEMENT (0xFFFD)
+
+    // Code points first .. first + count - 1 are glyphs glyph .. glyph + count - 1
+    typedef struct
+    {
+        uint32_t first;
+        uint16_t count;
+        uint16_t glyph;
+    } ssd1306_font_range_t;
+
+    /**
+     * @brief A font as column bytes, LSB at the top, as the frame buffer holds them.
+     *
+     * A glyph is width bytes of its top page, then width bytes of the next page, and so on.
+     * ASCII ' '..'~' are glyphs 0..94 in every font, so looking them up is an index; other
+     * code points are found by a binary search in the sorted ranges after ranges[0].
+     * tools/fontgen.py generates these tables from a BDF or TTF font.
+     */
+    typedef struct
+    {
+        uint8_t pages;          // Height in pages of 8 rows, 1..4
+        uint8_t spacing;        // Blank columns after each glyph
+        uint8_t fixed_width;    // Nonzero: every glyph is this wide, width and offset are NULL
+        uint16_t fallback;      // Glyph drawn for a code point the font does not have
+        const uint8_t *bitmap;
+        const uint8_t *width;   // Per glyph, columns
+        const uint16_t *offset; // Per glyph, into bitmap (identical glyphs share their bytes)
+        const ssd1306_font_range_t *ranges; // ranges[0]: ASCII from glyph 0
+        uint16_t n_ranges;
+    } ssd1306_font_t;
+
+    extern const ssd1306_font_t ssd1306_font_6x8;   // ssd1306xled_font6x8, ASCII
+    extern const ssd1306_font_t ssd1306_font_8x16;  // ssd1306xled_font8x16, ASCII
+    extern const ssd1306_font_t ssd1306_font_petme8; // font_petme128_8x8, ASCII
+    extern const ssd1306_font_t ssd1306_font_sans8; // Proportional 8 rows, Latin-1, IJ and the euro sign
+
+    /**
+     * @brief Decode the next code point of a UTF-8 string and advance *s past it.
+     *
+     * @return The code point, 0 at the end of the string (*s stays there), or
+     *         SSD1306_UTF8_REPLACEMENT for a malformed, overlong or truncated sequence or a
+     *         surrogate (*s advances one byte, so decoding goes on at the next one).
+     */
+    uint32_t ssd1306_utf8_next(const char **s);
+
+    // Glyph of a code point: an index for ASCII, a binary search of the ranges otherwise
+    uint16_t ssd1306_font_glyph(const ssd1306_font_t *font, uint32_t cp);
+
+    // Column bytes of a glyph (see ssd1306_font_t) and its width
+    const uint8_t *ssd1306_font_bitmap(const ssd1306_font_t *font, uint16_t glyph, uint8_t *width);
+
+    // Width in pixels of a UTF-8 text, the spacing between the glyphs included (not after the last)
+    uint16_t ssd1306_text_width(const ssd1306_font_t *font, const char *utf8);
+
+    /**
+     * @brief Draw a UTF-8 text into the frame buffer with its top left at x, y (pixels).
+     *
+     * Glyphs and their spacing overwrite what is under them; color 0 draws inverted. A text
+     * at a page boundary (y a multiple of 8) is copied a byte per column and page, other
+     * positions go pixel by pixel. Clipped at the edges of the display.
+     *
+     * @return Column after the text (may be beyond the display).
+     */
+    int ssd1306_print(ssd1306_handle_t *dev, const ssd1306_font_t *font, int x, int y, uint8_t color,
+                      const char *utf8);
+
+#ifdef __cplusplus
+}
+#endif
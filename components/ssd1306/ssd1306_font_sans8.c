@@ -0,0 +1,113 @@
+// ssd1306_font_sans8.c
+// Generated by tools/fontgen.py from oled_sans8.bdf, do not edit
+// 194 glyphs, 8 rows in 1 page(s), 790 bytes of bitmap; missing ASCII: none
+
+#include "ssd1306_font.h"
+
+static const uint8_t ssd1306_font_sans8_bitmap[790] = {
+    0x00, 0x00, 0x2F, 0x07, 0x00, 0x07, 0x14, 0x7F, 0x14, 0x7F, 0x14, 0x24, 0x2A, 0x7F, 0x2A, 0x12,
+    0x23, 0x13, 0x08, 0x64, 0x62, 0x36, 0x49, 0x55, 0x22, 0x50, 0x05, 0x03, 0x1C, 0x22, 0x41, 0x41,
+    0x22, 0x1C, 0x14, 0x08, 0x3E, 0x08, 0x14, 0x08, 0x08, 0x3E, 0x08, 0x08, 0xA0, 0x60, 0x08, 0x08,
+    0x08, 0x08, 0x08, 0x60, 0x60, 0x20, 0x10, 0x08, 0x04, 0x02, 0x3E, 0x51, 0x49, 0x45, 0x3E, 0x00,
+    0x42, 0x7F, 0x40, 0x00, 0x42, 0x61, 0x51, 0x49, 0x46, 0x21, 0x41, 0x45, 0x4B, 0x31, 0x18, 0x14,
+    0x12, 0x7F, 0x10, 0x27, 0x45, 0x45, 0x45, 0x39, 0x3C, 0x4A, 0x49, 0x49, 0x30, 0x01, 0x71, 0x09,
+    0x05, 0x03, 0x36, 0x49, 0x49, 0x49, 0x36, 0x06, 0x49, 0x49, 0x29, 0x1E, 0x36, 0x36, 0x56, 0x36,
+    0x08, 0x14, 0x22, 0x41, 0x14, 0x14, 0x14, 0x14, 0x14, 0x41, 0x22, 0x14, 0x08, 0x02, 0x01, 0x51,
+    0x09, 0x06, 0x32, 0x49, 0x59, 0x51, 0x3E, 0x7C, 0x12, 0x11, 0x12, 0x7C, 0x7F, 0x49, 0x49, 0x36,
+    0x3E, 0x41, 0x41, 0x22, 0x7F, 0x41, 0x22, 0x1C, 0x7F, 0x49, 0x49, 0x41, 0x7F, 0x09, 0x09, 0x01,
+    0x3E, 0x41, 0x49, 0x7A, 0x7F, 0x08, 0x08, 0x7F, 0x41, 0x7F, 0x41, 0x20, 0x40, 0x41, 0x3F, 0x01,
+    0x7F, 0x08, 0x14, 0x22, 0x41, 0x7F, 0x40, 0x40, 0x40, 0x7F, 0x02, 0x0C, 0x02, 0x7F, 0x7F, 0x04,
+    0x08, 0x10, 0x7F, 0x3E, 0x41, 0x41, 0x3E, 0x7F, 0x09, 0x09, 0x06, 0x3E, 0x41, 0x51, 0x21, 0x5E,
+    0x7F, 0x09, 0x19, 0x29, 0x46, 0x46, 0x49, 0x49, 0x31, 0x01, 0x01, 0x7F, 0x01, 0x01, 0x3F, 0x40,
+    0x40, 0x3F, 0x1F, 0x20, 0x40, 0x20, 0x1F, 0x3F, 0x40, 0x38, 0x40, 0x3F, 0x63, 0x14, 0x08, 0x14,
+    0x63, 0x07, 0x08, 0x70, 0x08, 0x07, 0x61, 0x51, 0x49, 0x45, 0x43, 0x7F, 0x41, 0x41, 0x55, 0x2A,
+    0x55, 0x2A, 0x55, 0x41, 0x41, 0x7F, 0x04, 0x02, 0x01, 0x02, 0x04, 0x40, 0x40, 0x40, 0x40, 0x40,
+    0x01, 0x02, 0x04, 0x20, 0x54, 0x54, 0x78, 0x7F, 0x48, 0x44, 0x38, 0x38, 0x44, 0x44, 0x20, 0x38,
+    0x44, 0x48, 0x7F, 0x38, 0x54, 0x54, 0x18, 0x08, 0x7E, 0x09, 0x01, 0x02, 0x18, 0xA4, 0xA4, 0x7C,
+    0x7F, 0x08, 0x04, 0x78, 0x44, 0x7D, 0x40, 0x40, 0x80, 0x84, 0x7D, 0x7F, 0x10, 0x28, 0x44, 0x41,
+    0x7F, 0x40, 0x7C, 0x04, 0x18, 0x04, 0x78, 0x7C, 0x08, 0x04, 0x78, 0x38, 0x44, 0x44, 0x38, 0xFC,
+    0x24, 0x24, 0x18, 0x18, 0x24, 0x18, 0xFC, 0x7C, 0x08, 0x04, 0x08, 0x48, 0x54, 0x54, 0x20, 0x04,
+    0x3F, 0x44, 0x40, 0x20, 0x3C, 0x40, 0x20, 0x7C, 0x1C, 0x20, 0x40, 0x20, 0x1C, 0x3C, 0x40, 0x30,
+    0x40, 0x3C, 0x44, 0x28, 0x10, 0x28, 0x44, 0x1C, 0xA0, 0xA0, 0x7C, 0x44, 0x64, 0x54, 0x4C, 0x44,
+    0x08, 0x77, 0x7F, 0x77, 0x08, 0x10, 0x08, 0x10, 0x08, 0x7D, 0x18, 0x24, 0x7E, 0x24, 0x48, 0x7E,
+    0x49, 0x41, 0x22, 0x22, 0x1C, 0x14, 0x1C, 0x22, 0x29, 0x2A, 0x7C, 0x2A, 0x29, 0x77, 0x0A, 0x55,
+    0x55, 0x28, 0x01, 0x00, 0x01, 0x3E, 0x41, 0x5D, 0x55, 0x41, 0x3E, 0x2C, 0x2D, 0x2F, 0x10, 0x28,
+    0x44, 0x10, 0x28, 0x44, 0x08, 0x08, 0x08, 0x18, 0x10, 0x10, 0x10, 0x3E, 0x41, 0x7D, 0x55, 0x69,
+    0x3E, 0x01, 0x01, 0x01, 0x01, 0x02, 0x05, 0x02, 0x24, 0x24, 0x2E, 0x24, 0x24, 0x09, 0x0D, 0x0A,
+    0x09, 0x0B, 0x06, 0x02, 0x01, 0xFC, 0x20, 0x20, 0x1C, 0x20, 0x06, 0x0F, 0x7F, 0x01, 0x7F, 0x18,
+    0x18, 0x80, 0x80, 0x0A, 0x0F, 0x08, 0x26, 0x29, 0x26, 0x44, 0x28, 0x10, 0x44, 0x28, 0x10, 0x27,
+    0x10, 0x28, 0x54, 0x7A, 0xC1, 0x27, 0x10, 0x08, 0x6C, 0x5A, 0x41, 0x05, 0x27, 0x10, 0x28, 0x54,
+    0x7A, 0xC1, 0x30, 0x48, 0x45, 0x40, 0x20, 0x70, 0x29, 0x26, 0x28, 0x70, 0x70, 0x28, 0x26, 0x29,
+    0x70, 0x70, 0x2A, 0x25, 0x2A, 0x70, 0x70, 0x2A, 0x25, 0x2A, 0x71, 0x70, 0x29, 0x24, 0x29, 0x70,
+    0x70, 0x2B, 0x25, 0x2B, 0x70, 0x7E, 0x09, 0x09, 0x7F, 0x49, 0x49, 0x41, 0xBE, 0xC1, 0x41, 0x22,
+    0x7D, 0x56, 0x54, 0x44, 0x7C, 0x56, 0x55, 0x44, 0x7E, 0x55, 0x56, 0x44, 0x7D, 0x54, 0x55, 0x44,
+    0x45, 0x7E, 0x44, 0x44, 0x7E, 0x45, 0x46, 0x7D, 0x46, 0x45, 0x7C, 0x45, 0x08, 0x7F, 0x49, 0x49,
+    0x41, 0x36, 0x08, 0x7C, 0x12, 0x21, 0x02, 0x7D, 0x39, 0x46, 0x44, 0x38, 0x38, 0x46, 0x45, 0x38,
+    0x3A, 0x45, 0x46, 0x38, 0x3A, 0x45, 0x46, 0x39, 0x39, 0x44, 0x45, 0x38, 0x22, 0x14, 0x08, 0x14,
+    0x22, 0x7E, 0x61, 0x5D, 0x43, 0x3F, 0x3D, 0x42, 0x40, 0x3C, 0x3C, 0x42, 0x41, 0x3C, 0x3E, 0x41,
+    0x42, 0x3C, 0x3D, 0x40, 0x41, 0x3C, 0x0C, 0x10, 0x62, 0x11, 0x0C, 0x7F, 0x12, 0x12, 0x12, 0x0C,
+    0x7E, 0x01, 0x49, 0x36, 0x21, 0x56, 0x54, 0x78, 0x20, 0x56, 0x55, 0x78, 0x22, 0x55, 0x56, 0x78,
+    0x22, 0x55, 0x56, 0x79, 0x21, 0x54, 0x55, 0x78, 0x23, 0x55, 0x57, 0x78, 0x20, 0x54, 0x54, 0x38,
+    0x54, 0x54, 0x58, 0xB8, 0xC4, 0x44, 0x20, 0x39, 0x56, 0x54, 0x18, 0x38, 0x56, 0x55, 0x18, 0x3A,
+    0x55, 0x56, 0x18, 0x39, 0x54, 0x55, 0x18, 0x45, 0x7E, 0x40, 0x44, 0x7E, 0x41, 0x46, 0x7D, 0x42,
+    0x00, 0x45, 0x7C, 0x41, 0x00, 0x20, 0x55, 0x52, 0x55, 0x38, 0x7E, 0x09, 0x06, 0x79, 0x08, 0x08,
+    0x2A, 0x08, 0x08, 0x78, 0x64, 0x54, 0x4C, 0x3C, 0x3D, 0x42, 0x20, 0x7C, 0x3C, 0x42, 0x21, 0x7C,
+    0x3E, 0x41, 0x22, 0x7C, 0x3D, 0x40, 0x21, 0x7C, 0x1C, 0xA2, 0xA1, 0x7C, 0xFE, 0x24, 0x24, 0x24,
+    0x18, 0x1D, 0xA0, 0xA1, 0x7C, 0x7F, 0x41, 0x20, 0x40, 0x40, 0x3F, 0x45, 0x7C, 0xC0, 0x84, 0x7D,
+    0x14, 0x3E, 0x55, 0x55, 0x41, 0x22,
+};
+
+static const uint8_t ssd1306_font_sans8_width[194] = {
+    2, 1, 3, 5, 5, 5, 5, 2, 3, 3, 5, 5, 2, 5, 2, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 2, 2, 4, 5, 4, 5,
+    5, 5, 4, 4, 4, 4, 4, 4, 4, 3, 5, 5, 4, 5, 5, 4,
+    4, 5, 5, 4, 5, 4, 5, 5, 5, 5, 5, 3, 5, 3, 5, 5,
+    3, 4, 4, 4, 4, 4, 5, 4, 4, 3, 4, 4, 3, 5, 4, 4,
+    4, 4, 4, 4, 5, 4, 5, 5, 5, 4, 5, 2, 1, 2, 4, 2,
+    1, 4, 5, 5, 5, 1, 4, 3, 6, 3, 6, 4, 3, 6, 4, 3,
+    5, 3, 3, 2, 5, 5, 2, 2, 3, 3, 6, 6, 6, 7, 5, 5,
+    5, 5, 5, 5, 5, 7, 4, 4, 4, 4, 4, 3, 3, 3, 3, 7,
+    5, 4, 4, 4, 4, 4, 5, 5, 4, 4, 4, 4, 5, 5, 4, 4,
+    4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 3, 3, 3, 5, 5,
+    4, 4, 4, 4, 4, 4, 5, 5, 4, 4, 4, 4, 4, 5, 4, 6,
+    5, 6,
+};
+
+static const uint16_t ssd1306_font_sans8_offset[194] = {
+    0, 2, 3, 6, 11, 16, 21, 26, 28, 31, 34, 39,
+    44, 46, 51, 53, 58, 63, 68, 73, 78, 83, 88, 93,
+    98, 103, 108, 110, 112, 116, 121, 125, 130, 135, 140, 144,
+    148, 152, 156, 160, 164, 168, 171, 176, 181, 185, 190, 195,
+    199, 203, 208, 213, 217, 222, 226, 231, 236, 241, 246, 251,
+    254, 259, 262, 267, 272, 275, 279, 283, 287, 291, 295, 300,
+    304, 308, 311, 315, 319, 322, 327, 331, 335, 339, 343, 347,
+    351, 356, 360, 365, 370, 375, 379, 384, 386, 387, 389, 0,
+    393, 394, 398, 403, 408, 413, 414, 418, 421, 427, 430, 436,
+    440, 443, 449, 453, 456, 461, 464, 467, 469, 474, 479, 481,
+    483, 486, 489, 495, 501, 507, 514, 519, 524, 529, 534, 539,
+    544, 549, 556, 560, 564, 568, 572, 576, 579, 582, 585, 588,
+    595, 600, 604, 608, 612, 616, 620, 625, 630, 634, 638, 642,
+    646, 651, 656, 660, 664, 668, 672, 676, 680, 684, 691, 695,
+    699, 703, 707, 711, 714, 717, 720, 725, 730, 600, 604, 608,
+    612, 616, 734, 739, 744, 748, 752, 756, 760, 764, 769, 773,
+    779, 784,
+};
+
+static const ssd1306_font_range_t ssd1306_font_sans8_ranges[4] = {
+    {0x0020, 95, 0},
+    {0x00A0, 96, 95},
+    {0x0132, 2, 191},
+    {0x20AC, 1, 193},
+};
+
+const ssd1306_font_t ssd1306_font_sans8 = {
+    .pages = 1,
+    .spacing = 1,
+    .fixed_width = 0,
+    .fallback = 31,
+    .bitmap = ssd1306_font_sans8_bitmap,
+    .width = ssd1306_font_sans8_width,
+    .offset = ssd1306_font_sans8_offset,
+    .ranges = ssd1306_font_sans8_ranges,
+    .n_ranges = 4,
+};
@@ -0,0 +1,315 @@
+/**
+ * @file font_bench.c
+ * @brief Glyph tables of ssd1306_font.h: UTF-8, lookup, text width and drawing.
+ *
+ * Checked: the UTF-8 decoder on valid and malformed input, the lookup of every code point of
+ * the proportional font (and the fallback for the ones it lacks), text widths, that the
+ * fixed fonts draw exactly what the per-pixel print functions drew before, and that a text
+ * off a page boundary is the page-aligned one shifted. Prints the width of a few labels in
+ * the 6x8 and the proportional font, lookups per second (ASCII index, range search) and the
+ * time to draw a line. Exit status 1 when a check failed.
+ *
+ * usage: font_bench [-n LOOPS] [-p]
+ *   -n  loops of the timings (default 20000)
+ *   -p  print the sample text as drawn
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "ssd1306.h"
+#include "ssd1306_font.h"
+#include "ssd1306_fonts.h"
+#include "host_bench.h"
+
+static const char *TAG = "font_bench";
+
+static ssd1306_handle_t s_dev;
+static ssd1306_handle_t s_ref;
+static volatile uint32_t s_sink; // keeps the timed loops
+
+static void display_init(ssd1306_handle_t *dev)
+{
+    memset(dev, 0, sizeof(*dev));
+    dev->width = 128;
+    dev->height = 64;
+    dev->pages = 8;
+}
+
+// Decode all of s, compare with the expected code points
+static void check_utf8(const char *s, const uint32_t *expect, int n)
+{
+    const char *p = s;
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t cp = ssd1306_utf8_next(&p);
+        if (cp != expect[i])
+        {
+            printf("FAIL utf8 code point %d: U+%04" PRIX32 ", expected U+%04" PRIX32 "\n", i, cp, expect[i]);
+            bench_failed++;
+            return;
+        }
+    }
+    CHECK(ssd1306_utf8_next(&p) == 0 && *p == '\0');
+}
+
+static void test_utf8(void)
+{
+    const uint32_t R = SSD1306_UTF8_REPLACEMENT;
+    check_utf8("Az", (const uint32_t[]){'A', 'z'}, 2);
+    check_utf8("\xC3\xA9\xC3\xAB", (const uint32_t[]){0xE9, 0xEB}, 2);       // é ë
+    check_utf8("\xE2\x82\xAC" "5", (const uint32_t[]){0x20AC, '5'}, 2);      // €5
+    check_utf8("\xF0\x9F\x98\x80", (const uint32_t[]){0x1F600}, 1);          // 4 bytes
+    check_utf8("\xC3" "A", (const uint32_t[]){R, 'A'}, 2);                   // truncated
+    check_utf8("\xC3", (const uint32_t[]){R}, 1);                            // truncated at the end
+    check_utf8("\x80" "a", (const uint32_t[]){R, 'a'}, 2);                   // lone continuation
+    check_utf8("\xC0\xAF", (const uint32_t[]){R, R}, 2);                     // overlong '/'
+    check_utf8("\xED\xA0\x80", (const uint32_t[]){R, R, R}, 3);              // surrogate
+    check_utf8("\xF4\x90\x80\x80", (const uint32_t[]){R, R, R, R}, 4);       // above U+10FFFF
+    check_utf8("\xFF" "b", (const uint32_t[]){R, 'b'}, 2);
+}
+
+static void test_lookup(void)
+{
+    const ssd1306_font_t *f = &ssd1306_font_sans8;
+    uint16_t expect = 0;
+    for (uint32_t cp = 0x20; cp <= 0x7E; cp++)
+    {
+        CHECK(ssd1306_font_glyph(f, cp) == expect++);
+    }
+    for (uint32_t cp = 0xA0; cp <= 0xFF; cp++)
+    {
+        CHECK(ssd1306_font_glyph(f, cp) == expect++);
+    }
+    CHECK(ssd1306_font_glyph(f, 0x132) == expect++);
+    CHECK(ssd1306_font_glyph(f, 0x133) == expect++);
+    CHECK(ssd1306_font_glyph(f, 0x20AC) == expect++);
+    uint16_t q = ssd1306_font_glyph(f, '?');
+    const uint32_t lacking[] = {0x00, 0x1F, 0x7F, 0x9F, 0x100, 0x131, 0x134, 0x20AB, 0x20AD, 0xFFFD, 0x1F600};
+    for (size_t i = 0; i < sizeof(lacking) / sizeof(lacking[0]); i++)
+    {
+        CHECK(ssd1306_font_glyph(f, lacking[i]) == q);
+    }
+    CHECK(ssd1306_font_glyph(&ssd1306_font_6x8, 0xE9) == ssd1306_font_glyph(&ssd1306_font_6x8, '?'));
+}
+
+static void test_width(void)
+{
+    const ssd1306_font_t *f = &ssd1306_font_sans8;
+    uint8_t w;
+    CHECK(ssd1306_text_width(f, "") == 0);
+    CHECK(ssd1306_text_width(&ssd1306_font_6x8, "speed") == 30);
+    CHECK(ssd1306_text_width(&ssd1306_font_8x16, "\xC3\xA9t\xC3\xA9") == 24); // 3 glyphs
+    ssd1306_font_bitmap(f, ssd1306_font_glyph(f, 'i'), &w);
+    uint8_t wi = w;
+    ssd1306_font_bitmap(f, ssd1306_font_glyph(f, 'W'), &w);
+    CHECK(wi < w);
+    CHECK(ssd1306_text_width(f, "iW") == wi + f->spacing + w);
+    for (char d = '0'; d <= '9'; d++)
+    {
+        ssd1306_font_bitmap(f, ssd1306_font_glyph(f, d), &w);
+        CHECK(w == 5); // digits are tabular, numbers do not jump
+    }
+    // the drawn text ends where the width says
+    const char *text = "\xC3\x89\xC3\xA9n \xE2\x82\xAC 12,50";
+    display_init(&s_dev);
+    CHECK(ssd1306_print(&s_dev, f, 3, 8, 1, text) == 3 + ssd1306_text_width(f, text));
+    CHECK(ssd1306_print(&s_dev, f, 100, 8, 1, text) == 100 + ssd1306_text_width(f, text)); // clipped
+}
+
+// The per-pixel print the driver had before the glyph tables
+static void reference_print(ssd1306_handle_t *dev, const uint8_t *table, int header, int w, int h, int x, int y,
+                            uint8_t color, const char *str)
+{
+    for (size_t i = 0; str[i]; i++)
+    {
+        const uint8_t *g = &table[header + (str[i] - 32) * (h > 8 ? 16 : w)];
+        for (int c = 0; c < w; c++)
+        {
+            uint32_t col = h > 8 ? (uint32_t)(g[c] | g[c + 8] << 8) : g[c];
+            col = color ? col : ~col;
+            for (int bit = 0; bit < h; bit++)
+            {
+                ssd1306_set_pixel(dev, x + i * w + c, y + bit, (col >> bit) & 1);
+            }
+        }
+    }
+}
+
+static void test_fixed(void)
+{
+    char ascii[96];
+    for (int i = 0; i < 95; i++)
+    {
+        ascii[i] = (char)(' ' + i);
+    }
+    ascii[95] = '\0';
+    const int ys[] = {0, 8, 13, 40};
+    for (size_t k = 0; k < sizeof(ys) / sizeof(ys[0]); k++)
+    {
+        for (uint8_t color = 0; color < 2; color++)
+        {
+            for (int part = 0; part < 95; part += 21)
+            {
+                char line[22];
+                snprintf(line, sizeof(line), "%.21s", &ascii[part]);
+                display_init(&s_dev);
+                display_init(&s_ref);
+                ssd1306_printFixed6(&s_dev, 0, ys[k], color, line);
+                reference_print(&s_ref, ssd1306xled_font6x8, 4, 6, 8, 0, ys[k], color, line);
+                CHECK(memcmp(s_dev.buffer, s_ref.buffer, sizeof(s_dev.buffer)) == 0);
+
+                line[16] = '\0';
+                display_init(&s_dev);
+                display_init(&s_ref);
+                ssd1306_printFixed16(&s_dev, 0, ys[k], color, line);
+                reference_print(&s_ref, ssd1306xled_font8x16, 4, 8, 16, 0, ys[k], color, line);
+                CHECK(memcmp(s_dev.buffer, s_ref.buffer, sizeof(s_dev.buffer)) == 0);
+            }
+        }
+    }
+}
+
+// Off a page boundary the text is the aligned one moved down
+static void test_shift(void)
+{
+    const char *text = "Druk \xC3\xA9\xC3\xA9n: \xC2\xB1" "5 \xC2\xB0" "C";
+    for (int dy = 1; dy < 8; dy++)
+    {
+        display_init(&s_ref);
+        display_init(&s_dev);
+        ssd1306_print(&s_ref, &ssd1306_font_sans8, 0, 8, 1, text);
+        ssd1306_print(&s_dev, &ssd1306_font_sans8, 0, 8 + dy, 1, text);
+        int wrong = 0;
+        for (int x = 0; x < 128; x++)
+        {
+            uint16_t a = s_ref.buffer[128 + x] | s_ref.buffer[256 + x] << 8;
+            uint16_t b = s_dev.buffer[128 + x] | s_dev.buffer[256 + x] << 8;
+            wrong += (uint16_t)(a << dy) != b;
+        }
+        CHECK(wrong == 0);
+    }
+}
+
+static void print_buffer(const ssd1306_handle_t *dev, int pages)
+{
+    for (int y = 0; y < pages * 8; y++)
+    {
+        for (int x = 0; x < 128; x++)
+        {
+            putchar(dev->buffer[(y / 8) * 128 + x] >> (y & 7) & 1 ? '#' : '.');
+        }
+        putchar('\n');
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int loops = 20000;
+    bool print = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            loops = atoi(optarg);
+            break;
+        case 'p':
+            print = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n LOOPS] [-p]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (loops < 1)
+    {
+        fprintf(stderr, "need -n >= 1\n");
+        return 2;
+    }
+
+    test_utf8();
+    test_lookup();
+    test_width();
+    test_fixed();
+    test_shift();
+
+    const char *labels[] = {"Temperatuur buiten", "Snelheid 1230 mV", "Rem: \xC3\xA9\xC3\xA9n relais aan",
+                            "Storing \xE2\x80\x93 geen verbinding"};
+    printf("%6s %6s  %s\n", "6x8", "sans8", "label (pixels)");
+    for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); i++)
+    {
+        uint16_t fixed = ssd1306_text_width(&ssd1306_font_6x8, labels[i]);
+        uint16_t prop = ssd1306_text_width(&ssd1306_font_sans8, labels[i]);
+        printf("%6u %6u  %s\n", fixed, prop, labels[i]);
+        CHECK(prop * 10 < fixed * 9);
+    }
+    // the last one only fits the display in the proportional font
+    CHECK(ssd1306_text_width(&ssd1306_font_6x8, labels[3]) > 128 && ssd1306_text_width(&ssd1306_font_sans8, labels[3]) <= 128);
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < loops; i++)
+    {
+        for (uint32_t cp = 0x20; cp <= 0x7E; cp++)
+        {
+            s_sink += ssd1306_font_glyph(&ssd1306_font_sans8, cp);
+        }
+    }
+    int64_t ascii_us = esp_timer_get_time() - start;
+    start = esp_timer_get_time();
+    for (int i = 0; i < loops; i++)
+    {
+        for (uint32_t cp = 0xA0; cp <= 0xFE; cp++) // 95 as well
+        {
+            s_sink += ssd1306_font_glyph(&ssd1306_font_sans8, cp + (cp == 0xFE ? 0x1FAE : 0));
+        }
+    }
+    int64_t range_us = esp_timer_get_time() - start;
+    printf("lookups: ASCII %" PRId64 " ns, Latin-1 and beyond %" PRId64 " ns\n", ascii_us * 1000 / loops / 95,
+           range_us * 1000 / loops / 95);
+
+    const char *line = "Snelheid: 1230 mV \xE2\x80\x94 rem 0 mV";
+    int lines = loops / 10 + 1;
+    int64_t t[3];
+    for (int k = 0; k < 3; k++)
+    {
+        display_init(&s_dev);
+        start = esp_timer_get_time();
+        for (int i = 0; i < lines; i++)
+        {
+            switch (k)
+            {
+            case 0:
+                ssd1306_printFixed6(&s_dev, 0, 8, 1, line);
+                break;
+            case 1:
+                ssd1306_print(&s_dev, &ssd1306_font_sans8, 0, 8, 1, line);
+                break;
+            default:
+                ssd1306_print(&s_dev, &ssd1306_font_sans8, 0, 11, 1, line);
+                break;
+            }
+        }
+        t[k] = esp_timer_get_time() - start;
+    }
+    printf("draw a line: 6x8 %" PRId64 " ns, sans8 %" PRId64 " ns, sans8 off a page %" PRId64 " ns\n",
+           t[0] * 1000 / lines, t[1] * 1000 / lines, t[2] * 1000 / lines);
+
+    if (print)
+    {
+        display_init(&s_dev);
+        ssd1306_print(&s_dev, &ssd1306_font_sans8, 0, 0, 1, "\xC3\x89\xC3\xA9n br\xC3\xBBl\xC3\xA9\x65, \xC4\xB3s \xE2\x82\xAC 12,50");
+        ssd1306_print(&s_dev, &ssd1306_font_sans8, 0, 8, 1, "\xC2\xB0" "C \xC2\xB5" "A \xC2\xB1" "5% \xC3\x9F \xC3\xA6 \xC3\x98 \xC3\x91 \xC3\xA7");
+        ssd1306_print(&s_dev, &ssd1306_font_6x8, 0, 16, 1, labels[0]);
+        ssd1306_print(&s_dev, &ssd1306_font_sans8, 0, 24, 1, labels[0]);
+        print_buffer(&s_dev, 4);
+    }
+    return bench_result(TAG);
+}
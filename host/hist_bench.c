@@ -0,0 +1,476 @@
+/**
+ * @file hist_bench.c
+ * @brief Checks of the actuator history against the DAC and relay models, and a decoder
+ * of its binary streams and files.
+ *
+ * Actuator frames with a moving DAC channel and toggling relays go to the models while the
+ * history records; the ring is smaller than the writes, so blocks are evicted. Checked:
+ * the decoded history equals what the models received (newest writes, in order), the
+ * record size, the CSV and the binary stream, streaming while the 1 kHz control loop runs,
+ * the failsafe writes marked as such, and the flush task (sector-sized appends, rotation).
+ * Exit status 1 when a check failed.
+ *
+ * usage: hist_bench [-n FRAMES]      run the checks
+ *        hist_bench -d FILE          decode a stream ('hist -b') or a file ('hist -f') to CSV
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/i2c_master.h"
+#include "gp8413_sdc.h"
+#include "m5_4relay.h"
+#include "actuator.h"
+#include "control_exec.h"
+#include "failsafe.h"
+#include "act_history.h"
+#include "i2c_sim.h"
+#include "sim_devices.h"
+#include "host_bench.h"
+
+#define CONTROL_PORT (0)
+#define RING_SIZE (8 * 1024)
+
+static const char *TAG = "hist_bench";
+
+static sim_gp8413_t s_dac_model;
+static sim_m54r_t s_relay_model;
+static gp8413_handle_t *s_dac;
+static m54_ctx_t s_relay;
+static actuator_t s_act;
+
+// What the models received, one entry per write (DAC transfer or relay write)
+typedef struct
+{
+    uint16_t code[2];
+    uint8_t relay;
+} expect_t;
+
+static int64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Decode blocks back to back, skipping what is not a block (console text around a stream)
+static uint32_t decode(const uint8_t *buf, size_t len, FILE *csv, bool *ended)
+{
+    act_history_reader_t reader;
+    act_history_entry_t entry;
+    char line[64];
+    uint32_t n = 0;
+    *ended = false;
+    for (size_t pos = 0; pos < len;)
+    {
+        esp_err_t ret = act_history_reader_init(&reader, buf + pos, len - pos);
+        if (ret == ESP_ERR_NOT_FOUND)
+        {
+            *ended = true;
+            break;
+        }
+        if (ret != ESP_OK)
+        {
+            pos++;
+            continue;
+        }
+        while (act_history_read(&reader, &entry))
+        {
+            if (csv)
+            {
+                act_history_format_csv(&entry, line, sizeof(line));
+                fprintf(csv, "%s\n", line);
+            }
+            n++;
+        }
+        pos += sizeof(act_history_block_t) + reader.len;
+    }
+    return n;
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(size > 0 ? (size_t)size : 1);
+    *len = buf ? fread(buf, 1, (size_t)size, f) : 0;
+    fclose(f);
+    return buf;
+}
+
+// Binary stream into memory, as 'hist -b' sends it over the console
+typedef struct
+{
+    uint8_t *buf;
+    size_t len;
+    size_t size;
+} membuf_t;
+
+static int mem_write(void *io, const uint8_t *buf, size_t len)
+{
+    membuf_t *m = io;
+    if (m->len + len > m->size)
+    {
+        return -1;
+    }
+    memcpy(m->buf + m->len, buf, len);
+    m->len += len;
+    return (int)len;
+}
+
+static expect_t s_models; // State of the models after the last write
+
+static uint32_t expect_add(expect_t *expect, uint32_t n_expect, uint32_t max)
+{
+    if (expect && n_expect < max)
+    {
+        expect[n_expect] = s_models;
+    }
+    return n_expect + 1;
+}
+
+// Frames with channel 0 moving every frame and the relays toggling every 50; what the
+// models got is appended to expect
+static uint32_t apply_frames(int frames, int first, expect_t *expect, uint32_t n_expect, uint32_t max)
+{
+    for (int i = first; i < first + frames; i++)
+    {
+        actuator_frame_t frame = {
+            .dac_mv = {(uint16_t)(i * 7 % 10000), (uint16_t)(i / 100 * 100 % 10000)},
+            .relays = (uint8_t)((i / 50) & 0x0f),
+            .leds = (uint8_t)((i / 200) & 0x0f),
+        };
+        uint32_t dac_writes = s_dac_model.writes;
+        uint32_t relay_writes = s_relay_model.writes;
+        CHECK(actuator_apply(&s_act, &frame, NULL) == ESP_OK);
+        // the DAC transfer goes first, then the relay write
+        if (s_dac_model.writes != dac_writes)
+        {
+            s_models.code[0] = sim_gp8413_code(&s_dac_model, 0);
+            s_models.code[1] = sim_gp8413_code(&s_dac_model, 1);
+            n_expect = expect_add(expect, n_expect, max);
+        }
+        if (s_relay_model.writes != relay_writes)
+        {
+            s_models.relay = sim_m54r_reg(&s_relay_model, M54R_REG_RELAY);
+            n_expect = expect_add(expect, n_expect, max);
+        }
+        CHECK(s_dac_model.writes - dac_writes <= 1 && s_relay_model.writes - relay_writes <= 1);
+    }
+    return n_expect;
+}
+
+// Compares the values the history has seen
+static bool same(const act_history_entry_t *e, const expect_t *x)
+{
+    return (!(e->known & ACT_HISTORY_CH0) || e->code[0] == x->code[0]) &&
+           (!(e->known & ACT_HISTORY_CH1) || e->code[1] == x->code[1]) &&
+           (!(e->known & ACT_HISTORY_RELAY) || e->relay == x->relay);
+}
+
+static void check_ring(int frames)
+{
+    static act_history_entry_t entries[65536];
+    expect_t *expect = calloc((size_t)frames * 2, sizeof(expect_t));
+    act_history_status_t st;
+    act_history_config_t cfg = ACT_HISTORY_CONFIG_DEFAULT();
+    cfg.size = RING_SIZE;
+
+    CHECK(act_history_start(&cfg) == ESP_OK);
+    int64_t wall = esp_timer_get_time();
+    int64_t cpu = cpu_ns();
+    uint32_t n_expect = apply_frames(frames, 0, expect, 0, (uint32_t)frames * 2);
+    int64_t cpu_on = cpu_ns() - cpu;
+    int64_t wall_on = esp_timer_get_time() - wall;
+    act_history_get_status(&st);
+    CHECK(st.records == n_expect && st.evicted > 0 && st.ignored == 0);
+    CHECK(st.bytes < st.records * 6); // 4..5 bytes for a write of one channel
+
+    // the newest writes, in order, as the models got them
+    act_history_cursor_t cursor = {0};
+    static uint8_t block[ACT_HISTORY_BLOCK_SIZE];
+    act_history_reader_t reader;
+    uint32_t n = 0;
+    int64_t last_us = 0;
+    bool monotonic = true;
+    size_t len;
+    while ((len = act_history_next_block(&cursor, block, true, NULL)) > 0)
+    {
+        CHECK(act_history_reader_init(&reader, block, len) == ESP_OK);
+        while (n < 65536 && act_history_read(&reader, &entries[n]))
+        {
+            monotonic = monotonic && entries[n].t_us >= last_us;
+            last_us = entries[n].t_us;
+            n++;
+        }
+    }
+    CHECK(monotonic && n > 0 && n < n_expect);
+    uint32_t mismatch = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        mismatch += same(&entries[i], &expect[n_expect - n + i]) ? 0 : 1;
+    }
+    CHECK(mismatch == 0);
+    CHECK(entries[n - 1].known == (ACT_HISTORY_CH0 | ACT_HISTORY_CH1 | ACT_HISTORY_RELAY));
+
+    // the same without recording: the cost of the tap
+    act_history_stop();
+    wall = esp_timer_get_time();
+    cpu = cpu_ns();
+    apply_frames(frames, frames, NULL, 0, 0);
+    int64_t cpu_off = cpu_ns() - cpu;
+    int64_t wall_off = esp_timer_get_time() - wall;
+
+    printf("%-26s %8s %8s %10s %10s\n", "frames", "writes", "bytes", "cpu(us)", "wall(us)");
+    printf("%-26s %8" PRIu32 " %8s %10.3f %10.3f\n", "without history", n_expect, "-", cpu_off / 1000.0 / frames,
+           (double)wall_off / frames);
+    printf("%-26s %8" PRIu32 " %8" PRIu32 " %10.3f %10.3f\n", "with history", st.records, st.bytes,
+           cpu_on / 1000.0 / frames, (double)wall_on / frames);
+    printf("ring %u bytes: %" PRIu32 " writes kept of %" PRIu32 ", %.2f bytes per write, %" PRIu32 " blocks evicted\n",
+           (unsigned)st.size, n, n_expect, (double)st.bytes / st.records, st.evicted);
+
+    // CSV: one line per kept write, the header first
+    membuf_t csv = {.size = 1 << 20};
+    csv.buf = malloc(csv.size);
+    FILE *f = fmemopen(csv.buf, csv.size, "w");
+    CHECK(act_history_write_csv(f, 0) == n);
+    fclose(f);
+    CHECK(strncmp((char *)csv.buf, ACT_HISTORY_CSV_HEADER "\n", strlen(ACT_HISTORY_CSV_HEADER) + 1) == 0);
+
+    // binary: the same writes, then the end header; since_us keeps only the newest blocks
+    membuf_t bin = {.buf = csv.buf, .size = csv.size};
+    bool ended;
+    CHECK(act_history_write_binary(mem_write, &bin, 0) == (int)bin.len);
+    CHECK(decode(bin.buf, bin.len, NULL, &ended) == n && ended);
+    int64_t since = entries[n - 10].t_us;
+    bin.len = 0;
+    act_history_write_binary(mem_write, &bin, since);
+    uint32_t tail = decode(bin.buf, bin.len, NULL, &ended);
+    CHECK(tail >= 10 && tail < n && ended);
+    free(csv.buf);
+    free(expect);
+}
+
+static void ramp_speed(void *arg, const control_tick_t *tick, actuator_frame_t *frame)
+{
+    uint32_t *calls = arg;
+    (*calls)++;
+    frame->dac_mv[0] = (uint16_t)(tick->seq % 1000 * 10);
+}
+
+// Stream while the 1 kHz loop writes: the loop does not miss a commit, the stream decodes
+static void check_stream_under_load(void)
+{
+    control_exec_config_t cfg = CONTROL_EXEC_CONFIG_DEFAULT();
+    control_exec_stats_t loop;
+    act_history_status_t st;
+    membuf_t bin = {.size = 1 << 20};
+    bin.buf = malloc(bin.size);
+    uint32_t streams = 0;
+    uint32_t decoded = 0;
+    uint32_t calls = 0;
+    bool all_ended = true;
+
+    CHECK(act_history_start(NULL) == ESP_OK);
+    cfg.act = &s_act;
+    CHECK(control_exec_add(ramp_speed, &calls) == ESP_OK);
+    CHECK(control_exec_start(&cfg) == ESP_OK);
+    int64_t end = esp_timer_get_time() + 300000;
+    while (esp_timer_get_time() < end)
+    {
+        bool ended;
+        bin.len = 0;
+        CHECK(act_history_write_binary(mem_write, &bin, 0) > 0);
+        decoded += decode(bin.buf, bin.len, NULL, &ended);
+        all_ended = all_ended && ended;
+        streams++;
+        vTaskDelay(1);
+    }
+    CHECK(control_exec_stop() == ESP_OK);
+    CHECK(control_exec_remove(ramp_speed, &calls) == ESP_OK);
+    control_exec_get_stats(&loop, false);
+    act_history_get_status(&st);
+    printf("1 kHz loop, streamed %" PRIu32 " times: %" PRIu32 " loops, %" PRIu32 " commit errors, %" PRIu32
+           " writes recorded\n", streams, loop.loops, loop.commit_errors, st.records);
+    CHECK(loop.loops >= 150 && calls == loop.loops && loop.commit_errors == 0 && st.records >= loop.loops / 2);
+    CHECK(all_ended && decoded > 0);
+    free(bin.buf);
+}
+
+// The failsafe writes around the drivers; the history has them, marked
+static void check_failsafe(void)
+{
+    act_history_cursor_t cursor = {0};
+    static uint8_t block[ACT_HISTORY_BLOCK_SIZE];
+    act_history_reader_t reader;
+    act_history_entry_t e, last = {0};
+    int marked = 0;
+    size_t len;
+
+    CHECK(act_history_start(NULL) == ESP_OK);
+    actuator_frame_t frame = {.dac_mv = {3000, 4000}, .relays = 0x05};
+    CHECK(actuator_apply(&s_act, &frame, NULL) == ESP_OK);
+    failsafe_config_t cfg = FAILSAFE_CONFIG_DEFAULT();
+    cfg.act = &s_act;
+    CHECK(failsafe_start(&cfg) == ESP_OK);
+    CHECK(failsafe_trip() == ESP_OK);
+    for (int i = 0; i < 100 && failsafe_get_state() != FAILSAFE_SAFE; i++)
+    {
+        vTaskDelay(1);
+    }
+    CHECK(failsafe_get_state() == FAILSAFE_SAFE);
+    while ((len = act_history_next_block(&cursor, block, true, NULL)) > 0)
+    {
+        CHECK(act_history_reader_init(&reader, block, len) == ESP_OK);
+        while (act_history_read(&reader, &e))
+        {
+            marked += (e.set & ACT_HISTORY_STANDBY) ? 1 : 0;
+            last = e;
+        }
+    }
+    CHECK(marked == 2 && (last.set & ACT_HISTORY_STANDBY));
+    CHECK(last.code[0] == 0 && last.code[1] == 0 && last.relay == 0);
+    CHECK(failsafe_stop() == ESP_OK);
+}
+
+// Flush task: sector-sized appends, a partial one after max_age, rotation to .old
+static void check_flush(int frames)
+{
+    char dir[] = "/tmp/hist_benchXXXXXX";
+    char path[64], old[64];
+    act_history_status_t st;
+    bool ended;
+
+    CHECK(mkdtemp(dir) != NULL);
+    snprintf(path, sizeof(path), "%s/act.bin", dir);
+    snprintf(old, sizeof(old), "%s/act.old", dir);
+    CHECK(act_history_start(NULL) == ESP_OK);
+    act_history_flush_config_t cfg = ACT_HISTORY_FLUSH_CONFIG_DEFAULT();
+    cfg.path = path;
+    cfg.max_age_ms = 200;
+    cfg.max_file_kb = 16;
+    CHECK(act_history_flush_start(&cfg) == ESP_OK);
+    CHECK(act_history_flush_start(&cfg) == ESP_ERR_INVALID_STATE);
+
+    uint32_t n_expect = 0;
+    for (int round = 0; round < 4; round++)
+    {
+        n_expect = apply_frames(frames, round * frames, NULL, n_expect, 0);
+        vTaskDelay(pdMS_TO_TICKS(20)); // the flush task keeps up
+    }
+    act_history_get_status(&st);
+    uint32_t sectors = st.flush_writes;
+    CHECK(sectors > 0 && st.flush_bytes == sectors * ACT_HISTORY_FLUSH_SIZE); // no partial write yet
+
+    // a little more, then quiet: written after max_age without a full sector
+    apply_frames(10, 4 * frames, NULL, 0, 0);
+    vTaskDelay(pdMS_TO_TICKS(1500));
+    act_history_get_status(&st);
+    CHECK(st.flush_writes > sectors && st.flush_bytes % ACT_HISTORY_FLUSH_SIZE != 0);
+    CHECK(act_history_flush_stop() == ESP_OK && act_history_flush_stop() == ESP_ERR_INVALID_STATE);
+    act_history_get_status(&st);
+    CHECK(!st.flushing && st.flush_lost == 0 && st.flush_errors == 0);
+
+    size_t len_new = 0, len_old = 0;
+    uint8_t *cur = read_file(path, &len_new);
+    uint8_t *prev = read_file(old, &len_old);
+    CHECK(cur != NULL && prev != NULL); // rotated at 16 KB
+    uint32_t in_files = (prev ? decode(prev, len_old, NULL, &ended) : 0) +
+                        (cur ? decode(cur, len_new, NULL, &ended) : 0);
+    printf("flush: %" PRIu32 " writes, %" PRIu32 " bytes, files %u + %u bytes, %" PRIu32 " of %" PRIu32
+           " writes in the files\n", st.flush_writes, st.flush_bytes, (unsigned)len_old, (unsigned)len_new, in_files,
+           st.records);
+    CHECK(len_new + len_old <= st.flush_bytes && in_files > 0 && in_files <= st.records);
+    free(cur);
+    free(prev);
+    remove(path);
+    remove(old);
+    rmdir(dir);
+}
+
+static int decode_file(const char *path)
+{
+    size_t len;
+    bool ended;
+    uint8_t *buf = read_file(path, &len);
+    if (!buf)
+    {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+    printf(ACT_HISTORY_CSV_HEADER "\n");
+    decode(buf, len, stdout, &ended);
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 3000;
+    int opt;
+    esp_log_level_set("*", ESP_LOG_WARN);
+    while ((opt = getopt(argc, argv, "n:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 'd':
+            return decode_file(optarg);
+        default:
+            fprintf(stderr, "usage: %s [-n FRAMES] | -d FILE\n", argv[0]);
+            return 2;
+        }
+    }
+    if (frames < 2000 || frames > 30000)
+    {
+        fprintf(stderr, "need -n 2000..30000 (the ring must overflow)\n");
+        return 2;
+    }
+
+    CHECK(sim_gp8413_attach(&s_dac_model, CONTROL_PORT, GP8413_I2C_ADDRESS) == ESP_OK);
+    CHECK(sim_m54r_attach(&s_relay_model, CONTROL_PORT, M54R_ADDR) == ESP_OK);
+    i2c_master_bus_handle_t bus = bench_bus(CONTROL_PORT, false);
+    gp8413_config_t dac_config = {
+        .bus_handle = bus,
+        .device_addr = GP8413_I2C_ADDRESS,
+        .output_range = GP8413_OUTPUT_RANGE_10V,
+    };
+    s_dac = gp8413_init(&dac_config);
+    s_relay.device_address = M54R_ADDR;
+    s_relay.bus_handle = bus;
+    s_relay.scl_speed_hz = 400000;
+    if (s_dac == NULL || m54_init(&s_relay) != ESP_OK || actuator_init(&s_act, s_dac, &s_relay) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "device setup failed");
+        return 1;
+    }
+
+    check_ring(frames);
+    check_stream_under_load();
+    check_failsafe();
+    check_flush(frames);
+    act_history_print(stdout);
+    act_history_stop();
+    gp8413_deinit(&s_dac);
+
+    return bench_result(TAG);
+}
@@ -0,0 +1,51 @@
+/**
+ * @file host_bench.c
+ * @brief Check counting and bus setup shared by the host programs.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "host_bench.h"
+#include "esp_log.h"
+#include "i2c_sched.h"
+#include "i2c_async.h"
+
+int bench_failed;
+
+int bench_result(const char *tag)
+{
+    if (bench_failed)
+    {
+        ESP_LOGE(tag, "%d checks failed", bench_failed);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
+
+i2c_master_bus_config_t bench_bus_config(int port)
+{
+    i2c_master_bus_config_t config = {
+        .i2c_port = port,
+        .sda_io_num = -1,
+        .scl_io_num = -1,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .flags.enable_internal_pullup = true,
+    };
+    return config;
+}
+
+i2c_master_bus_handle_t bench_new_bus(const i2c_master_bus_config_t *config, bool async)
+{
+    i2c_master_bus_handle_t bus = NULL;
+    ESP_ERROR_CHECK(async ? i2c_async_new_bus(config, &bus) : i2c_new_master_bus(config, &bus));
+    ESP_ERROR_CHECK(i2c_sched_start(BENCH_SCHED_PRIORITY));
+    return bus;
+}
+
+i2c_master_bus_handle_t bench_bus(int port, bool async)
+{
+    i2c_master_bus_config_t config = bench_bus_config(port);
+    return bench_new_bus(&config, async);
+}
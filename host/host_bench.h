@@ -0,0 +1,53 @@
+// host_bench.h
+// Shared by the host programs: the CHECK macro and its failure count, the simulated buses
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "driver/i2c_master.h"
+
+#define BENCH_SCHED_PRIORITY (5) // Scheduler lanes, as in app_main
+
+    extern int bench_failed; // Checks that failed so far
+
+// Count and report a failed condition, the program goes on
+#define CHECK(cond)                                                   \
+    do                                                                \
+    {                                                                 \
+        if (!(cond))                                                  \
+        {                                                             \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);    \
+            bench_failed++;                                           \
+        }                                                             \
+    } while (0)
+
+    /**
+     * @brief End of a program: report the failed checks or "all checks passed".
+     *
+     * @return Exit status, 1 when a check failed.
+     */
+    int bench_result(const char *tag);
+
+    // Bus config of the programs: the port, default clock source, internal pull-ups, no pins
+    i2c_master_bus_config_t bench_bus_config(int port);
+
+    /**
+     * @brief Create a simulated bus and start the scheduler lanes (once). Aborts on failure.
+     *
+     * @param async  true: i2c_async_new_bus(), as the display bus of app_main
+     */
+    i2c_master_bus_handle_t bench_new_bus(const i2c_master_bus_config_t *config, bool async);
+
+    // bench_new_bus() with bench_bus_config(port)
+    i2c_master_bus_handle_t bench_bus(int port, bool async);
+
+#ifdef __cplusplus
+}
+#endif
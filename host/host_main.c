@@ -0,0 +1,778 @@
+/**
+ * @file host_main.c
+ * @brief Host run of the drivers on the simulated I2C buses: checks and bus-time report.
+ *
+ * Puts the models of the DAC, the relay unit and two displays on the simulated buses (port 0
+ * synchronous like the control bus, port 1 asynchronous like the display bus), runs the
+ * real drivers, the scheduler, the boot inventory, a bus scan, actuator frames, the 1 kHz
+ * control loop, the heartbeat failsafe and a transaction script against them and checks the
+ * device state the models ended up with, and the per-device statistics. Last, a slave holds
+ * SDA low and the bus monitor has to recover the bus and restore the DAC. The script and a
+ * display frame are captured, and the capture is replayed from the ring and from its text
+ * dump. Every step prints its transactions and the bus time at the configured SCL speed, so
+ * a change in the I2C traffic shows up in CI.
+ * Exit status 1 when a check failed.
+ *
+ * usage: i2c_host_sim [-r] [-v] [-p] [-s SCL_HZ]
+ *   -r  sleep the bus time (wall-clock timing as on the target)
+ *   -v  driver logging at info level
+ *   -p  print the display images
+ *   -s  SCL speed of all devices (default 100000)
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/i2c_master.h"
+#include "i2c_bus.h"
+#include "i2c_inventory.h"
+#include "i2c_scan.h"
+#include "i2c_stats.h"
+#include "i2c_batch.h"
+#include "i2c_capture.h"
+#include "i2c_replay.h"
+#include "i2c_recover.h"
+#include "boot_trace.h"
+#include "actuator.h"
+#include "control_exec.h"
+#include "failsafe.h"
+#include "gp8413_sdc.h"
+#include "m5_4relay.h"
+#include "ssd1306.h"
+#include "i2c_sim.h"
+#include "sim_devices.h"
+#include "host_bench.h"
+
+#define CONTROL_PORT (0)
+#define DISPLAY_PORT (1)
+
+static const char *TAG = "host_sim";
+
+static sim_gp8413_t s_dac_model;
+static sim_m54r_t s_relay_model;
+static sim_ssd1306_t s_oled_model[2]; // control bus, display bus
+static ssd1306_handle_t s_oled[2];
+static m54_ctx_t s_relay;
+static uint32_t s_speed_hz = 100000;
+
+static i2c_sim_stats_t s_step_start[I2C_SIM_MAX_PORTS];
+static int64_t s_step_us;
+
+static void step_begin(void)
+{
+    for (int port = 0; port < I2C_SIM_MAX_PORTS; port++)
+    {
+        i2c_sim_get_stats(port, &s_step_start[port], false);
+    }
+    s_step_us = esp_timer_get_time();
+}
+
+// One report line: transactions, bytes and bus time of the step, over all ports
+static void step_end(const char *name)
+{
+    uint32_t transactions = 0;
+    uint32_t nacks = 0;
+    uint64_t bytes = 0;
+    uint64_t bus_ns = 0;
+    for (int port = 0; port < I2C_SIM_MAX_PORTS; port++)
+    {
+        i2c_sim_stats_t now;
+        i2c_sim_get_stats(port, &now, false);
+        transactions += now.transactions - s_step_start[port].transactions;
+        nacks += now.nacks - s_step_start[port].nacks;
+        bytes += now.bytes - s_step_start[port].bytes;
+        bus_ns += now.bus_ns - s_step_start[port].bus_ns;
+    }
+    printf("%-22s %6" PRIu32 " %6" PRIu32 " %8" PRIu64 " %10" PRIu64 " %10" PRId64 "\n", name, transactions, nacks,
+           bytes, bus_ns / 1000, esp_timer_get_time() - s_step_us);
+}
+
+static bool display_matches(const ssd1306_handle_t *dev, const sim_ssd1306_t *model)
+{
+    for (int p = 0; p < dev->pages; p++)
+    {
+        if (memcmp(model->gddram[p], &dev->buffer[p * SSD1306_MAX_WIDTH], dev->width) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void run_inventory(void)
+{
+    static i2c_inventory_device_t devices[] = {
+        {.name = "dac", .port = CONTROL_PORT, .device_address = GP8413_I2C_ADDRESS, .id_write = {0x02},
+         .id_write_len = 1},
+        {.name = "relay", .port = CONTROL_PORT, .device_address = M54R_ADDR, .optional = true,
+         .id_write = {M54R_REG_MODE}, .id_write_len = 1, .id_read_len = 1, .id_mask = {0xfe}, .id_value = {0x00}},
+        {.name = "display", .port = DISPLAY_PORT, .device_address = SSD1306_I2C_ADDRESS, .optional = true,
+         .id_write = {0x00}, .id_write_len = 1},
+        {.name = "absent", .port = CONTROL_PORT, .device_address = 0x50, .optional = true, .id_write = {0x00},
+         .id_write_len = 1},
+    };
+
+    step_begin();
+    esp_err_t ret = i2c_inventory_run(devices, sizeof(devices) / sizeof(devices[0]), s_speed_hz);
+    step_end("inventory");
+    CHECK(ret == ESP_OK);
+    CHECK(i2c_inventory_present("dac"));
+    CHECK(i2c_inventory_present("relay"));
+    CHECK(i2c_inventory_present("display"));
+    CHECK(!i2c_inventory_present("absent"));
+}
+
+static void run_scan(i2c_master_bus_handle_t bus, i2c_master_bus_handle_t display_bus)
+{
+    i2c_scan_result_t result;
+    step_begin();
+    esp_err_t ret = i2c_scan_bus(bus, NULL, &result);
+    step_end("scan");
+    CHECK(ret == ESP_OK);
+    CHECK(result.bus_handle == bus && !result.stuck);
+    CHECK(i2c_scan_bit(result.present, GP8413_I2C_ADDRESS));
+    CHECK(i2c_scan_bit(result.present, M54R_ADDR));
+    CHECK(i2c_scan_bit(result.present, SSD1306_I2C_ADDRESS));
+    CHECK(!i2c_scan_bit(result.present, 0x50) && i2c_scan_bit(result.probed, 0x50));
+
+    i2c_scan_result_t cached;
+    CHECK(i2c_scan_get_cached(bus, I2C_SCAN_CACHE_MAX_AGE_MS, &cached));
+    CHECK(memcmp(cached.present, result.present, sizeof(result.present)) == 0);
+
+    // the display bus is asynchronous, probed with one-byte reads
+    i2c_scan_result_t results[I2C_SCAN_MAX_PORTS];
+    step_begin();
+    ret = i2c_scan_all_ports(NULL, results);
+    step_end("scan all ports");
+    CHECK(ret == ESP_OK);
+    CHECK(results[CONTROL_PORT].bus_handle == bus);
+    CHECK(results[DISPLAY_PORT].bus_handle == display_bus && !results[DISPLAY_PORT].stuck);
+    CHECK(i2c_scan_bit(results[DISPLAY_PORT].present, SSD1306_I2C_ADDRESS));
+    CHECK(!i2c_scan_bit(results[DISPLAY_PORT].present, GP8413_I2C_ADDRESS));
+    CHECK(i2c_scan_bit(results[DISPLAY_PORT].probed, GP8413_I2C_ADDRESS));
+}
+
+static void run_dac(i2c_master_bus_handle_t bus)
+{
+    gp8413_config_t config = {
+        .bus_handle = bus,
+        .device_addr = GP8413_I2C_ADDRESS,
+        .output_range = GP8413_OUTPUT_RANGE_10V,
+        .channel0 = {.voltage = 2500, .enable = true},
+        .channel1 = {.voltage = 7500, .enable = true},
+    };
+
+    step_begin();
+    gp8413_handle_t *dac = gp8413_init(&config);
+    step_end("dac init");
+    CHECK(dac != NULL);
+    if (!dac)
+    {
+        return;
+    }
+    CHECK(sim_gp8413_range_mv(&s_dac_model) == 10000);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 2500);
+    CHECK(sim_gp8413_mv(&s_dac_model, 1) == 7500);
+
+    step_begin();
+    CHECK(gp8413_set_output_voltage(dac, 1000, 0) == ESP_OK);
+    step_end("dac set one channel");
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 1000);
+
+    // both channels staged: one auto-increment transfer
+    step_begin();
+    CHECK(gp8413_stage_output_voltage(dac, 4000, 0) == ESP_OK);
+    CHECK(gp8413_stage_output_voltage(dac, 6000, 1) == ESP_OK);
+    CHECK(gp8413_flush(dac) == ESP_OK);
+    step_end("dac stage+flush both");
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 4000);
+    CHECK(sim_gp8413_mv(&s_dac_model, 1) == 6000);
+
+    uint32_t writes = s_dac_model.writes;
+    step_begin();
+    CHECK(gp8413_set_output_voltage(dac, 6000, 1) == ESP_OK);
+    step_end("dac unchanged value");
+    CHECK(s_dac_model.writes == writes);
+
+    // a write that is not acknowledged, then the shadow written back
+    i2c_sim_nack_next(CONTROL_PORT, GP8413_I2C_ADDRESS, 1);
+    CHECK(gp8413_set_output_voltage(dac, 3000, 0) != ESP_OK);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 4000);
+    memset(s_dac_model.regs, 0, sizeof(s_dac_model.regs)); // power cycle
+    step_begin();
+    CHECK(gp8413_restore(dac, bus) == ESP_OK);
+    step_end("dac restore");
+    CHECK(sim_gp8413_range_mv(&s_dac_model) == 10000);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 3000);
+    CHECK(sim_gp8413_mv(&s_dac_model, 1) == 6000);
+
+    gp8413_deinit(&dac);
+}
+
+static void run_relay(i2c_master_bus_handle_t bus)
+{
+    s_relay_model.regs[M54R_REG_RELAY] = 0x10; // state left by an earlier run
+    s_relay.device_address = M54R_ADDR;
+    s_relay.bus_handle = bus;
+    s_relay.scl_speed_hz = s_speed_hz;
+
+    step_begin();
+    CHECK(m54_init(&s_relay) == ESP_OK);
+    step_end("relay init");
+    uint8_t state = 0;
+    CHECK(m54_led_get(&s_relay, 0, &state) == ESP_OK && state == 1);
+
+    step_begin();
+    CHECK(m54_relay_set(&s_relay, 2, 1) == ESP_OK);
+    CHECK(m54_led_set(&s_relay, 3, 1) == ESP_OK);
+    step_end("relay set 2, led 3");
+    CHECK(sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) == 0x94);
+
+    step_begin();
+    CHECK(m54_relay_get(&s_relay, 2, &state) == ESP_OK && state == 1);
+    step_end("relay get (shadow)");
+
+    step_begin();
+    CHECK(m54_relay_set_all(&s_relay, 0) == ESP_OK);
+    step_end("relay all off");
+    CHECK(sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) == 0x90);
+
+    memset(s_relay_model.regs, 0, sizeof(s_relay_model.regs)); // power cycle
+    step_begin();
+    CHECK(m54_restore(&s_relay) == ESP_OK);
+    step_end("relay restore");
+    CHECK(sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) == 0x90);
+    CHECK(sim_m54r_reg(&s_relay_model, M54R_REG_MODE) == 0x00);
+}
+
+// Complete frames against the shadows: only what differs goes out, DAC and relay back to back
+static void run_actuator(i2c_master_bus_handle_t bus)
+{
+    gp8413_config_t config = {
+        .bus_handle = bus,
+        .device_addr = GP8413_I2C_ADDRESS,
+        .output_range = GP8413_OUTPUT_RANGE_10V,
+    };
+    gp8413_handle_t *dac = gp8413_init(&config);
+    actuator_t act;
+    actuator_stats_t st;
+    int64_t t_us = 0;
+
+    CHECK(dac != NULL);
+    if (!dac || actuator_init(&act, dac, &s_relay) != ESP_OK)
+    {
+        return;
+    }
+    actuator_frame_t frame = {.dac_mv = {3000, 5000}, .relays = 0x05, .leds = 0x0a};
+    step_begin();
+    CHECK(actuator_apply(&act, &frame, &t_us) == ESP_OK && t_us > 0);
+    step_end("actuator frame");
+    CHECK(act.stats.transactions == 2);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 3000 && sim_gp8413_mv(&s_dac_model, 1) == 5000);
+    CHECK(sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) == 0xa5);
+
+    uint32_t dac_writes = s_dac_model.writes;
+    uint32_t relay_writes = s_relay_model.writes;
+    step_begin();
+    CHECK(actuator_apply(&act, &frame, NULL) == ESP_OK);
+    step_end("actuator unchanged");
+    CHECK(s_dac_model.writes == dac_writes && s_relay_model.writes == relay_writes);
+    CHECK(act.stats.unchanged == 1);
+
+    frame.dac_mv[1] = 0; // brake off: one channel, the relays stay
+    step_begin();
+    CHECK(actuator_apply(&act, &frame, NULL) == ESP_OK);
+    step_end("actuator brake only");
+    CHECK(act.stats.transactions == 3);
+    CHECK(sim_gp8413_mv(&s_dac_model, 1) == 0 && s_relay_model.writes == relay_writes);
+
+    // a console command switched a relay: the next frame puts it back
+    CHECK(m54_relay_set(&s_relay, 3, 1) == ESP_OK);
+    CHECK(actuator_apply(&act, &frame, NULL) == ESP_OK);
+    CHECK(sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) == 0xa5);
+
+    // out of range: nothing is written
+    actuator_frame_t bad = frame;
+    bad.dac_mv[0] = 20000;
+    bad.relays = 0x0f;
+    CHECK(actuator_apply(&act, &bad, NULL) == ESP_ERR_INVALID_ARG);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 3000 && sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) == 0xa5);
+
+    actuator_frame_t now;
+    actuator_get_frame(&act, &now);
+    CHECK(memcmp(&now, &frame, sizeof(now)) == 0);
+    actuator_get_stats(&act, &st, true);
+    CHECK(st.frames == 4 && st.failed == 0 && st.skew_max_us <= st.latency_max_us);
+    CHECK(act.stats.frames == 0);
+
+    frame.relays = 0x00;
+    frame.leds = 0x00;
+    CHECK(actuator_apply(&act, &frame, NULL) == ESP_OK);
+    gp8413_deinit(&dac);
+}
+
+static void ramp_speed(void *arg, const control_tick_t *tick, actuator_frame_t *frame)
+{
+    uint32_t *calls = arg;
+    (*calls)++;
+    frame->dac_mv[0] = (uint16_t)((tick->seq / 10) % 10 * 100); // new setpoint every 10 loops
+}
+
+// 1 kHz loop on the timer thread: callbacks every loop, commits only when the frame changed
+static void run_control(i2c_master_bus_handle_t bus)
+{
+    gp8413_config_t config = {
+        .bus_handle = bus,
+        .device_addr = GP8413_I2C_ADDRESS,
+        .output_range = GP8413_OUTPUT_RANGE_10V,
+    };
+    gp8413_handle_t *dac = gp8413_init(&config);
+    actuator_t act;
+    uint32_t calls = 0;
+    control_exec_stats_t st;
+
+    CHECK(dac != NULL);
+    if (!dac || actuator_init(&act, dac, &s_relay) != ESP_OK)
+    {
+        return;
+    }
+    control_exec_config_t cfg = CONTROL_EXEC_CONFIG_DEFAULT();
+    cfg.act = &act;
+    CHECK(control_exec_add(ramp_speed, &calls) == ESP_OK);
+    CHECK(control_exec_start(&cfg) == ESP_OK);
+    CHECK(control_exec_start(&cfg) == ESP_ERR_INVALID_STATE);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    actuator_frame_t frame;
+    control_exec_get_frame(&frame);
+    frame.relays = 0x03;
+    control_exec_set_frame(&frame); // from outside the loop, like the console
+    vTaskDelay(pdMS_TO_TICKS(100));
+    CHECK(control_exec_stop() == ESP_OK);
+    CHECK(control_exec_remove(ramp_speed, &calls) == ESP_OK);
+
+    control_exec_get_stats(&st, false);
+    control_exec_get_frame(&frame);
+    CHECK(st.loops >= 100 && calls == st.loops);
+    CHECK(st.commit_errors == 0);
+    CHECK(act.stats.frames == st.loops && act.stats.unchanged >= st.loops / 2); // most loops write nothing
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == frame.dac_mv[0]);
+    CHECK((sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) & 0x0f) == 0x03);
+    control_exec_print(stdout);
+
+    frame.relays = 0x00;
+    CHECK(actuator_apply(&act, &frame, NULL) == ESP_OK);
+    gp8413_deinit(&dac);
+}
+
+static failsafe_state_t wait_failsafe(void)
+{
+    failsafe_state_t state = failsafe_get_state();
+    for (int i = 0; i < 100 && (state == FAILSAFE_ARMED || state == FAILSAFE_TRIPPED); i++)
+    {
+        vTaskDelay(1);
+        state = failsafe_get_state();
+    }
+    return state;
+}
+
+// The host goes quiet while the control loop drives the outputs: DAC 0 V, relays open, held
+static void run_failsafe(i2c_master_bus_handle_t bus)
+{
+    gp8413_config_t config = {
+        .bus_handle = bus,
+        .device_addr = GP8413_I2C_ADDRESS,
+        .output_range = GP8413_OUTPUT_RANGE_10V,
+    };
+    gp8413_handle_t *dac = gp8413_init(&config);
+    actuator_t act;
+    uint32_t calls = 0;
+    failsafe_stats_t st;
+    control_exec_stats_t loop;
+
+    CHECK(dac != NULL);
+    if (!dac || actuator_init(&act, dac, &s_relay) != ESP_OK)
+    {
+        return;
+    }
+    CHECK(failsafe_trip() == ESP_ERR_INVALID_STATE && failsafe_clear() == ESP_ERR_INVALID_STATE);
+    failsafe_config_t cfg = FAILSAFE_CONFIG_DEFAULT();
+    cfg.timeout_ms = 50;
+    cfg.act = &act;
+    CHECK(failsafe_start(&cfg) == ESP_OK);
+    CHECK(failsafe_start(&cfg) == ESP_ERR_INVALID_STATE);
+
+    control_exec_config_t loop_cfg = CONTROL_EXEC_CONFIG_DEFAULT();
+    loop_cfg.act = &act;
+    CHECK(control_exec_add(ramp_speed, &calls) == ESP_OK);
+    CHECK(control_exec_start(&loop_cfg) == ESP_OK);
+    actuator_frame_t frame = {.dac_mv = {0, 2000}, .relays = 0x03};
+    control_exec_set_frame(&frame);
+    for (int i = 0; i < 15; i++) // heartbeats every tick, well within the window
+    {
+        failsafe_feed();
+        vTaskDelay(1);
+    }
+    CHECK(failsafe_get_state() == FAILSAFE_ARMED);
+    CHECK(sim_gp8413_mv(&s_dac_model, 1) == 2000 && (sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) & 0x0f) == 0x03);
+
+    // the host stops: the loop keeps writing setpoints, the failsafe wins
+    CHECK(wait_failsafe() == FAILSAFE_SAFE);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 0 && sim_gp8413_mv(&s_dac_model, 1) == 0);
+    CHECK(sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) == 0x00);
+    failsafe_feed(); // too late, a trip is latched
+    vTaskDelay(2);
+    CHECK(failsafe_get_state() == FAILSAFE_SAFE);
+    CHECK(sim_gp8413_mv(&s_dac_model, 1) == 0 && sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) == 0x00);
+    CHECK(control_exec_stop() == ESP_OK);
+    CHECK(control_exec_remove(ramp_speed, &calls) == ESP_OK);
+    control_exec_get_stats(&loop, false);
+    CHECK(loop.commit_errors > 0); // refused while held
+
+    // release, then an emergency stop by hand
+    CHECK(failsafe_clear() == ESP_OK && failsafe_get_state() == FAILSAFE_ARMED);
+    CHECK(failsafe_trip() == ESP_OK);
+    CHECK(wait_failsafe() == FAILSAFE_SAFE);
+    failsafe_get_stats(&st, false);
+    CHECK(st.trips == 2 && st.confirmed == 2 && st.write_errors == 0 && st.feeds >= 15);
+    CHECK(st.safe_max_us >= st.detect_max_us && st.safe_max_us < 100000);
+    failsafe_print(stdout);
+
+    // disarm: the drivers know the devices again, the next frame goes out
+    CHECK(failsafe_stop() == ESP_OK && failsafe_get_state() == FAILSAFE_OFF);
+    frame = (actuator_frame_t){.dac_mv = {1000, 0}, .relays = 0x01};
+    CHECK(actuator_apply(&act, &frame, NULL) == ESP_OK);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 1000 && sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) == 0x01);
+
+    frame.dac_mv[0] = 0;
+    frame.relays = 0x00;
+    CHECK(actuator_apply(&act, &frame, NULL) == ESP_OK);
+    gp8413_deinit(&dac);
+}
+
+// One display per port at the same address: two devices in the statistics
+static void run_stats(void)
+{
+    static i2c_stats_dev_t devs[I2C_STATS_MAX_DEVICES];
+    uint32_t display_txns[I2C_STATS_MAX_PORTS] = {0};
+    int n = i2c_stats_get_all(devs);
+    for (int i = 0; i < n; i++)
+    {
+        if (devs[i].device_address == SSD1306_I2C_ADDRESS)
+        {
+            CHECK(devs[i].port < I2C_STATS_MAX_PORTS && display_txns[devs[i].port] == 0);
+            display_txns[devs[i].port % I2C_STATS_MAX_PORTS] = devs[i].transactions;
+        }
+    }
+    CHECK(display_txns[CONTROL_PORT] > 0 && display_txns[DISPLAY_PORT] > 0);
+
+    static uint8_t buf[I2C_STATS_EXPORT_MAX_SIZE];
+    size_t len = i2c_stats_export(buf, sizeof(buf));
+    CHECK(len == 8 + 2 * I2C_STATS_MAX_PORTS + (size_t)n * (2 + 4 * (6 + I2C_STATS_HIST_BUCKETS)));
+    CHECK(buf[4] == I2C_STATS_EXPORT_VERSION && buf[5] == n && buf[7] == I2C_STATS_MAX_PORTS);
+}
+
+static void draw_test_frame(ssd1306_handle_t *dev, int frame)
+{
+    char line[24];
+    ssd1306_fill(dev, 0);
+    snprintf(line, sizeof(line), "frame %d", frame);
+    ssd1306_printFixed8(dev, 0, 0, 1, line);
+    ssd1306_printFixed6(dev, 0, 16, 1, "host simulation");
+    for (int x = 0; x < dev->width; x++)
+    {
+        ssd1306_set_pixel(dev, x, 40 + (x + frame) % 24, 1);
+    }
+}
+
+static void run_display(int index, i2c_master_bus_handle_t bus, bool print)
+{
+    ssd1306_handle_t *dev = &s_oled[index];
+    const char *name = index ? "async" : "sync";
+    char step[32];
+
+    dev->device_address = SSD1306_I2C_ADDRESS;
+    dev->bus_handle = bus;
+    dev->scl_speed_hz = s_speed_hz;
+    step_begin();
+    ssd1306_init(dev, 128, 64, 0);
+    snprintf(step, sizeof(step), "display %s init", name);
+    step_end(step);
+    CHECK(dev->dev_handle != NULL);
+    CHECK(s_oled_model[index].display_on);
+    CHECK(s_oled_model[index].addressing_mode == 0);
+
+    for (int frame = 0; frame < 2; frame++)
+    {
+        draw_test_frame(dev, frame);
+        step_begin();
+        if (index)
+        {
+            CHECK(ssd1306_show_async(dev) == ESP_OK);
+            CHECK(ssd1306_wait(dev, 1000) == ESP_OK);
+        }
+        else
+        {
+            ssd1306_show(dev);
+        }
+        snprintf(step, sizeof(step), "display %s frame %d", name, frame);
+        step_end(step);
+        CHECK(display_matches(dev, &s_oled_model[index]));
+    }
+    if (index)
+    {
+        // the display stretches the clock past the wait: the wait still returns only when the
+        // driver is done with the staging buffers
+        i2c_sim_stretch_next(DISPLAY_PORT, 100);
+        draw_test_frame(dev, 2);
+        CHECK(ssd1306_show_async(dev) == ESP_OK);
+        int64_t start_us = esp_timer_get_time();
+        CHECK(ssd1306_wait(dev, 10) == ESP_OK);
+        CHECK(esp_timer_get_time() - start_us >= 100000);
+        CHECK(display_matches(dev, &s_oled_model[index]));
+    }
+    if (print)
+    {
+        sim_ssd1306_print(&s_oled_model[index], stdout);
+    }
+}
+
+static void run_batch(void)
+{
+    static i2c_batch_t batch;
+    char err[64] = "";
+    const char *script = "w 0x26 0x11 0x05; c 0x26 0x11 = 0x05; r 0x26 2 0x10; w 0x26 0x11 0x00";
+
+    CHECK(i2c_batch_compile(script, s_speed_hz, &batch, err, sizeof(err)) == ESP_OK);
+    step_begin();
+    CHECK(i2c_batch_run(&batch, true) == ESP_OK);
+    step_end("batch script");
+    CHECK(batch.passed == batch.n_steps);
+    CHECK(sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) == 0x00);
+}
+
+// Capture the script and an async frame, then replay them from the ring and from the dump
+static void run_capture_replay(void)
+{
+    i2c_capture_status_t st;
+    i2c_replay_stats_t stats;
+    i2c_replay_config_t config = I2C_REPLAY_CONFIG_DEFAULT();
+    config.scl_speed_hz = s_speed_hz;
+
+    CHECK(i2c_capture_start(16 * 1024, false) == ESP_OK);
+    run_batch();
+    draw_test_frame(&s_oled[1], 7);
+    CHECK(ssd1306_show_async(&s_oled[1]) == ESP_OK);
+    CHECK(ssd1306_wait(&s_oled[1], 1000) == ESP_OK);
+    i2c_capture_stop();
+    i2c_capture_get_status(&st);
+    CHECK(st.records == 4 + 1 + (uint32_t)s_oled[1].pages); // script steps, frame command and pages
+    CHECK(st.dropped == 0);
+
+    memset(s_oled_model[1].gddram, 0, sizeof(s_oled_model[1].gddram));
+    step_begin();
+    CHECK(i2c_replay_capture(&config, &stats) == ESP_OK);
+    step_end("replay ring");
+    CHECK(stats.transactions == st.records);
+    CHECK(stats.result_mismatch == 0 && stats.data_mismatch == 0 && stats.skipped == 0);
+    CHECK(display_matches(&s_oled[1], &s_oled_model[1]));
+
+    FILE *dump = tmpfile();
+    CHECK(dump != NULL);
+    if (!dump)
+    {
+        return;
+    }
+    CHECK(i2c_capture_dump(dump, 0) == st.records);
+    rewind(dump);
+    memset(s_oled_model[1].gddram, 0, sizeof(s_oled_model[1].gddram));
+    step_begin();
+    CHECK(i2c_replay_file(dump, &config, &stats) == ESP_OK);
+    step_end("replay dump");
+    fclose(dump);
+    CHECK(stats.transactions == st.records);
+    CHECK(stats.result_mismatch == 0 && stats.data_mismatch == 0 && stats.skipped == 0);
+    CHECK(display_matches(&s_oled[1], &s_oled_model[1]));
+
+    // a ring smaller than the traffic keeps the newest records
+    CHECK(i2c_capture_start(640, false) == ESP_OK);
+    CHECK(ssd1306_show_async(&s_oled[1]) == ESP_OK);
+    CHECK(ssd1306_wait(&s_oled[1], 1000) == ESP_OK);
+    i2c_capture_stop();
+    i2c_capture_get_status(&st);
+    CHECK(st.dropped > 0 && st.records + st.dropped == 1 + (uint32_t)s_oled[1].pages);
+}
+
+static void restore_dac(i2c_master_bus_handle_t new_bus, void *arg)
+{
+    gp8413_restore((gp8413_handle_t *)arg, new_bus); // this thread waits meanwhile
+}
+
+// Wait for the monitor, at most a second
+static bool wait_recover(i2c_recover_stats_t *st, uint32_t recoveries, bool bus_down)
+{
+    for (int i = 0; i < 100; i++)
+    {
+        i2c_recover_get_stats(st);
+        if (st->recoveries >= recoveries && st->bus_down == bus_down)
+        {
+            return true;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+// A slave keeps SDA low: timeouts, clocks + STOP, bus rebuilt, DAC state written again
+static void run_recovery(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *bus)
+{
+    gp8413_config_t config = {
+        .bus_handle = *bus,
+        .device_addr = GP8413_I2C_ADDRESS,
+        .output_range = GP8413_OUTPUT_RANGE_10V,
+        .channel0 = {.voltage = 1500, .enable = true},
+        .channel1 = {.voltage = 8500, .enable = true},
+    };
+    gp8413_handle_t *dac = gp8413_init(&config);
+    i2c_recover_stats_t st;
+
+    CHECK(dac != NULL);
+    if (!dac)
+    {
+        return;
+    }
+    i2c_recover_config_t recover_config = {
+        .bus_config = *bus_config,
+        .bus_handle = bus,
+        .timeout_threshold = 3,
+        .check_period_ms = 20,
+        .holdoff_ms = 10,
+        .on_recovered = restore_dac,
+        .cb_arg = dac,
+        .task_priority = 5,
+    };
+    CHECK(i2c_recover_start(&recover_config) == ESP_OK);
+
+    // reset in the middle of a read: the DAC lost its registers, SDA is released after 5 clocks
+    memset(s_dac_model.regs, 0, sizeof(s_dac_model.regs));
+    i2c_sim_stick_sda(CONTROL_PORT, 5);
+    step_begin();
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK(gp8413_set_output_voltage(dac, 2000, 0) == ESP_ERR_TIMEOUT);
+    }
+    CHECK(wait_recover(&st, 1, false));
+    step_end("recover timeouts");
+    CHECK(st.recoveries == 1 && st.failures == 0 && st.last_clocks == 5);
+    CHECK(st.last_reason == I2C_RECOVER_REASON_TIMEOUTS);
+    CHECK(sim_gp8413_range_mv(&s_dac_model) == 10000);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 2000 && sim_gp8413_mv(&s_dac_model, 1) == 8500);
+    CHECK(gp8413_set_output_voltage(dac, 2500, 0) == ESP_OK && sim_gp8413_mv(&s_dac_model, 0) == 2500);
+
+    // SDA low on the idle bus, and the bus cannot be created at the first two tries
+    memset(s_dac_model.regs, 0, sizeof(s_dac_model.regs));
+    i2c_sim_stick_sda(CONTROL_PORT, 2);
+    i2c_sim_fail_bus_create(CONTROL_PORT, 2);
+    step_begin();
+    CHECK(wait_recover(&st, 2, false));
+    step_end("recover idle check");
+    CHECK(st.recoveries == 2 && st.failures == 2 && st.last_clocks == 2);
+    CHECK(st.last_reason == I2C_RECOVER_REASON_SDA_LOW);
+    CHECK(*bus != NULL && sim_gp8413_mv(&s_dac_model, 0) == 2500 && sim_gp8413_mv(&s_dac_model, 1) == 8500);
+
+    // no bus at all: the monitor gives up, a manual recovery brings it back
+    i2c_sim_fail_bus_create(CONTROL_PORT, I2C_RECOVER_REBUILD_TRIES);
+    CHECK(i2c_recover_now() != ESP_OK);
+    CHECK(wait_recover(&st, 2, true));
+    CHECK(*bus == NULL && st.failures == 2 + I2C_RECOVER_REBUILD_TRIES);
+    memset(s_dac_model.regs, 0, sizeof(s_dac_model.regs));
+    CHECK(i2c_recover_now() == ESP_OK);
+    i2c_recover_get_stats(&st);
+    CHECK(*bus != NULL && st.recoveries == 3 && !st.bus_down);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 2500 && sim_gp8413_mv(&s_dac_model, 1) == 8500);
+
+    gp8413_deinit(&dac);
+}
+
+int main(int argc, char **argv)
+{
+    bool print = false;
+    int opt;
+    esp_log_level_set("*", ESP_LOG_WARN);
+    while ((opt = getopt(argc, argv, "rvps:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            i2c_sim_set_realtime(true);
+            break;
+        case 'v':
+            esp_log_level_set("*", ESP_LOG_INFO);
+            break;
+        case 'p':
+            print = true;
+            break;
+        case 's':
+            s_speed_hz = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r] [-v] [-p] [-s SCL_HZ]\n", argv[0]);
+            return 2;
+        }
+    }
+    boot_trace_mark("startup");
+
+    CHECK(sim_gp8413_attach(&s_dac_model, CONTROL_PORT, GP8413_I2C_ADDRESS) == ESP_OK);
+    CHECK(sim_m54r_attach(&s_relay_model, CONTROL_PORT, M54R_ADDR) == ESP_OK);
+    CHECK(sim_ssd1306_attach(&s_oled_model[0], CONTROL_PORT, SSD1306_I2C_ADDRESS) == ESP_OK);
+    CHECK(sim_ssd1306_attach(&s_oled_model[1], DISPLAY_PORT, SSD1306_I2C_ADDRESS) == ESP_OK);
+
+    // pins, so the recovery can clock the control bus free
+    i2c_master_bus_config_t control_config = bench_bus_config(CONTROL_PORT);
+    control_config.sda_io_num = 7;
+    control_config.scl_io_num = 8;
+    i2c_master_bus_config_t display_config = bench_bus_config(DISPLAY_PORT);
+    display_config.sda_io_num = 9;
+    display_config.scl_io_num = 10;
+    i2c_master_bus_handle_t control_bus = bench_new_bus(&control_config, false);
+    i2c_master_bus_handle_t display_bus = bench_new_bus(&display_config, true);
+    boot_trace_mark("buses");
+
+    printf("%-22s %6s %6s %8s %10s %10s\n", "step", "txns", "nacks", "bytes", "bus(us)", "wall(us)");
+    run_inventory();
+    boot_trace_mark("inventory");
+    run_scan(control_bus, display_bus);
+    run_dac(control_bus);
+    boot_trace_mark("dac");
+    run_relay(control_bus);
+    run_actuator(control_bus);
+    run_control(control_bus);
+    run_failsafe(control_bus);
+    run_display(0, control_bus, print);
+    run_display(1, display_bus, print);
+    run_stats();
+    boot_trace_mark("display");
+    run_capture_replay();
+    boot_trace_mark("ready");
+    run_recovery(&control_config, &control_bus);
+
+    for (int port = 0; port < I2C_SIM_MAX_PORTS; port++)
+    {
+        i2c_sim_stats_t st;
+        i2c_sim_get_stats(port, &st, false);
+        printf("bus %d: %" PRIu32 " transactions, %" PRIu32 " nacks, %" PRIu32 " timeouts, %" PRIu64 " bytes, %" PRIu64
+               " us at %" PRIu32 " Hz\n", port, st.transactions, st.nacks, st.timeouts, st.bytes, st.bus_ns / 1000,
+               s_speed_hz);
+    }
+    boot_trace_print(stdout);
+
+    return bench_result(TAG);
+}
@@ -0,0 +1,77 @@
+// driver/gptimer.h
+// Host build: the ESP-IDF 5.5 general purpose timer API, alarms from a POSIX thread (port/gptimer_posix.c)
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+
+    typedef struct gptimer_t *gptimer_handle_t;
+
+    typedef enum
+    {
+        GPTIMER_CLK_SRC_DEFAULT = 0,
+    } gptimer_clock_source_t;
+
+    typedef enum
+    {
+        GPTIMER_COUNT_DOWN,
+        GPTIMER_COUNT_UP,
+    } gptimer_count_direction_t;
+
+    typedef struct
+    {
+        gptimer_clock_source_t clk_src;
+        gptimer_count_direction_t direction;
+        uint32_t resolution_hz; // Counter ticks per second
+        int intr_priority;
+        struct
+        {
+            uint32_t intr_shared : 1;
+        } flags;
+    } gptimer_config_t;
+
+    typedef struct
+    {
+        uint64_t count_value;
+        uint64_t alarm_value;
+    } gptimer_alarm_event_data_t;
+
+    // Runs on the timer thread, stands in for the alarm interrupt
+    typedef bool (*gptimer_alarm_cb_t)(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx);
+
+    typedef struct
+    {
+        gptimer_alarm_cb_t on_alarm;
+    } gptimer_event_callbacks_t;
+
+    typedef struct
+    {
+        uint64_t alarm_count;
+        uint64_t reload_count;
+        struct
+        {
+            uint32_t auto_reload_on_alarm : 1;
+        } flags;
+    } gptimer_alarm_config_t;
+
+    esp_err_t gptimer_new_timer(const gptimer_config_t *config, gptimer_handle_t *ret_timer);
+    esp_err_t gptimer_del_timer(gptimer_handle_t timer);
+    esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer, const gptimer_event_callbacks_t *cbs,
+                                               void *user_data);
+    esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t *config);
+    esp_err_t gptimer_enable(gptimer_handle_t timer);
+    esp_err_t gptimer_disable(gptimer_handle_t timer);
+    esp_err_t gptimer_start(gptimer_handle_t timer);
+    esp_err_t gptimer_stop(gptimer_handle_t timer);
+
+#ifdef __cplusplus
+}
+#endif
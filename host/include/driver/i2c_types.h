@@ -0,0 +1,57 @@
+// driver/i2c_types.h
+// Host build: I2C master types of ESP-IDF 5.5
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef int i2c_port_num_t;
+
+    typedef enum
+    {
+        I2C_NUM_0 = 0,
+        I2C_NUM_1 = 1,
+        I2C_NUM_MAX,
+    } i2c_port_t;
+
+    typedef enum
+    {
+        I2C_ADDR_BIT_LEN_7 = 0,
+        I2C_ADDR_BIT_LEN_10 = 1,
+    } i2c_addr_bit_len_t;
+
+    typedef enum
+    {
+        I2C_CLK_SRC_DEFAULT = 0,
+        I2C_CLK_SRC_XTAL = 1,
+    } i2c_clock_source_t;
+
+    typedef enum
+    {
+        I2C_EVENT_ALIVE,
+        I2C_EVENT_DONE,
+        I2C_EVENT_NACK,
+        I2C_EVENT_TIMEOUT,
+    } i2c_master_event_t;
+
+    typedef struct i2c_master_bus_t *i2c_master_bus_handle_t;
+    typedef struct i2c_master_dev_t *i2c_master_dev_handle_t;
+
+    typedef struct
+    {
+        i2c_master_event_t event;
+    } i2c_master_event_data_t;
+
+    typedef bool (*i2c_master_callback_t)(i2c_master_dev_handle_t i2c_dev, const i2c_master_event_data_t *evt_data,
+                                          void *arg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,8 @@
+// esp_attr.h
+// Host build: placement attributes have no meaning off-target
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_BSS_ATTR
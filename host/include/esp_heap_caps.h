@@ -0,0 +1,27 @@
+// esp_heap_caps.h
+// Host build: capability allocation on malloc(), there is no PSRAM
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+    // NULL for MALLOC_CAP_SPIRAM, so callers take their internal RAM fallback
+    void *heap_caps_malloc(size_t size, uint32_t caps);
+    void *heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+    void heap_caps_free(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,44 @@
+// esp_log.h
+// Host build: ESP-IDF logging on stdout, with the level filter of esp_log_level_set()
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef enum
+    {
+        ESP_LOG_NONE,
+        ESP_LOG_ERROR,
+        ESP_LOG_WARN,
+        ESP_LOG_INFO,
+        ESP_LOG_DEBUG,
+        ESP_LOG_VERBOSE,
+    } esp_log_level_t;
+
+    void esp_log_level_set(const char *tag, esp_log_level_t level);
+    esp_log_level_t esp_log_level_get(const char *tag); // "*" or a tag without its own level: the default
+    void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+        __attribute__((format(printf, 3, 4)));
+    uint32_t esp_log_timestamp(void);
+
+#define ESP_HOST_LOG(level, letter, tag, format, ...) \
+    esp_log_write(level, tag, letter " (%" PRIu32 ") %s: " format "\n", esp_log_timestamp(), tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) ESP_HOST_LOG(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_HOST_LOG(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_HOST_LOG(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_HOST_LOG(ESP_LOG_DEBUG, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_HOST_LOG(ESP_LOG_VERBOSE, "V", tag, format, ##__VA_ARGS__)
+#define ESP_EARLY_LOGE ESP_LOGE
+#define ESP_EARLY_LOGW ESP_LOGW
+#define ESP_EARLY_LOGI ESP_LOGI
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,17 @@
+// esp_rom_sys.h
+// Host build: busy delay
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    void esp_rom_delay_us(uint32_t us);
+
+#ifdef __cplusplus
+}
+#endif
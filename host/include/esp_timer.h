@@ -0,0 +1,17 @@
+// esp_timer.h
+// Host build: microsecond time since start (CLOCK_MONOTONIC)
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
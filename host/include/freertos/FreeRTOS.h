@@ -0,0 +1,68 @@
+// freertos/FreeRTOS.h
+// Host build: the FreeRTOS subset used by the components, on POSIX threads (port/freertos_posix.c)
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+
+    typedef uint32_t TickType_t;
+    typedef int BaseType_t;
+    typedef unsigned int UBaseType_t;
+    typedef uint8_t StackType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES 25
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((uint64_t)(xTimeInMs) * configTICK_RATE_HZ) / 1000U))
+#define pdTICKS_TO_MS(xTicks) ((uint32_t)(((uint64_t)(xTicks) * 1000U) / configTICK_RATE_HZ))
+#define tskNO_AFFINITY 0x7fffffff
+
+    // Backing store of a static semaphore, large enough for the pthread objects
+    typedef struct
+    {
+        uint64_t storage[24];
+    } StaticSemaphore_t;
+
+    typedef struct
+    {
+        uint64_t storage[8];
+    } StaticTask_t;
+
+    // Critical sections: one process-wide recursive mutex, the spinlock argument is ignored
+    typedef struct
+    {
+        int owner;
+    } portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+    void vPortEnterCritical(void);
+    void vPortExitCritical(void);
+
+#define portENTER_CRITICAL(mux) ((void)(mux), vPortEnterCritical())
+#define portEXIT_CRITICAL(mux) ((void)(mux), vPortExitCritical())
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+#define portENTER_CRITICAL_SAFE(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_SAFE(mux) portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR(x) ((void)(x))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,38 @@
+// freertos/task.h
+// Host build: tasks are POSIX threads, notifications a counter per task
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0U)
+
+    typedef struct tskTaskControlBlock *TaskHandle_t;
+    typedef void (*TaskFunction_t)(void *);
+
+    BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters,
+                           UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask);
+    BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth,
+                                       void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask,
+                                       BaseType_t xCoreID);
+    void vTaskDelete(TaskHandle_t xTaskToDelete); // Only NULL (the calling task) is supported
+    void vTaskDelay(TickType_t xTicksToDelay);
+    TickType_t xTaskGetTickCount(void);
+    TaskHandle_t xTaskGetCurrentTaskHandle(void);
+    UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask);
+    const char *pcTaskGetName(TaskHandle_t xTaskToQuery);
+
+    BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+    void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken);
+    uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+
+    BaseType_t xPortGetCoreID(void);
+
+#ifdef __cplusplus
+}
+#endif
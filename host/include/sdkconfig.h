@@ -0,0 +1,8 @@
+// sdkconfig.h
+// Host build: the configuration values the components read
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_SOC_HP_I2C_NUM 2
@@ -0,0 +1,240 @@
+/**
+ * @file pid_bench.c
+ * @brief Loop rate and CPU per loop of the fixed-point PID block, and closed-loop checks.
+ *
+ * The block drives channel 0 of the GP8413 model on the simulated bus; a first-order plant
+ * (gain 1, tau 20 ms) reads what the model outputs and is the feedback. Measured: the update
+ * alone, and complete loops (feedback, update, write when the quantised output changed) while
+ * the plant settles on a setpoint and while it holds it. CPU is the process CPU time per
+ * loop, so the scheduler task that does the I2C write is included.
+ *
+ * Checked: settling on reachable setpoints, no writes once settled, the clamp to the output
+ * range, recovery from a setpoint out of range within a few loops (anti-windup), a failing
+ * feedback source, and the block as a callback of the 1 kHz control executive.
+ * Exit status 1 when a check failed.
+ *
+ * usage: pid_bench [-r] [-n LOOPS]
+ *   -r  sleep the I2C bus time (wall-clock timing as on the target)
+ *   -n  loops per measurement (default 2000)
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/i2c_master.h"
+#include "gp8413_sdc.h"
+#include "actuator.h"
+#include "control_exec.h"
+#include "dac_pid.h"
+#include "i2c_sim.h"
+#include "sim_devices.h"
+#include "host_bench.h"
+#include "sim_plant.h"
+
+#define CONTROL_PORT (0)
+#define PERIOD_US (1000)
+#define TAU_US (20000)
+#define TOLERANCE (10) // Settled: within this many units of the setpoint
+
+static const char *TAG = "pid_bench";
+
+static sim_gp8413_t s_dac_model;
+static gp8413_handle_t *s_dac;
+
+static int64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void report(const char *name, uint32_t loops, uint32_t writes, int64_t wall_us, int64_t cpu)
+{
+    printf("%-24s %7" PRIu32 " %7" PRIu32 " %10.0f %10.3f %10.3f\n", name, loops, writes,
+           wall_us ? loops * 1e6 / wall_us : 0.0, cpu / 1000.0 / loops, (double)wall_us / loops);
+}
+
+static void pid_config(dac_pid_config_t *config, void *plant)
+{
+    *config = (dac_pid_config_t){
+        .kp = 1.0f,
+        .ki = 50.0f, // zero on the plant pole: closed loop tau 20 ms
+        .period_us = PERIOD_US,
+        .channel = 0,
+        .feedback = sim_plant_feedback,
+        .feedback_ctx = plant,
+    };
+}
+
+// Loops against the plant; returns how many the plant needed to settle, -1 when it did not
+static int run_loops(dac_pid_t *pid, int32_t setpoint, int loops, const char *name, uint32_t *max_mv)
+{
+    uint32_t writes = pid->stats.writes;
+    int settled = -1;
+    dac_pid_set_setpoint(pid, setpoint);
+    int64_t wall = esp_timer_get_time();
+    int64_t cpu = cpu_ns();
+    for (int i = 0; i < loops; i++)
+    {
+        CHECK(dac_pid_step(pid) == ESP_OK);
+        bool near = llabs((long long)pid->measured - setpoint) <= TOLERANCE;
+        settled = near ? (settled < 0 ? i : settled) : -1;
+        if (max_mv && sim_gp8413_mv(&s_dac_model, 0) > *max_mv)
+        {
+            *max_mv = sim_gp8413_mv(&s_dac_model, 0);
+        }
+    }
+    if (name)
+    {
+        report(name, (uint32_t)loops, pid->stats.writes - writes, esp_timer_get_time() - wall, cpu_ns() - cpu);
+    }
+    return settled;
+}
+
+static void bench_update(int loops)
+{
+    dac_pid_t pid;
+    dac_pid_config_t config;
+    pid_config(&config, NULL);
+    config.kd = 0.001f;
+    CHECK(dac_pid_init(&pid, &config, s_dac) == ESP_OK);
+    volatile int32_t sink = 0;
+    int n = loops * 100;
+    int64_t wall = esp_timer_get_time();
+    int64_t cpu = cpu_ns();
+    for (int i = 0; i < n; i++)
+    {
+        sink += dac_pid_update(&pid, 5000, i & 8191);
+    }
+    report("update only (PID)", (uint32_t)n, 0, esp_timer_get_time() - wall, cpu_ns() - cpu);
+}
+
+static void bench_closed_loop(int loops)
+{
+    dac_pid_t pid;
+    dac_pid_config_t config;
+    sim_plant_t plant;
+    uint32_t max_mv = 0;
+
+    sim_plant_init(&plant, &s_dac_model, 0, 1.0f, TAU_US, PERIOD_US);
+    pid_config(&config, &plant);
+    CHECK(dac_pid_init(&pid, &config, s_dac) == ESP_OK);
+
+    int settle = run_loops(&pid, 2000, loops, "step to 2000", &max_mv);
+    CHECK(settle >= 0 && settle < 300);
+    uint32_t writes = pid.stats.writes;
+    run_loops(&pid, 2000, loops, "hold 2000", &max_mv);
+    CHECK(pid.stats.writes - writes <= 2); // settled: the quantised output does not move
+    settle = run_loops(&pid, 5000, loops, "step to 5000", &max_mv);
+    CHECK(settle >= 0 && settle < 300);
+
+    // out of reach: the output sits at the 10 V clamp, the integrator does not wind up
+    run_loops(&pid, 12000, loops, "beyond the range", &max_mv);
+    CHECK(pid.out_mv == 10000 && max_mv == 10000 && pid.stats.saturated > 0);
+    dac_pid_set_setpoint(&pid, 3000);
+    CHECK(dac_pid_step(&pid) == ESP_OK);
+    CHECK(pid.out_mv < 10000); // leaves the clamp on the first loop with a negative error
+    settle = run_loops(&pid, 3000, loops, "back to 3000", &max_mv);
+    CHECK(settle >= 0 && settle < 300);
+
+    // below the clamp: the output stays at out_min
+    run_loops(&pid, -500, 200, NULL, NULL);
+    CHECK(pid.out_mv == 0 && sim_gp8413_mv(&s_dac_model, 0) == 0);
+
+    // no measurement: the loop keeps the last output
+    pid.feedback = NULL;
+    uint32_t out = pid.out_mv;
+    CHECK(dac_pid_step(&pid) == ESP_ERR_INVALID_STATE && pid.out_mv == out && pid.stats.feedback_errors == 1);
+    pid.feedback = sim_plant_feedback;
+    dac_pid_print(&pid, stdout);
+}
+
+// The block as a control_exec callback: the frame goes out through the actuator
+static void check_control_exec(void)
+{
+    dac_pid_t pid;
+    dac_pid_config_t config;
+    sim_plant_t plant;
+    actuator_t act;
+    control_exec_stats_t st;
+
+    sim_plant_init(&plant, &s_dac_model, 0, 1.0f, TAU_US, 0); // wall clock
+    pid_config(&config, &plant);
+    CHECK(dac_pid_init(&pid, &config, s_dac) == ESP_OK);
+    CHECK(actuator_init(&act, s_dac, NULL) == ESP_OK);
+    dac_pid_set_setpoint(&pid, 4000);
+
+    control_exec_config_t cfg = CONTROL_EXEC_CONFIG_DEFAULT();
+    cfg.act = &act;
+    CHECK(control_exec_add(dac_pid_control, &pid) == ESP_OK);
+    CHECK(control_exec_start(&cfg) == ESP_OK);
+    vTaskDelay(pdMS_TO_TICKS(400));
+    CHECK(control_exec_stop() == ESP_OK);
+    CHECK(control_exec_remove(dac_pid_control, &pid) == ESP_OK);
+    control_exec_get_stats(&st, false);
+
+    printf("control_exec 1 kHz: %" PRIu32 " loops, %" PRIu32 " writes, %" PRIu32 " frames unchanged, "
+           "measured %" PRId32 "\n", st.loops, pid.stats.writes, act.stats.unchanged, pid.measured);
+    CHECK(st.loops >= 200 && pid.stats.loops == st.loops && st.commit_errors == 0);
+    CHECK(llabs((long long)pid.measured - 4000) <= 2 * TOLERANCE);
+    CHECK(pid.stats.writes < st.loops && act.stats.unchanged > 0);
+}
+
+int main(int argc, char **argv)
+{
+    int loops = 2000;
+    int opt;
+    esp_log_level_set("*", ESP_LOG_WARN);
+    while ((opt = getopt(argc, argv, "rn:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            i2c_sim_set_realtime(true);
+            break;
+        case 'n':
+            loops = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r] [-n LOOPS]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (loops < 500)
+    {
+        fprintf(stderr, "need -n >= 500 (the plant settles in about 300 loops)\n");
+        return 2;
+    }
+
+    CHECK(sim_gp8413_attach(&s_dac_model, CONTROL_PORT, GP8413_I2C_ADDRESS) == ESP_OK);
+    i2c_master_bus_handle_t control_bus = bench_bus(CONTROL_PORT, false);
+    gp8413_config_t dac_config = {
+        .bus_handle = control_bus,
+        .device_addr = GP8413_I2C_ADDRESS,
+        .output_range = GP8413_OUTPUT_RANGE_10V,
+    };
+    s_dac = gp8413_init(&dac_config);
+    if (s_dac == NULL)
+    {
+        ESP_LOGE(TAG, "device setup failed");
+        return 1;
+    }
+
+    printf("%-24s %7s %7s %10s %10s %10s\n", "loop", "loops", "writes", "loops/s", "cpu(us)", "wall(us)");
+    bench_update(loops);
+    bench_closed_loop(loops);
+    check_control_exec();
+    gp8413_deinit(&s_dac);
+
+    return bench_result(TAG);
+}
@@ -0,0 +1,175 @@
+/**
+ * @file esp_posix.c
+ * @brief ESP-IDF system services of the host build: time, delays, logging, error names, heap (GPIO: i2c_sim.c).
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+
+#define LOG_MAX_TAGS (16)
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_log_level_t s_default_level = ESP_LOG_INFO;
+static struct
+{
+    const char *tag;
+    esp_log_level_t level;
+} s_tag_level[LOG_MAX_TAGS];
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    static int64_t start;
+    if (start == 0)
+    {
+        start = now_us(); // like the target: time since boot
+    }
+    return now_us() - start;
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (long)(us % 1000000) * 1000};
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+    {
+    }
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    portENTER_CRITICAL(&s_mux);
+    if (strcmp(tag, "*") == 0)
+    {
+        s_default_level = level;
+        memset(s_tag_level, 0, sizeof(s_tag_level));
+    }
+    else
+    {
+        for (int i = 0; i < LOG_MAX_TAGS; i++)
+        {
+            if (s_tag_level[i].tag == NULL || strcmp(s_tag_level[i].tag, tag) == 0)
+            {
+                s_tag_level[i].tag = tag;
+                s_tag_level[i].level = level;
+                break;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+esp_log_level_t esp_log_level_get(const char *tag)
+{
+    esp_log_level_t level = s_default_level;
+    portENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < LOG_MAX_TAGS && s_tag_level[i].tag; i++)
+    {
+        if (strcmp(s_tag_level[i].tag, tag) == 0)
+        {
+            level = s_tag_level[i].level;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    esp_log_level_t limit = s_default_level;
+    portENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < LOG_MAX_TAGS && s_tag_level[i].tag; i++)
+    {
+        if (strcmp(s_tag_level[i].tag, tag) == 0)
+        {
+            limit = s_tag_level[i].level;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+    if (level > limit)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:
+        return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION:
+        return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_INVALID_MAC:
+        return "ESP_ERR_INVALID_MAC";
+    case ESP_ERR_NOT_FINISHED:
+        return "ESP_ERR_NOT_FINISHED";
+    case ESP_ERR_NOT_ALLOWED:
+        return "ESP_ERR_NOT_ALLOWED";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return (caps & MALLOC_CAP_SPIRAM) ? NULL : malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    return (caps & MALLOC_CAP_SPIRAM) ? NULL : calloc(n, size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
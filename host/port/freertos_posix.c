@@ -0,0 +1,335 @@
+/**
+ * @file freertos_posix.c
+ * @brief The FreeRTOS subset used by the components, on POSIX threads.
+ *
+ * Enough for the host build: tasks are threads (priority and stack size are recorded and
+ * ignored, the host scheduler decides), task notifications are a counter with a condition
+ * variable, semaphores live in their StaticSemaphore_t and critical sections share one
+ * recursive mutex. Ticks follow CONFIG_FREERTOS_HZ on CLOCK_MONOTONIC.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+struct tskTaskControlBlock
+{
+    pthread_t thread;
+    char name[16];
+    UBaseType_t priority;
+    TaskFunction_t fn;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+};
+
+struct QueueDefinition
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned count;
+};
+
+_Static_assert(sizeof(struct QueueDefinition) <= sizeof(StaticSemaphore_t), "StaticSemaphore_t too small");
+
+static __thread struct tskTaskControlBlock *s_current;
+static pthread_mutex_t s_critical;
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+
+static void cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// Absolute CLOCK_MONOTONIC deadline ticks from now
+static struct timespec deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ns = (uint64_t)ticks * (1000000000ULL / configTICK_RATE_HZ);
+    ts.tv_sec += ns / 1000000000ULL;
+    ts.tv_nsec += ns % 1000000000ULL;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+// Wait on cond until pred(ctx) holds; false on timeout. Lock held.
+static bool wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, bool (*pred)(void *), void *ctx)
+{
+    struct timespec ts = deadline(ticks);
+    while (!pred(ctx))
+    {
+        if (ticks == 0)
+        {
+            return false;
+        }
+        if (ticks == portMAX_DELAY)
+        {
+            pthread_cond_wait(cond, lock);
+        }
+        else if (pthread_cond_timedwait(cond, lock, &ts) == ETIMEDOUT)
+        {
+            return pred(ctx);
+        }
+    }
+    return true;
+}
+
+static struct tskTaskControlBlock *tcb_new(const char *name, UBaseType_t priority)
+{
+    struct tskTaskControlBlock *tcb = calloc(1, sizeof(*tcb));
+    if (!tcb)
+    {
+        return NULL;
+    }
+    strncpy(tcb->name, name ? name : "", sizeof(tcb->name) - 1);
+    tcb->priority = priority;
+    pthread_mutex_init(&tcb->lock, NULL);
+    cond_init(&tcb->cond);
+    return tcb;
+}
+
+static void *task_entry(void *arg)
+{
+    s_current = arg;
+    s_current->fn(s_current->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth,
+                                   void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask,
+                                   BaseType_t xCoreID)
+{
+    (void)usStackDepth;
+    (void)xCoreID;
+    struct tskTaskControlBlock *tcb = tcb_new(pcName, uxPriority);
+    if (!tcb)
+    {
+        return pdFAIL;
+    }
+    tcb->fn = pxTaskCode;
+    tcb->arg = pvParameters;
+    if (pxCreatedTask)
+    {
+        *pxCreatedTask = tcb; // before the task runs, like FreeRTOS
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&tcb->thread, &attr, task_entry, tcb);
+    pthread_attr_destroy(&attr);
+    if (rc != 0)
+    {
+        if (pxCreatedTask)
+        {
+            *pxCreatedTask = NULL;
+        }
+        free(tcb);
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask)
+{
+    return xTaskCreatePinnedToCore(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask,
+                                   tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    struct tskTaskControlBlock *self = xTaskGetCurrentTaskHandle();
+    assert(xTaskToDelete == NULL || xTaskToDelete == self);
+    s_current = NULL;
+    pthread_mutex_destroy(&self->lock);
+    pthread_cond_destroy(&self->cond);
+    free(self);
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    if (xTicksToDelay == 0)
+    {
+        sched_yield();
+        return;
+    }
+    struct timespec ts = deadline(xTicksToDelay);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ms = (uint64_t)ts.tv_sec * 1000U + (uint64_t)ts.tv_nsec / 1000000U;
+    return (TickType_t)(ms * configTICK_RATE_HZ / 1000U);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (!s_current)
+    {
+        // a thread the shim did not start (main): give it a control block on first use
+        s_current = tcb_new("main", 1);
+        assert(s_current);
+        s_current->thread = pthread_self();
+    }
+    return s_current;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask)
+{
+    return (xTask ? xTask : xTaskGetCurrentTaskHandle())->priority;
+}
+
+const char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    return (xTaskToQuery ? xTaskToQuery : xTaskGetCurrentTaskHandle())->name;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    pthread_mutex_lock(&xTaskToNotify->lock);
+    xTaskToNotify->notify++;
+    pthread_cond_signal(&xTaskToNotify->cond);
+    pthread_mutex_unlock(&xTaskToNotify->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    xTaskNotifyGive(xTaskToNotify);
+    if (pxHigherPriorityTaskWoken)
+    {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+}
+
+static bool notified(void *ctx)
+{
+    return ((struct tskTaskControlBlock *)ctx)->notify != 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    struct tskTaskControlBlock *self = xTaskGetCurrentTaskHandle();
+    pthread_mutex_lock(&self->lock);
+    wait_until(&self->cond, &self->lock, xTicksToWait, notified, self);
+    uint32_t value = self->notify;
+    if (value)
+    {
+        self->notify = xClearCountOnExit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&self->lock);
+    return value;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    return 0;
+}
+
+static SemaphoreHandle_t sem_init(StaticSemaphore_t *buffer, unsigned count)
+{
+    struct QueueDefinition *sem = (struct QueueDefinition *)buffer;
+    pthread_mutex_init(&sem->lock, NULL);
+    cond_init(&sem->cond);
+    sem->count = count;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *pxSemaphoreBuffer)
+{
+    return sem_init(pxSemaphoreBuffer, 0); // created empty
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *pxMutexBuffer)
+{
+    return sem_init(pxMutexBuffer, 1); // created available
+}
+
+static bool available(void *ctx)
+{
+    return ((struct QueueDefinition *)ctx)->count != 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime)
+{
+    pthread_mutex_lock(&xSemaphore->lock);
+    bool ok = wait_until(&xSemaphore->cond, &xSemaphore->lock, xBlockTime, available, xSemaphore);
+    if (ok)
+    {
+        xSemaphore->count = 0;
+    }
+    pthread_mutex_unlock(&xSemaphore->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    pthread_mutex_lock(&xSemaphore->lock);
+    BaseType_t ret = xSemaphore->count ? pdFALSE : pdTRUE; // binary: a second give fails
+    xSemaphore->count = 1;
+    pthread_cond_signal(&xSemaphore->cond);
+    pthread_mutex_unlock(&xSemaphore->lock);
+    return ret;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t xSemaphore, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken)
+    {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return xSemaphoreGive(xSemaphore);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+{
+    pthread_mutex_destroy(&xSemaphore->lock);
+    pthread_cond_destroy(&xSemaphore->cond);
+}
+
+static void critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(void)
+{
+    pthread_once(&s_critical_once, critical_init);
+    pthread_mutex_lock(&s_critical);
+}
+
+void vPortExitCritical(void)
+{
+    pthread_mutex_unlock(&s_critical);
+}
@@ -0,0 +1,172 @@
+/**
+ * @file gptimer_posix.c
+ * @brief General purpose timer of the host build: the alarm interrupt is a thread.
+ *
+ * The thread sleeps to absolute CLOCK_MONOTONIC alarm times, so the alarms do not drift;
+ * how late each one fires is up to the host scheduler. Counter values are derived from the
+ * time since gptimer_start(), at the configured resolution.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include "driver/gptimer.h"
+
+struct gptimer_t
+{
+    uint32_t resolution_hz;
+    gptimer_alarm_cb_t on_alarm;
+    void *user_ctx;
+    gptimer_alarm_config_t alarm;
+    bool enabled;
+    bool running;
+    atomic_bool stop;
+    pthread_t thread;
+};
+
+static int64_t ns_of(const struct timespec *ts)
+{
+    return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static void *timer_thread(void *arg)
+{
+    gptimer_handle_t timer = arg;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int64_t start_ns = ns_of(&start);
+    uint64_t alarm = timer->alarm.alarm_count;
+    uint64_t period = timer->alarm.alarm_count - timer->alarm.reload_count;
+
+    while (!atomic_load(&timer->stop))
+    {
+        int64_t at_ns = start_ns + (int64_t)(alarm * 1000000000ull / timer->resolution_hz);
+        struct timespec at = {.tv_sec = at_ns / 1000000000, .tv_nsec = at_ns % 1000000000};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL) == EINTR)
+        {
+        }
+        if (atomic_load(&timer->stop))
+        {
+            break;
+        }
+        gptimer_alarm_event_data_t edata = {.count_value = alarm, .alarm_value = alarm};
+        if (timer->on_alarm)
+        {
+            timer->on_alarm(timer, &edata, timer->user_ctx);
+        }
+        if (!timer->alarm.flags.auto_reload_on_alarm || period == 0)
+        {
+            break;
+        }
+        alarm += period;
+    }
+    return NULL;
+}
+
+esp_err_t gptimer_new_timer(const gptimer_config_t *config, gptimer_handle_t *ret_timer)
+{
+    if (!config || !ret_timer || config->resolution_hz == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gptimer_handle_t timer = calloc(1, sizeof(*timer));
+    if (!timer)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->resolution_hz = config->resolution_hz;
+    *ret_timer = timer;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_del_timer(gptimer_handle_t timer)
+{
+    if (!timer)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->enabled)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(timer);
+    return ESP_OK;
+}
+
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer, const gptimer_event_callbacks_t *cbs,
+                                           void *user_data)
+{
+    if (!timer || !cbs)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->enabled)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->on_alarm = cbs->on_alarm;
+    timer->user_ctx = user_data;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t *config)
+{
+    if (!timer || !config || (config->flags.auto_reload_on_alarm && config->reload_count >= config->alarm_count))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    timer->alarm = *config;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_enable(gptimer_handle_t timer)
+{
+    if (!timer || timer->enabled)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_disable(gptimer_handle_t timer)
+{
+    if (!timer || !timer->enabled || timer->running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_start(gptimer_handle_t timer)
+{
+    if (!timer || !timer->enabled || timer->running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    atomic_store(&timer->stop, false);
+    if (pthread_create(&timer->thread, NULL, timer_thread, timer) != 0)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->running = true;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_stop(gptimer_handle_t timer)
+{
+    if (!timer || !timer->running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    atomic_store(&timer->stop, true);
+    pthread_join(timer->thread, NULL);
+    timer->running = false;
+    return ESP_OK;
+}
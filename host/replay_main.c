@@ -0,0 +1,116 @@
+/**
+ * @file replay_main.c
+ * @brief Replay a capture from the board ('i2ccap -w') against the simulated buses.
+ *
+ * The device models sit where the board has its devices: DAC, relay unit and display on
+ * port 0 (synchronous), a second display on port 1 (asynchronous, as with
+ * CONFIG_EXAMPLE_I2C_DISPLAY_BUS). Every captured transaction is re-run with its original
+ * spacing and its result and read data compared with the capture. The models start in
+ * their power-on state, so reads of state the board had before the capture may differ.
+ * Exit status 1 on a mismatch.
+ *
+ * usage: i2c_host_replay [-r] [-v] [-p] [-f] [-s SCL_HZ] CAPTURE
+ *   -r  sleep the bus time (wall-clock timing as on the target)
+ *   -v  log every mismatch
+ *   -p  print the display images afterwards
+ *   -f  back to back, ignore the captured timing
+ *   -s  SCL speed of all devices (default 100000)
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "driver/i2c_master.h"
+#include "i2c_replay.h"
+#include "gp8413_sdc.h"
+#include "m5_4relay.h"
+#include "ssd1306.h"
+#include "i2c_sim.h"
+#include "sim_devices.h"
+#include "host_bench.h"
+
+static sim_gp8413_t s_dac_model;
+static sim_m54r_t s_relay_model;
+static sim_ssd1306_t s_oled_model[2];
+
+int main(int argc, char **argv)
+{
+    i2c_replay_config_t config = I2C_REPLAY_CONFIG_DEFAULT();
+    bool print = false;
+    int opt;
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+    while ((opt = getopt(argc, argv, "rvpfs:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            i2c_sim_set_realtime(true);
+            break;
+        case 'v':
+            esp_log_level_set("i2c_replay", ESP_LOG_DEBUG);
+            break;
+        case 'p':
+            print = true;
+            break;
+        case 'f':
+            config.time_scale = 0;
+            break;
+        case 's':
+            config.scl_speed_hz = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-r] [-v] [-p] [-f] [-s SCL_HZ] CAPTURE\n", argv[0]);
+        return 2;
+    }
+    FILE *in = fopen(argv[optind], "r");
+    if (!in)
+    {
+        perror(argv[optind]);
+        return 2;
+    }
+
+    ESP_ERROR_CHECK(sim_gp8413_attach(&s_dac_model, 0, GP8413_I2C_ADDRESS));
+    ESP_ERROR_CHECK(sim_m54r_attach(&s_relay_model, 0, M54R_ADDR));
+    ESP_ERROR_CHECK(sim_ssd1306_attach(&s_oled_model[0], 0, SSD1306_I2C_ADDRESS));
+    ESP_ERROR_CHECK(sim_ssd1306_attach(&s_oled_model[1], 1, SSD1306_I2C_ADDRESS));
+
+    bench_bus(0, false); // the replay finds the buses by port
+    bench_bus(1, true);
+
+    i2c_replay_stats_t stats;
+    esp_err_t ret = i2c_replay_file(in, &config, &stats);
+    fclose(in);
+    i2c_replay_print(&stats, stdout);
+
+    for (int port = 0; port < I2C_SIM_MAX_PORTS; port++)
+    {
+        i2c_sim_stats_t st;
+        i2c_sim_get_stats(port, &st, false);
+        printf("bus %d: %" PRIu32 " transactions, %" PRIu32 " nacks, %" PRIu64 " bytes, %" PRIu64 " us\n", port,
+               st.transactions, st.nacks, st.bytes, st.bus_ns / 1000);
+    }
+    printf("dac %" PRIu32 " / %" PRIu32 " mV, relay 0x%02x\n", sim_gp8413_mv(&s_dac_model, 0),
+           sim_gp8413_mv(&s_dac_model, 1), sim_m54r_reg(&s_relay_model, M54R_REG_RELAY));
+    if (print)
+    {
+        sim_ssd1306_print(&s_oled_model[0], stdout);
+        sim_ssd1306_print(&s_oled_model[1], stdout);
+    }
+    if (ret == ESP_ERR_NOT_FOUND)
+    {
+        fprintf(stderr, "%s: no transactions\n", argv[optind]);
+    }
+    return ret == ESP_OK ? 0 : 1;
+}
@@ -0,0 +1,454 @@
+/**
+ * @file rpc_bench.c
+ * @brief Latency benchmark and checks of the binary console RPC over a pty loopback.
+ *
+ * The server (components/console_rpc, the code the 'rpc' command runs) serves the slave side
+ * of a pseudo terminal in a thread, with the real drivers on the simulated buses behind it;
+ * the client library talks to the master side. Measured: the round trip of one request at a
+ * time, a window of pipelined requests and batched ops, for PING (transport only) and DAC_SET
+ * (transport and the I2C write). Then the device state of the models is checked after DAC,
+ * relay and display requests, and a corrupted frame, an unknown opcode and the switch back
+ * to the REPL are tried. Exit status 1 when a check failed.
+ *
+ * The pty has no baud rate, the numbers are the protocol and scheduling overhead; on the
+ * board the USB frame interval adds to every round trip, which is what pipelining hides.
+ *
+ * usage: rpc_bench [-r] [-n COUNT] [-w WINDOW]
+ *   -r  sleep the I2C bus time (wall-clock timing as on the target)
+ *   -n  requests per measurement (default 2000)
+ *   -w  requests in flight when pipelining (default 16)
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <pty.h>
+#include <termios.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/i2c_master.h"
+#include "gp8413_sdc.h"
+#include "m5_4relay.h"
+#include "ssd1306.h"
+#include "rpc_server.h"
+#include "rpc_devices.h"
+#include "rpc_client.h"
+#include "i2c_sim.h"
+#include "sim_devices.h"
+#include "host_bench.h"
+
+#define CONTROL_PORT (0)
+#define DISPLAY_PORT (1)
+#define TIMEOUT_MS (2000)
+
+static const char *TAG = "rpc_bench";
+
+static sim_gp8413_t s_dac_model;
+static sim_m54r_t s_relay_model;
+static sim_ssd1306_t s_oled_model;
+static gp8413_handle_t *s_dac;
+static m54_ctx_t s_relay;
+static ssd1306_handle_t s_oled;
+
+static int s_server_fd;
+static esp_err_t s_server_ret;
+static rpc_server_stats_t s_server_stats;
+
+static gp8413_handle_t *get_dac(void)
+{
+    return s_dac;
+}
+
+static m54_ctx_t *get_relay(void)
+{
+    return &s_relay;
+}
+
+static ssd1306_handle_t *get_display(void)
+{
+    return &s_oled;
+}
+
+static int pty_read(void *io, uint8_t *buf, size_t len)
+{
+    ssize_t n;
+    do
+    {
+        n = read(*(int *)io, buf, len);
+    } while (n < 0 && errno == EINTR);
+    return (int)n;
+}
+
+static int pty_write(void *io, const uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len)
+    {
+        ssize_t n = write(*(int *)io, &buf[pos], len - pos);
+        if (n < 0 && errno != EINTR)
+        {
+            return -1;
+        }
+        pos += n > 0 ? (size_t)n : 0;
+    }
+    return (int)len;
+}
+
+static void *server_thread(void *arg)
+{
+    static const rpc_devices_t devices = {
+        .dac = get_dac,
+        .relay = get_relay,
+        .display = get_display,
+    };
+    const rpc_server_config_t config = {
+        .read = pty_read,
+        .write = pty_write,
+        .io = &s_server_fd,
+        .ops = rpc_device_ops,
+        .n_ops = rpc_device_ops_count,
+        .ctx = (void *)&devices,
+    };
+    (void)arg;
+    s_server_ret = rpc_server_run(&config, &s_server_stats);
+    return NULL;
+}
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// One result line: operations per second and the latency spread of the requests
+static void report(const char *name, int64_t *lat_us, int n, int64_t total_us, int ops_per_request)
+{
+    qsort(lat_us, (size_t)n, sizeof(lat_us[0]), cmp_i64);
+    printf("%-22s %8d %10.0f %8" PRId64 " %8" PRId64 " %8" PRId64 " %8" PRId64 "\n", name, n * ops_per_request,
+           total_us ? (double)n * ops_per_request * 1e6 / (double)total_us : 0.0, lat_us[0], lat_us[n / 2],
+           lat_us[(n * 99) / 100], lat_us[n - 1]);
+}
+
+static void dac_body(uint8_t *body, int i)
+{
+    rpc_body_dac_set(body, 0x03, (uint16_t)(i * 7 % 10000), (uint16_t)(10000 - i * 7 % 10000));
+}
+
+// Round trip of one request at a time
+static void bench_sequential(rpc_client_t *client, const char *name, uint8_t op, int n, int64_t *lat,
+                             rpc_response_t *resp)
+{
+    uint8_t body[8];
+    int64_t start = now_us();
+    for (int i = 0; i < n; i++)
+    {
+        size_t len = 0;
+        if (op == RPC_OP_DAC_SET)
+        {
+            dac_body(body, i);
+            len = 5;
+        }
+        int64_t t0 = now_us();
+        int ret = rpc_client_call(client, op, body, len, resp, TIMEOUT_MS);
+        lat[i] = now_us() - t0;
+        if (ret != 0 || resp->status != ESP_OK)
+        {
+            CHECK(ret == 0 && resp->status == ESP_OK);
+            return;
+        }
+    }
+    report(name, lat, n, now_us() - start, 1);
+}
+
+// Up to window requests in flight; a new one goes out for every response
+static void bench_pipelined(rpc_client_t *client, const char *name, uint8_t op, int n, int window, int64_t *lat,
+                            rpc_response_t *resp)
+{
+    int64_t *sent = calloc((size_t)n, sizeof(int64_t));
+    uint16_t first_id = 0;
+    uint8_t body[8];
+    int next = 0;
+    int done = 0;
+    int64_t start = now_us();
+
+    while (done < n)
+    {
+        while (next < n && next - done < window)
+        {
+            size_t len = 0;
+            if (op == RPC_OP_DAC_SET)
+            {
+                dac_body(body, next);
+                len = 5;
+            }
+            sent[next] = now_us();
+            int id = rpc_client_send(client, op, body, len);
+            CHECK(id > 0);
+            if (next == 0)
+            {
+                first_id = (uint16_t)id;
+            }
+            next++;
+        }
+        int ret = rpc_client_recv(client, resp, TIMEOUT_MS);
+        if (ret != 0)
+        {
+            CHECK(ret == 0);
+            free(sent);
+            return;
+        }
+        int index = (uint16_t)(resp->id - first_id);
+        CHECK(index == done && resp->status == ESP_OK); // in request order
+        if (index >= 0 && index < n)
+        {
+            lat[done] = now_us() - sent[index];
+        }
+        done++;
+    }
+    report(name, lat, n, now_us() - start, 1);
+    free(sent);
+}
+
+// Requests of ops_per_batch DAC_SET / RELAY_SET / RELAY_GET ops
+static void bench_batch(rpc_client_t *client, const char *name, int n, int ops_per_batch, int64_t *lat,
+                        rpc_response_t *resp)
+{
+    static rpc_batch_t batch;
+    int batches = n / ops_per_batch;
+    int64_t start = now_us();
+    for (int i = 0; i < batches; i++)
+    {
+        uint8_t body[8];
+        rpc_batch_init(&batch, RPC_BATCH_STOP);
+        for (int k = 0; k < ops_per_batch; k++)
+        {
+            switch (k % 3)
+            {
+            case 0:
+                dac_body(body, i * ops_per_batch + k);
+                rpc_batch_add(&batch, RPC_OP_DAC_SET, body, 5);
+                break;
+            case 1:
+                rpc_batch_add(&batch, RPC_OP_RELAY_SET, body, rpc_body_relay_set(body, 0x0f, (uint8_t)(k & 0x0f)));
+                break;
+            default:
+                rpc_batch_add(&batch, RPC_OP_RELAY_GET, NULL, 0);
+                break;
+            }
+        }
+        int64_t t0 = now_us();
+        int ret = rpc_client_call(client, RPC_OP_BATCH, batch.body, batch.len, resp, TIMEOUT_MS);
+        lat[i] = now_us() - t0;
+        if (ret != 0 || resp->status != ESP_OK)
+        {
+            CHECK(ret == 0 && resp->status == ESP_OK);
+            return;
+        }
+    }
+    report(name, lat, batches, now_us() - start, ops_per_batch);
+}
+
+static bool display_matches(const ssd1306_handle_t *dev, const sim_ssd1306_t *model)
+{
+    for (int p = 0; p < dev->pages; p++)
+    {
+        if (memcmp(model->gddram[p], &dev->buffer[p * SSD1306_MAX_WIDTH], dev->width) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void run_checks(rpc_client_t *client, rpc_response_t *resp)
+{
+    CHECK(rpc_dac_set(client, 0x03, 1234, 8765, TIMEOUT_MS) == ESP_OK);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 1234 && sim_gp8413_mv(&s_dac_model, 1) == 8765);
+    CHECK(rpc_dac_set(client, 0x02, 0, 4321, TIMEOUT_MS) == ESP_OK);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 1234 && sim_gp8413_mv(&s_dac_model, 1) == 4321);
+    CHECK(rpc_dac_set(client, 0x01, 20000, 0, TIMEOUT_MS) == ESP_ERR_INVALID_ARG); // above the 10 V range
+    CHECK(rpc_client_call(client, RPC_OP_DAC_GET, NULL, 0, resp, TIMEOUT_MS) == 0 && resp->len == 4 &&
+          rpc_get_u16(&resp->body[0]) == 1234 && rpc_get_u16(&resp->body[2]) == 4321);
+
+    uint8_t relays = 0xff;
+    CHECK(rpc_relay_set(client, 0x0f, 0x00, &relays, TIMEOUT_MS) == ESP_OK && relays == 0x00);
+    CHECK(rpc_relay_set(client, 0x05, 0x05, &relays, TIMEOUT_MS) == ESP_OK && relays == 0x05);
+    CHECK(rpc_relay_set(client, 0x04, 0x00, &relays, TIMEOUT_MS) == ESP_OK && relays == 0x01);
+    CHECK((sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) & 0x0f) == 0x01);
+    CHECK(rpc_relay_get(client, &relays, TIMEOUT_MS) == ESP_OK && relays == 0x01);
+    CHECK(rpc_relay_set(client, 0x10, 0x10, NULL, TIMEOUT_MS) == ESP_ERR_INVALID_ARG); // LED bit
+
+    CHECK(rpc_display_text(client, RPC_DISPLAY_CLEAR | RPC_DISPLAY_SHOW, 0, 0, 8, "rpc bench", TIMEOUT_MS) ==
+          ESP_OK);
+    CHECK(ssd1306_wait(&s_oled, TIMEOUT_MS) == ESP_OK);
+    CHECK(display_matches(&s_oled, &s_oled_model));
+    CHECK(sim_ssd1306_pixel(&s_oled_model, 1, 1) || sim_ssd1306_pixel(&s_oled_model, 2, 2) ||
+          s_oled_model.data_bytes > 0);
+    uint8_t stripes[128];
+    memset(stripes, 0xaa, sizeof(stripes));
+    CHECK(rpc_display_frame(client, RPC_DISPLAY_SHOW, 7 * SSD1306_MAX_WIDTH, stripes, sizeof(stripes),
+                            TIMEOUT_MS) == ESP_OK);
+    CHECK(ssd1306_wait(&s_oled, TIMEOUT_MS) == ESP_OK);
+    CHECK(s_oled_model.gddram[7][0] == 0xaa && s_oled_model.gddram[7][127] == 0xaa);
+    CHECK(rpc_display_text(client, 0, 0, 0, 7, "x", TIMEOUT_MS) == ESP_ERR_INVALID_ARG); // no 7 px font
+    CHECK(rpc_display_frame(client, 0, 1000, stripes, sizeof(stripes), TIMEOUT_MS) == ESP_ERR_INVALID_ARG);
+
+    // a batch that stops at the failing op, the relay set after it does not run
+    static rpc_batch_t batch;
+    uint8_t body[8];
+    rpc_batch_init(&batch, RPC_BATCH_STOP);
+    rpc_batch_add(&batch, RPC_OP_DAC_SET, body, rpc_body_dac_set(body, 0x01, 500, 0));
+    rpc_batch_add(&batch, RPC_OP_DAC_SET, body, rpc_body_dac_set(body, 0x01, 60000, 0));
+    rpc_batch_add(&batch, RPC_OP_RELAY_SET, body, rpc_body_relay_set(body, 0x0f, 0x0f));
+    CHECK(rpc_client_call(client, RPC_OP_BATCH, batch.body, batch.len, resp, TIMEOUT_MS) == 0);
+    CHECK(resp->status == ESP_FAIL);
+    size_t pos = 0;
+    int ops = 0;
+    uint8_t op;
+    int32_t status;
+    const uint8_t *data;
+    size_t len;
+    while (rpc_batch_next(resp, &pos, &op, &status, &data, &len))
+    {
+        CHECK(op == RPC_OP_DAC_SET && status == (ops == 0 ? ESP_OK : ESP_ERR_INVALID_ARG));
+        ops++;
+    }
+    CHECK(ops == 2);
+    CHECK(sim_gp8413_mv(&s_dac_model, 0) == 500);
+    CHECK((sim_m54r_reg(&s_relay_model, M54R_REG_RELAY) & 0x0f) == 0x01);
+
+    // unknown opcode, then garbage and a frame with a bad CRC: the server answers and stays in sync
+    CHECK(rpc_client_call(client, 0x55, NULL, 0, resp, TIMEOUT_MS) == 0 && resp->status == ESP_ERR_NOT_SUPPORTED);
+    uint8_t bad[RPC_MAX_ENCODED];
+    rpc_msg_t msg = {.id = 999, .op = RPC_OP_PING};
+    size_t n = rpc_frame_encode(&msg, bad, sizeof(bad));
+    bad[n - 2] ^= 0x01;
+    CHECK(write(client->fd, "I (123) log line\n", 17) == 17);
+    CHECK(write(client->fd, bad, n) == (ssize_t)n);
+    CHECK(rpc_ping(client, TIMEOUT_MS) == ESP_OK);
+}
+
+int main(int argc, char **argv)
+{
+    int count = 2000;
+    int window = 16;
+    int opt;
+    esp_log_level_set("*", ESP_LOG_WARN);
+    while ((opt = getopt(argc, argv, "rn:w:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            i2c_sim_set_realtime(true);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'w':
+            window = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r] [-n COUNT] [-w WINDOW]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (count < 100 || window < 1 || window > RPC_CLIENT_MAX_PENDING)
+    {
+        fprintf(stderr, "need -n >= 100 and -w 1..%d\n", RPC_CLIENT_MAX_PENDING);
+        return 2;
+    }
+
+    // the devices: DAC and relay on the synchronous control bus, the display on the async bus
+    CHECK(sim_gp8413_attach(&s_dac_model, CONTROL_PORT, GP8413_I2C_ADDRESS) == ESP_OK);
+    CHECK(sim_m54r_attach(&s_relay_model, CONTROL_PORT, M54R_ADDR) == ESP_OK);
+    CHECK(sim_ssd1306_attach(&s_oled_model, DISPLAY_PORT, SSD1306_I2C_ADDRESS) == ESP_OK);
+    i2c_master_bus_handle_t control_bus = bench_bus(CONTROL_PORT, false);
+    i2c_master_bus_handle_t display_bus = bench_bus(DISPLAY_PORT, true);
+
+    gp8413_config_t dac_config = {
+        .bus_handle = control_bus,
+        .device_addr = GP8413_I2C_ADDRESS,
+        .output_range = GP8413_OUTPUT_RANGE_10V,
+    };
+    s_dac = gp8413_init(&dac_config);
+    CHECK(s_dac != NULL);
+    s_relay.device_address = M54R_ADDR;
+    s_relay.bus_handle = control_bus;
+    s_relay.scl_speed_hz = 100000;
+    CHECK(m54_init(&s_relay) == ESP_OK);
+    s_oled.device_address = SSD1306_I2C_ADDRESS;
+    s_oled.bus_handle = display_bus;
+    s_oled.scl_speed_hz = 400000;
+    ssd1306_init(&s_oled, 128, 64, 0);
+    if (bench_failed || s_dac == NULL)
+    {
+        ESP_LOGE(TAG, "device setup failed");
+        return 1;
+    }
+
+    // both ends raw: no echo, no line discipline, bytes as they are
+    int master_fd, slave_fd;
+    struct termios tio;
+    if (openpty(&master_fd, &slave_fd, NULL, NULL, NULL) != 0)
+    {
+        perror("openpty");
+        return 1;
+    }
+    tcgetattr(slave_fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave_fd, TCSANOW, &tio);
+    tcsetattr(master_fd, TCSANOW, &tio);
+    s_server_fd = slave_fd;
+    pthread_t server;
+    pthread_create(&server, NULL, server_thread, NULL);
+
+    rpc_client_t client;
+    rpc_client_attach(&client, master_fd);
+    CHECK(rpc_client_connect(&client, false, TIMEOUT_MS) == 0);
+
+    rpc_response_t *resp = malloc(sizeof(*resp));
+    int64_t *lat = malloc((size_t)count * sizeof(int64_t));
+    char name[32];
+    printf("%-22s %8s %10s %8s %8s %8s %8s\n", "pty loopback", "ops", "ops/s", "min(us)", "p50(us)", "p99(us)",
+           "max(us)");
+    bench_sequential(&client, "ping", RPC_OP_PING, count, lat, resp);
+    snprintf(name, sizeof(name), "ping window %d", window);
+    bench_pipelined(&client, name, RPC_OP_PING, count, window, lat, resp);
+    bench_sequential(&client, "dac_set", RPC_OP_DAC_SET, count, lat, resp);
+    snprintf(name, sizeof(name), "dac_set window %d", window);
+    bench_pipelined(&client, name, RPC_OP_DAC_SET, count, window, lat, resp);
+    bench_batch(&client, "batch of 12 ops", count, 12, lat, resp);
+
+    run_checks(&client, resp);
+
+    CHECK(rpc_repl(&client, TIMEOUT_MS) == ESP_OK);
+    pthread_join(server, NULL);
+    CHECK(s_server_ret == ESP_OK);
+    CHECK(s_server_stats.dropped >= 2); // the log line and the bad CRC
+    CHECK(s_server_stats.unknown == 1);
+    printf("server: %" PRIu32 " requests, %" PRIu32 " bad frames, %" PRIu32 " bytes in, %" PRIu32
+           " bytes out in %" PRIu32 " writes\n", s_server_stats.requests, s_server_stats.dropped,
+           s_server_stats.bytes_in, s_server_stats.bytes_out, s_server_stats.writes);
+
+    rpc_client_close(&client);
+    close(slave_fd);
+    free(lat);
+    free(resp);
+    return bench_result(TAG);
+}
@@ -0,0 +1,444 @@
+/**
+ * @file rpc_client.c
+ * @brief Linux client of the binary console RPC.
+ *
+ * Plain POSIX: termios for the serial port, poll() for the timeouts. Requests are encoded
+ * and written at once, so a caller that sends a window of requests before reading gets
+ * them into one USB packet and the server answers them with one write.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include "rpc_client.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static speed_t baud_to_speed(int baud)
+{
+    switch (baud)
+    {
+    case 9600:
+        return B9600;
+    case 19200:
+        return B19200;
+    case 38400:
+        return B38400;
+    case 57600:
+        return B57600;
+    case 115200:
+        return B115200;
+    case 230400:
+        return B230400;
+    case 460800:
+        return B460800;
+    case 921600:
+        return B921600;
+    default:
+        return 0;
+    }
+}
+
+int rpc_client_open(rpc_client_t *client, const char *path, int baud)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        if (baud)
+        {
+            speed_t speed = baud_to_speed(baud);
+            if (speed == 0)
+            {
+                close(fd);
+                return -EINVAL;
+            }
+            cfsetispeed(&tio, speed);
+            cfsetospeed(&tio, speed);
+        }
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    rpc_client_attach(client, fd);
+    return 0;
+}
+
+void rpc_client_attach(rpc_client_t *client, int fd)
+{
+    memset(client, 0, sizeof(*client));
+    client->fd = fd;
+    client->next_id = 1;
+    rpc_decoder_init(&client->dec);
+}
+
+void rpc_client_close(rpc_client_t *client)
+{
+    if (client->fd >= 0)
+    {
+        close(client->fd);
+    }
+    free(client->stash);
+    client->stash = NULL;
+    client->n_stash = 0;
+    client->fd = -1;
+}
+
+static int write_all(int fd, const uint8_t *buf, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int rpc_client_send(rpc_client_t *client, uint8_t op, const void *body, size_t len)
+{
+    uint16_t id = client->next_id++;
+    if (client->next_id == 0)
+    {
+        client->next_id = 1; // id 0 is the HELLO of the server
+    }
+    rpc_msg_t msg = {.id = id, .op = op, .body = body, .len = len};
+    size_t n = rpc_frame_encode(&msg, client->tx, sizeof(client->tx));
+    if (n == 0)
+    {
+        return -EMSGSIZE;
+    }
+    int ret = write_all(client->fd, client->tx, n);
+    return ret < 0 ? ret : id;
+}
+
+// Next response frame from the port, no stash
+static int read_frame(rpc_client_t *client, rpc_response_t *resp, int64_t deadline)
+{
+    for (;;)
+    {
+        while (client->rx_pos < client->rx_len)
+        {
+            rpc_msg_t msg;
+            if (rpc_decoder_push(&client->dec, client->rx[client->rx_pos++], &msg) && (msg.op & RPC_OP_RESPONSE))
+            {
+                resp->id = msg.id;
+                resp->op = msg.op & ~RPC_OP_RESPONSE;
+                resp->status = msg.status;
+                resp->len = msg.len;
+                memcpy(resp->body, msg.body, msg.len);
+                client->dropped = client->dec.dropped;
+                return 0;
+            }
+        }
+        client->dropped = client->dec.dropped;
+
+        int64_t left = deadline - now_ms();
+        if (left <= 0)
+        {
+            return -ETIMEDOUT;
+        }
+        struct pollfd pfd = {.fd = client->fd, .events = POLLIN};
+        int ret = poll(&pfd, 1, (int)left);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+        if (ret == 0)
+        {
+            return -ETIMEDOUT;
+        }
+        ssize_t n = read(client->fd, client->rx, sizeof(client->rx));
+        if (n < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return -errno;
+        }
+        if (n == 0)
+        {
+            return -EPIPE;
+        }
+        client->rx_len = (size_t)n;
+        client->rx_pos = 0;
+    }
+}
+
+int rpc_client_recv(rpc_client_t *client, rpc_response_t *resp, int timeout_ms)
+{
+    if (client->n_stash)
+    {
+        *resp = client->stash[0];
+        client->n_stash--;
+        memmove(&client->stash[0], &client->stash[1], client->n_stash * sizeof(client->stash[0]));
+        return 0;
+    }
+    return read_frame(client, resp, now_ms() + timeout_ms);
+}
+
+int rpc_client_wait(rpc_client_t *client, uint16_t id, rpc_response_t *resp, int timeout_ms)
+{
+    for (size_t i = 0; i < client->n_stash; i++)
+    {
+        if (client->stash[i].id == id)
+        {
+            *resp = client->stash[i];
+            client->n_stash--;
+            memmove(&client->stash[i], &client->stash[i + 1], (client->n_stash - i) * sizeof(client->stash[0]));
+            return 0;
+        }
+    }
+
+    int64_t deadline = now_ms() + timeout_ms;
+    for (;;)
+    {
+        int ret = read_frame(client, resp, deadline);
+        if (ret < 0 || resp->id == id)
+        {
+            return ret;
+        }
+        if (resp->id == 0)
+        {
+            continue; // a HELLO, the server restarted
+        }
+        if (client->stash == NULL)
+        {
+            client->stash = malloc(RPC_CLIENT_MAX_PENDING * sizeof(client->stash[0]));
+            if (client->stash == NULL)
+            {
+                return -ENOMEM;
+            }
+        }
+        if (client->n_stash < RPC_CLIENT_MAX_PENDING)
+        {
+            client->stash[client->n_stash++] = *resp;
+        }
+    }
+}
+
+int rpc_client_call(rpc_client_t *client, uint8_t op, const void *body, size_t len, rpc_response_t *resp,
+                    int timeout_ms)
+{
+    int id = rpc_client_send(client, op, body, len);
+    if (id < 0)
+    {
+        return id;
+    }
+    return rpc_client_wait(client, (uint16_t)id, resp, timeout_ms);
+}
+
+int rpc_client_connect(rpc_client_t *client, bool send_command, int timeout_ms)
+{
+    if (send_command)
+    {
+        static const char command[] = "\rrpc\r";
+        int ret = write_all(client->fd, (const uint8_t *)command, sizeof(command) - 1);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+
+    rpc_response_t *resp = malloc(sizeof(*resp));
+    if (resp == NULL)
+    {
+        return -ENOMEM;
+    }
+    int64_t deadline = now_ms() + timeout_ms;
+    int ret;
+    do
+    {
+        ret = read_frame(client, resp, deadline);
+    } while (ret == 0 && !(resp->id == 0 && resp->op == RPC_OP_HELLO));
+    if (ret == 0 && (resp->len < 3 || resp->body[0] != RPC_VERSION))
+    {
+        ret = -EPROTO;
+    }
+    free(resp);
+    return ret;
+}
+
+size_t rpc_body_dac_set(uint8_t *body, uint8_t channel_mask, uint16_t mv0, uint16_t mv1)
+{
+    body[0] = channel_mask;
+    rpc_put_u16(&body[1], mv0);
+    rpc_put_u16(&body[3], mv1);
+    return 5;
+}
+
+size_t rpc_body_relay_set(uint8_t *body, uint8_t mask, uint8_t state)
+{
+    body[0] = mask;
+    body[1] = state;
+    return 2;
+}
+
+size_t rpc_body_display_text(uint8_t *body, uint8_t flags, uint8_t x, uint8_t y, uint8_t font, const char *text)
+{
+    size_t n = strlen(text);
+    if (n > RPC_MAX_BODY - 4)
+    {
+        n = RPC_MAX_BODY - 4;
+    }
+    body[0] = flags;
+    body[1] = x;
+    body[2] = y;
+    body[3] = font;
+    memcpy(&body[4], text, n);
+    return 4 + n;
+}
+
+// Call with a response on the heap, status of the device or -errno
+static int call(rpc_client_t *client, uint8_t op, const void *body, size_t len, uint8_t *out, size_t out_len,
+                int timeout_ms)
+{
+    rpc_response_t *resp = malloc(sizeof(*resp));
+    if (resp == NULL)
+    {
+        return -ENOMEM;
+    }
+    int ret = rpc_client_call(client, op, body, len, resp, timeout_ms);
+    if (ret == 0)
+    {
+        ret = resp->status;
+        if (ret == 0 && out)
+        {
+            if (resp->len < out_len)
+            {
+                ret = -EPROTO;
+            }
+            else
+            {
+                memcpy(out, resp->body, out_len);
+            }
+        }
+    }
+    free(resp);
+    return ret;
+}
+
+int rpc_ping(rpc_client_t *client, int timeout_ms)
+{
+    return call(client, RPC_OP_PING, NULL, 0, NULL, 0, timeout_ms);
+}
+
+int rpc_dac_set(rpc_client_t *client, uint8_t channel_mask, uint16_t mv0, uint16_t mv1, int timeout_ms)
+{
+    uint8_t body[5];
+    size_t len = rpc_body_dac_set(body, channel_mask, mv0, mv1);
+    return call(client, RPC_OP_DAC_SET, body, len, NULL, 0, timeout_ms);
+}
+
+int rpc_relay_set(rpc_client_t *client, uint8_t mask, uint8_t state, uint8_t *relays, int timeout_ms)
+{
+    uint8_t body[2];
+    size_t len = rpc_body_relay_set(body, mask, state);
+    return call(client, RPC_OP_RELAY_SET, body, len, relays, relays ? 1 : 0, timeout_ms);
+}
+
+int rpc_relay_get(rpc_client_t *client, uint8_t *relays, int timeout_ms)
+{
+    return call(client, RPC_OP_RELAY_GET, NULL, 0, relays, 1, timeout_ms);
+}
+
+int rpc_display_text(rpc_client_t *client, uint8_t flags, uint8_t x, uint8_t y, uint8_t font, const char *text,
+                     int timeout_ms)
+{
+    uint8_t body[RPC_MAX_BODY];
+    size_t len = rpc_body_display_text(body, flags, x, y, font, text);
+    return call(client, RPC_OP_DISPLAY_TEXT, body, len, NULL, 0, timeout_ms);
+}
+
+int rpc_display_frame(rpc_client_t *client, uint8_t flags, uint16_t offset, const uint8_t *data, size_t len,
+                      int timeout_ms)
+{
+    uint8_t body[RPC_MAX_BODY];
+    if (len > RPC_MAX_BODY - 3)
+    {
+        return -EMSGSIZE;
+    }
+    body[0] = flags;
+    rpc_put_u16(&body[1], offset);
+    memcpy(&body[3], data, len);
+    return call(client, RPC_OP_DISPLAY_FRAME, body, 3 + len, NULL, 0, timeout_ms);
+}
+
+int rpc_repl(rpc_client_t *client, int timeout_ms)
+{
+    return call(client, RPC_OP_REPL, NULL, 0, NULL, 0, timeout_ms);
+}
+
+void rpc_batch_init(rpc_batch_t *batch, uint8_t flags)
+{
+    batch->body[0] = flags;
+    batch->len = 1;
+}
+
+int rpc_batch_add(rpc_batch_t *batch, uint8_t op, const void *body, size_t len)
+{
+    if (len > sizeof(batch->body) - batch->len || sizeof(batch->body) - batch->len - len < 3)
+    {
+        return -ENOSPC;
+    }
+    batch->body[batch->len] = op;
+    rpc_put_u16(&batch->body[batch->len + 1], (uint16_t)len);
+    if (len)
+    {
+        memcpy(&batch->body[batch->len + 3], body, len);
+    }
+    batch->len += 3 + len;
+    return 0;
+}
+
+bool rpc_batch_next(const rpc_response_t *resp, size_t *pos, uint8_t *op, int32_t *status, const uint8_t **data,
+                    size_t *len)
+{
+    size_t p = *pos;
+    if (resp->len < 7 || p > resp->len - 7)
+    {
+        return false;
+    }
+    size_t n = rpc_get_u16(&resp->body[p + 5]);
+    if (n > resp->len - p - 7)
+    {
+        return false;
+    }
+    *op = resp->body[p];
+    *status = rpc_get_i32(&resp->body[p + 1]);
+    *data = &resp->body[p + 7];
+    *len = n;
+    *pos = p + 7 + n;
+    return true;
+}
@@ -0,0 +1,134 @@
+// rpc_client.h
+// Linux client of the binary console RPC ('rpc' command): serial port setup, pipelined requests
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "rpc_frame.h"
+
+#define RPC_CLIENT_MAX_PENDING (64) // Requests in flight
+
+    typedef struct
+    {
+        uint16_t id;
+        uint8_t op; // Opcode of the request (without RPC_OP_RESPONSE)
+        int32_t status; // esp_err_t of the device, 0 = ESP_OK
+        size_t len;
+        uint8_t body[RPC_MAX_BODY];
+    } rpc_response_t;
+
+    typedef struct
+    {
+        int fd;
+        uint16_t next_id;
+        rpc_decoder_t dec;
+        uint8_t rx[1024];
+        size_t rx_len, rx_pos;
+        uint8_t tx[RPC_MAX_ENCODED];
+        // responses that came in while waiting for another id
+        rpc_response_t *stash;
+        size_t n_stash;
+        uint32_t dropped; // Frames that failed COBS or CRC, and text between frames
+    } rpc_client_t;
+
+    // Batch request under construction, see rpc_batch_add()
+    typedef struct
+    {
+        uint8_t body[RPC_MAX_BODY];
+        size_t len;
+    } rpc_batch_t;
+
+    /**
+     * @brief Open a serial device (/dev/ttyACM0, /dev/ttyUSB0, a pty) in raw mode.
+     *
+     * @param baud 0 keeps the speed (USB CDC and ptys ignore it anyway).
+     * @return 0 on success, -errno on failure.
+     */
+    int rpc_client_open(rpc_client_t *client, const char *path, int baud);
+
+    // Use an already open, raw file descriptor
+    void rpc_client_attach(rpc_client_t *client, int fd);
+    void rpc_client_close(rpc_client_t *client);
+
+    /**
+     * @brief Wait for the HELLO the server sends when it starts.
+     *
+     * With send_command the 'rpc' console command is typed first, for a board at the
+     * i2c-tools> prompt. Console text before the HELLO is skipped.
+     *
+     * @return 0 with the protocol version checked, -ETIMEDOUT or -EPROTO.
+     */
+    int rpc_client_connect(rpc_client_t *client, bool send_command, int timeout_ms);
+
+    /**
+     * @brief Send one request without waiting: pipelining is several sends, then as many
+     *        rpc_client_recv() calls; responses come back in request order.
+     *
+     * @return Request id (>= 0), or -errno.
+     */
+    int rpc_client_send(rpc_client_t *client, uint8_t op, const void *body, size_t len);
+
+    /**
+     * @brief Next response, in arrival order. Stashed responses (see rpc_client_wait) first.
+     *
+     * @return 0, -ETIMEDOUT or -errno of the read.
+     */
+    int rpc_client_recv(rpc_client_t *client, rpc_response_t *resp, int timeout_ms);
+
+    // Response to request id; others that arrive first are kept for rpc_client_recv()
+    int rpc_client_wait(rpc_client_t *client, uint16_t id, rpc_response_t *resp, int timeout_ms);
+
+    /**
+     * @brief Send and wait: the round trip of one request.
+     *
+     * @return 0 when the response arrived (the device result is resp->status), -errno otherwise.
+     */
+    int rpc_client_call(rpc_client_t *client, uint8_t op, const void *body, size_t len, rpc_response_t *resp,
+                        int timeout_ms);
+
+    // Request bodies of the device opcodes; return the body length
+    size_t rpc_body_dac_set(uint8_t *body, uint8_t channel_mask, uint16_t mv0, uint16_t mv1);
+    size_t rpc_body_relay_set(uint8_t *body, uint8_t mask, uint8_t state);
+    size_t rpc_body_display_text(uint8_t *body, uint8_t flags, uint8_t x, uint8_t y, uint8_t font, const char *text);
+
+    // Blocking helpers; return the device status (0 = ESP_OK) or -errno of the transport
+    int rpc_ping(rpc_client_t *client, int timeout_ms);
+    int rpc_dac_set(rpc_client_t *client, uint8_t channel_mask, uint16_t mv0, uint16_t mv1, int timeout_ms);
+    int rpc_relay_set(rpc_client_t *client, uint8_t mask, uint8_t state, uint8_t *relays, int timeout_ms);
+    int rpc_relay_get(rpc_client_t *client, uint8_t *relays, int timeout_ms);
+    int rpc_display_text(rpc_client_t *client, uint8_t flags, uint8_t x, uint8_t y, uint8_t font, const char *text,
+                         int timeout_ms);
+    int rpc_display_frame(rpc_client_t *client, uint8_t flags, uint16_t offset, const uint8_t *data, size_t len,
+                          int timeout_ms);
+
+    // Back to the text console ('rpc' returns to the prompt)
+    int rpc_repl(rpc_client_t *client, int timeout_ms);
+
+    /**
+     * @brief Batch: several opcodes in one request, run in order on the device.
+     *
+     * @param flags RPC_BATCH_STOP to skip the rest after a failing op.
+     */
+    void rpc_batch_init(rpc_batch_t *batch, uint8_t flags);
+    int rpc_batch_add(rpc_batch_t *batch, uint8_t op, const void *body, size_t len); // -ENOSPC when full
+
+    /**
+     * @brief Walk the per-op results of a BATCH response.
+     *
+     * @param pos In/out cursor, start at 0.
+     * @return true with op, status and the reply of the next op; false at the end.
+     */
+    bool rpc_batch_next(const rpc_response_t *resp, size_t *pos, uint8_t *op, int32_t *status, const uint8_t **data,
+                        size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
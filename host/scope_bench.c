@@ -0,0 +1,215 @@
+/**
+ * @file scope_bench.c
+ * @brief Sample rate and display bus occupancy of the OLED scope next to the 1 kHz loop.
+ *
+ * The GP8413 and the SSD1306 models share one bus at 400 kHz, the bus time is slept (as on
+ * the target). The control executive ramps DAC channel 0 every millisecond and holds
+ * channel 1, while the scope samples what the DAC model outputs at 50, 100 and 200 Hz.
+ * Per rate it prints the columns per second, lost samples, the write time of a column and
+ * the share of the bus the display took; for comparison, the time of one full frame. The
+ * share is the wire time the simulated bus counted for the display (the bus time minus the
+ * DAC writes) over the nominal time of the columns, so it does not depend on the host.
+ *
+ * Checked: the display share per column, the loop commits every frame, the panel image
+ * equals the frame buffer, and the trace of channel 1 is at its row with the gap after it.
+ * The sample and loop rates are wall-clock figures of a busy host: only checked loosely.
+ * Exit status 1 when a check failed.
+ *
+ * usage: scope_bench [-t MS] [-p]
+ *   -t  time per rate (default 500)
+ *   -p  print the display image at the end
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/i2c_master.h"
+#include "i2c_bus.h"
+#include "gp8413_sdc.h"
+#include "ssd1306.h"
+#include "actuator.h"
+#include "control_exec.h"
+#include "oled_scope.h"
+#include "i2c_sim.h"
+#include "sim_devices.h"
+#include "host_bench.h"
+
+#define CONTROL_PORT (0)
+#define SPEED_HZ (400000)
+#define CH1_MV (2500) // Held: row 24 of the lower pane
+#define CH1_ROW (32 + 24)
+
+static const char *TAG = "scope_bench";
+
+static sim_gp8413_t s_dac_model;
+static sim_ssd1306_t s_oled_model;
+static gp8413_handle_t *s_dac;
+static ssd1306_handle_t s_display;
+static actuator_t s_act;
+
+// What the DAC outputs, as the board takes it from the actuator history
+static esp_err_t model_sample(void *ctx, uint16_t code[2])
+{
+    const sim_gp8413_t *dac = ctx;
+    code[0] = sim_gp8413_code(dac, 0);
+    code[1] = sim_gp8413_code(dac, 1);
+    return ESP_OK;
+}
+
+static void ramp(void *arg, const control_tick_t *tick, actuator_frame_t *frame)
+{
+    uint32_t *calls = arg;
+    (*calls)++;
+    frame->dac_mv[0] = (uint16_t)(tick->seq % 1000 * 10);
+    frame->dac_mv[1] = CH1_MV;
+}
+
+static void run_rate(uint32_t rate_hz, int ms)
+{
+    oled_scope_config_t config = OLED_SCOPE_CONFIG_DEFAULT();
+    oled_scope_stats_t st;
+    config.display = &s_display;
+    config.sample = model_sample;
+    config.sample_ctx = &s_dac_model;
+    config.rate_hz = rate_hz;
+    i2c_sim_stats_t bus;
+    i2c_sim_get_stats(CONTROL_PORT, &bus, true);
+    uint32_t dac_writes = s_dac_model.writes;
+    CHECK(oled_scope_start(&config) == ESP_OK);
+    vTaskDelay(pdMS_TO_TICKS(ms));
+    CHECK(oled_scope_stop() == ESP_OK);
+    oled_scope_get_stats(&st);
+    i2c_sim_get_stats(CONTROL_PORT, &bus, false);
+    dac_writes = s_dac_model.writes - dac_writes;
+
+    // every frame of the loop writes both DAC channels: the register and four bytes
+    uint64_t dac_ns = dac_writes * i2c_sim_transaction_ns(SPEED_HZ, 5, 0);
+    uint64_t display_ns = bus.bus_ns > dac_ns ? bus.bus_ns - dac_ns : 0;
+    uint32_t per_s = (uint32_t)((uint64_t)st.samples * 1000000 / st.elapsed_us);
+    uint32_t permille = st.samples ? (uint32_t)(display_ns / st.samples * rate_hz / 1000000) : 0;
+    printf("%5" PRIu32 " %8" PRIu32 " %6" PRIu32 " %7" PRIu32 " %10" PRIu32 " %10" PRIu32 " %10" PRIu32
+           " %7" PRIu32 ".%" PRIu32 "\n",
+           rate_hz, st.samples, per_s, st.missed, st.samples ? st.bytes / st.samples : 0,
+           st.samples ? (uint32_t)(st.write_total_us / st.samples) : 0, st.write_max_us, permille / 10,
+           permille % 10);
+    CHECK(per_s >= rate_hz / 2 && per_s <= rate_hz * 2);
+    CHECK(st.write_errors == 0 && st.sample_errors == 0);
+    CHECK(permille > 0 && permille < rate_hz); // about 0.7 ms per column: 0.07 % per Hz
+}
+
+// The panel shows the buffer; channel 1 sits at its row in the last column, the gap is blank
+static void check_image(void)
+{
+    CHECK(memcmp(s_oled_model.gddram, s_display.buffer, sizeof(s_display.buffer)) == 0);
+    int last = SSD1306_MAX_WIDTH - 1; // no gap after the right edge
+    for (int x = 0; x < SSD1306_MAX_WIDTH; x++)
+    {
+        bool blank = true;
+        for (int p = 0; p < SSD1306_MAX_PAGES; p++)
+        {
+            blank = blank && s_oled_model.gddram[p][x] == 0;
+        }
+        if (blank)
+        {
+            last = x - 1; // the gap follows the newest column
+            break;
+        }
+    }
+    CHECK(last >= 0);
+    if (last >= 0)
+    {
+        CHECK(sim_ssd1306_pixel(&s_oled_model, last, CH1_ROW) && !sim_ssd1306_pixel(&s_oled_model, last, CH1_ROW - 1));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int ms = 500;
+    bool print = false;
+    int opt;
+    esp_log_level_set("*", ESP_LOG_WARN);
+    while ((opt = getopt(argc, argv, "t:p")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            ms = atoi(optarg);
+            break;
+        case 'p':
+            print = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t MS] [-p]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (ms < 200)
+    {
+        fprintf(stderr, "need -t >= 200\n");
+        return 2;
+    }
+
+    CHECK(sim_gp8413_attach(&s_dac_model, CONTROL_PORT, GP8413_I2C_ADDRESS) == ESP_OK);
+    CHECK(sim_ssd1306_attach(&s_oled_model, CONTROL_PORT, SSD1306_I2C_ADDRESS) == ESP_OK);
+    i2c_sim_set_realtime(true);
+    i2c_master_bus_handle_t bus = bench_bus(CONTROL_PORT, false);
+    ESP_ERROR_CHECK(i2c_bus_set_device_speed(bus, GP8413_I2C_ADDRESS, SPEED_HZ)); // as 'i2ctune' leaves it
+    gp8413_config_t dac_config = {
+        .bus_handle = bus,
+        .device_addr = GP8413_I2C_ADDRESS,
+        .output_range = GP8413_OUTPUT_RANGE_10V,
+    };
+    s_dac = gp8413_init(&dac_config);
+    s_display.bus_handle = bus;
+    s_display.device_address = SSD1306_I2C_ADDRESS;
+    s_display.scl_speed_hz = SPEED_HZ;
+    ssd1306_init(&s_display, 128, 64, 0);
+    if (s_dac == NULL || s_display.dev_handle == NULL || actuator_init(&s_act, s_dac, NULL) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "device setup failed");
+        return 1;
+    }
+
+    int64_t start = esp_timer_get_time();
+    ssd1306_show(&s_display);
+    uint32_t frame_us = (uint32_t)(esp_timer_get_time() - start);
+    printf("full frame: %" PRIu32 " us, at most %" PRIu32 " frames/s with the bus to itself\n", frame_us,
+           frame_us ? 1000000 / frame_us : 0);
+
+    control_exec_config_t cfg = CONTROL_EXEC_CONFIG_DEFAULT();
+    control_exec_stats_t loop;
+    uint32_t calls = 0;
+    cfg.act = &s_act;
+    CHECK(control_exec_add(ramp, &calls) == ESP_OK);
+    CHECK(control_exec_start(&cfg) == ESP_OK);
+    printf("%5s %8s %6s %7s %10s %10s %10s %9s\n", "Hz", "columns", "per s", "missed", "bytes/col", "avg(us)",
+           "max(us)", "display%");
+    run_rate(50, ms);
+    run_rate(100, ms);
+    run_rate(200, ms);
+    CHECK(control_exec_stop() == ESP_OK);
+    CHECK(control_exec_remove(ramp, &calls) == ESP_OK);
+    control_exec_get_stats(&loop, false);
+    printf("1 kHz loop alongside: %" PRIu32 " loops, %" PRIu32 " commit errors, %" PRIu32 " deadline misses, "
+           "commit max %" PRIu32 " us\n", loop.loops, loop.commit_errors, loop.deadline_misses, loop.commit_max_us);
+    CHECK(loop.commit_errors == 0 && calls == loop.loops && loop.loops >= (uint32_t)ms * 3 / 2);
+
+    check_image();
+    oled_scope_print(stdout);
+    if (print)
+    {
+        sim_ssd1306_print(&s_oled_model, stdout);
+    }
+    gp8413_deinit(&s_dac);
+
+    return bench_result(TAG);
+}
@@ -0,0 +1,717 @@
+/**
+ * @file i2c_sim.c
+ * @brief The ESP-IDF I2C master API on simulated buses, for the host build.
+ *
+ * Every port is a wire with device models attached (i2c_sim_attach). A transaction holds
+ * the wire, is passed to the model at its address (no model = NACK) and adds its wire time
+ * at the SCL speed of the device to the port statistics, so bus time can be measured
+ * without hardware. Buses with trans_queue_depth run their transfers on a worker thread
+ * and report the completion through on_trans_done, like the interrupt of the real driver;
+ * the write buffers are not copied, as on the target.
+ *
+ * The GPIO stand-ins see the SDA and SCL pins of the buses: a port with a stuck slave
+ * (i2c_sim_stick_sda) reads SDA low until SCL was clocked often enough, so the bus
+ * recovery runs its real bit-bang sequence against it. All other pins read high.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "driver/i2c_master.h"
+#include "driver/gpio.h"
+#include "i2c_sim.h"
+
+typedef struct
+{
+    i2c_master_dev_handle_t dev;
+    const uint8_t *write_buf;
+    size_t write_len;
+    uint8_t *read_buf;
+    size_t read_len;
+} sim_op_t;
+
+struct i2c_master_bus_t
+{
+    int port;
+    int n_devices;
+    // asynchronous mode: transfer queue served by the worker
+    size_t queue_depth;
+    sim_op_t *queue;
+    size_t head;
+    size_t count;
+    bool stop;
+    bool started; // worker thread exists
+    pthread_t worker;
+    pthread_mutex_t qlock;
+    pthread_cond_t qcond;
+};
+
+struct i2c_master_dev_t
+{
+    struct i2c_master_bus_t *bus;
+    uint16_t device_address;
+    uint32_t scl_speed_hz;
+    i2c_master_callback_t on_trans_done;
+    void *user_data;
+};
+
+typedef struct
+{
+    const i2c_sim_model_t *model; // NULL = free slot
+    void *ctx;
+    uint16_t device_address;
+    int nack_next;
+} sim_slot_t;
+
+static struct
+{
+    pthread_mutex_t wire; // one transaction at a time, held for its whole (simulated) duration
+    struct i2c_master_bus_t *bus;
+    sim_slot_t slots[I2C_SIM_MAX_MODELS];
+    i2c_sim_stats_t stats;
+    // the lines, for the GPIO stand-ins
+    int sda_io;      // Pins of the last bus created on the port, -1 = none yet
+    int scl_io;
+    int sda_stuck;   // SCL pulses until the slave releases SDA, < 0: never, 0: SDA is free
+    bool scl_low;    // Driven low by gpio_set_level(), a rising edge is one clock
+    int fail_create; // i2c_new_master_bus() calls that fail
+    int stretch_ms;  // Extra wire time of the next transaction
+} s_ports[I2C_SIM_MAX_PORTS];
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER; // bus table and slots
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static bool s_realtime;
+
+static void ports_init(void)
+{
+    for (int p = 0; p < I2C_SIM_MAX_PORTS; p++)
+    {
+        pthread_mutex_init(&s_ports[p].wire, NULL);
+        s_ports[p].sda_io = -1;
+        s_ports[p].scl_io = -1;
+    }
+}
+
+static bool port_ok(int port)
+{
+    pthread_once(&s_once, ports_init);
+    return port >= 0 && port < I2C_SIM_MAX_PORTS;
+}
+
+uint64_t i2c_sim_transaction_ns(uint32_t scl_speed_hz, size_t write_len, size_t read_len)
+{
+    if (scl_speed_hz == 0)
+    {
+        return 0;
+    }
+    uint64_t bits = 1 + 9; // start, address + ACK
+    bits += 9 * (uint64_t)write_len;
+    if (read_len)
+    {
+        if (write_len)
+        {
+            bits += 1 + 9; // repeated start, address
+        }
+        bits += 9 * (uint64_t)read_len;
+    }
+    bits += 1; // stop
+    return bits * 1000000000ULL / scl_speed_hz;
+}
+
+static sim_slot_t *find_slot(int port, uint16_t device_address)
+{
+    for (int i = 0; i < I2C_SIM_MAX_MODELS; i++)
+    {
+        sim_slot_t *s = &s_ports[port].slots[i];
+        if (s->model && s->device_address == device_address)
+        {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// One transaction on the wire of a port: ESP_OK, ESP_ERR_INVALID_STATE when it was not
+// acknowledged, ESP_ERR_TIMEOUT while SDA is held low
+static esp_err_t wire_transfer(int port, uint16_t device_address, uint32_t scl_speed_hz, const uint8_t *write_buf,
+                               size_t write_len, uint8_t *read_buf, size_t read_len)
+{
+    pthread_mutex_lock(&s_ports[port].wire);
+
+    pthread_mutex_lock(&s_lock);
+    bool stuck = s_ports[port].sda_stuck != 0;
+    int stretch_ms = s_ports[port].stretch_ms;
+    s_ports[port].stretch_ms = 0;
+    pthread_mutex_unlock(&s_lock);
+    if (stretch_ms)
+    {
+        struct timespec ts = {.tv_sec = stretch_ms / 1000, .tv_nsec = (long)(stretch_ms % 1000) * 1000000L};
+        while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        {
+        }
+    }
+    if (stuck)
+    {
+        // no START condition possible: the controller gives up after its timeout
+        s_ports[port].stats.transactions++;
+        s_ports[port].stats.timeouts++;
+        pthread_mutex_unlock(&s_ports[port].wire);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    pthread_mutex_lock(&s_lock);
+    sim_slot_t *slot = find_slot(port, device_address);
+    bool ack = slot != NULL;
+    if (slot && slot->nack_next > 0)
+    {
+        slot->nack_next--;
+        ack = false;
+    }
+    const i2c_sim_model_t *model = slot ? slot->model : NULL;
+    void *ctx = slot ? slot->ctx : NULL;
+    pthread_mutex_unlock(&s_lock);
+
+    uint64_t ns;
+    if (!ack)
+    {
+        ns = i2c_sim_transaction_ns(scl_speed_hz, 0, 0); // the address is not acknowledged, stop
+    }
+    else
+    {
+        if (write_len && model->write)
+        {
+            ack = model->write(ctx, write_buf, write_len);
+        }
+        if (ack && read_len)
+        {
+            if (model->read)
+            {
+                model->read(ctx, read_buf, read_len);
+            }
+            else
+            {
+                memset(read_buf, 0xff, read_len);
+            }
+        }
+        ns = i2c_sim_transaction_ns(scl_speed_hz, write_len, ack ? read_len : 0);
+    }
+
+    i2c_sim_stats_t *st = &s_ports[port].stats;
+    st->transactions++;
+    st->bus_ns += ns;
+    if (ack)
+    {
+        st->bytes += write_len + read_len;
+    }
+    else
+    {
+        st->nacks++;
+    }
+
+    if (s_realtime && ns)
+    {
+        struct timespec ts = {.tv_sec = (time_t)(ns / 1000000000ULL), .tv_nsec = (long)(ns % 1000000000ULL)};
+        while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        {
+        }
+    }
+    pthread_mutex_unlock(&s_ports[port].wire);
+    return ack ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+static void *bus_worker(void *arg)
+{
+    struct i2c_master_bus_t *bus = arg;
+    pthread_mutex_lock(&bus->qlock);
+    for (;;)
+    {
+        while (bus->count == 0 && !bus->stop)
+        {
+            pthread_cond_wait(&bus->qcond, &bus->qlock);
+        }
+        if (bus->count == 0)
+        {
+            break;
+        }
+        sim_op_t op = bus->queue[bus->head];
+        pthread_mutex_unlock(&bus->qlock);
+
+        struct i2c_master_dev_t *dev = op.dev;
+        esp_err_t ret = wire_transfer(bus->port, dev->device_address, dev->scl_speed_hz, op.write_buf, op.write_len,
+                                      op.read_buf, op.read_len);
+        if (dev->on_trans_done)
+        {
+            i2c_master_event_data_t evt = {
+                .event = ret == ESP_OK ? I2C_EVENT_DONE : ret == ESP_ERR_TIMEOUT ? I2C_EVENT_TIMEOUT : I2C_EVENT_NACK,
+            };
+            dev->on_trans_done(dev, &evt, dev->user_data);
+        }
+
+        pthread_mutex_lock(&bus->qlock);
+        bus->head = (bus->head + 1) % bus->queue_depth;
+        bus->count--;
+        pthread_cond_broadcast(&bus->qcond); // room in the queue, or idle
+    }
+    pthread_mutex_unlock(&bus->qlock);
+    return NULL;
+}
+
+// Wait with the queue lock held; false when the deadline passed
+static bool queue_wait(struct i2c_master_bus_t *bus, const struct timespec *until)
+{
+    if (until == NULL)
+    {
+        pthread_cond_wait(&bus->qcond, &bus->qlock);
+        return true;
+    }
+    return pthread_cond_timedwait(&bus->qcond, &bus->qlock, until) != ETIMEDOUT;
+}
+
+static struct timespec *timeout_to_deadline(int timeout_ms, struct timespec *ts)
+{
+    if (timeout_ms < 0)
+    {
+        return NULL; // -1 = wait forever, as in the IDF driver
+    }
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+static esp_err_t do_transfer(i2c_master_dev_handle_t dev, const uint8_t *write_buf, size_t write_len,
+                             uint8_t *read_buf, size_t read_len, int timeout_ms)
+{
+    if (!dev || (write_len && !write_buf) || (read_len && !read_buf))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct i2c_master_bus_t *bus = dev->bus;
+    if (bus->queue_depth == 0)
+    {
+        return wire_transfer(bus->port, dev->device_address, dev->scl_speed_hz, write_buf, write_len, read_buf,
+                             read_len);
+    }
+
+    // asynchronous: queue and return, the result comes through on_trans_done
+    struct timespec ts;
+    struct timespec *until = timeout_to_deadline(timeout_ms, &ts);
+    pthread_mutex_lock(&bus->qlock);
+    while (bus->count == bus->queue_depth)
+    {
+        if (!queue_wait(bus, until))
+        {
+            pthread_mutex_unlock(&bus->qlock);
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    bus->queue[(bus->head + bus->count) % bus->queue_depth] = (sim_op_t){
+        .dev = dev,
+        .write_buf = write_buf,
+        .write_len = write_len,
+        .read_buf = read_buf,
+        .read_len = read_len,
+    };
+    bus->count++;
+    pthread_cond_broadcast(&bus->qcond);
+    pthread_mutex_unlock(&bus->qlock);
+    return ESP_OK;
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle)
+{
+    if (!bus_config || !ret_bus_handle || bus_config->i2c_port >= I2C_SIM_MAX_PORTS || bus_config->i2c_port < -1)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_once(&s_once, ports_init);
+
+    struct i2c_master_bus_t *bus = calloc(1, sizeof(*bus));
+    if (!bus)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_init(&bus->qlock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&bus->qcond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&s_lock);
+    int port = bus_config->i2c_port;
+    if (port < 0)
+    {
+        for (port = 0; port < I2C_SIM_MAX_PORTS && s_ports[port].bus; port++)
+        {
+        }
+    }
+    if (port >= I2C_SIM_MAX_PORTS || s_ports[port].bus)
+    {
+        pthread_mutex_unlock(&s_lock);
+        free(bus);
+        return ESP_ERR_NOT_FOUND; // no free controller
+    }
+    if (s_ports[port].fail_create > 0)
+    {
+        s_ports[port].fail_create--;
+        pthread_mutex_unlock(&s_lock);
+        free(bus);
+        return ESP_FAIL;
+    }
+    bus->port = port;
+    s_ports[port].bus = bus;
+    s_ports[port].sda_io = bus_config->sda_io_num;
+    s_ports[port].scl_io = bus_config->scl_io_num;
+    pthread_mutex_unlock(&s_lock);
+
+    if (bus_config->trans_queue_depth)
+    {
+        bus->queue_depth = bus_config->trans_queue_depth;
+        bus->queue = calloc(bus->queue_depth, sizeof(sim_op_t));
+        bus->started = bus->queue && pthread_create(&bus->worker, NULL, bus_worker, bus) == 0;
+        if (!bus->started)
+        {
+            i2c_del_master_bus(bus);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    *ret_bus_handle = bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus_handle)
+{
+    if (!bus_handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (bus_handle->n_devices)
+    {
+        return ESP_ERR_INVALID_STATE; // remove the devices first, like the IDF driver
+    }
+    if (bus_handle->queue)
+    {
+        pthread_mutex_lock(&bus_handle->qlock);
+        bus_handle->stop = true; // the worker finishes the queue first
+        pthread_cond_broadcast(&bus_handle->qcond);
+        pthread_mutex_unlock(&bus_handle->qlock);
+        if (bus_handle->started)
+        {
+            pthread_join(bus_handle->worker, NULL);
+        }
+    }
+    pthread_mutex_lock(&s_lock);
+    s_ports[bus_handle->port].bus = NULL;
+    pthread_mutex_unlock(&s_lock);
+    pthread_mutex_destroy(&bus_handle->qlock);
+    pthread_cond_destroy(&bus_handle->qcond);
+    free(bus_handle->queue);
+    free(bus_handle);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_get_bus_handle(i2c_port_num_t port_num, i2c_master_bus_handle_t *ret_handle)
+{
+    if (!ret_handle || !port_ok(port_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    *ret_handle = s_ports[port_num].bus;
+    pthread_mutex_unlock(&s_lock);
+    return *ret_handle ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config,
+                                    i2c_master_dev_handle_t *ret_handle)
+{
+    if (!bus_handle || !dev_config || !ret_handle || dev_config->scl_speed_hz == 0 ||
+        dev_config->dev_addr_length != I2C_ADDR_BIT_LEN_7 || dev_config->device_address > 0x7f)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct i2c_master_dev_t *dev = calloc(1, sizeof(*dev));
+    if (!dev)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    dev->bus = bus_handle;
+    dev->device_address = dev_config->device_address;
+    dev->scl_speed_hz = dev_config->scl_speed_hz;
+    pthread_mutex_lock(&s_lock);
+    bus_handle->n_devices++;
+    pthread_mutex_unlock(&s_lock);
+    *ret_handle = dev;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle)
+{
+    if (!handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct i2c_master_bus_t *bus = handle->bus;
+    if (bus->queue)
+    {
+        i2c_master_bus_wait_all_done(bus, -1); // no queued transfer may refer to it
+    }
+    pthread_mutex_lock(&s_lock);
+    bus->n_devices--;
+    pthread_mutex_unlock(&s_lock);
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_register_event_callbacks(i2c_master_dev_handle_t i2c_dev,
+                                              const i2c_master_event_callbacks_t *cbs, void *user_data)
+{
+    if (!i2c_dev || !cbs)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (i2c_dev->bus->queue_depth == 0)
+    {
+        return ESP_ERR_INVALID_STATE; // callbacks need an asynchronous bus
+    }
+    i2c_dev->on_trans_done = cbs->on_trans_done;
+    i2c_dev->user_data = user_data;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                              int xfer_timeout_ms)
+{
+    return do_transfer(i2c_dev, write_buffer, write_size, NULL, 0, xfer_timeout_ms);
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t *read_buffer, size_t read_size,
+                             int xfer_timeout_ms)
+{
+    return do_transfer(i2c_dev, NULL, 0, read_buffer, read_size, xfer_timeout_ms);
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer,
+                                      size_t write_size, uint8_t *read_buffer, size_t read_size,
+                                      int xfer_timeout_ms)
+{
+    return do_transfer(i2c_dev, write_buffer, write_size, read_buffer, read_size, xfer_timeout_ms);
+}
+
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms)
+{
+    (void)xfer_timeout_ms;
+    if (!bus_handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = wire_transfer(bus_handle->port, address, I2C_SIM_PROBE_SPEED_HZ, NULL, 0, NULL, 0);
+    return ret == ESP_ERR_INVALID_STATE ? ESP_ERR_NOT_FOUND : ret;
+}
+
+esp_err_t i2c_master_bus_wait_all_done(i2c_master_bus_handle_t bus_handle, int timeout_ms)
+{
+    if (!bus_handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!bus_handle->queue)
+    {
+        return ESP_OK;
+    }
+    struct timespec ts;
+    struct timespec *until = timeout_to_deadline(timeout_ms, &ts);
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&bus_handle->qlock);
+    while (bus_handle->count)
+    {
+        if (!queue_wait(bus_handle, until))
+        {
+            ret = ESP_ERR_TIMEOUT;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&bus_handle->qlock);
+    return ret;
+}
+
+esp_err_t i2c_master_bus_reset(i2c_master_bus_handle_t bus_handle)
+{
+    return bus_handle ? ESP_OK : ESP_ERR_INVALID_ARG; // the wire has no state to clear
+}
+
+esp_err_t i2c_sim_attach(int port, uint16_t device_address, const i2c_sim_model_t *model, void *ctx)
+{
+    if (!port_ok(port) || !model)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&s_lock);
+    if (find_slot(port, device_address))
+    {
+        ret = ESP_ERR_INVALID_STATE; // two devices on one address
+    }
+    else
+    {
+        for (int i = 0; i < I2C_SIM_MAX_MODELS; i++)
+        {
+            sim_slot_t *s = &s_ports[port].slots[i];
+            if (s->model == NULL)
+            {
+                *s = (sim_slot_t){.model = model, .ctx = ctx, .device_address = device_address};
+                ret = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+void i2c_sim_detach(int port, uint16_t device_address)
+{
+    if (!port_ok(port))
+    {
+        return;
+    }
+    pthread_mutex_lock(&s_lock);
+    sim_slot_t *s = find_slot(port, device_address);
+    if (s)
+    {
+        memset(s, 0, sizeof(*s));
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void i2c_sim_set_realtime(bool realtime)
+{
+    s_realtime = realtime;
+}
+
+void i2c_sim_nack_next(int port, uint16_t device_address, int count)
+{
+    if (!port_ok(port))
+    {
+        return;
+    }
+    pthread_mutex_lock(&s_lock);
+    sim_slot_t *s = find_slot(port, device_address);
+    if (s)
+    {
+        s->nack_next = count;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void i2c_sim_stick_sda(int port, int clocks)
+{
+    if (!port_ok(port))
+    {
+        return;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_ports[port].sda_stuck = clocks;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void i2c_sim_stretch_next(int port, int ms)
+{
+    if (!port_ok(port))
+    {
+        return;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_ports[port].stretch_ms = ms;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void i2c_sim_fail_bus_create(int port, int count)
+{
+    if (!port_ok(port))
+    {
+        return;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_ports[port].fail_create = count;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void i2c_sim_get_stats(int port, i2c_sim_stats_t *stats, bool reset)
+{
+    if (!port_ok(port) || !stats)
+    {
+        return;
+    }
+    pthread_mutex_lock(&s_ports[port].wire); // not in the middle of a transaction
+    *stats = s_ports[port].stats;
+    if (reset)
+    {
+        memset(&s_ports[port].stats, 0, sizeof(s_ports[port].stats));
+    }
+    pthread_mutex_unlock(&s_ports[port].wire);
+}
+
+// GPIO stand-ins: only the SDA and SCL pins of the simulated buses are modelled
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    return config ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    return (gpio_num >= 0 && gpio_num < GPIO_NUM_MAX) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_once(&s_once, ports_init);
+    pthread_mutex_lock(&s_lock);
+    for (int p = 0; p < I2C_SIM_MAX_PORTS; p++)
+    {
+        if (s_ports[p].scl_io != gpio_num)
+        {
+            continue;
+        }
+        if (level && s_ports[p].scl_low && s_ports[p].sda_stuck > 0)
+        {
+            s_ports[p].sda_stuck--; // the slave clocks out one more bit
+        }
+        s_ports[p].scl_low = !level;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    int level = 1;
+    pthread_once(&s_once, ports_init);
+    pthread_mutex_lock(&s_lock);
+    for (int p = 0; p < I2C_SIM_MAX_PORTS; p++)
+    {
+        if ((s_ports[p].sda_io == gpio_num && s_ports[p].sda_stuck != 0) ||
+            (s_ports[p].scl_io == gpio_num && s_ports[p].scl_low))
+        {
+            level = 0;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return level;
+}
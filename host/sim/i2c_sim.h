@@ -0,0 +1,92 @@
+// i2c_sim.h
+// Simulated I2C buses behind the host driver/i2c_master.h: device models, bus time, faults
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+
+#define I2C_SIM_MAX_PORTS (2)         // Like the ESP32-P4 HP I2C controllers
+#define I2C_SIM_MAX_MODELS (8)        // Device models per port
+#define I2C_SIM_PROBE_SPEED_HZ (100000) // SCL of i2c_master_probe(), as in the IDF driver
+
+    /*
+     * Register-level device model. It sees the bytes of a transaction after the address
+     * byte; a write followed by a read (repeated start) calls write, then read. Models run
+     * with the bus to themselves, one transaction at a time.
+     */
+    typedef struct
+    {
+        const char *name;
+        bool (*write)(void *ctx, const uint8_t *data, size_t len); // false = NACK
+        void (*read)(void *ctx, uint8_t *data, size_t len);        // NULL: reads 0xff
+    } i2c_sim_model_t;
+
+    typedef struct
+    {
+        uint32_t transactions;
+        uint32_t nacks;
+        uint32_t timeouts; // Transactions on a bus held low (i2c_sim_stick_sda)
+        uint64_t bytes;  // Payload bytes written and read, address bytes not counted
+        uint64_t bus_ns; // Time on the wire at the SCL speed of each device
+    } i2c_sim_stats_t;
+
+    /**
+     * @brief Put a device model on a port. It stays when the bus on the port is deleted
+     *        and created again, like a device on the wire.
+     */
+    esp_err_t i2c_sim_attach(int port, uint16_t device_address, const i2c_sim_model_t *model, void *ctx);
+
+    void i2c_sim_detach(int port, uint16_t device_address);
+
+    /**
+     * @brief Sleep the bus time of every transaction, so wall-clock measurements (esp_timer)
+     *        see the timing of the real bus. Off by default: the bus time is only counted.
+     */
+    void i2c_sim_set_realtime(bool realtime);
+
+    /**
+     * @brief Fault injection: the next count transactions to the device are not acknowledged.
+     */
+    void i2c_sim_nack_next(int port, uint16_t device_address, int count);
+
+    /**
+     * @brief Fault injection: a slave holds SDA low, as after a reset in the middle of a read.
+     *
+     * Every transaction on the port times out (ESP_ERR_TIMEOUT, I2C_EVENT_TIMEOUT) and the
+     * SDA pin of the bus reads low through gpio_get_level() until SCL was pulsed clocks times
+     * with gpio_set_level(); clocks < 0: SDA is never released. The pins are the ones of the
+     * last bus created on the port, they stay while the bus is deleted.
+     */
+    void i2c_sim_stick_sda(int port, int clocks);
+
+    /**
+     * @brief Fault injection: the next transaction on the port holds the wire ms longer, as a
+     *        slave that stretches the clock. A bus reset does not shorten it.
+     */
+    void i2c_sim_stretch_next(int port, int ms);
+
+    /**
+     * @brief Fault injection: the next count i2c_new_master_bus() calls for the port fail.
+     */
+    void i2c_sim_fail_bus_create(int port, int count);
+
+    void i2c_sim_get_stats(int port, i2c_sim_stats_t *stats, bool reset);
+
+    /**
+     * @brief Wire time of one transaction: start, address, data with ACK bits, repeated start
+     *        and address for the read part, stop.
+     */
+    uint64_t i2c_sim_transaction_ns(uint32_t scl_speed_hz, size_t write_len, size_t read_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,71 @@
+// sim_devices.h
+// Register-level models of the SSD1306, GP8413 and M5 4-relay for the simulated I2C bus
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+
+#define SIM_SSD1306_PAGES (8)
+#define SIM_SSD1306_COLUMNS (128)
+
+    // SSD1306: command parser and the GDDRAM image the panel shows
+    typedef struct
+    {
+        uint8_t gddram[SIM_SSD1306_PAGES][SIM_SSD1306_COLUMNS];
+        bool display_on;
+        bool inverted;
+        uint8_t contrast;
+        uint8_t addressing_mode; // 0 horizontal, 1 vertical, 2 page (reset)
+        uint8_t col_start, col_end, page_start, page_end;
+        uint8_t col, page; // GDDRAM pointer
+        // a command and its arguments may come in separate transactions (Co=1 writes)
+        uint8_t cmd[8];
+        uint8_t cmd_len;
+        uint8_t cmd_need;
+        uint32_t commands;   // Complete commands executed
+        uint32_t data_bytes; // GDDRAM bytes written
+    } sim_ssd1306_t;
+
+    // GP8413: range register and the two channel codes, write-only
+    typedef struct
+    {
+        uint8_t regs[8]; // 0x01 range code, 0x02..0x05 channel 0 and 1 codes, low byte first
+        uint32_t writes;
+    } sim_gp8413_t;
+
+    // M5 4-relay unit: MODE (0x10) and RELAY (0x11, relays bit 0..3, LEDs bit 4..7)
+    typedef struct
+    {
+        uint8_t regs[256];
+        uint8_t pointer; // Register pointer, auto-increments on reads and writes
+        uint32_t writes;
+    } sim_m54r_t;
+
+    /**
+     * @brief Reset the model to its power-on state and put it on the bus.
+     */
+    esp_err_t sim_ssd1306_attach(sim_ssd1306_t *oled, int port, uint16_t device_address);
+    esp_err_t sim_gp8413_attach(sim_gp8413_t *dac, int port, uint16_t device_address);
+    esp_err_t sim_m54r_attach(sim_m54r_t *relay, int port, uint16_t device_address);
+
+    bool sim_ssd1306_pixel(const sim_ssd1306_t *oled, int x, int y);
+    void sim_ssd1306_print(const sim_ssd1306_t *oled, FILE *out); // ASCII image, 2 rows per line
+
+    uint32_t sim_gp8413_range_mv(const sim_gp8413_t *dac); // 0 when the range was never set
+    uint16_t sim_gp8413_code(const sim_gp8413_t *dac, int channel);
+    uint32_t sim_gp8413_mv(const sim_gp8413_t *dac, int channel);
+
+    uint8_t sim_m54r_reg(const sim_m54r_t *relay, uint8_t reg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file sim_gp8413.c
+ * @brief GP8413 model for the simulated I2C bus.
+ *
+ * A write sets the register pointer and stores the following bytes with auto-increment,
+ * so one transaction can set both channels. Range codes 0x55 (5 V) and 0x77 (10 V) are the
+ * ones the driver uses. The device is write-only: reads return the released bus (0xff).
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <string.h>
+#include "i2c_sim.h"
+#include "sim_devices.h"
+
+static bool gp8413_write(void *ctx, const uint8_t *data, size_t len)
+{
+    sim_gp8413_t *dac = ctx;
+    size_t reg = data[0];
+    if (reg >= sizeof(dac->regs) || reg + (len - 1) > sizeof(dac->regs))
+    {
+        return false; // no such register: NACK
+    }
+    if (len > 1)
+    {
+        memcpy(&dac->regs[reg], &data[1], len - 1);
+        dac->writes++;
+    }
+    return true;
+}
+
+static const i2c_sim_model_t s_model = {
+    .name = "gp8413",
+    .write = gp8413_write,
+};
+
+esp_err_t sim_gp8413_attach(sim_gp8413_t *dac, int port, uint16_t device_address)
+{
+    memset(dac, 0, sizeof(*dac));
+    return i2c_sim_attach(port, device_address, &s_model, dac);
+}
+
+uint32_t sim_gp8413_range_mv(const sim_gp8413_t *dac)
+{
+    switch (dac->regs[0x01])
+    {
+    case 0x55:
+        return 5000;
+    case 0x77:
+        return 10000;
+    default:
+        return 0;
+    }
+}
+
+uint16_t sim_gp8413_code(const sim_gp8413_t *dac, int channel)
+{
+    int reg = 0x02 + 2 * (channel & 1);
+    return (uint16_t)(dac->regs[reg] | (dac->regs[reg + 1] << 8));
+}
+
+uint32_t sim_gp8413_mv(const sim_gp8413_t *dac, int channel)
+{
+    return (uint32_t)(((uint64_t)sim_gp8413_code(dac, channel) * sim_gp8413_range_mv(dac) + 16383) / 32767);
+}
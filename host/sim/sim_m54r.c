@@ -0,0 +1,55 @@
+/**
+ * @file sim_m54r.c
+ * @brief M5 4-relay unit model for the simulated I2C bus.
+ *
+ * Register-pointer device: the first written byte sets the pointer, following bytes are
+ * stored and reads continue from the pointer, both with auto-increment.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <string.h>
+#include "i2c_sim.h"
+#include "sim_devices.h"
+
+static bool m54r_write(void *ctx, const uint8_t *data, size_t len)
+{
+    sim_m54r_t *relay = ctx;
+    relay->pointer = data[0];
+    for (size_t i = 1; i < len; i++)
+    {
+        relay->regs[relay->pointer++] = data[i];
+    }
+    if (len > 1)
+    {
+        relay->writes++;
+    }
+    return true;
+}
+
+static void m54r_read(void *ctx, uint8_t *data, size_t len)
+{
+    sim_m54r_t *relay = ctx;
+    for (size_t i = 0; i < len; i++)
+    {
+        data[i] = relay->regs[relay->pointer++];
+    }
+}
+
+static const i2c_sim_model_t s_model = {
+    .name = "m54r",
+    .write = m54r_write,
+    .read = m54r_read,
+};
+
+esp_err_t sim_m54r_attach(sim_m54r_t *relay, int port, uint16_t device_address)
+{
+    memset(relay, 0, sizeof(*relay));
+    return i2c_sim_attach(port, device_address, &s_model, relay);
+}
+
+uint8_t sim_m54r_reg(const sim_m54r_t *relay, uint8_t reg)
+{
+    return relay->regs[reg];
+}
@@ -0,0 +1,48 @@
+/**
+ * @file sim_plant.c
+ * @brief First-order plant for closed-loop runs on the host.
+ *
+ * The input is what the GP8413 model outputs, so the loop closes over the simulated bus:
+ * only setpoints that reached the model move the plant. Integer state (Q16.16); with a fixed
+ * time step per read the run is deterministic, with dt_us 0 it follows the wall clock.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <math.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "sim_plant.h"
+
+void sim_plant_init(sim_plant_t *plant, const sim_gp8413_t *dac, int channel, float gain, uint32_t tau_us,
+                    uint32_t dt_us)
+{
+    memset(plant, 0, sizeof(*plant));
+    plant->dac = dac;
+    plant->channel = channel;
+    plant->gain_q16 = (int32_t)lroundf(gain * 65536.0f);
+    plant->tau_us = tau_us ? tau_us : 1;
+    plant->dt_us = dt_us;
+}
+
+esp_err_t sim_plant_feedback(void *ctx, int32_t *value)
+{
+    sim_plant_t *plant = ctx;
+    int64_t now = esp_timer_get_time();
+    int64_t dt = plant->dt_us ? plant->dt_us : (plant->last_us ? now - plant->last_us : 0);
+    int64_t target = (int64_t)plant->gain_q16 * sim_gp8413_mv(plant->dac, plant->channel);
+
+    plant->last_us = now;
+    if (dt >= plant->tau_us)
+    {
+        plant->y_q16 = target;
+    }
+    else
+    {
+        plant->y_q16 += (target - plant->y_q16) * dt / plant->tau_us;
+    }
+    plant->reads++;
+    *value = (int32_t)((plant->y_q16 + 0x8000) >> 16) + plant->offset;
+    return ESP_OK;
+}
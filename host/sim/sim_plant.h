@@ -0,0 +1,38 @@
+// sim_plant.h
+// First-order plant driven by a GP8413 model channel: the feedback of a control loop on the host
+// Edwin vd Oetelaar, juni 2025
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_err.h"
+#include "sim_devices.h"
+
+    // y' = (gain * u - y) / tau, u the millivolts the DAC model outputs
+    typedef struct
+    {
+        const sim_gp8413_t *dac;
+        int channel;
+        int32_t gain_q16; // Output units per mV, Q16.16
+        uint32_t tau_us;
+        uint32_t dt_us;   // Time step per feedback read, 0: the time since the last read
+        int32_t offset;   // Added to the output (a load, a sensor offset)
+        int64_t y_q16;
+        int64_t last_us;
+        uint32_t reads;
+    } sim_plant_t;
+
+    void sim_plant_init(sim_plant_t *plant, const sim_gp8413_t *dac, int channel, float gain, uint32_t tau_us,
+                        uint32_t dt_us);
+
+    // Advance the plant and return its output: a dac_pid_feedback_t
+    esp_err_t sim_plant_feedback(void *ctx, int32_t *value);
+
+#ifdef __cplusplus
+}
+#endif
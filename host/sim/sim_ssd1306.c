@@ -0,0 +1,204 @@
+/**
+ * @file sim_ssd1306.c
+ * @brief SSD1306 model for the simulated I2C bus.
+ *
+ * Every transaction is a sequence of control bytes: Co=1 means one byte follows and then
+ * the next control byte, Co=0 means the rest of the transaction is of one kind; D/C# selects
+ * command or GDDRAM data. Commands with arguments may be split over transactions, as the
+ * driver does with its one-command-per-write calls. Data is written at the GDDRAM pointer,
+ * which moves as the addressing mode and the column and page windows say.
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <string.h>
+#include "i2c_sim.h"
+#include "sim_devices.h"
+
+// Argument bytes of the commands that have them
+static uint8_t arg_count(uint8_t cmd)
+{
+    switch (cmd)
+    {
+    case 0x20: // memory addressing mode
+    case 0x81: // contrast
+    case 0x8D: // charge pump
+    case 0xA8: // multiplex ratio
+    case 0xD3: // display offset
+    case 0xD5: // clock divide
+    case 0xD9: // pre-charge
+    case 0xDA: // COM pins
+    case 0xDB: // VCOMH deselect
+        return 1;
+    case 0x21: // column address
+    case 0x22: // page address
+    case 0xA3: // vertical scroll area
+        return 2;
+    case 0x29: // vertical and horizontal scroll
+    case 0x2A:
+        return 5;
+    case 0x26: // horizontal scroll
+    case 0x27:
+        return 6;
+    default:
+        return 0;
+    }
+}
+
+static void execute(sim_ssd1306_t *oled)
+{
+    const uint8_t *c = oled->cmd;
+    oled->commands++;
+    if (c[0] <= 0x0F) // page mode: lower column nibble
+    {
+        oled->col = (oled->col & 0xF0) | (c[0] & 0x0F);
+    }
+    else if (c[0] <= 0x1F) // page mode: upper column nibble
+    {
+        oled->col = (oled->col & 0x0F) | ((c[0] & 0x07) << 4);
+    }
+    else if (c[0] >= 0xB0 && c[0] <= 0xB7) // page mode: page
+    {
+        oled->page = c[0] & 0x07;
+    }
+    else
+    {
+        switch (c[0])
+        {
+        case 0x20:
+            oled->addressing_mode = c[1] & 0x03;
+            break;
+        case 0x21:
+            oled->col_start = c[1] & 0x7F;
+            oled->col_end = c[2] & 0x7F;
+            oled->col = oled->col_start;
+            break;
+        case 0x22:
+            oled->page_start = c[1] & 0x07;
+            oled->page_end = c[2] & 0x07;
+            oled->page = oled->page_start;
+            break;
+        case 0x81:
+            oled->contrast = c[1];
+            break;
+        case 0xA6:
+        case 0xA7:
+            oled->inverted = c[0] & 0x01;
+            break;
+        case 0xAE:
+        case 0xAF:
+            oled->display_on = c[0] & 0x01;
+            break;
+        default:
+            break; // panel set-up, no effect on the image
+        }
+    }
+}
+
+static void command_byte(sim_ssd1306_t *oled, uint8_t b)
+{
+    if (oled->cmd_need == 0)
+    {
+        oled->cmd[0] = b;
+        oled->cmd_len = 1;
+        oled->cmd_need = arg_count(b);
+    }
+    else
+    {
+        oled->cmd[oled->cmd_len++] = b;
+        oled->cmd_need--;
+    }
+    if (oled->cmd_need == 0)
+    {
+        execute(oled);
+    }
+}
+
+static void data_byte(sim_ssd1306_t *oled, uint8_t b)
+{
+    oled->gddram[oled->page][oled->col] = b;
+    oled->data_bytes++;
+
+    switch (oled->addressing_mode)
+    {
+    case 0: // horizontal: along the column window, then the next page
+        if (oled->col++ >= oled->col_end)
+        {
+            oled->col = oled->col_start;
+            oled->page = (oled->page >= oled->page_end) ? oled->page_start : oled->page + 1;
+        }
+        break;
+    case 1: // vertical: down the page window, then the next column
+        if (oled->page++ >= oled->page_end)
+        {
+            oled->page = oled->page_start;
+            oled->col = (oled->col >= oled->col_end) ? oled->col_start : oled->col + 1;
+        }
+        break;
+    default: // page: along the page, the pointer wraps within it
+        oled->col = (oled->col + 1) % SIM_SSD1306_COLUMNS;
+        break;
+    }
+}
+
+static bool ssd1306_write(void *ctx, const uint8_t *data, size_t len)
+{
+    sim_ssd1306_t *oled = ctx;
+    size_t i = 0;
+    while (i < len)
+    {
+        uint8_t control = data[i++];
+        bool data_mode = control & 0x40;
+        size_t end = (control & 0x80) ? ((i < len) ? i + 1 : i) : len; // Co=1: one byte
+        for (; i < end; i++)
+        {
+            if (data_mode)
+            {
+                data_byte(oled, data[i]);
+            }
+            else
+            {
+                command_byte(oled, data[i]);
+            }
+        }
+    }
+    return true;
+}
+
+static const i2c_sim_model_t s_model = {
+    .name = "ssd1306",
+    .write = ssd1306_write,
+};
+
+esp_err_t sim_ssd1306_attach(sim_ssd1306_t *oled, int port, uint16_t device_address)
+{
+    memset(oled, 0, sizeof(*oled));
+    oled->contrast = 0x7F;
+    oled->addressing_mode = 2;
+    oled->col_end = SIM_SSD1306_COLUMNS - 1;
+    oled->page_end = SIM_SSD1306_PAGES - 1;
+    return i2c_sim_attach(port, device_address, &s_model, oled);
+}
+
+bool sim_ssd1306_pixel(const sim_ssd1306_t *oled, int x, int y)
+{
+    if (x < 0 || x >= SIM_SSD1306_COLUMNS || y < 0 || y >= 8 * SIM_SSD1306_PAGES)
+    {
+        return false;
+    }
+    return (oled->gddram[y / 8][x] >> (y % 8)) & 1;
+}
+
+void sim_ssd1306_print(const sim_ssd1306_t *oled, FILE *out)
+{
+    static const char *cell[4] = {" ", "▀", "▄", "█"}; // upper, lower, both halves
+    for (int y = 0; y < 8 * SIM_SSD1306_PAGES; y += 2)
+    {
+        for (int x = 0; x < SIM_SSD1306_COLUMNS; x++)
+        {
+            fputs(cell[sim_ssd1306_pixel(oled, x, y) | (sim_ssd1306_pixel(oled, x, y + 1) << 1)], out);
+        }
+        fputc('\n', out);
+    }
+}
@@ -0,0 +1,203 @@
+/**
+ * @file ui_bench.c
+ * @brief Bytes and bus time of the retained status screen against a full frame per update.
+ *
+ * The status screen of 'status' runs on the SSD1306 model at 400 kHz. A run of updates ramps
+ * the speed by 10 mV, holds the brake and toggles a relay now and then, as a slow control
+ * loop would. The same run is done twice: flushing only the changed widgets, and redrawing
+ * and sending the whole frame every update (the display was updated like that so far). Per
+ * way it prints the bytes and the bus time per update and the render time.
+ *
+ * Checked: the number formatting, an unchanged screen sends nothing, one changed digit sends
+ * one 8x16 cell (29 bytes), one relay one icon (21 bytes), the text matches what
+ * ssd1306_printFixed6/16 draw, and the panel image equals the frame buffer after every
+ * update. Exit status 1 when a check failed.
+ *
+ * usage: ui_bench [-n UPDATES] [-p]
+ *   -n  updates per way (default 500)
+ *   -p  print the display image at the end
+ *
+ * Author: Edwin vd Oetelaar
+ * Date: June 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/i2c_master.h"
+#include "i2c_bus.h"
+#include "ssd1306.h"
+#include "oled_ui.h"
+#include "oled_status.h"
+#include "i2c_sim.h"
+#include "sim_devices.h"
+#include "host_bench.h"
+
+#define DISPLAY_PORT (0)
+#define SPEED_HZ (400000)
+#define FULL_SCALE_MV (10000)
+
+static const char *TAG = "ui_bench";
+
+static sim_ssd1306_t s_oled_model;
+static ssd1306_handle_t s_display;
+static oled_status_t s_status;
+
+static void check_format(int32_t value, uint8_t n, const char *expect)
+{
+    char cells[OLED_UI_MAX_CELLS + 1] = {0};
+    oled_ui_format_int(value, cells, n);
+    if (strcmp(cells, expect) != 0)
+    {
+        printf("FAIL format %" PRId32 " in %u cells: '%s', expected '%s'\n", value, n, cells, expect);
+        bench_failed++;
+    }
+}
+
+// Bus traffic of one update: transactions and bytes on the wire
+static void update(const oled_status_values_t *v, i2c_sim_stats_t *bus)
+{
+    i2c_sim_get_stats(DISPLAY_PORT, bus, true);
+    CHECK(oled_status_update(&s_status, v) == ESP_OK);
+    i2c_sim_get_stats(DISPLAY_PORT, bus, true);
+    CHECK(memcmp(s_oled_model.gddram, s_display.buffer, sizeof(s_display.buffer)) == 0);
+}
+
+// The text rows as the fixed-width print functions draw them
+static void check_text(const oled_status_values_t *v)
+{
+    static ssd1306_handle_t ref = {.width = 128, .height = 64, .pages = 8}; // drawn into, never sent
+    char line[24];
+    memset(ref.buffer, 0, sizeof(ref.buffer));
+    ssd1306_printFixed6(&ref, 0, 0, 1, "speed");
+    ssd1306_printFixed6(&ref, 66, 0, 1, "brake");
+    snprintf(line, sizeof(line), "%5" PRId32 "mV", v->speed_mv);
+    ssd1306_printFixed16(&ref, 0, 8, 1, line);
+    snprintf(line, sizeof(line), "%5" PRId32 "mV", v->brake_mv);
+    ssd1306_printFixed16(&ref, 66, 8, 1, line);
+    ssd1306_printFixed6(&ref, 0, 56, 1, v->link);
+    CHECK(memcmp(&ref.buffer[0], &s_display.buffer[0], 3 * SSD1306_MAX_WIDTH) == 0); // pages 0..2
+    CHECK(memcmp(&ref.buffer[7 * SSD1306_MAX_WIDTH], &s_display.buffer[7 * SSD1306_MAX_WIDTH],
+                 strlen(v->link) * 6) == 0);
+}
+
+// n updates of a ramp; full: the whole frame every update
+static void run(int n, bool full)
+{
+    oled_status_values_t v = {.speed_mv = 0, .brake_mv = 2500, .relays = 0x1, .link = "link ok"};
+    i2c_sim_stats_t bus;
+    uint64_t bytes = 0, bus_ns = 0;
+    uint32_t render_us = 0;
+    for (int i = 0; i < n; i++)
+    {
+        v.speed_mv = (i * 10) % FULL_SCALE_MV;
+        v.relays = (uint8_t)(0x1 | ((i / 50) & 1) << 2);
+        if (full)
+        {
+            oled_ui_invalidate_all(&s_status.ui);
+        }
+        int64_t start = esp_timer_get_time();
+        update(&v, &bus);
+        render_us += (uint32_t)(esp_timer_get_time() - start);
+        bytes += bus.bytes;
+        bus_ns += bus.bus_ns;
+    }
+    check_text(&v);
+    printf("%-10s %8" PRIu64 " %10" PRIu64 " %12" PRIu64 " %10" PRIu32 "\n", full ? "full" : "retained",
+           bytes / n, bus_ns / n / 1000, bus_ns / 1000000, render_us / n);
+    if (!full)
+    {
+        const oled_ui_stats_t *st = &s_status.ui.stats;
+        printf("%-10s %" PRIu32 " renders, %" PRIu32 " without change, %" PRIu32 " windows, %" PRIu32
+               " frames, %" PRIu32 " errors\n", "", st->renders, st->idle, st->windows, st->frames, st->errors);
+        CHECK(st->errors == 0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int n = 500;
+    bool print = false;
+    int opt;
+    esp_log_level_set("*", ESP_LOG_WARN);
+    while ((opt = getopt(argc, argv, "n:p")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 'p':
+            print = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n UPDATES] [-p]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (n < 100)
+    {
+        fprintf(stderr, "need -n >= 100\n");
+        return 2;
+    }
+
+    check_format(1234, 5, " 1234");
+    check_format(0, 5, "    0");
+    check_format(-12, 5, "  -12");
+    check_format(-1234, 5, "-1234");
+    check_format(12345, 5, "12345");
+    check_format(123456, 5, "#####");
+    check_format(-12345, 5, "#####");
+    check_format(INT32_MIN, 11, "-2147483648");
+
+    CHECK(sim_ssd1306_attach(&s_oled_model, DISPLAY_PORT, SSD1306_I2C_ADDRESS) == ESP_OK);
+    i2c_master_bus_handle_t bus = bench_bus(DISPLAY_PORT, false);
+    s_display.bus_handle = bus;
+    s_display.device_address = SSD1306_I2C_ADDRESS;
+    s_display.scl_speed_hz = SPEED_HZ;
+    ssd1306_init(&s_display, 128, 64, 0);
+    if (s_display.dev_handle == NULL || oled_status_init(&s_status, &s_display, FULL_SCALE_MV) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "display setup failed");
+        return 1;
+    }
+
+    // the first update is the whole frame, then only what changes
+    oled_status_values_t v = {.speed_mv = 1230, .brake_mv = 2500, .relays = 0x1, .link = "link ok"};
+    i2c_sim_stats_t st;
+    update(&v, &st);
+    CHECK(s_status.ui.stats.frames == 1 && st.bytes > 1024);
+    check_text(&v);
+    update(&v, &st);
+    CHECK(st.transactions == 0 && s_status.ui.stats.idle == 1);
+    v.speed_mv = 1240; // one digit, the bar stays at the same column
+    update(&v, &st);
+    CHECK(st.transactions == 1 && st.bytes == ssd1306_window_bytes(8, 2) && st.bytes == 29);
+    check_text(&v);
+    v.relays = 0x5; // one icon
+    update(&v, &st);
+    CHECK(st.transactions == 1 && st.bytes == ssd1306_window_bytes(8, 1) && st.bytes == 21);
+    v.link = "link LOST"; // "ok" becomes "LOST": cells 5..8
+    update(&v, &st);
+    CHECK(st.transactions == 1 && st.bytes == ssd1306_window_bytes(4 * 6, 1));
+    check_text(&v);
+    v.brake_mv = FULL_SCALE_MV + 1; // the bar clamps, the number shows it
+    update(&v, &st);
+    CHECK(s_status.ui.widgets[s_status.brake_bar].fill == 58 && s_status.ui.stats.errors == 0);
+    check_text(&v);
+
+    printf("%-10s %8s %10s %12s %10s\n", "", "bytes", "bus us", "bus ms total", "render us");
+    run(n, true);
+    memset(&s_status.ui.stats, 0, sizeof(s_status.ui.stats));
+    run(n, false);
+
+    if (print)
+    {
+        sim_ssd1306_print(&s_oled_model, stdout);
+    }
+    return bench_result(TAG);
+}
@@ -14,19 +14,122 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
 #include "argtable3/argtable3.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "driver/i2c_master.h"
 #include "esp_console.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "gp8413_sdc.h"
 #include "ssd1306.h"
+#include "ssd1306_font.h"
 #include "m5_4relay.h"
+#include "i2c_bus.h"
+#include "i2c_sched.h"
+#include "i2c_scan.h"
+#include "i2c_dump.h"
+#include "i2c_stats.h"
+#include "i2c_recover.h"
+#include "i2c_async.h"
+#include "i2c_tune.h"
+#include "i2c_batch.h"
+#include "i2c_inventory.h"
+#include "i2c_capture.h"
+#include "i2c_replay.h"
+#include "boot_trace.h"
+#include "actuator.h"
+#include "control_exec.h"
+#include "failsafe.h"
+#include "act_history.h"
+#include "oled_scope.h"
+#include "oled_status.h"
+#include "rpc_server.h"
+#include "rpc_devices.h"
+#include "cmd_i2ctools.h"
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+#include "driver/usb_serial_jtag.h"
+#elif CONFIG_ESP_CONSOLE_UART
+#include "driver/uart.h"
+#endif
 
 static const char *TAG = "cmd_i2ctools";
 
 #define I2C_TOOL_TIMEOUT_VALUE_MS (50)
-static uint32_t i2c_frequency = 100 * 1000;
-i2c_master_bus_handle_t tool_bus_handle;
+static uint32_t i2c_frequency = 100 * 1000; // default device speed, see i2ctune for per-device speeds
+i2c_master_bus_handle_t tool_bus_handles[I2C_TOOL_MAX_BUSES]; // bus table, index = I2C port
+
+// Devices with a driver context, their bus can be changed at runtime with 'i2cbus'
+typedef enum
+{
+    TOOL_DEV_DAC = 0,
+    TOOL_DEV_RELAY,
+    TOOL_DEV_DISPLAY,
+    TOOL_DEV_MAX
+} tool_dev_t;
+
+static const char *tool_dev_names[TOOL_DEV_MAX] = {"dac", "relay", "display"};
+
+static const uint16_t tool_dev_addr[TOOL_DEV_MAX] = {
+    [TOOL_DEV_DAC] = GP8413_I2C_ADDRESS,
+    [TOOL_DEV_RELAY] = M54R_ADDR,
+    [TOOL_DEV_DISPLAY] = SSD1306_I2C_ADDRESS,
+};
+
+static int s_dev_bus[TOOL_DEV_MAX] = {
+    [TOOL_DEV_DAC] = I2C_NUM_0,
+    [TOOL_DEV_RELAY] = I2C_NUM_0,
+#if CONFIG_EXAMPLE_I2C_DISPLAY_BUS
+    [TOOL_DEV_DISPLAY] = I2C_NUM_1, // bulk display traffic on its own bus
+#else
+    [TOOL_DEV_DISPLAY] = I2C_NUM_0,
+#endif
+};
+
+static volatile bool s_status_running; // 'status' refreshes the status screen
+
+static void (*volatile s_command_hook)(void); // see i2ctools_set_command_hook()
+
+void i2ctools_set_command_hook(void (*hook)(void))
+{
+    s_command_hook = hook;
+}
+
+static int run_cmd(void *context, int argc, char **argv)
+{
+    void (*hook)(void) = s_command_hook;
+    if (hook)
+    {
+        hook();
+    }
+    return ((esp_console_cmd_func_t)context)(argc, argv);
+}
+
+// Every command goes through run_cmd, so the hook runs before each of them
+static esp_err_t register_cmd(const esp_console_cmd_t *cmd)
+{
+    esp_console_cmd_t wrapped = *cmd;
+    wrapped.func = NULL;
+    wrapped.func_w_context = run_cmd;
+    wrapped.context = (void *)cmd->func;
+    return esp_console_cmd_register(&wrapped);
+}
+
+// Bus selected with the --bus option of a command, bus 0 by default
+static i2c_master_bus_handle_t get_bus(const struct arg_int *bus_arg)
+{
+    int bus = bus_arg->count ? bus_arg->ival[0] : I2C_NUM_0;
+    if (bus < 0 || bus >= I2C_TOOL_MAX_BUSES || tool_bus_handles[bus] == NULL)
+    {
+        ESP_LOGE(TAG, "I2C bus %d is not configured, see 'i2cconfig'", bus);
+        return NULL;
+    }
+    return tool_bus_handles[bus];
+}
 
 static esp_err_t i2c_get_port(int port, i2c_port_t *i2c_port)
 {
@@ -48,6 +151,51 @@ static struct
     struct arg_end *end;
 } i2cconfig_args;
 
+typedef struct
+{
+    i2c_master_bus_config_t config;
+    bool async;
+} rebuild_bus_t;
+
+// Runs on the lane of the port: delete the bus (cached device handles first) and create it
+// with the new pins. On failure tool_bus_handles[port] is NULL, the port is not configured.
+static esp_err_t rebuild_bus_exec(void *arg)
+{
+    rebuild_bus_t *rebuild = (rebuild_bus_t *)arg;
+    i2c_master_bus_handle_t *bus = &tool_bus_handles[rebuild->config.i2c_port];
+    if (*bus != NULL)
+    {
+        if (i2c_bus_release_all(*bus) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Failed to release cached I2C devices");
+        }
+        i2c_async_forget_bus(*bus);
+        esp_err_t err = i2c_del_master_bus(*bus);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        *bus = NULL;
+    }
+    return rebuild->async ? i2c_async_new_bus(&rebuild->config, bus) : i2c_new_master_bus(&rebuild->config, bus);
+}
+
+// Tasks that keep device handles between transfers; the bus cannot be replaced under them
+static bool bus_in_background_use(void)
+{
+    const char *user = control_exec_running() ? "the control loop ('ctrl -x')"
+                       : failsafe_running()   ? "the failsafe ('failsafe -x')"
+                       : oled_scope_running() ? "the scope ('scope -x')"
+                       : s_status_running     ? "the status screen ('status -x')"
+                                              : NULL;
+    if (user != NULL)
+    {
+        printf("stop %s before changing the bus\n", user);
+        return true;
+    }
+    return false;
+}
+
 static int do_i2cconfig_cmd(int argc, char **argv)
 {
     int nerrors = arg_parse(argc, argv, (void **)&i2cconfig_args);
@@ -91,28 +239,39 @@ static int do_i2cconfig_cmd(int argc, char **argv)
         return 1;
     }
 
-    esp_err_t err = i2c_del_master_bus(tool_bus_handle);
-    if (err != ESP_OK)
+    if (i2c_port >= I2C_TOOL_MAX_BUSES)
     {
-        ESP_LOGE(TAG, "Failed to delete existing I2C bus");
+        ESP_LOGE(TAG, "Only ports 0..%d are in the bus table", I2C_TOOL_MAX_BUSES - 1);
         return 1;
     }
 
-    i2c_master_bus_config_t i2c_bus_config = {
-        .clk_source = I2C_CLK_SRC_DEFAULT,
-        .i2c_port = i2c_port,
-        .scl_io_num = i2c_gpio_scl,
-        .sda_io_num = i2c_gpio_sda,
-        .glitch_ignore_cnt = 7,
-        .flags.enable_internal_pullup = true,
-    };
+    if (bus_in_background_use())
+    {
+        return 1;
+    }
 
-    err = i2c_new_master_bus(&i2c_bus_config, &tool_bus_handle);
+    rebuild_bus_t rebuild = {
+        .async = i2c_async_port_is_async(i2c_port), // the display bus stays interrupt driven
+        .config = {
+            .clk_source = I2C_CLK_SRC_DEFAULT,
+            .i2c_port = i2c_port,
+            .scl_io_num = i2c_gpio_scl,
+            .sda_io_num = i2c_gpio_sda,
+            .glitch_ignore_cnt = 7,
+            .flags.enable_internal_pullup = true,
+        },
+    };
+    // on the lane of the port, so no queued transfer or bus check runs on the old handles
+    esp_err_t err = i2c_sched_run(i2c_port, I2C_SCHED_PRIO_URGENT, rebuild_bus_exec, &rebuild);
     if (err != ESP_OK)
     {
-        ESP_LOGE(TAG, "Failed to create new I2C bus");
+        ESP_LOGE(TAG, "Failed to %s I2C bus", tool_bus_handles[i2c_port] ? "delete existing" : "create new");
         return 1;
     }
+    if (i2c_port == I2C_NUM_0)
+    {
+        i2c_recover_set_bus_config(&rebuild.config); // recovery rebuilds with the new pins
+    }
 
     return 0;
 }
@@ -130,49 +289,131 @@ static void register_i2cconfig(void)
         .hint = NULL,
         .func = &do_i2cconfig_cmd,
         .argtable = &i2cconfig_args};
-    ESP_ERROR_CHECK(esp_console_cmd_register(&i2cconfig_cmd));
+    ESP_ERROR_CHECK(register_cmd(&i2cconfig_cmd));
+}
+
+static struct
+{
+    struct arg_int *timeout;
+    struct arg_int *first;
+    struct arg_int *last;
+    struct arg_lit *all;
+    struct arg_lit *rescan;
+    struct arg_lit *ports;
+    struct arg_int *bus;
+    struct arg_end *end;
+} i2cdetect_args;
+
+static void print_scan_result(const i2c_scan_result_t *result, bool cached)
+{
+    i2c_scan_print(result);
+    uint32_t age_ms = (uint32_t)((esp_timer_get_time() - result->timestamp_us) / 1000);
+    printf("%s%s, scan took %" PRIu32 " us, age %" PRIu32 " ms\r\n",
+           cached ? "cached result" : "fresh scan",
+           result->stuck ? ", BUS STUCK" : "",
+           result->duration_us, age_ms);
 }
 
 static int do_i2cdetect_cmd(int argc, char **argv)
 {
-    uint8_t address;
-    printf("     0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f\r\n");
-    for (int i = 0; i < 128; i += 16)
+    int nerrors = arg_parse(argc, argv, (void **)&i2cdetect_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, i2cdetect_args.end, argv[0]);
+        return 0;
+    }
+
+    i2c_scan_config_t config = I2C_SCAN_CONFIG_DEFAULT();
+    bool custom = false;
+    if (i2cdetect_args.timeout->count)
+    {
+        config.probe_timeout_ms = i2cdetect_args.timeout->ival[0];
+        custom = true;
+    }
+    // checked as int, the config fields are uint8_t and would wrap (300 -> 44)
+    int first = config.first_addr;
+    int last = config.last_addr;
+    if (i2cdetect_args.first->count)
+    {
+        first = i2cdetect_args.first->ival[0];
+        custom = true;
+    }
+    if (i2cdetect_args.last->count)
+    {
+        last = i2cdetect_args.last->ival[0];
+        custom = true;
+    }
+    if (i2cdetect_args.all->count)
+    {
+        config.include_reserved = true;
+        custom = true;
+    }
+    if (config.probe_timeout_ms < 1 || first < 0 || last > 0x7f || first > last)
+    {
+        ESP_LOGE(TAG, "Invalid timeout or address range");
+        return 1;
+    }
+    config.first_addr = (uint8_t)first;
+    config.last_addr = (uint8_t)last;
+
+    if (i2cdetect_args.ports->count)
     {
-        printf("%02x: ", i);
-        for (int j = 0; j < 16; j++)
+        i2c_scan_result_t results[I2C_SCAN_MAX_PORTS];
+        i2c_scan_all_ports(&config, results);
+        for (int port = 0; port < I2C_SCAN_MAX_PORTS; port++)
         {
-            fflush(stdout);
-            address = i + j;
-            esp_err_t ret = i2c_master_probe(tool_bus_handle, address, I2C_TOOL_TIMEOUT_VALUE_MS);
-            if (ret == ESP_OK)
-            {
-                printf("%02x ", address);
-            }
-            else if (ret == ESP_ERR_TIMEOUT)
-            {
-                printf("UU ");
-            }
-            else
+            if (results[port].bus_handle == NULL)
             {
-                printf("-- ");
+                continue;
             }
+            printf("I2C port %d\r\n", port);
+            print_scan_result(&results[port], false);
         }
-        printf("\r\n");
+        return 0;
+    }
+
+    i2c_master_bus_handle_t bus = get_bus(i2cdetect_args.bus);
+    if (bus == NULL)
+    {
+        return 1;
+    }
+
+    // a plain i2cdetect reuses a recent default scan of the same bus
+    i2c_scan_result_t result;
+    if (!custom && !i2cdetect_args.rescan->count &&
+        i2c_scan_get_cached(bus, I2C_SCAN_CACHE_MAX_AGE_MS, &result))
+    {
+        print_scan_result(&result, true);
+        return 0;
     }
 
+    esp_err_t err = i2c_scan_bus(bus, &config, &result);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Scan failed: %s", esp_err_to_name(err));
+        return 1;
+    }
+    print_scan_result(&result, false);
     return 0;
 }
 
 static void register_i2cdetect(void)
 {
+    i2cdetect_args.timeout = arg_int0("t", "timeout", "<ms>", "Probe timeout in ms (default 10)");
+    i2cdetect_args.first = arg_int0(NULL, "first", "<addr>", "First address to probe");
+    i2cdetect_args.last = arg_int0(NULL, "last", "<addr>", "Last address to probe");
+    i2cdetect_args.all = arg_lit0("a", "all", "Also probe the reserved addresses");
+    i2cdetect_args.rescan = arg_lit0("r", "rescan", "Ignore the cached result");
+    i2cdetect_args.ports = arg_lit0("p", "ports", "Scan all installed I2C ports in parallel");
+    i2cdetect_args.bus = arg_int0(NULL, "bus", "<port>", "Bus to scan (default 0)");
+    i2cdetect_args.end = arg_end(2);
     const esp_console_cmd_t i2cdetect_cmd = {
         .command = "i2cdetect",
         .help = "Scan I2C bus for devices",
         .hint = NULL,
         .func = &do_i2cdetect_cmd,
-        .argtable = NULL};
-    ESP_ERROR_CHECK(esp_console_cmd_register(&i2cdetect_cmd));
+        .argtable = &i2cdetect_args};
+    ESP_ERROR_CHECK(register_cmd(&i2cdetect_cmd));
 }
 
 static struct
@@ -180,6 +421,7 @@ static struct
     struct arg_int *chip_address;
     struct arg_int *register_address;
     struct arg_int *data_length;
+    struct arg_int *bus;
     struct arg_end *end;
 } i2cget_args;
 
@@ -206,20 +448,16 @@ static int do_i2cget_cmd(int argc, char **argv)
     {
         len = i2cget_args.data_length->ival[0];
     }
-    uint8_t *data = malloc(len);
-
-    i2c_device_config_t i2c_dev_conf = {
-        .scl_speed_hz = i2c_frequency,
-        .device_address = chip_addr,
-    };
-
+    i2c_master_bus_handle_t bus = get_bus(i2cget_args.bus);
     i2c_master_dev_handle_t dev_handle;
-    if (i2c_master_bus_add_device(tool_bus_handle, &i2c_dev_conf, &dev_handle) != ESP_OK)
+    if (bus == NULL || i2c_bus_get_device(bus, chip_addr, i2c_frequency, &dev_handle) != ESP_OK)
     {
         return 1;
     }
 
-    esp_err_t ret = i2c_master_transmit_receive(dev_handle, (uint8_t *)&data_addr, 1, data, len, I2C_TOOL_TIMEOUT_VALUE_MS);
+    uint8_t *data = malloc(len);
+
+    esp_err_t ret = i2c_sched_transmit_receive(dev_handle, I2C_SCHED_PRIO_NORMAL, (uint8_t *)&data_addr, 1, data, len, I2C_TOOL_TIMEOUT_VALUE_MS);
     if (ret == ESP_OK)
     {
         for (int i = 0; i < len; i++)
@@ -244,10 +482,6 @@ static int do_i2cget_cmd(int argc, char **argv)
         ESP_LOGW(TAG, "Read failed");
     }
     free(data);
-    if (i2c_master_bus_rm_device(dev_handle) != ESP_OK)
-    {
-        return 1;
-    }
     return 0;
 }
 
@@ -256,6 +490,7 @@ static void register_i2cget(void)
     i2cget_args.chip_address = arg_int1("c", "chip", "<chip_addr>", "Specify the address of the chip on that bus");
     i2cget_args.register_address = arg_int0("r", "register", "<register_addr>", "Specify the address on that chip to read from");
     i2cget_args.data_length = arg_int0("l", "length", "<length>", "Specify the length to read from that data address");
+    i2cget_args.bus = arg_int0(NULL, "bus", "<port>", "Bus the chip is on (default 0)");
     i2cget_args.end = arg_end(1);
     const esp_console_cmd_t i2cget_cmd = {
         .command = "i2cget",
@@ -263,7 +498,7 @@ static void register_i2cget(void)
         .hint = NULL,
         .func = &do_i2cget_cmd,
         .argtable = &i2cget_args};
-    ESP_ERROR_CHECK(esp_console_cmd_register(&i2cget_cmd));
+    ESP_ERROR_CHECK(register_cmd(&i2cget_cmd));
 }
 
 static struct
@@ -271,6 +506,7 @@ static struct
     struct arg_int *chip_address;
     struct arg_int *register_address;
     struct arg_int *data;
+    struct arg_int *bus;
     struct arg_end *end;
 } i2cset_args;
 
@@ -294,12 +530,9 @@ static int do_i2cset_cmd(int argc, char **argv)
     /* Check data: "-d" option */
     int len = i2cset_args.data->count;
 
-    i2c_device_config_t i2c_dev_conf = {
-        .scl_speed_hz = i2c_frequency,
-        .device_address = chip_addr,
-    };
+    i2c_master_bus_handle_t bus = get_bus(i2cset_args.bus);
     i2c_master_dev_handle_t dev_handle;
-    if (i2c_master_bus_add_device(tool_bus_handle, &i2c_dev_conf, &dev_handle) != ESP_OK)
+    if (bus == NULL || i2c_bus_get_device(bus, chip_addr, i2c_frequency, &dev_handle) != ESP_OK)
     {
         return 1;
     }
@@ -310,7 +543,7 @@ static int do_i2cset_cmd(int argc, char **argv)
     {
         data[i + 1] = i2cset_args.data->ival[i];
     }
-    esp_err_t ret = i2c_master_transmit(dev_handle, data, len + 1, I2C_TOOL_TIMEOUT_VALUE_MS);
+    esp_err_t ret = i2c_sched_transmit(dev_handle, I2C_SCHED_PRIO_NORMAL, data, len + 1, I2C_TOOL_TIMEOUT_VALUE_MS);
     if (ret == ESP_OK)
     {
         ESP_LOGI(TAG, "Write OK");
@@ -325,10 +558,6 @@ static int do_i2cset_cmd(int argc, char **argv)
     }
 
     free(data);
-    if (i2c_master_bus_rm_device(dev_handle) != ESP_OK)
-    {
-        return 1;
-    }
     return 0;
 }
 
@@ -337,6 +566,7 @@ static void register_i2cset(void)
     i2cset_args.chip_address = arg_int1("c", "chip", "<chip_addr>", "Specify the address of the chip on that bus");
     i2cset_args.register_address = arg_int0("r", "register", "<register_addr>", "Specify the address on that chip to read from");
     i2cset_args.data = arg_intn(NULL, NULL, "<data>", 0, 256, "Specify the data to write to that data address");
+    i2cset_args.bus = arg_int0(NULL, "bus", "<port>", "Bus the chip is on (default 0)");
     i2cset_args.end = arg_end(2);
     const esp_console_cmd_t i2cset_cmd = {
         .command = "i2cset",
@@ -344,13 +574,21 @@ static void register_i2cset(void)
         .hint = NULL,
         .func = &do_i2cset_cmd,
         .argtable = &i2cset_args};
-    ESP_ERROR_CHECK(esp_console_cmd_register(&i2cset_cmd));
+    ESP_ERROR_CHECK(register_cmd(&i2cset_cmd));
 }
 
 static struct
 {
     struct arg_int *chip_address;
     struct arg_int *size;
+    struct arg_int *width;
+    struct arg_int *start;
+    struct arg_int *length;
+    struct arg_int *burst;
+    struct arg_int *chunk;
+    struct arg_lit *no_autoinc;
+    struct arg_lit *recheck;
+    struct arg_int *bus;
     struct arg_end *end;
 } i2cdump_args;
 
@@ -365,91 +603,90 @@ static int do_i2cdump_cmd(int argc, char **argv)
 
     /* Check chip address: "-c" option */
     int chip_addr = i2cdump_args.chip_address->ival[0];
+    i2c_dump_config_t config = {
+        .device_address = chip_addr,
+        .reg_addr_len = 1,
+        .start = 0,
+        .length = 256,
+        .burst = I2C_DUMP_MAX_BURST,
+        .chunk_size = I2C_DUMP_DEFAULT_CHUNK,
+        .access_size = 1,
+        .no_autoinc = i2cdump_args.no_autoinc->count > 0,
+        .timeout_ms = I2C_TOOL_TIMEOUT_VALUE_MS,
+    };
     /* Check read size: "-s" option */
-    int size = 1;
     if (i2cdump_args.size->count)
     {
-        size = i2cdump_args.size->ival[0];
+        config.access_size = i2cdump_args.size->ival[0];
     }
-    if (size != 1 && size != 2 && size != 4)
+    if (config.access_size != 1 && config.access_size != 2 && config.access_size != 4)
     {
         ESP_LOGE(TAG, "Wrong read size. Only support 1,2,4");
         return 1;
     }
-
-    i2c_device_config_t i2c_dev_conf = {
-        .scl_speed_hz = i2c_frequency,
-        .device_address = chip_addr,
-    };
-    i2c_master_dev_handle_t dev_handle;
-    if (i2c_master_bus_add_device(tool_bus_handle, &i2c_dev_conf, &dev_handle) != ESP_OK)
+    /* Register address width: "-w" option */
+    if (i2cdump_args.width->count)
+    {
+        config.reg_addr_len = i2cdump_args.width->ival[0];
+    }
+    if (i2cdump_args.start->count)
+    {
+        config.start = i2cdump_args.start->ival[0];
+    }
+    if (i2cdump_args.length->count)
+    {
+        config.length = i2cdump_args.length->ival[0];
+    }
+    if (i2cdump_args.burst->count)
     {
+        config.burst = i2cdump_args.burst->ival[0];
+    }
+    if (i2cdump_args.chunk->count)
+    {
+        config.chunk_size = i2cdump_args.chunk->ival[0];
+    }
+    uint32_t space = (config.reg_addr_len == 2) ? I2C_DUMP_MAX_LENGTH : 256;
+    if ((config.reg_addr_len != 1 && config.reg_addr_len != 2) || config.start >= space ||
+        config.length == 0 || config.length > space - config.start ||
+        config.burst < 1 || config.burst > I2C_DUMP_MAX_BURST ||
+        config.chunk_size < 1 || config.chunk_size > I2C_DUMP_MAX_BURST)
+    {
+        ESP_LOGE(TAG, "Invalid width (1|2), range, burst or chunk size (1..%d)", I2C_DUMP_MAX_BURST);
         return 1;
     }
-
-    uint8_t data_addr;
-    uint8_t data[4];
-    int32_t block[16];
-    printf("     0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f"
-           "    0123456789abcdef\r\n");
-    for (int i = 0; i < 128; i += 16)
+    if (i2cdump_args.recheck->count)
     {
-        printf("%02x: ", i);
-        for (int j = 0; j < 16; j += size)
-        {
-            fflush(stdout);
-            data_addr = i + j;
-            esp_err_t ret = i2c_master_transmit_receive(dev_handle, &data_addr, 1, data, size, I2C_TOOL_TIMEOUT_VALUE_MS);
-            if (ret == ESP_OK)
-            {
-                for (int k = 0; k < size; k++)
-                {
-                    printf("%02x ", data[k]);
-                    block[j + k] = data[k];
-                }
-            }
-            else
-            {
-                for (int k = 0; k < size; k++)
-                {
-                    printf("XX ");
-                    block[j + k] = -1;
-                }
-            }
-        }
-        printf("   ");
-        for (int k = 0; k < 16; k++)
-        {
-            if (block[k] < 0)
-            {
-                printf("X");
-            }
-            if ((block[k] & 0xff) == 0x00 || (block[k] & 0xff) == 0xff)
-            {
-                printf(".");
-            }
-            else if ((block[k] & 0xff) < 32 || (block[k] & 0xff) >= 127)
-            {
-                printf("?");
-            }
-            else
-            {
-                printf("%c", (char)(block[k] & 0xff));
-            }
-        }
-        printf("\r\n");
+        i2c_dump_forget(chip_addr & 0x7f);
     }
-    if (i2c_master_bus_rm_device(dev_handle) != ESP_OK)
+
+    i2c_master_bus_handle_t bus = get_bus(i2cdump_args.bus);
+    i2c_master_dev_handle_t dev_handle;
+    if (bus == NULL || i2c_bus_get_device(bus, chip_addr, i2c_frequency, &dev_handle) != ESP_OK)
     {
         return 1;
     }
+
+    i2c_dump_stats_t stats;
+    int64_t start_us = esp_timer_get_time();
+    i2c_dump(dev_handle, &config, stdout, &stats);
+    printf("%" PRIu32 " transactions%s, %" PRIu32 " bytes failed, %" PRId64 " us\r\n",
+           stats.transactions, stats.fallback ? " (per-register)" : "", stats.failed,
+           esp_timer_get_time() - start_us);
     return 0;
 }
 
 static void register_i2cdump(void)
 {
     i2cdump_args.chip_address = arg_int1("c", "chip", "<chip_addr>", "Specify the address of the chip on that bus");
-    i2cdump_args.size = arg_int0("s", "size", "<size>", "Specify the size of each read");
+    i2cdump_args.size = arg_int0("s", "size", "<size>", "Specify the size of each read (per-register mode)");
+    i2cdump_args.width = arg_int0("w", "width", "<1|2>", "Register address width in bytes (2 for EEPROMs)");
+    i2cdump_args.start = arg_int0(NULL, "start", "<reg>", "First register to dump (default 0)");
+    i2cdump_args.length = arg_int0("n", "length", "<bytes>", "Number of bytes to dump (default 256)");
+    i2cdump_args.burst = arg_int0("b", "burst", "<bytes>", "Bytes per auto-increment read (default 256)");
+    i2cdump_args.chunk = arg_int0("k", "chunk", "<bytes>", "Bytes per bus transaction of a burst (default 32)");
+    i2cdump_args.no_autoinc = arg_lit0(NULL, "no-autoinc", "Read register by register");
+    i2cdump_args.recheck = arg_lit0(NULL, "recheck", "Check again whether the chip auto-increments");
+    i2cdump_args.bus = arg_int0(NULL, "bus", "<port>", "Bus the chip is on (default 0)");
     i2cdump_args.end = arg_end(1);
     const esp_console_cmd_t i2cdump_cmd = {
         .command = "i2cdump",
@@ -457,7 +694,7 @@ static void register_i2cdump(void)
         .hint = NULL,
         .func = &do_i2cdump_cmd,
         .argtable = &i2cdump_args};
-    ESP_ERROR_CHECK(esp_console_cmd_register(&i2cdump_cmd));
+    ESP_ERROR_CHECK(register_cmd(&i2cdump_cmd));
 }
 
 static struct
@@ -467,6 +704,103 @@ static struct
     struct arg_end *end;
 } dacset_args;
 
+// The DAC and relay contexts below belong to the commands that hold this lock. After a
+// bus recovery the monitor restores them on the scheduler task only when the lock is free;
+// otherwise the command that has them does it when it is done (outputs_unlock).
+static SemaphoreHandle_t s_outputs_lock;
+static StaticSemaphore_t s_outputs_lock_buf;
+static portMUX_TYPE s_outputs_mux = portMUX_INITIALIZER_UNLOCKED;
+static atomic_uint s_restore_ports; // Bit per port recovered while the contexts were in use
+
+static void restore_outputs(int port);
+
+static bool outputs_lock(TickType_t wait)
+{
+    if (s_outputs_lock == NULL)
+    {
+        portENTER_CRITICAL(&s_outputs_mux);
+        if (s_outputs_lock == NULL)
+        {
+            s_outputs_lock = xSemaphoreCreateMutexStatic(&s_outputs_lock_buf);
+        }
+        portEXIT_CRITICAL(&s_outputs_mux);
+    }
+    return xSemaphoreTake(s_outputs_lock, wait) == pdTRUE;
+}
+
+// Restore what was recovered meanwhile, then release the contexts
+static void outputs_unlock(void)
+{
+    do
+    {
+        unsigned ports = atomic_exchange(&s_restore_ports, 0);
+        for (int port = 0; port < I2C_TOOL_MAX_BUSES; port++)
+        {
+            if (ports & (1u << port))
+            {
+                restore_outputs(port);
+            }
+        }
+        xSemaphoreGive(s_outputs_lock);
+        // a recovery after the exchange found the lock taken and left its port behind
+    } while (atomic_load(&s_restore_ports) != 0 && outputs_lock(0));
+}
+
+// Run a command that uses the DAC or relay context; an output command is a heartbeat too
+static int with_outputs(int (*cmd)(int argc, char **argv), int argc, char **argv)
+{
+    failsafe_feed();
+    outputs_lock(portMAX_DELAY);
+    int ret = cmd(argc, argv);
+    outputs_unlock();
+    return ret;
+}
+
+// DAC context, kept between commands and rebuilt when i2cconfig replaced the bus or
+// the DAC was assigned to another bus
+static gp8413_handle_t *s_dac = NULL;
+static uint32_t s_dac_generation;
+
+static gp8413_handle_t *get_dac(void)
+{
+    uint32_t voltage_ch0 = 0;
+    uint32_t voltage_ch1 = 0;
+    i2c_master_bus_handle_t bus = tool_bus_handles[s_dev_bus[TOOL_DEV_DAC]];
+
+    if (s_dac != NULL && (s_dac_generation != i2c_bus_generation() || s_dac->bus_handle != bus))
+    {
+        // bus was rebuilt or changed, restore the last known outputs on the new bus
+        voltage_ch0 = s_dac->current_voltage_ch0;
+        voltage_ch1 = s_dac->current_voltage_ch1;
+        gp8413_deinit(&s_dac);
+    }
+
+    if (s_dac == NULL)
+    {
+        gp8413_config_t config = {
+            .bus_handle = bus,
+            .device_addr = GP8413_I2C_ADDRESS,
+            .output_range = GP8413_OUTPUT_RANGE_10V,
+            .channel0 = {.voltage = voltage_ch0, .enable = true},
+            .channel1 = {.voltage = voltage_ch1, .enable = true}};
+
+        s_dac = gp8413_init(&config);
+        s_dac_generation = i2c_bus_generation();
+    }
+    return s_dac;
+}
+
+// While 'ctrl' runs the loop owns the DAC and relay contexts; setpoints go through 'act'
+static bool outputs_owned_by_loop(void)
+{
+    if (control_exec_running())
+    {
+        printf("the control loop drives the outputs, use 'act' or 'ctrl -x'\n");
+        return true;
+    }
+    return false;
+}
+
 static int do_dacset_cmd(int argc, char **argv)
 {
     int nerrors = arg_parse(argc, argv, (void **)&dacset_args);
@@ -476,77 +810,58 @@ static int do_dacset_cmd(int argc, char **argv)
         return 0;
     }
 
-    gp8413_config_t config = {
-        .bus_handle = tool_bus_handle,
-        .device_addr = GP8413_I2C_ADDRESS,
-        .output_range = GP8413_OUTPUT_RANGE_10V,
-        .channel0 = {
-            .voltage = 0,
-            .enable = false},
-        .channel1 = {.voltage = 0, .enable = false}};
-
-    // if (dacset_args.ch0_val->count == 0 && dacset_args.ch1_val->count == 0)
-    // {
-    //     ESP_LOGE(TAG, "No output value specified for channel 0 or channel 1");
-    //     return 1;
-    // }
-    //
-    if (dacset_args.ch0_val->count == 1)
-    {
-        config.channel0.voltage = dacset_args.ch0_val->ival[0];
-        config.channel0.enable = true;
-    }
-    else if (dacset_args.ch1_val->count == 1)
+    if (outputs_owned_by_loop())
     {
-        config.channel1.voltage = dacset_args.ch1_val->ival[0];
-        config.channel1.enable = true;
+        return 0;
     }
 
-    if (config.channel0.voltage > 10000 || config.channel1.voltage > 10000)
+    bool set_ch0 = dacset_args.ch0_val->count == 1;
+    bool set_ch1 = dacset_args.ch1_val->count == 1;
+    int ch0_val = set_ch0 ? dacset_args.ch0_val->ival[0] : 0;
+    int ch1_val = set_ch1 ? dacset_args.ch1_val->ival[0] : 0;
+
+    if (ch0_val < 0 || ch0_val > 10000 || ch1_val < 0 || ch1_val > 10000)
     {
         ESP_LOGE(TAG, "Output voltage must be between 0 and 10000 mV");
         return 1;
     }
 
-    ESP_LOGI(TAG, "Initializing DAC with parameters: "
-                  "Device Address: 0x%02x, "
-                  "Output Range: %d mV, "
-                  "Channel Type: %d, "
-                  "Channel 0 Voltage: %d mV, "
-                  "Channel 1 Voltage: %d mV",
-             config.device_addr,
-             config.output_range,
-             config.channel0.voltage,
-             config.channel1.voltage);
-
-    gp8413_handle_t *dac = gp8413_init(&config);
+    gp8413_handle_t *dac = get_dac();
     if (dac == NULL)
     {
         ESP_LOGE(TAG, "Failed to initialize DAC");
         return 1;
     }
-    // ESP_LOGI(TAG, "DAC initialized successfully");
-    // esp_err_t ret = gp8413_set_output_voltage(dac, ch0_val, 0);
-    // if (ret != ESP_OK)
-    // {
-    //     ESP_LOGE(TAG, "Failed to set output voltage for channel 0: %s", esp_err_to_name(ret));
-    //     gp8413_deinit(&dac);
-    //     return 1;
-    // }
-    // ret = gp8413_set_output_voltage(dac, ch1_val, 1);
-    // if (ret != ESP_OK)
-    // {
-    //     ESP_LOGE(TAG, "Failed to set output voltage for channel 1: %s", esp_err_to_name(ret));
-    //     gp8413_deinit(&dac);
-    //     return 1;
-    // }
-    ESP_LOGI(TAG, "Output voltage set successfully");
-    // ESP_LOGI(TAG, "Setting output voltage to %d mV on channel 0", ch0_val);
-    // ESP_LOGI(TAG, "Setting output voltage to %d mV on channel 1", ch1_val);
-    gp8413_deinit(&dac);
+
+    esp_err_t ret = ESP_OK;
+    if (set_ch0 && set_ch1)
+    {
+        ret = gp8413_set_output_voltage_dual(dac, ch0_val, ch1_val);
+    }
+    else if (set_ch0)
+    {
+        ret = gp8413_set_output_voltage(dac, ch0_val, 0);
+    }
+    else if (set_ch1)
+    {
+        ret = gp8413_set_output_voltage(dac, ch1_val, 1);
+    }
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to set output voltage: %s", esp_err_to_name(ret));
+        return 1;
+    }
+    ESP_LOGI(TAG, "Output voltage set successfully, ch0 %" PRIu32 " mV, ch1 %" PRIu32 " mV",
+             dac->current_voltage_ch0, dac->current_voltage_ch1);
     return 0;
 }
 
+static int do_dacset_locked(int argc, char **argv)
+{
+    return with_outputs(do_dacset_cmd, argc, argv);
+}
+
 static void register_dac_set(void)
 {
     dacset_args.ch0_val = arg_int0("s", "ch0", "<ch0 speed in mv>", "Output value for channel 0 in millivolts");
@@ -556,17 +871,69 @@ static void register_dac_set(void)
         .command = "dac_set_output",
         .help = "Set value of DAC output",
         .hint = NULL,
-        .func = &do_dacset_cmd,
+        .func = &do_dacset_locked,
         .argtable = &dacset_args};
-    ESP_ERROR_CHECK(esp_console_cmd_register(&dacset_cmd));
+    ESP_ERROR_CHECK(register_cmd(&dacset_cmd));
 }
 
 static struct
 {
     struct arg_int *ch0_val;
+    struct arg_str *text;
     struct arg_end *end;
 } ssdset_args;
 
+// Display context, kept between commands and rebuilt when i2cconfig replaced the bus or
+// the display was assigned to another bus
+static ssd1306_handle_t s_display;
+static uint32_t s_display_generation;
+
+static ssd1306_handle_t *get_display(void)
+{
+    i2c_master_bus_handle_t bus = tool_bus_handles[s_dev_bus[TOOL_DEV_DISPLAY]];
+    if (s_display.dev_handle != NULL && s_display_generation == i2c_bus_generation() && s_display.bus_handle == bus)
+    {
+        return &s_display; // already initialized on the current bus
+    }
+    if (bus == NULL)
+    {
+        ESP_LOGE(TAG, "Display bus %d is not configured", s_dev_bus[TOOL_DEV_DISPLAY]);
+        return NULL;
+    }
+
+    s_display.bus_handle = bus;
+    s_display.device_address = SSD1306_I2C_ADDRESS;
+    s_display.scl_speed_hz = i2c_frequency;
+    s_display.external_vcc = 0; // Set to 1 if using external VCC
+    s_display.dev_handle = NULL;
+    s_display_generation = i2c_bus_generation();
+
+    ssd1306_init(&s_display, 128, 64, 0); // Initialize the SSD1306 display
+    if (s_display.dev_handle == NULL)
+    {
+        return NULL;
+    }
+    ESP_LOGI(TAG, "SSD1306 display initialized successfully");
+    return &s_display;
+}
+
+// While 'scope' or 'status' runs it owns the display: both keep what is on the panel in the
+// buffer and flush only parts of it
+static bool display_owned(void)
+{
+    if (oled_scope_running())
+    {
+        printf("the scope draws on the display, stop it with 'scope -x'\n");
+        return true;
+    }
+    if (s_status_running)
+    {
+        printf("the status screen draws on the display, stop it with 'status -x'\n");
+        return true;
+    }
+    return false;
+}
+
 static int do_ssd1306_cmd(int argc, char **argv)
 {
     int nerrors = arg_parse(argc, argv, (void **)&ssdset_args);
@@ -576,53 +943,54 @@ static int do_ssd1306_cmd(int argc, char **argv)
         return 0;
     }
 
+    if (display_owned())
+    {
+        return 0;
+    }
     uint32_t ch0_val = ssdset_args.ch0_val->ival[0];
     ESP_LOGI(TAG, "Setting SSD1306 display text to: %d", ch0_val);
 
-    ssd1306_handle_t dev = {
-        .bus_handle = tool_bus_handle,
-        // Assuming tool_bus_handle is already initialized and points to the I2C bus
-        .device_address = SSD1306_I2C_ADDRESS,
-        .scl_speed_hz = i2c_frequency,
-        .external_vcc = 0, // Set to 1 if using external VCC
-        .width = 128,
-        .height = 64,
-        .pages = 8,         // For a 128x64 display, there are 8 pages
-        .dev_handle = NULL, // This will be set when the device is initialized
-        .buffer = {0},      // clear the buffer
-    };
-
-    ssd1306_init(&dev, 128, 64, 0); // Initialize the SSD1306 display
-    if (dev.dev_handle == NULL)
+    ssd1306_handle_t *dev = get_display();
+    if (dev == NULL)
     {
         ESP_LOGE(TAG, "Failed to initialize SSD1306 display");
         return 1;
     }
-    ESP_LOGI(TAG, "SSD1306 display initialized successfully");
-    // Fill the display with white color (1)
+
+    if (ssdset_args.text->count)
+    {
+        // UTF-8 in the proportional font, centred when it fits
+        const char *text = ssdset_args.text->sval[0];
+        uint16_t width = ssd1306_text_width(&ssd1306_font_sans8, text);
+        ssd1306_fill(dev, 0x00);
+        ssd1306_print(dev, &ssd1306_font_sans8, width < dev->width ? (dev->width - width) / 2 : 0, 24, 1, text);
+        ssd1306_show(dev);
+        printf("%u pixels wide (%u in the 6x8 font)%s\r\n", width, ssd1306_text_width(&ssd1306_font_6x8, text),
+               width > dev->width ? ", cut off" : "");
+        return 0;
+    }
 
     char buf[16];
     snprintf(buf, sizeof(buf), "Value: %ld", ch0_val);
-    ssd1306_printFixed16(&dev, 0, 0, 1, buf); // Draw the string at (0, 0) with white color
-    ssd1306_show(&dev);                       // Show the drawn string on the display
+    ssd1306_fill(dev, 0x00);                 // clear the previous text
+    ssd1306_printFixed16(dev, 0, 0, 1, buf); // Draw the string at (0, 0) with white color
+    ssd1306_show(dev);                       // Show the drawn string on the display
     ESP_LOGI(TAG, "SSD1306 display updated with text: %s", buf);
-
-    ssd1306_deinit(&dev); // Deinitialize the display after use
-    ESP_LOGI(TAG, "SSD1306 display deinitialized successfully");
     return 0;
 }
 
 static void register_ssd1306(void)
 {
     ssdset_args.ch0_val = arg_int0("s", "txt", "display integer", "some value");
-    ssdset_args.end = arg_end(2);
+    ssdset_args.text = arg_str0("t", "text", "<utf8>", "Text in the proportional font, Latin-1 and the euro sign");
+    ssdset_args.end = arg_end(3);
     const esp_console_cmd_t ssdset_cmd = {
         .command = "ssd1306",
         .help = "Set text",
         .hint = NULL,
         .func = &do_ssd1306_cmd,
         .argtable = &ssdset_args};
-    ESP_ERROR_CHECK(esp_console_cmd_register(&ssdset_cmd));
+    ESP_ERROR_CHECK(register_cmd(&ssdset_cmd));
 }
 
 // m54r_console.c
@@ -651,6 +1019,39 @@ static struct
 ////////////////////////////////////////////////////////////////////////////////
 // Commandofunctie
 ////////////////////////////////////////////////////////////////////////////////
+// Relay-context, blijft bestaan tussen commando's en wordt opnieuw opgebouwd als
+// i2cconfig de bus heeft vervangen of het board aan een andere bus is toegewezen
+static m54_ctx_t s_relay;
+static uint32_t s_relay_generation;
+
+static m54_ctx_t *get_relay(void)
+{
+    i2c_master_bus_handle_t bus = tool_bus_handles[s_dev_bus[TOOL_DEV_RELAY]];
+    if (s_relay.initialized && s_relay_generation == i2c_bus_generation() && s_relay.bus_handle == bus)
+    {
+        return &s_relay; // al geïnitialiseerd op de huidige bus
+    }
+    if (s_relay.initialized)
+    {
+        m54_deinit(&s_relay); // oude bus-handle is niet meer geldig
+    }
+
+    s_relay.device_address = M54R_ADDR;
+    s_relay.bus_handle = bus; // I2C-bus uit de bus-tabel
+    s_relay.dev_handle = NULL;            // Wordt ingesteld in m54_init
+    s_relay.scl_speed_hz = i2c_frequency;
+    s_relay_generation = i2c_bus_generation();
+
+    esp_err_t err = m54_init(&s_relay);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "m54r_init mislukt: %s", esp_err_to_name(err));
+        m54_deinit(&s_relay); // volgende keer opnieuw proberen
+        return NULL;
+    }
+    return &s_relay;
+}
+
 static int do_m54r_cmd(int argc, char **argv)
 {
     int nerrors = arg_parse(argc, argv, (void **)&m54r_args);
@@ -660,24 +1061,18 @@ static int do_m54r_cmd(int argc, char **argv)
         return 0;
     }
 
-    // Maak en initialiseer device-handle
-    // de scope is de stack, dus we moeten de handle niet vrijgeven
-    m54_ctx_t dev = {
-        .device_address = M54R_ADDR,
-        .bus_handle = tool_bus_handle, // Externe I2C-bus-handle
-        .dev_handle = NULL,            // Wordt ingesteld in m54r_init
-        .scl_speed_hz = i2c_frequency,
-        .initialized = 0,    // Initieel niet geïnitialiseerd
-        .relay_state = 0x00, // Initieel alle relays UIT
-        .led_state = 0x00,   // Initieel alle LEDs UIT
-        0};
+    if (outputs_owned_by_loop())
+    {
+        return 0;
+    }
 
-    esp_err_t err = m54_init(&dev);
-    if (err != ESP_OK)
+    // Haal de blijvende device-context op (wordt opnieuw opgebouwd na i2cconfig)
+    m54_ctx_t *dev = get_relay();
+    if (dev == NULL)
     {
-        ESP_LOGE(TAG, "m54r_init mislukt: %s", esp_err_to_name(err));
         return 1;
     }
+    esp_err_t err;
 
     // 1) Relay Set
     if (m54r_args.relay->count && m54r_args.set->count)
@@ -690,7 +1085,7 @@ static int do_m54r_cmd(int argc, char **argv)
         }
         else
         {
-            err = m54_relay_set(&dev, (uint8_t)idx, (bool)state);
+            err = m54_relay_set(dev, (uint8_t)idx, (bool)state);
             if (err == ESP_OK)
             {
                 ESP_LOGI(TAG, "Relay %d %s", idx, state ? "AAN" : "UIT");
@@ -712,7 +1107,7 @@ static int do_m54r_cmd(int argc, char **argv)
         else
         {
             uint8_t reg_val = 0;
-            err = m54_relay_get(&dev, idx, &reg_val);
+            err = m54_relay_get(dev, idx, &reg_val);
             if (err == ESP_OK)
             {
                 bool state = (reg_val) ? true : false;
@@ -736,7 +1131,7 @@ static int do_m54r_cmd(int argc, char **argv)
         }
         else
         {
-            err = m54_led_set(&dev, (uint8_t)idx, (bool)state);
+            err = m54_led_set(dev, (uint8_t)idx, (bool)state);
             if (err == ESP_OK)
             {
                 ESP_LOGI(TAG, "LED %d %s", idx, state ? "AAN" : "UIT");
@@ -758,7 +1153,7 @@ static int do_m54r_cmd(int argc, char **argv)
         else
         {
             uint8_t reg_val = 0;
-            err = m54_led_get(&dev, idx, &reg_val);
+            err = m54_led_get(dev, idx, &reg_val);
             if (err == ESP_OK)
             {
                 bool state = (reg_val) ? true : false;
@@ -781,7 +1176,7 @@ static int do_m54r_cmd(int argc, char **argv)
         }
         else
         {
-            err = m54_mode_set(&dev, mode_val);
+            err = m54_mode_set(dev, mode_val);
             if (err == ESP_OK)
             {
                 ESP_LOGI(TAG, "Mode gezet op: %s", mode_val ? "Automatisch" : "Manueel");
@@ -793,14 +1188,17 @@ static int do_m54r_cmd(int argc, char **argv)
         }
     }
 
-    // Sluit af
-    m54_deinit(&dev);
     return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // Registratiefunctie
 ////////////////////////////////////////////////////////////////////////////////
+static int do_m54r_locked(int argc, char **argv)
+{
+    return with_outputs(do_m54r_cmd, argc, argv);
+}
+
 static void register_m54r(void)
 {
     // --relay <index>
@@ -828,9 +1226,1718 @@ static void register_m54r(void)
                 "  --led   <0-3> --get\n"
                 "  --mode  <0|1>",
         .hint = NULL,
-        .func = &do_m54r_cmd,
+        .func = &do_m54r_locked,
         .argtable = &m54r_args};
-    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+    ESP_ERROR_CHECK(register_cmd(&cmd));
+}
+
+static struct
+{
+    struct arg_lit *reset;
+    struct arg_end *end;
+} i2csched_args;
+
+static int do_i2csched_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&i2csched_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, i2csched_args.end, argv[0]);
+        return 0;
+    }
+
+    static const char *prio_names[I2C_SCHED_PRIO_MAX] = {"urgent", "normal", "bulk"};
+    printf("prio     transactions   chunks  preempt  missed  wait avg(us)  wait max(us)\r\n");
+    for (int p = 0; p < I2C_SCHED_PRIO_MAX; p++)
+    {
+        i2c_sched_stats_t st;
+        i2c_sched_get_stats(p, &st, i2csched_args.reset->count > 0);
+        uint32_t avg = st.transactions ? (uint32_t)(st.wait_total_us / st.transactions) : 0;
+        printf("%-8s %12" PRIu32 " %8" PRIu32 " %8" PRIu32 " %7" PRIu32 " %13" PRIu32 " %13" PRIu32 "\r\n",
+               prio_names[p], st.transactions, st.chunks, st.preemptions, st.deadline_misses, avg, st.wait_max_us);
+    }
+    return 0;
+}
+
+static void register_i2csched(void)
+{
+    i2csched_args.reset = arg_lit0("r", "reset", "Clear the statistics after printing");
+    i2csched_args.end = arg_end(1);
+    const esp_console_cmd_t i2csched_cmd = {
+        .command = "i2csched",
+        .help = "Show I2C scheduler queueing latency per priority",
+        .hint = NULL,
+        .func = &do_i2csched_cmd,
+        .argtable = &i2csched_args};
+    ESP_ERROR_CHECK(register_cmd(&i2csched_cmd));
+}
+
+static struct
+{
+    struct arg_str *dev;
+    struct arg_int *bus;
+    struct arg_end *end;
+} i2cbus_args;
+
+static int do_i2cbus_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&i2cbus_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, i2cbus_args.end, argv[0]);
+        return 0;
+    }
+
+    if (i2cbus_args.dev->count)
+    {
+        int dev = -1;
+        for (int i = 0; i < TOOL_DEV_MAX; i++)
+        {
+            if (strcmp(i2cbus_args.dev->sval[0], tool_dev_names[i]) == 0)
+            {
+                dev = i;
+            }
+        }
+        if (dev < 0 || !i2cbus_args.bus->count)
+        {
+            ESP_LOGE(TAG, "Use --dev <dac|relay|display> --bus <port>");
+            return 1;
+        }
+        int bus = i2cbus_args.bus->ival[0];
+        if (bus < 0 || bus >= I2C_TOOL_MAX_BUSES || tool_bus_handles[bus] == NULL)
+        {
+            ESP_LOGE(TAG, "I2C bus %d is not configured, see 'i2cconfig'", bus);
+            return 1;
+        }
+        s_dev_bus[dev] = bus; // the driver context moves on its next use
+    }
+
+    printf("bus  installed  devices\r\n");
+    for (int bus = 0; bus < I2C_TOOL_MAX_BUSES; bus++)
+    {
+        printf("%3d  %-9s ", bus, tool_bus_handles[bus] ? "yes" : "no");
+        for (int dev = 0; dev < TOOL_DEV_MAX; dev++)
+        {
+            if (s_dev_bus[dev] == bus)
+            {
+                printf(" %s", tool_dev_names[dev]);
+            }
+        }
+        printf("\r\n");
+    }
+    return 0;
+}
+
+static void register_i2cbus(void)
+{
+    i2cbus_args.dev = arg_str0(NULL, "dev", "<dac|relay|display>", "Device to move to another bus");
+    i2cbus_args.bus = arg_int0(NULL, "bus", "<port>", "Bus (I2C port) for the device");
+    i2cbus_args.end = arg_end(2);
+    const esp_console_cmd_t i2cbus_cmd = {
+        .command = "i2cbus",
+        .help = "Show the bus table, assign a device to a bus",
+        .hint = NULL,
+        .func = &do_i2cbus_cmd,
+        .argtable = &i2cbus_args};
+    ESP_ERROR_CHECK(register_cmd(&i2cbus_cmd));
+}
+
+static struct
+{
+    struct arg_int *count;
+    struct arg_end *end;
+} i2cbench_args;
+
+static volatile bool s_bench_load;
+static StaticSemaphore_t s_bench_done_buf;
+static SemaphoreHandle_t s_bench_done;
+
+// Background display traffic: full frame flushes as fast as the bus allows
+static void bench_display_task(void *arg)
+{
+    ssd1306_handle_t *display = (ssd1306_handle_t *)arg;
+    while (s_bench_load)
+    {
+        ssd1306_show_async(display); // waits for the previous frame on an asynchronous bus
+    }
+    ssd1306_wait(display, 1000);
+    xSemaphoreGive(s_bench_done);
+    vTaskDelete(NULL);
+}
+
+// DAC setpoint latency: min, average and max time of one gp8413 write in us
+static void bench_dac(gp8413_handle_t *dac, int count, uint32_t result[3])
+{
+    uint64_t total = 0;
+    uint32_t base = dac->current_voltage_ch0;
+    // toggle 1 mV, the register shadow drops writes of an unchanged value
+    uint32_t other = (base > 0) ? base - 1 : base + 1;
+    result[0] = UINT32_MAX;
+    result[2] = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int64_t start = esp_timer_get_time();
+        gp8413_set_output_voltage(dac, (i & 1) ? base : other, 0);
+        uint32_t took = (uint32_t)(esp_timer_get_time() - start);
+        total += took;
+        result[0] = (took < result[0]) ? took : result[0];
+        result[2] = (took > result[2]) ? took : result[2];
+        vTaskDelay(1); // spread the samples over the display frames
+    }
+    gp8413_set_output_voltage(dac, base, 0);
+    result[1] = (uint32_t)(total / count);
+}
+
+static int do_i2cbench_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&i2cbench_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, i2cbench_args.end, argv[0]);
+        return 0;
+    }
+
+    if (display_owned())
+    {
+        return 0;
+    }
+    int count = i2cbench_args.count->count ? i2cbench_args.count->ival[0] : 200;
+    gp8413_handle_t *dac = get_dac();
+    ssd1306_handle_t *display = get_display();
+    if (count < 1 || dac == NULL || display == NULL)
+    {
+        ESP_LOGE(TAG, "Need a DAC and a display, and a count > 0");
+        return 1;
+    }
+    if (s_bench_done == NULL)
+    {
+        s_bench_done = xSemaphoreCreateBinaryStatic(&s_bench_done_buf);
+    }
+
+    printf("Toggling DAC channel 0 between %" PRIu32 " and %" PRIu32 " mV, %d writes per measurement\r\n",
+           dac->current_voltage_ch0,
+           dac->current_voltage_ch0 > 0 ? dac->current_voltage_ch0 - 1 : dac->current_voltage_ch0 + 1, count);
+    esp_log_level_set("GP8413_SDC", ESP_LOG_WARN); // per-write logging would dominate
+    uint32_t idle[3], loaded[3];
+    bench_dac(dac, count, idle);
+
+    s_bench_load = true;
+    if (xTaskCreate(bench_display_task, "bench_disp", 3072, display, uxTaskPriorityGet(NULL), NULL) != pdPASS)
+    {
+        s_bench_load = false;
+        esp_log_level_set("GP8413_SDC", ESP_LOG_INFO);
+        ESP_LOGE(TAG, "Failed to create the display load task");
+        return 1;
+    }
+    bench_dac(dac, count, loaded);
+    s_bench_load = false;
+    xSemaphoreTake(s_bench_done, portMAX_DELAY);
+    esp_log_level_set("GP8413_SDC", ESP_LOG_INFO);
+
+    // time the caller spends in a flush: the whole transfer, or only the queueing
+    int64_t start = esp_timer_get_time();
+    ssd1306_show(display);
+    uint32_t flush_us = (uint32_t)(esp_timer_get_time() - start);
+    start = esp_timer_get_time();
+    ssd1306_show_async(display);
+    uint32_t queue_us = (uint32_t)(esp_timer_get_time() - start);
+    ssd1306_wait(display, 1000);
+    uint32_t done_us = (uint32_t)(esp_timer_get_time() - start);
+
+    printf("DAC on bus %d, display on bus %d (%s), %d writes\r\n",
+           s_dev_bus[TOOL_DEV_DAC], s_dev_bus[TOOL_DEV_DISPLAY],
+           s_dev_bus[TOOL_DEV_DAC] == s_dev_bus[TOOL_DEV_DISPLAY] ? "shared" : "separate", count);
+    printf("                  min(us)  avg(us)  max(us)\r\n");
+    printf("display idle     %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\r\n", idle[0], idle[1], idle[2]);
+    printf("display flushing %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\r\n", loaded[0], loaded[1], loaded[2]);
+    printf("display flush: blocking %" PRIu32 " us, async %" PRIu32 " us in caller (on display after %" PRIu32 " us)%s\r\n",
+           flush_us, queue_us, done_us, i2c_async_port_is_async(s_dev_bus[TOOL_DEV_DISPLAY]) ? "" : ", bus not async");
+    return 0;
+}
+
+static int do_i2cbench_locked(int argc, char **argv)
+{
+    return with_outputs(do_i2cbench_cmd, argc, argv);
+}
+
+static void register_i2cbench(void)
+{
+    i2cbench_args.count = arg_int0("n", "count", "<writes>", "DAC writes per measurement (default 200)");
+    i2cbench_args.end = arg_end(1);
+    const esp_console_cmd_t i2cbench_cmd = {
+        .command = "i2cbench",
+        .help = "Measure DAC update latency with the display idle and flushing.\n"
+                "Moves DAC channel 0 by 1 mV back and forth, then restores it",
+        .hint = NULL,
+        .func = &do_i2cbench_locked,
+        .argtable = &i2cbench_args};
+    ESP_ERROR_CHECK(register_cmd(&i2cbench_cmd));
+}
+
+static struct
+{
+    struct arg_lit *simulate;
+    struct arg_lit *now;
+    struct arg_end *end;
+} i2crecover_args;
+
+static int do_i2crecover_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&i2crecover_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, i2crecover_args.end, argv[0]);
+        return 0;
+    }
+
+    if (i2crecover_args.now->count)
+    {
+        esp_err_t err = i2c_recover_now();
+        printf("Recovery: %s\r\n", esp_err_to_name(err));
+    }
+    else if (i2crecover_args.simulate->count)
+    {
+        i2c_recover_simulate_fault();
+        printf("Simulated stuck bus, the monitor will recover it\r\n");
+        return 0;
+    }
+
+    i2c_recover_stats_t st;
+    i2c_recover_get_stats(&st);
+    printf("recoveries: %" PRIu32 ", failures: %" PRIu32 "\r\n", st.recoveries, st.failures);
+    printf("last: %s, %" PRIu32 " clocks, %" PRIu32 " us (max %" PRIu32 " us)\r\n",
+           i2c_recover_reason_name(st.last_reason), st.last_clocks, st.last_us, st.max_us);
+    if (st.bus_down)
+    {
+        printf("the bus could not be created again, 'i2crecover -n' or 'i2cconfig' to retry\r\n");
+    }
+    return 0;
+}
+
+static void register_i2crecover(void)
+{
+    i2crecover_args.simulate = arg_lit0("s", "simulate", "Simulate SDA stuck low, exercises detection and recovery");
+    i2crecover_args.now = arg_lit0("n", "now", "Recover the bus now (9 clocks + STOP, rebuild, replay)");
+    i2crecover_args.end = arg_end(2);
+    const esp_console_cmd_t i2crecover_cmd = {
+        .command = "i2crecover",
+        .help = "Show stuck-bus recovery statistics",
+        .hint = NULL,
+        .func = &do_i2crecover_cmd,
+        .argtable = &i2crecover_args};
+    ESP_ERROR_CHECK(register_cmd(&i2crecover_cmd));
+}
+
+static struct
+{
+    struct arg_str *dev;
+    struct arg_int *iterations;
+    struct arg_int *margin;
+    struct arg_int *max;
+    struct arg_lit *clear;
+    struct arg_end *end;
+} i2ctune_args;
+
+// Integrity check per device: the relay board is read back, DAC and display are write-only
+// and get a pattern without side effects (register pointer only, control byte only)
+static const uint8_t s_tune_dac_pattern[] = {0x02};
+static const uint8_t s_tune_display_pattern[] = {0x00};
+
+static void tune_one(tool_dev_t dev, const i2c_tune_config_t *config)
+{
+    i2c_master_bus_handle_t bus = tool_bus_handles[s_dev_bus[dev]];
+    i2c_tune_ack_t ack = {0};
+    i2c_tune_readback_t readback = {.reg = M54R_REG_RELAY, .len = 1};
+    i2c_tune_check_t check = i2c_tune_check_ack;
+    void *arg = &ack;
+    i2c_tune_result_t result;
+
+    if (bus == NULL)
+    {
+        printf("%s: bus %d not configured\r\n", tool_dev_names[dev], s_dev_bus[dev]);
+        return;
+    }
+    switch (dev)
+    {
+    case TOOL_DEV_RELAY:
+        check = i2c_tune_check_readback;
+        arg = &readback;
+        break;
+    case TOOL_DEV_DAC:
+        ack.data = s_tune_dac_pattern;
+        ack.len = sizeof(s_tune_dac_pattern);
+        break;
+    default:
+        ack.data = s_tune_display_pattern;
+        ack.len = sizeof(s_tune_display_pattern);
+        break;
+    }
+
+    esp_err_t err = i2c_tune_device(bus, tool_dev_addr[dev], check, arg, config, &result);
+    printf("%s (bus %d, 0x%02x), %s check\r\n", tool_dev_names[dev], s_dev_bus[dev], tool_dev_addr[dev],
+           check == i2c_tune_check_ack ? "ACK" : "readback");
+    printf("  speed(Hz)  result  best(us)\r\n");
+    for (int s = 0; s < result.n_speeds; s++)
+    {
+        if (result.failures[s])
+        {
+            printf("  %9" PRIu32 "  FAIL\r\n", result.speed_hz[s]);
+        }
+        else
+        {
+            printf("  %9" PRIu32 "  ok      %8" PRIu32 "\r\n", result.speed_hz[s], result.best_us[s]);
+        }
+    }
+    if (err == ESP_OK)
+    {
+        printf("  reliable up to %" PRIu32 " Hz, using %" PRIu32 " Hz\r\n", result.max_ok_hz, result.tuned_hz);
+    }
+    else
+    {
+        printf("  %s\r\n", err == ESP_ERR_NOT_FOUND ? "no answer, speed setting cleared" : esp_err_to_name(err));
+    }
+}
+
+static int do_i2ctune_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&i2ctune_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, i2ctune_args.end, argv[0]);
+        return 0;
+    }
+
+    int only = -1;
+    if (i2ctune_args.dev->count)
+    {
+        for (int i = 0; i < TOOL_DEV_MAX; i++)
+        {
+            if (strcmp(i2ctune_args.dev->sval[0], tool_dev_names[i]) == 0)
+            {
+                only = i;
+            }
+        }
+        if (only < 0)
+        {
+            ESP_LOGE(TAG, "Unknown device, use dac, relay or display");
+            return 1;
+        }
+    }
+
+    if (i2ctune_args.clear->count)
+    {
+        for (int dev = 0; dev < TOOL_DEV_MAX; dev++)
+        {
+            i2c_master_bus_handle_t bus = tool_bus_handles[s_dev_bus[dev]];
+            if ((only < 0 || only == dev) && bus != NULL)
+            {
+                i2c_bus_set_device_speed(bus, tool_dev_addr[dev], 0);
+                printf("%s: back to %" PRIu32 " Hz\r\n", tool_dev_names[dev], i2c_frequency);
+            }
+        }
+        return 0;
+    }
+
+    // candidates from 100 kHz up to --max
+    static const uint32_t all_speeds[] = {100000, 200000, 400000, 600000, 800000, 1000000};
+    uint32_t max = i2ctune_args.max->count ? (uint32_t)i2ctune_args.max->ival[0] : 1000000;
+    i2c_tune_config_t config = {
+        .speeds = all_speeds,
+        .iterations = i2ctune_args.iterations->count ? i2ctune_args.iterations->ival[0] : 0,
+        .margin_pct = i2ctune_args.margin->count ? i2ctune_args.margin->ival[0] : 0,
+    };
+    while (config.n_speeds < (int)(sizeof(all_speeds) / sizeof(all_speeds[0])) && all_speeds[config.n_speeds] <= max)
+    {
+        config.n_speeds++;
+    }
+    if (config.n_speeds == 0 || config.iterations < 0 || config.margin_pct >= 100)
+    {
+        ESP_LOGE(TAG, "Need --max >= 100000, -n >= 1 and -m < 100");
+        return 1;
+    }
+    if (config.margin_pct == 0 && i2ctune_args.margin->count)
+    {
+        config.margin_pct = -1; // explicit 0: no margin
+    }
+
+    for (int dev = 0; dev < TOOL_DEV_MAX; dev++)
+    {
+        if (only < 0 || only == dev)
+        {
+            tune_one(dev, &config);
+        }
+    }
+    // drivers pick up the new speed through the registry generation; the display is
+    // initialised again on its next use
+    return 0;
+}
+
+static void register_i2ctune(void)
+{
+    i2ctune_args.dev = arg_str0(NULL, "dev", "<dac|relay|display>", "Tune one device (default all)");
+    i2ctune_args.iterations = arg_int0("n", "iterations", "<n>", "Checks per speed (default 32)");
+    i2ctune_args.margin = arg_int0("m", "margin", "<percent>", "Safety margin below the highest passing speed (default 20)");
+    i2ctune_args.max = arg_int0(NULL, "max", "<Hz>", "Highest speed to try (default 1000000)");
+    i2ctune_args.clear = arg_lit0("c", "clear", "Forget the tuned speed");
+    i2ctune_args.end = arg_end(5);
+    const esp_console_cmd_t i2ctune_cmd = {
+        .command = "i2ctune",
+        .help = "Find the highest reliable SCL speed per device and use it",
+        .hint = NULL,
+        .func = &do_i2ctune_cmd,
+        .argtable = &i2ctune_args};
+    ESP_ERROR_CHECK(register_cmd(&i2ctune_cmd));
+}
+
+static struct
+{
+    struct arg_str *script;
+    struct arg_str *file;
+    struct arg_int *repeat;
+    struct arg_lit *quiet;
+    struct arg_lit *stop;
+    struct arg_end *end;
+} i2cbatch_args;
+
+#define I2C_BATCH_MAX_SCRIPT (2048)
+
+static i2c_batch_t s_batch; // ~2.5 KB, kept off the console task stack
+static char s_batch_text[I2C_BATCH_MAX_SCRIPT];
+
+static int do_i2cbatch_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&i2cbatch_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, i2cbatch_args.end, argv[0]);
+        return 0;
+    }
+
+    const char *text;
+    if (i2cbatch_args.file->count)
+    {
+        // script from the FAT partition, e.g. /data/bringup.txt
+        FILE *f = fopen(i2cbatch_args.file->sval[0], "r");
+        if (f == NULL)
+        {
+            ESP_LOGE(TAG, "Cannot open %s", i2cbatch_args.file->sval[0]);
+            return 1;
+        }
+        size_t n = fread(s_batch_text, 1, sizeof(s_batch_text) - 1, f);
+        // a file of exactly the maximum size fills the buffer without hitting EOF yet
+        bool too_long = n == sizeof(s_batch_text) - 1 && fgetc(f) != EOF;
+        bool failed = ferror(f);
+        fclose(f);
+        if (failed)
+        {
+            ESP_LOGE(TAG, "Cannot read %s", i2cbatch_args.file->sval[0]);
+            return 1;
+        }
+        if (too_long)
+        {
+            ESP_LOGE(TAG, "Script larger than %d bytes", I2C_BATCH_MAX_SCRIPT - 1);
+            return 1;
+        }
+        s_batch_text[n] = '\0';
+        text = s_batch_text;
+    }
+    else if (i2cbatch_args.script->count)
+    {
+        text = i2cbatch_args.script->sval[0];
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Give a script, e.g. i2cbatch \"w 0x59 0x01 0x11; c 0x26 0x10 = 0x01\", or -f <file>");
+        return 1;
+    }
+
+    char err[64];
+    esp_err_t ret = i2c_batch_compile(text, i2c_frequency, &s_batch, err, sizeof(err));
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Script error, %s", err);
+        return 1;
+    }
+
+    int repeat = i2cbatch_args.repeat->count ? i2cbatch_args.repeat->ival[0] : 1;
+    if (repeat < 1)
+    {
+        ESP_LOGE(TAG, "Repeat count must be at least 1");
+        return 1;
+    }
+    int runs_failed = 0;
+    for (int i = 0; i < repeat; i++)
+    {
+        ret = i2c_batch_run(&s_batch, i2cbatch_args.stop->count > 0);
+        if (ret == ESP_ERR_INVALID_STATE)
+        {
+            ESP_LOGE(TAG, "Bus was rebuilt during the run, start again");
+            return 1;
+        }
+        runs_failed += (ret != ESP_OK);
+        if (ret != ESP_OK && i2cbatch_args.stop->count)
+        {
+            break;
+        }
+    }
+    // results of the last run
+    i2c_batch_print(&s_batch, stdout, i2cbatch_args.quiet->count > 0);
+    if (repeat > 1)
+    {
+        printf("%d runs, %d failed\r\n", repeat, runs_failed);
+    }
+    return runs_failed ? 1 : 0;
+}
+
+static void register_i2cbatch(void)
+{
+    i2cbatch_args.script = arg_str0(NULL, NULL, "<script>", "Steps separated by ';': bus P | w ADDR B.. | r ADDR N [B..] | c ADDR B.. = E.. | d MS");
+    i2cbatch_args.file = arg_str0("f", "file", "<path>", "Read the script from a file, e.g. /data/bringup.txt");
+    i2cbatch_args.repeat = arg_int0("n", "repeat", "<runs>", "Run the script several times");
+    i2cbatch_args.quiet = arg_lit0("q", "quiet", "Only print the summary");
+    i2cbatch_args.stop = arg_lit0("s", "stop", "Stop at the first failing step");
+    i2cbatch_args.end = arg_end(5);
+    const esp_console_cmd_t i2cbatch_cmd = {
+        .command = "i2cbatch",
+        .help = "Run an I2C transaction script (writes, reads, checks, delays) back to back",
+        .hint = NULL,
+        .func = &do_i2cbatch_cmd,
+        .argtable = &i2cbatch_args};
+    ESP_ERROR_CHECK(register_cmd(&i2cbatch_cmd));
+}
+
+static struct
+{
+    struct arg_lit *reset;
+    struct arg_lit *export;
+    struct arg_end *end;
+} i2cstats_args;
+
+static int do_i2cstats_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&i2cstats_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, i2cstats_args.end, argv[0]);
+        return 0;
+    }
+
+    if (i2cstats_args.export->count)
+    {
+        // binary snapshot as one hex line, for host side tooling
+        static uint8_t buf[I2C_STATS_EXPORT_MAX_SIZE];
+        size_t len = i2c_stats_export(buf, sizeof(buf));
+        for (size_t i = 0; i < len; i++)
+        {
+            printf("%02x", buf[i]);
+        }
+        printf("\r\n");
+    }
+    else
+    {
+        static i2c_stats_dev_t devs[I2C_STATS_MAX_DEVICES];
+        int n = i2c_stats_get_all(devs);
+        printf("port addr  transactions     bytes   nacks  timeouts  errors  busy(ms)\r\n");
+        for (int i = 0; i < n; i++)
+        {
+            const i2c_stats_dev_t *d = &devs[i];
+            printf("%4d 0x%02x  %12" PRIu32 " %9" PRIu32 " %7" PRIu32 " %9" PRIu32 " %7" PRIu32 " %9" PRIu32 "\r\n",
+                   d->port, d->device_address, d->transactions, d->bytes, d->nacks, d->timeouts, d->errors,
+                   d->busy_us / 1000);
+            printf("           latency:");
+            for (int b = 0; b < I2C_STATS_HIST_BUCKETS; b++)
+            {
+                if (d->hist[b])
+                {
+                    printf(" <%" PRIu32 "us:%" PRIu32, (uint32_t)2 << b, d->hist[b]);
+                }
+            }
+            printf("\r\n");
+        }
+        for (int port = 0; port < I2C_STATS_MAX_PORTS; port++)
+        {
+            uint32_t util = i2c_stats_utilisation_permille(port);
+            printf("bus %d utilisation (last %d ms): %" PRIu32 ".%" PRIu32 "%%\r\n", port,
+                   I2C_STATS_WINDOW_SLOTS * I2C_STATS_SLOT_US / 1000, util / 10, util % 10);
+        }
+    }
+
+    if (i2cstats_args.reset->count)
+    {
+        i2c_stats_reset();
+    }
+    return 0;
+}
+
+static void register_i2cstats(void)
+{
+    i2cstats_args.reset = arg_lit0("r", "reset", "Clear the counters after printing");
+    i2cstats_args.export = arg_lit0("x", "export", "Print a binary snapshot as hex");
+    i2cstats_args.end = arg_end(2);
+    const esp_console_cmd_t i2cstats_cmd = {
+        .command = "i2cstats",
+        .help = "Show per-device I2C latency histograms, error counters and the utilisation of each bus",
+        .hint = NULL,
+        .func = &do_i2cstats_cmd,
+        .argtable = &i2cstats_args};
+    ESP_ERROR_CHECK(register_cmd(&i2cstats_cmd));
+}
+
+// Device table of the boot inventory, published through i2c_inventory. Identity checks:
+// the DAC and the display are write-only and must ACK a register pointer / control byte,
+// the relay board must return a mode register with only bit0 in use.
+static i2c_inventory_device_t s_inventory[TOOL_DEV_MAX] = {
+    [TOOL_DEV_DAC] = {.name = "dac", .device_address = GP8413_I2C_ADDRESS, .id_write = {0x02}, .id_write_len = 1},
+    [TOOL_DEV_RELAY] = {.name = "relay", .device_address = M54R_ADDR, .optional = true, .id_write = {M54R_REG_MODE},
+                        .id_write_len = 1, .id_read_len = 1, .id_mask = {0xfe}, .id_value = {0x00}},
+    [TOOL_DEV_DISPLAY] = {.name = "display", .device_address = SSD1306_I2C_ADDRESS, .optional = true,
+                          .id_write = {0x00}, .id_write_len = 1},
+};
+
+esp_err_t i2ctools_inventory(void)
+{
+    for (int dev = 0; dev < TOOL_DEV_MAX; dev++)
+    {
+        s_inventory[dev].port = s_dev_bus[dev]; // the bus can be changed with 'i2cbus'
+    }
+    return i2c_inventory_run(s_inventory, TOOL_DEV_MAX, i2c_frequency);
+}
+
+static struct
+{
+    struct arg_lit *run;
+    struct arg_end *end;
+} i2cinv_args;
+
+static int do_i2cinv_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&i2cinv_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, i2cinv_args.end, argv[0]);
+        return 0;
+    }
+    if (i2cinv_args.run->count)
+    {
+        i2ctools_inventory();
+    }
+    i2c_inventory_print(stdout);
+    return 0;
+}
+
+static void register_i2cinv(void)
+{
+    i2cinv_args.run = arg_lit0("r", "run", "Check the devices again");
+    i2cinv_args.end = arg_end(1);
+    const esp_console_cmd_t i2cinv_cmd = {
+        .command = "i2cinv",
+        .help = "Show the device inventory taken at boot (presence and identity per bus)",
+        .hint = NULL,
+        .func = &do_i2cinv_cmd,
+        .argtable = &i2cinv_args};
+    ESP_ERROR_CHECK(register_cmd(&i2cinv_cmd));
+}
+
+static int do_bootprof_cmd(int argc, char **argv)
+{
+    boot_trace_print(stdout);
+    return 0;
+}
+
+static void register_bootprof(void)
+{
+    const esp_console_cmd_t bootprof_cmd = {
+        .command = "bootprof",
+        .help = "Show the time of each boot stage (compare two captures with tools/bootprof_compare.py)",
+        .hint = NULL,
+        .func = &do_bootprof_cmd,
+        .argtable = NULL};
+    ESP_ERROR_CHECK(register_cmd(&bootprof_cmd));
+}
+
+static struct
+{
+    struct arg_lit *start;
+    struct arg_int *size;
+    struct arg_lit *oneshot;
+    struct arg_lit *stop;
+    struct arg_lit *dump;
+    struct arg_int *last;
+    struct arg_str *write;
+    struct arg_end *end;
+} i2ccap_args;
+
+static int do_i2ccap_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&i2ccap_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, i2ccap_args.end, argv[0]);
+        return 0;
+    }
+
+    if (i2ccap_args.stop->count)
+    {
+        i2c_capture_stop();
+    }
+    if (i2ccap_args.start->count)
+    {
+        int kb = i2ccap_args.size->count ? i2ccap_args.size->ival[0] : I2C_CAPTURE_DEFAULT_SIZE / 1024;
+        if (kb < 1)
+        {
+            ESP_LOGE(TAG, "Capture size must be at least 1 KB");
+            return 1;
+        }
+        esp_err_t ret = i2c_capture_start((size_t)kb * 1024, i2ccap_args.oneshot->count > 0);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Capture not started: %s", esp_err_to_name(ret));
+            return 1;
+        }
+    }
+    uint32_t last = i2ccap_args.last->count ? (uint32_t)i2ccap_args.last->ival[0] : 0;
+    if (i2ccap_args.dump->count)
+    {
+        i2c_capture_dump(stdout, last);
+    }
+    if (i2ccap_args.write->count)
+    {
+        // e.g. /data/cap.txt, replay with 'i2creplay /data/cap.txt' or on the host
+        FILE *f = fopen(i2ccap_args.write->sval[0], "w");
+        if (f == NULL)
+        {
+            ESP_LOGE(TAG, "Cannot create %s", i2ccap_args.write->sval[0]);
+            return 1;
+        }
+        uint32_t n = i2c_capture_dump(f, last);
+        bool failed = ferror(f) != 0;
+        failed |= (fclose(f) != 0);
+        if (failed)
+        {
+            ESP_LOGE(TAG, "Write to %s failed", i2ccap_args.write->sval[0]);
+            return 1;
+        }
+        printf("%" PRIu32 " transactions written to %s\r\n", n, i2ccap_args.write->sval[0]);
+    }
+
+    i2c_capture_status_t st;
+    i2c_capture_get_status(&st);
+    printf("capture %s%s: %" PRIu32 " transactions in %u/%u bytes (%s), %" PRIu32 " recorded, %" PRIu32 " dropped\r\n",
+           st.active ? "running" : "stopped", st.stop_when_full ? " (stop when full)" : "", st.records,
+           (unsigned)st.used, (unsigned)st.size, st.psram ? "psram" : "internal", st.total, st.dropped);
+    return 0;
+}
+
+static void register_i2ccap(void)
+{
+    i2ccap_args.start = arg_lit0("s", "start", "Start capturing, clears the capture");
+    i2ccap_args.size = arg_int0("k", "size", "<KB>", "Ring size in KB (default 64)");
+    i2ccap_args.oneshot = arg_lit0("o", "oneshot", "Stop recording when full instead of overwriting the oldest");
+    i2ccap_args.stop = arg_lit0("x", "stop", "Stop capturing, the capture is kept");
+    i2ccap_args.dump = arg_lit0("d", "dump", "Print the capture");
+    i2ccap_args.last = arg_int0("n", "last", "<count>", "Only the last transactions (dump and write)");
+    i2ccap_args.write = arg_str0("w", "write", "<path>", "Write the capture to a file, e.g. /data/cap.txt");
+    i2ccap_args.end = arg_end(7);
+    const esp_console_cmd_t i2ccap_cmd = {
+        .command = "i2ccap",
+        .help = "Capture every I2C transaction of drivers and tools (not i2cdetect probes) into a ring",
+        .hint = NULL,
+        .func = &do_i2ccap_cmd,
+        .argtable = &i2ccap_args};
+    ESP_ERROR_CHECK(register_cmd(&i2ccap_cmd));
+}
+
+static struct
+{
+    struct arg_str *file;
+    struct arg_int *scale;
+    struct arg_lit *fast;
+    struct arg_lit *nocheck;
+    struct arg_end *end;
+} i2creplay_args;
+
+static int do_i2creplay_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&i2creplay_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, i2creplay_args.end, argv[0]);
+        return 0;
+    }
+
+    i2c_replay_config_t config = I2C_REPLAY_CONFIG_DEFAULT();
+    config.scl_speed_hz = i2c_frequency;
+    config.check_reads = (i2creplay_args.nocheck->count == 0);
+    if (i2creplay_args.scale->count)
+    {
+        int scale = i2creplay_args.scale->ival[0];
+        if (scale < 0 || scale > 10000)
+        {
+            ESP_LOGE(TAG, "Time scale must be 0..10000 %%");
+            return 1;
+        }
+        config.time_scale = (uint16_t)scale;
+    }
+    if (i2creplay_args.fast->count)
+    {
+        config.time_scale = 0;
+    }
+
+    i2c_replay_stats_t stats;
+    esp_err_t ret;
+    if (i2creplay_args.file->count)
+    {
+        FILE *f = fopen(i2creplay_args.file->sval[0], "r");
+        if (f == NULL)
+        {
+            ESP_LOGE(TAG, "Cannot open %s", i2creplay_args.file->sval[0]);
+            return 1;
+        }
+        ret = i2c_replay_file(f, &config, &stats);
+        fclose(f);
+    }
+    else
+    {
+        ret = i2c_replay_capture(&config, &stats);
+        if (ret == ESP_ERR_INVALID_STATE)
+        {
+            ESP_LOGE(TAG, "Capture is running, stop it first with 'i2ccap -x'");
+            return 1;
+        }
+    }
+    if (ret == ESP_ERR_NOT_FOUND)
+    {
+        ESP_LOGE(TAG, "Nothing to replay");
+        return 1;
+    }
+    i2c_replay_print(&stats, stdout);
+    return ret == ESP_OK ? 0 : 1;
+}
+
+static void register_i2creplay(void)
+{
+    i2creplay_args.file = arg_str0(NULL, NULL, "<path>", "Capture file written by 'i2ccap -w' (default: the capture ring)");
+    i2creplay_args.scale = arg_int0("t", "time", "<percent>", "Spacing in percent of the captured timing (default 100)");
+    i2creplay_args.fast = arg_lit0("f", "fast", "Back to back, ignore the captured timing");
+    i2creplay_args.nocheck = arg_lit0("n", "nocheck", "Do not compare read data");
+    i2creplay_args.end = arg_end(4);
+    const esp_console_cmd_t i2creplay_cmd = {
+        .command = "i2creplay",
+        .help = "Re-run an I2C capture on the bus with its original timing and compare results and reads",
+        .hint = NULL,
+        .func = &do_i2creplay_cmd,
+        .argtable = &i2creplay_args};
+    ESP_ERROR_CHECK(register_cmd(&i2creplay_cmd));
+}
+
+static struct
+{
+    struct arg_int *speed;
+    struct arg_int *brake;
+    struct arg_int *relays;
+    struct arg_int *leds;
+    struct arg_lit *stats;
+    struct arg_lit *reset;
+    struct arg_end *end;
+} act_args;
+
+// Actuator frames on the DAC and relay contexts of the commands above, rebound when
+// one of them was rebuilt
+static actuator_t s_act;
+
+static actuator_t *get_actuator(void)
+{
+    gp8413_handle_t *dac = get_dac();
+    m54_ctx_t *relay = get_relay();
+    if (dac == NULL && relay == NULL)
+    {
+        return NULL;
+    }
+    if (s_act.dac != dac || s_act.relay != relay)
+    {
+        actuator_init(&s_act, dac, relay);
+    }
+    return &s_act;
+}
+
+// Put the last known DAC outputs and relay state back on a recovered bus. Outputs lock held.
+static void restore_outputs(int port)
+{
+    i2c_master_bus_handle_t bus = tool_bus_handles[port];
+    bool dac = s_dac != NULL && s_dev_bus[TOOL_DEV_DAC] == port;
+    bool relay = s_relay.initialized && s_dev_bus[TOOL_DEV_RELAY] == port;
+    if (bus == NULL)
+    {
+        return;
+    }
+    if (control_exec_running())
+    {
+        // the loop task uses the contexts: it moves them before its next frame
+        actuator_resync(&s_act, dac && s_act.dac ? bus : NULL, relay && s_act.relay ? bus : NULL);
+        return;
+    }
+
+    if (dac)
+    {
+        s_dac_generation = i2c_bus_generation();
+        if (gp8413_restore(s_dac, bus) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to restore DAC outputs after bus recovery");
+        }
+    }
+    if (relay)
+    {
+        s_relay.bus_handle = bus;
+        s_relay_generation = i2c_bus_generation();
+        if (i2c_bus_get_device(bus, s_relay.device_address, s_relay.scl_speed_hz, &s_relay.dev_handle) != ESP_OK ||
+            m54_restore(&s_relay) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to restore relay state after bus recovery");
+        }
+    }
+}
+
+// Called by the bus monitor after a stuck-bus recovery, on the scheduler task
+void i2ctools_on_bus_recovered(i2c_master_bus_handle_t new_bus, void *arg)
+{
+    int port = i2c_bus_port_of(new_bus);
+    if (port < 0 || port >= I2C_TOOL_MAX_BUSES)
+    {
+        return;
+    }
+    atomic_fetch_or(&s_restore_ports, 1u << port);
+    if (outputs_lock(0))
+    {
+        outputs_unlock(); // restores the port now
+    }
+}
+
+// A value that does not fit the frame field is refused, not narrowed
+static bool act_arg_ok(const struct arg_int *arg, const char *name, int max)
+{
+    if (arg->count && (arg->ival[0] < 0 || arg->ival[0] > max))
+    {
+        ESP_LOGE(TAG, "%s must be 0..%d, not %d", name, max, arg->ival[0]);
+        return false;
+    }
+    return true;
+}
+
+static int do_act_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&act_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, act_args.end, argv[0]);
+        return 0;
+    }
+    // while the control loop runs it owns the devices: the frame goes to the loop
+    bool loop = control_exec_running();
+    actuator_t *act = loop ? &s_act : get_actuator();
+    if (act == NULL)
+    {
+        printf("no DAC and no relay board\n");
+        return 0;
+    }
+    int max_mv = act->dac ? (int)act->dac->output_range : UINT16_MAX;
+    if (!act_arg_ok(act_args.speed, "Speed (mV)", max_mv) || !act_arg_ok(act_args.brake, "Brake (mV)", max_mv) ||
+        !act_arg_ok(act_args.relays, "Relay mask", 0x0F) || !act_arg_ok(act_args.leds, "LED mask", 0x0F))
+    {
+        return 1;
+    }
+
+    // fields that are not given keep what the devices have now
+    actuator_frame_t frame;
+    if (loop)
+    {
+        control_exec_get_frame(&frame);
+    }
+    else
+    {
+        actuator_get_frame(act, &frame);
+    }
+    bool apply = false;
+    if (act_args.speed->count)
+    {
+        frame.dac_mv[0] = (uint16_t)act_args.speed->ival[0];
+        apply = true;
+    }
+    if (act_args.brake->count)
+    {
+        frame.dac_mv[1] = (uint16_t)act_args.brake->ival[0];
+        apply = true;
+    }
+    if (act_args.relays->count)
+    {
+        frame.relays = (uint8_t)act_args.relays->ival[0];
+        apply = true;
+    }
+    if (act_args.leds->count)
+    {
+        frame.leds = (uint8_t)act_args.leds->ival[0];
+        apply = true;
+    }
+    if (apply && loop)
+    {
+        control_exec_set_frame(&frame);
+        printf("frame for the control loop: %u/%u mV, relays 0x%x, leds 0x%x\n", frame.dac_mv[0], frame.dac_mv[1],
+               frame.relays, frame.leds);
+    }
+    else if (apply)
+    {
+        uint32_t txns = act->stats.transactions;
+        int64_t t_us = 0;
+        esp_err_t ret = actuator_apply(act, &frame, &t_us);
+        if (ret != ESP_OK)
+        {
+            printf("frame failed: %s\n", esp_err_to_name(ret));
+        }
+        else
+        {
+            printf("frame at %" PRId64 " us: %u/%u mV, relays 0x%x, leds 0x%x, %" PRIu32 " transactions, "
+                   "skew %" PRIu32 " us, latency %" PRIu32 " us\n",
+                   t_us, frame.dac_mv[0], frame.dac_mv[1], frame.relays, frame.leds, act->stats.transactions - txns,
+                   act->stats.skew_last_us, act->stats.latency_last_us);
+        }
+    }
+    if (act_args.stats->count || !apply)
+    {
+        actuator_print(act, stdout);
+    }
+    if (act_args.reset->count)
+    {
+        actuator_get_stats(act, NULL, true);
+    }
+    return 0;
+}
+
+static int do_act_locked(int argc, char **argv)
+{
+    return with_outputs(do_act_cmd, argc, argv);
+}
+
+static void register_act(void)
+{
+    act_args.speed = arg_int0("a", "speed", "<mV>", "DAC channel 0");
+    act_args.brake = arg_int0("b", "brake", "<mV>", "DAC channel 1");
+    act_args.relays = arg_int0("r", "relays", "<mask>", "Relays, bit 0..3");
+    act_args.leds = arg_int0("l", "leds", "<mask>", "LEDs, bit 0..3");
+    act_args.stats = arg_lit0("s", "stats", "Print the frame statistics");
+    act_args.reset = arg_lit0(NULL, "reset", "Clear the frame statistics");
+    act_args.end = arg_end(6);
+    const esp_console_cmd_t act_cmd = {
+        .command = "act",
+        .help = "Apply DAC setpoints, relays and LEDs as one frame, back to back on the bus",
+        .hint = NULL,
+        .func = &do_act_locked,
+        .argtable = &act_args};
+    ESP_ERROR_CHECK(register_cmd(&act_cmd));
+}
+
+static struct
+{
+    struct arg_int *period;
+    struct arg_lit *stop;
+    struct arg_lit *reset;
+    struct arg_end *end;
+} ctrl_args;
+
+static int do_ctrl_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&ctrl_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, ctrl_args.end, argv[0]);
+        return 0;
+    }
+    if (ctrl_args.stop->count)
+    {
+        esp_err_t ret = control_exec_stop();
+        printf("control loop %s\n", ret == ESP_OK ? "stopped" : "not running");
+    }
+    if (ctrl_args.period->count)
+    {
+        control_exec_config_t config = CONTROL_EXEC_CONFIG_DEFAULT();
+        config.period_us = (uint32_t)ctrl_args.period->ival[0];
+        config.act = get_actuator(); // bound before the start, the loop does not rebuild contexts
+        if (config.act == NULL)
+        {
+            printf("no DAC and no relay board\n");
+            return 0;
+        }
+        esp_err_t ret = control_exec_start(&config);
+        if (ret != ESP_OK)
+        {
+            printf("start failed: %s\n", esp_err_to_name(ret));
+            return 0;
+        }
+    }
+    control_exec_print(stdout);
+    if (ctrl_args.reset->count)
+    {
+        control_exec_get_stats(NULL, true);
+    }
+    return 0;
+}
+
+static int do_ctrl_locked(int argc, char **argv)
+{
+    return with_outputs(do_ctrl_cmd, argc, argv);
+}
+
+static void register_ctrl(void)
+{
+    ctrl_args.period = arg_int0("p", "period", "<us>", "Start the loop with this period (1000 = 1 kHz)");
+    ctrl_args.stop = arg_lit0("x", "stop", "Stop the loop");
+    ctrl_args.reset = arg_lit0(NULL, "reset", "Clear the loop statistics");
+    ctrl_args.end = arg_end(3);
+    const esp_console_cmd_t ctrl_cmd = {
+        .command = "ctrl",
+        .help = "Control loop on core 1: start, stop, period jitter, execution time and deadline misses",
+        .hint = NULL,
+        .func = &do_ctrl_locked,
+        .argtable = &ctrl_args};
+    ESP_ERROR_CHECK(register_cmd(&ctrl_cmd));
+}
+
+// Binary RPC on the console: the driver is used directly, the VFS would translate line
+// endings and its blocking read waits for the whole buffer
+#define RPC_TX_CHUNK (128) // Below the smallest console TX ring
+
+static struct
+{
+    struct arg_end *end;
+} rpc_args;
+
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+static int rpc_console_read(void *io, uint8_t *buf, size_t len)
+{
+    int n;
+    do
+    {
+        n = usb_serial_jtag_read_bytes(buf, len, portMAX_DELAY); // returns what is there
+    } while (n == 0);
+    return n;
+}
+
+static int rpc_console_write(void *io, const uint8_t *buf, size_t len)
+{
+    for (size_t pos = 0; pos < len;)
+    {
+        size_t n = len - pos < RPC_TX_CHUNK ? len - pos : RPC_TX_CHUNK;
+        if (usb_serial_jtag_write_bytes(&buf[pos], n, portMAX_DELAY) != (int)n)
+        {
+            return -1;
+        }
+        pos += n;
+    }
+    return (int)len;
+}
+#elif CONFIG_ESP_CONSOLE_UART
+static int rpc_console_read(void *io, uint8_t *buf, size_t len)
+{
+    // wait for one byte, then take what else is buffered
+    int n = uart_read_bytes(CONFIG_ESP_CONSOLE_UART_NUM, buf, 1, portMAX_DELAY);
+    size_t more = 0;
+    if (n == 1 && len > 1 && uart_get_buffered_data_len(CONFIG_ESP_CONSOLE_UART_NUM, &more) == ESP_OK && more)
+    {
+        int m = uart_read_bytes(CONFIG_ESP_CONSOLE_UART_NUM, &buf[1], more < len - 1 ? more : len - 1, 0);
+        n += m > 0 ? m : 0;
+    }
+    return n;
+}
+
+static int rpc_console_write(void *io, const uint8_t *buf, size_t len)
+{
+    return uart_write_bytes(CONFIG_ESP_CONSOLE_UART_NUM, buf, len);
+}
+#endif
+
+// Every request of the host is a heartbeat for the failsafe
+static void rpc_heartbeat(void *ctx, uint8_t op)
+{
+    failsafe_feed();
+}
+
+static int do_rpc_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&rpc_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, rpc_args.end, argv[0]);
+        return 0;
+    }
+    if (outputs_owned_by_loop())
+    {
+        return 0;
+    }
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG || CONFIG_ESP_CONSOLE_UART
+    static const rpc_devices_t devices = {
+        .dac = get_dac,
+        .relay = get_relay,
+        .display = get_display,
+    };
+    const rpc_server_config_t config = {
+        .read = rpc_console_read,
+        .write = rpc_console_write,
+        .ops = rpc_device_ops,
+        .n_ops = rpc_device_ops_count,
+        .ctx = (void *)&devices,
+        .on_request = rpc_heartbeat,
+    };
+    rpc_server_stats_t stats;
+
+    fflush(stdout); // text before the HELLO frame stays text
+    esp_err_t ret = rpc_server_run(&config, &stats);
+    printf("\nrpc: %s, %" PRIu32 " requests (%" PRIu32 " unknown), %" PRIu32 " bad frames, "
+           "%" PRIu32 " bytes in, %" PRIu32 " bytes out in %" PRIu32 " writes\n",
+           ret == ESP_OK ? "back to console" : "transport closed", stats.requests, stats.unknown, stats.dropped,
+           stats.bytes_in, stats.bytes_out, stats.writes);
+#else
+    printf("rpc: not available on this console (USB-Serial-JTAG or UART only)\n");
+#endif
+    return 0;
+}
+
+static int do_rpc_locked(int argc, char **argv)
+{
+    return with_outputs(do_rpc_cmd, argc, argv);
+}
+
+static void register_rpc(void)
+{
+    rpc_args.end = arg_end(1);
+    const esp_console_cmd_t rpc_cmd = {
+        .command = "rpc",
+        .help = "Switch the console to binary RPC (COBS frames, see README) until the host sends REPL",
+        .hint = NULL,
+        .func = &do_rpc_locked,
+        .argtable = &rpc_args};
+    ESP_ERROR_CHECK(register_cmd(&rpc_cmd));
+}
+
+static struct
+{
+    struct arg_int *timeout;
+    struct arg_lit *stop;
+    struct arg_lit *feed;
+    struct arg_lit *trip;
+    struct arg_lit *clear;
+    struct arg_lit *reset;
+    struct arg_end *end;
+} failsafe_args;
+
+static int do_failsafe_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&failsafe_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, failsafe_args.end, argv[0]);
+        return 0;
+    }
+    failsafe_state_t state = failsafe_get_state();
+    bool tripped = state == FAILSAFE_SAFE || state == FAILSAFE_FAILED;
+    // releasing writes the safe frame through the drivers, the loop must not use them meanwhile
+    if ((failsafe_args.clear->count || failsafe_args.stop->count) && tripped && outputs_owned_by_loop())
+    {
+        return 0;
+    }
+    if (failsafe_args.clear->count)
+    {
+        esp_err_t ret = failsafe_clear();
+        printf("clear: %s\n", ret == ESP_OK ? "outputs released, armed" : esp_err_to_name(ret));
+    }
+    if (failsafe_args.stop->count)
+    {
+        esp_err_t ret = failsafe_stop();
+        printf("failsafe %s\n", ret == ESP_OK ? "off" : esp_err_to_name(ret));
+    }
+    if (failsafe_args.timeout->count)
+    {
+        failsafe_config_t config = FAILSAFE_CONFIG_DEFAULT();
+        config.timeout_ms = (uint32_t)failsafe_args.timeout->ival[0];
+        config.act = control_exec_running() ? &s_act : get_actuator();
+        if (config.act == NULL)
+        {
+            printf("no DAC and no relay board\n");
+            return 0;
+        }
+        esp_err_t ret = failsafe_start(&config);
+        if (ret != ESP_OK)
+        {
+            printf("start failed: %s\n", esp_err_to_name(ret));
+            return 0;
+        }
+    }
+    if (failsafe_args.feed->count)
+    {
+        failsafe_feed();
+    }
+    if (failsafe_args.trip->count)
+    {
+        esp_err_t ret = failsafe_trip();
+        printf("trip: %s\n", ret == ESP_OK ? "safe writes fired" : esp_err_to_name(ret));
+        vTaskDelay(1); // let the standby finish before the state is printed
+    }
+    failsafe_print(stdout);
+    if (failsafe_args.reset->count)
+    {
+        failsafe_get_stats(NULL, true);
+    }
+    return 0;
+}
+
+static int do_failsafe_locked(int argc, char **argv)
+{
+    return with_outputs(do_failsafe_cmd, argc, argv);
+}
+
+static void register_failsafe(void)
+{
+    failsafe_args.timeout = arg_int0("t", "timeout", "<ms>", "Arm: trip when no heartbeat arrives within this window");
+    failsafe_args.stop = arg_lit0("x", "stop", "Disarm (releases the outputs after a trip)");
+    failsafe_args.feed = arg_lit0("f", "feed", "Heartbeat (every RPC request is one too)");
+    failsafe_args.trip = arg_lit0(NULL, "trip", "Trip now: DAC 0 V, relays open");
+    failsafe_args.clear = arg_lit0(NULL, "clear", "Release the outputs after a trip and arm again");
+    failsafe_args.reset = arg_lit0(NULL, "reset", "Clear the statistics");
+    failsafe_args.end = arg_end(6);
+    const esp_console_cmd_t failsafe_cmd = {
+        .command = "failsafe",
+        .help = "Heartbeat failsafe: DAC 0 V and relays open when the host goes quiet, time to safe state",
+        .hint = NULL,
+        .func = &do_failsafe_locked,
+        .argtable = &failsafe_args};
+    ESP_ERROR_CHECK(register_cmd(&failsafe_cmd));
+}
+
+static struct
+{
+    struct arg_lit *start;
+    struct arg_int *size;
+    struct arg_lit *stop;
+    struct arg_lit *csv;
+    struct arg_lit *binary;
+    struct arg_int *seconds;
+    struct arg_str *file;
+    struct arg_lit *noflush;
+    struct arg_end *end;
+} hist_args;
+
+static int do_hist_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&hist_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, hist_args.end, argv[0]);
+        return 0;
+    }
+    int64_t since_us = 0;
+    if (hist_args.seconds->count)
+    {
+        since_us = esp_timer_get_time() - (int64_t)hist_args.seconds->ival[0] * 1000000;
+        since_us = since_us > 0 ? since_us : 0;
+    }
+    if (hist_args.stop->count)
+    {
+        act_history_stop();
+    }
+    if (hist_args.start->count)
+    {
+        // the devices are recorded on the bus they are on now, see 'i2cbus'
+        act_history_config_t config = ACT_HISTORY_CONFIG_DEFAULT();
+        config.size = hist_args.size->count ? (size_t)hist_args.size->ival[0] * 1024 : 0;
+        config.dac_port = s_dev_bus[TOOL_DEV_DAC];
+        config.dac_addr = tool_dev_addr[TOOL_DEV_DAC];
+        config.relay_port = s_dev_bus[TOOL_DEV_RELAY];
+        config.relay_addr = tool_dev_addr[TOOL_DEV_RELAY];
+        esp_err_t ret = act_history_start(&config);
+        if (ret != ESP_OK)
+        {
+            printf("start failed: %s\r\n", esp_err_to_name(ret));
+            return 0;
+        }
+    }
+    if (hist_args.noflush->count)
+    {
+        esp_err_t ret = act_history_flush_stop();
+        printf("flush %s\r\n", ret == ESP_OK ? "stopped" : esp_err_to_name(ret));
+    }
+    if (hist_args.file->count)
+    {
+        act_history_flush_config_t config = ACT_HISTORY_FLUSH_CONFIG_DEFAULT();
+        config.path = hist_args.file->sval[0]; // copied by the flush task
+        esp_err_t ret = act_history_flush_start(&config);
+        if (ret != ESP_OK)
+        {
+            printf("flush failed: %s\r\n", esp_err_to_name(ret));
+        }
+    }
+    if (hist_args.csv->count)
+    {
+        uint32_t lines = act_history_write_csv(stdout, since_us);
+        printf("%" PRIu32 " writes\r\n", lines);
+        return 0;
+    }
+    if (hist_args.binary->count)
+    {
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG || CONFIG_ESP_CONSOLE_UART
+        fflush(stdout); // text before the first block stays text
+        int bytes = act_history_write_binary(rpc_console_write, NULL, since_us);
+        printf("\r\nhist: %d bytes\r\n", bytes);
+#else
+        printf("hist: binary only on USB-Serial-JTAG or UART\r\n");
+#endif
+        return 0;
+    }
+    act_history_print(stdout);
+    return 0;
+}
+
+static void register_hist(void)
+{
+    hist_args.start = arg_lit0("s", "start", "Start recording (clears the ring)");
+    hist_args.size = arg_int0("k", "kb", "<kb>", "Ring size for -s");
+    hist_args.stop = arg_lit0("x", "stop", "Stop recording, the ring is kept");
+    hist_args.csv = arg_lit0("c", "csv", "Print the history as CSV");
+    hist_args.binary = arg_lit0("b", "binary", "Stream the history as blocks on the console (decode with hist_bench -d)");
+    hist_args.seconds = arg_int0("t", "time", "<s>", "With -c or -b: only the last seconds");
+    hist_args.file = arg_str0("f", "file", "<path>", "Append closed blocks to this file, e.g. /data/act.bin");
+    hist_args.noflush = arg_lit0(NULL, "noflush", "Write what is left and stop appending to the file");
+    hist_args.end = arg_end(8);
+    const esp_console_cmd_t hist_cmd = {
+        .command = "hist",
+        .help = "History of the DAC words and relay byte written to the devices: status, CSV, binary, file",
+        .hint = NULL,
+        .func = &do_hist_cmd,
+        .argtable = &hist_args};
+    ESP_ERROR_CHECK(register_cmd(&hist_cmd));
+}
+
+static struct
+{
+    struct arg_lit *start;
+    struct arg_int *rate;
+    struct arg_lit *stop;
+    struct arg_end *end;
+} scope_args;
+
+// The scope plots what the DAC acked, from the actuator history: also the failsafe writes
+static esp_err_t scope_sample(void *ctx, uint16_t code[2])
+{
+    act_history_entry_t state;
+    if (!act_history_get_state(&state))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!(state.known & (ACT_HISTORY_CH0 | ACT_HISTORY_CH1)))
+    {
+        return ESP_ERR_NOT_FOUND; // no DAC write since the start of the history
+    }
+    code[0] = state.code[0];
+    code[1] = state.code[1];
+    return ESP_OK;
+}
+
+static int do_scope_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&scope_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, scope_args.end, argv[0]);
+        return 0;
+    }
+    if (scope_args.stop->count)
+    {
+        esp_err_t ret = oled_scope_stop();
+        printf("scope %s\r\n", ret == ESP_OK ? "stopped" : esp_err_to_name(ret));
+    }
+    if (scope_args.start->count)
+    {
+        if (s_status_running)
+        {
+            display_owned();
+            return 0;
+        }
+        if (!act_history_active())
+        {
+            printf("the scope samples the actuator history, start it with 'hist -s'\r\n");
+            return 0;
+        }
+        oled_scope_config_t config = OLED_SCOPE_CONFIG_DEFAULT();
+        config.display = get_display();
+        config.sample = scope_sample;
+        if (scope_args.rate->count)
+        {
+            config.rate_hz = (uint32_t)scope_args.rate->ival[0];
+        }
+        if (config.display == NULL)
+        {
+            printf("no display\r\n");
+            return 0;
+        }
+        esp_err_t ret = oled_scope_start(&config);
+        if (ret != ESP_OK)
+        {
+            printf("start failed: %s\r\n", esp_err_to_name(ret));
+            return 0;
+        }
+        printf("scope on bus %d: channel 0 upper half, channel 1 lower half, 0..full scale\r\n",
+               s_dev_bus[TOOL_DEV_DISPLAY]);
+        return 0;
+    }
+    oled_scope_print(stdout);
+    return 0;
+}
+
+static void register_scope(void)
+{
+    scope_args.start = arg_lit0("s", "start", "Start the scope on the display");
+    scope_args.rate = arg_int0("r", "rate", "<hz>", "Samples per second, one column each (default 100)");
+    scope_args.stop = arg_lit0("x", "stop", "Stop, the display keeps the last sweep");
+    scope_args.end = arg_end(3);
+    const esp_console_cmd_t scope_cmd = {
+        .command = "scope",
+        .help = "Both DAC channels over time on the OLED, one column per sample; rate and display bus share",
+        .hint = NULL,
+        .func = &do_scope_cmd,
+        .argtable = &scope_args};
+    ESP_ERROR_CHECK(register_cmd(&scope_cmd));
+}
+
+static struct
+{
+    struct arg_lit *start;
+    struct arg_int *rate;
+    struct arg_lit *stop;
+    struct arg_end *end;
+} status_args;
+
+#define STATUS_FULL_SCALE_MV (10000) // The DAC runs in its 10 V range (get_dac())
+
+static oled_status_t s_status;
+static uint32_t s_status_hz;
+static volatile bool s_status_stop;
+static StaticSemaphore_t s_status_done_buf;
+static SemaphoreHandle_t s_status_done;
+
+static const char *status_link(void)
+{
+    switch (failsafe_get_state())
+    {
+    case FAILSAFE_ARMED:
+        return "link ok";
+    case FAILSAFE_TRIPPED:
+    case FAILSAFE_SAFE:
+        return "link LOST";
+    case FAILSAFE_FAILED:
+        return "link FAIL";
+    default:
+        return "link -"; // no heartbeat watched
+    }
+}
+
+// Refreshes the screen from the actuator history; the widgets send only what changed
+static void status_task(void *arg)
+{
+    TickType_t wake = xTaskGetTickCount();
+    TickType_t period = pdMS_TO_TICKS(1000 / s_status_hz);
+    while (!s_status_stop)
+    {
+        act_history_entry_t state;
+        oled_status_values_t values = {.link = status_link()};
+        if (act_history_get_state(&state))
+        {
+            values.speed_mv = (int32_t)((uint32_t)state.code[0] * STATUS_FULL_SCALE_MV / 32767);
+            values.brake_mv = (int32_t)((uint32_t)state.code[1] * STATUS_FULL_SCALE_MV / 32767);
+            values.relays = state.relay & 0x0F;
+        }
+        oled_status_update(&s_status, &values);
+        vTaskDelayUntil(&wake, period ? period : 1);
+    }
+    xSemaphoreGive(s_status_done);
+    vTaskDelete(NULL);
+}
+
+static int do_status_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&status_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, status_args.end, argv[0]);
+        return 0;
+    }
+    if (status_args.stop->count)
+    {
+        if (!s_status_running)
+        {
+            printf("status: not running\r\n");
+            return 0;
+        }
+        s_status_stop = true;
+        xSemaphoreTake(s_status_done, portMAX_DELAY);
+        s_status_running = false;
+        printf("status stopped\r\n");
+    }
+    if (status_args.start->count)
+    {
+        if (display_owned())
+        {
+            return 0;
+        }
+        if (!act_history_active())
+        {
+            printf("the status screen shows the actuator history, start it with 'hist -s'\r\n");
+            return 0;
+        }
+        uint32_t hz = status_args.rate->count ? (uint32_t)status_args.rate->ival[0] : 10;
+        ssd1306_handle_t *display = get_display();
+        if (hz < 1 || hz > 50 || display == NULL)
+        {
+            printf("need a display and a rate of 1..50 Hz\r\n");
+            return 0;
+        }
+        if (oled_status_init(&s_status, display, STATUS_FULL_SCALE_MV) != ESP_OK)
+        {
+            printf("the status screen needs a 128x64 display\r\n");
+            return 0;
+        }
+        if (s_status_done == NULL)
+        {
+            s_status_done = xSemaphoreCreateBinaryStatic(&s_status_done_buf);
+        }
+        s_status_hz = hz;
+        s_status_stop = false;
+        s_status_running = true;
+        if (xTaskCreate(status_task, "status", 3072, NULL, 2, NULL) != pdPASS)
+        {
+            s_status_running = false;
+            printf("no memory for the task\r\n");
+            return 0;
+        }
+        printf("status screen at %" PRIu32 " Hz on bus %d\r\n", hz, s_dev_bus[TOOL_DEV_DISPLAY]);
+        return 0;
+    }
+    const oled_ui_stats_t *st = &s_status.ui.stats;
+    printf("status %s: %" PRIu32 " renders, %" PRIu32 " without change, %" PRIu32 " full frames, %" PRIu32
+           " windows, %" PRIu32 " bytes (%" PRIu32 " per render), %" PRIu32 " errors, render max %" PRIu32 " us\r\n",
+           s_status_running ? "running" : "stopped", st->renders, st->idle, st->frames, st->windows, st->bytes,
+           st->renders ? st->bytes / st->renders : 0, st->errors, st->render_max_us);
+    return 0;
+}
+
+static void register_status(void)
+{
+    status_args.start = arg_lit0("s", "start", "Start refreshing the status screen");
+    status_args.rate = arg_int0("r", "rate", "<hz>", "Refreshes per second, 1..50 (default 10)");
+    status_args.stop = arg_lit0("x", "stop", "Stop, the display keeps the last screen");
+    status_args.end = arg_end(3);
+    const esp_console_cmd_t status_cmd = {
+        .command = "status",
+        .help = "DAC outputs, relays and host link on the OLED; only changed widgets are sent",
+        .hint = NULL,
+        .func = &do_status_cmd,
+        .argtable = &status_args};
+    ESP_ERROR_CHECK(register_cmd(&status_cmd));
 }
 
 /**
@@ -850,5 +2957,23 @@ void register_i2ctools(void)
     register_dac_set();
     register_ssd1306();
     register_m54r(); // M54R console commands
+    register_i2csched();
+    register_i2cstats();
+    register_i2crecover();
+    register_i2cbus();
+    register_i2cbench();
+    register_i2ctune();
+    register_i2cbatch();
+    register_i2cinv();
+    register_bootprof();
+    register_i2ccap();
+    register_i2creplay();
+    register_act();
+    register_ctrl();
+    register_rpc();
+    register_failsafe();
+    register_hist();
+    register_scope();
+    register_status();
     ESP_LOGI(TAG, "I2C tools commands registered");
 }
\ No newline at end of file
@@ -13,9 +13,22 @@
 extern "C" {
 #endif
 
+#define I2C_TOOL_MAX_BUSES (2) // Bus table size, index = I2C port
+
 void register_i2ctools(void);
 
-extern i2c_master_bus_handle_t tool_bus_handle;
+// Run hook on the console task before every i2ctools command (NULL: none). The task is
+// between two lines then, the board attaches and saves the command history there.
+void i2ctools_set_command_hook(void (*hook)(void));
+
+// Bus recovery callback (i2c_recover): replays the DAC and relay state on the new bus, now or
+// when the command or control loop that uses them gets to it
+void i2ctools_on_bus_recovered(i2c_master_bus_handle_t new_bus, void *arg);
+
+// Boot inventory of the DAC, relay and display on their buses, see 'i2cinv'
+esp_err_t i2ctools_inventory(void);
+
+extern i2c_master_bus_handle_t tool_bus_handles[I2C_TOOL_MAX_BUSES];
 
 #ifdef __cplusplus
 }
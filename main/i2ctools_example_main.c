@@ -6,15 +6,26 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include <esp_timer.h>
 #include "esp_log.h"
 #include "esp_console.h"
 #include "esp_vfs_fat.h"
+#include "linenoise/linenoise.h"
 #include "cmd_system.h"
 #include "cmd_i2ctools.h"
 #include "driver/i2c_master.h"
 #include "gp8413_sdc.h"
+#include "i2c_sched.h"
+#include "i2c_recover.h"
+#include "i2c_async.h"
+#include "i2c_inventory.h"
+#include "i2c_capture.h"
+#include "act_history.h"
+#include "boot_trace.h"
 
 static const char *TAG = "i2c-tools";
 
@@ -27,8 +38,60 @@ static i2c_port_t i2c_port = I2C_NUM_0;
 
 #define MOUNT_PATH "/data"
 #define HISTORY_PATH MOUNT_PATH "/history.txt"
+#define HISTORY_SESSION_PATH MOUNT_PATH "/history.new"
 
-static void initialize_filesystem(void)
+static atomic_bool s_history_mounted; // set by the filesystem task
+static bool s_history_attached;       // console task only
+static int s_history_max;
+
+static int count_lines(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    int lines = 0;
+    int c;
+    if (f == NULL)
+    {
+        return 0;
+    }
+    while ((c = fgetc(f)) != EOF)
+    {
+        lines += c == '\n';
+    }
+    fclose(f);
+    return lines;
+}
+
+// Command hook (i2ctools_set_command_hook), on the console task between two lines: the
+// REPL does not touch the linenoise history now, and nothing else ever does. The REPL has
+// no save path, so it cannot overwrite the file of earlier sessions before it is attached.
+static void history_sync(void)
+{
+    if (!atomic_load(&s_history_mounted))
+    {
+        return;
+    }
+    if (!s_history_attached)
+    {
+        s_history_attached = true;
+        // earlier sessions go before the lines typed so far: session, old, session in
+        // memory, then a shorter maximum cuts the first copy of this session off
+        if (linenoiseHistorySave(HISTORY_SESSION_PATH) == 0)
+        {
+            int lines = count_lines(HISTORY_PATH) + count_lines(HISTORY_SESSION_PATH);
+            linenoiseHistoryLoad(HISTORY_PATH);
+            linenoiseHistoryLoad(HISTORY_SESSION_PATH);
+            remove(HISTORY_SESSION_PATH);
+            if (lines > 0 && lines < s_history_max)
+            {
+                linenoiseHistorySetMaxLen(lines);
+                linenoiseHistorySetMaxLen(s_history_max);
+            }
+        }
+    }
+    linenoiseHistorySave(HISTORY_PATH);
+}
+
+static bool initialize_filesystem(void)
 {
     static wl_handle_t wl_handle;
     const esp_vfs_fat_mount_config_t mount_config = {
@@ -38,8 +101,33 @@ static void initialize_filesystem(void)
     if (err != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to mount FATFS (%s)", esp_err_to_name(err));
-        return;
+        return false;
+    }
+#if CONFIG_EXAMPLE_ACT_HISTORY_FILE
+    act_history_flush_config_t flush_config = ACT_HISTORY_FLUSH_CONFIG_DEFAULT();
+    flush_config.path = MOUNT_PATH "/act.bin";
+    if (act_history_flush_start(&flush_config) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Actuator history not written to %s", flush_config.path);
+    }
+#endif
+    boot_trace_mark("filesystem");
+    ESP_LOGI(TAG, "FATFS mounted on %s", MOUNT_PATH);
+    return true;
+}
+
+// Mounting the FAT, and formatting it after a failed mount, takes from tens of ms to
+// seconds. It runs in the background at the lowest priority, started after the DAC is
+// in its safe state, so neither the actuators nor the prompt wait for the flash. This
+// task does not touch the linenoise history (plain statics, the REPL task uses them):
+// history_sync() attaches it on the console task.
+static void filesystem_task(void *arg)
+{
+    if (initialize_filesystem())
+    {
+        atomic_store(&s_history_mounted, true);
     }
+    vTaskDelete(NULL);
 }
 #endif // CONFIG_EXAMPLE_STORE_HISTORY
 
@@ -47,12 +135,13 @@ void app_main(void)
 {
     esp_console_repl_t *repl = NULL;
     esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    boot_trace_mark("startup"); // esp_timer start .. app_main: startup code and other components
 
 #if CONFIG_EXAMPLE_STORE_HISTORY
-    initialize_filesystem();
-    repl_config.history_save_path = HISTORY_PATH;
+    s_history_max = (int)repl_config.max_history_len; // no save path: history_sync() saves
 #endif
     repl_config.prompt = "i2c-tools>";
+    repl_config.task_core_id = 0; // core 1 is for the control loop ('ctrl')
 
     // install console REPL environment
 #if CONFIG_ESP_CONSOLE_UART
@@ -65,6 +154,7 @@ void app_main(void)
     esp_console_dev_usb_serial_jtag_config_t usbjtag_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_console_new_repl_usb_serial_jtag(&usbjtag_config, &repl_config, &repl));
 #endif
+    boot_trace_mark("console");
 
     i2c_master_bus_config_t i2c_bus_config = {
         .clk_source = I2C_CLK_SRC_DEFAULT,
@@ -93,11 +183,56 @@ void app_main(void)
     ESP_LOGW(TAG, "I2C bus SCL IO number: %d", i2c_bus_config.scl_io_num);
     ESP_LOGW(TAG, "I2C bus SDA IO number: %d", i2c_bus_config.sda_io_num);
     ESP_LOGW(TAG, "I2C bus port: %d", i2c_bus_config.i2c_port);
-    ESP_LOGW(TAG, "I2C bus handle: %p", tool_bus_handle);
+    ESP_LOGW(TAG, "I2C bus handle: %p", tool_bus_handles[i2c_port]);
+
+    ESP_ERROR_CHECK(i2c_new_master_bus(&i2c_bus_config, &tool_bus_handles[i2c_port]));
+
+#if CONFIG_EXAMPLE_I2C_DISPLAY_BUS
+    // second controller for the display, its flushes no longer delay DAC and relay writes;
+    // interrupt driven, so a flush is queued and the caller goes on drawing
+    i2c_master_bus_config_t display_bus_config = i2c_bus_config;
+    display_bus_config.i2c_port = I2C_NUM_1;
+    display_bus_config.scl_io_num = CONFIG_EXAMPLE_I2C_DISPLAY_SCL;
+    display_bus_config.sda_io_num = CONFIG_EXAMPLE_I2C_DISPLAY_SDA;
+    ESP_LOGW(TAG, "Display bus: port=%d, SDA=%d, SCL=%d", I2C_NUM_1, display_bus_config.sda_io_num, display_bus_config.scl_io_num);
+    ESP_ERROR_CHECK(i2c_async_new_bus(&display_bus_config, &tool_bus_handles[I2C_NUM_1]));
+#endif
+    boot_trace_mark("buses");
+    // all driver traffic goes through the scheduler, above the console task priority
+    ESP_ERROR_CHECK(i2c_sched_start(5));
+#if CONFIG_EXAMPLE_I2C_CAPTURE_KB > 0
+    // capture from the first transaction on, stops when full so the boot traffic is kept
+    if (i2c_capture_start(CONFIG_EXAMPLE_I2C_CAPTURE_KB * 1024, true) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "No boot capture");
+    }
+#endif
+#if CONFIG_EXAMPLE_ACT_HISTORY_KB > 0
+    // record the DAC and relay writes from the first one on (the inventory and the safe state)
+    act_history_config_t history_config = ACT_HISTORY_CONFIG_DEFAULT();
+    history_config.size = CONFIG_EXAMPLE_ACT_HISTORY_KB * 1024;
+    if (act_history_start(&history_config) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "No actuator history");
+    }
+#endif
 
-    ESP_ERROR_CHECK(i2c_new_master_bus(&i2c_bus_config, &tool_bus_handle));
+    // watch for a stuck bus (e.g. DAC brown-out holding SDA low) and recover without reboot
+    i2c_recover_config_t recover_config = {
+        .bus_config = i2c_bus_config,
+        .bus_handle = &tool_bus_handles[i2c_port],
+        .on_recovered = i2ctools_on_bus_recovered,
+        .task_priority = 4,
+    };
+    ESP_ERROR_CHECK(i2c_recover_start(&recover_config));
+    boot_trace_mark("scheduler");
+
+    // which devices are there: all buses at once, absent optional devices cost only a NACK
+    i2ctools_inventory();
+    boot_trace_mark("inventory");
 
     register_i2ctools();
+    boot_trace_mark("commands");
 
     printf("\n ==============================================================\n");
     printf(" |             Steps to Use i2c-tools                         |\n");
@@ -111,55 +246,86 @@ void app_main(void)
     printf(" |  7. Try 'dac_set_output' to set DAC voltages               |\n");
     printf(" |  8. Try 'ssd1306' [-s display integer]                     |\n");
     printf(" |  9. Try 'm54r' -relay 0-4 -state 0|1                     |\n");
+    printf(" | 10. Try 'i2csched' to see bus queueing latency             |\n");
+    printf(" | 11. Try 'i2cstats' for per-device latency and errors       |\n");
+    printf(" | 12. Try 'i2crecover' to see stuck-bus recoveries           |\n");
+    printf(" | 13. Try 'i2cbus' and 'i2cbench' for the display bus        |\n");
+    printf(" | 14. Try 'i2ctune' to find the fastest SCL per device       |\n");
+    printf(" | 15. Try 'i2cbatch' to run a script of I2C transactions     |\n");
+    printf(" | 16. Try 'i2cinv' to see the devices found at boot          |\n");
+    printf(" | 17. Try 'bootprof' to see where the boot time went         |\n");
+    printf(" | 18. Try 'i2ccap' and 'i2creplay' to record bus traffic     |\n");
+    printf(" | 19. Try 'rpc' for binary host control (tools: host/rpc)    |\n");
+    printf(" | 20. Try 'act' to set DAC and relays as one frame           |\n");
+    printf(" | 21. Try 'ctrl' to run the 1 kHz control loop on core 1     |\n");
+    printf(" | 22. Try 'failsafe -t 500' to arm the heartbeat failsafe    |\n");
+    printf(" | 23. Try 'hist -c' for the history of the DAC and relays    |\n");
+    printf(" | 24. Try 'scope -s' for a live view of the DAC on the OLED  |\n");
+    printf(" | 25. Try 'status -s' for the outputs and link on the OLED   |\n");
     printf(" ==============================================================\n\n");
 
     #if CONFIG_EXAMPLE_GP8413_SDC
-    
-    gp8413_config_t config = {
-        .bus_handle = tool_bus_handle,
-        .device_addr = GP8413_I2C_ADDRESS,
-        .output_range = GP8413_OUTPUT_RANGE_10V,
-        .channel0 = {
-            .voltage = 0,
-            .enable = true
-        },
-        .channel1 = {
-            .voltage = 0,
-            .enable = true
-        }
-    };
-
-    gp8413_handle_t *dac = gp8413_init(&config);
-    if (dac == NULL)
+    if (!i2c_inventory_present("dac"))
     {
-        ESP_LOGE(TAG, "Failed to initialize DAC");
-        return;
+        ESP_LOGW(TAG, "DAC not found at boot, not initialized");
     }
-
-    ESP_LOGI(TAG, "DAC initialized successfully");
-    ESP_LOGI(TAG, "Setting output voltage to 0V on channel 0");
-    esp_err_t ret = gp8413_set_output_voltage(dac, 0, 0);
-    if (ret != ESP_OK)
+    else
     {
-        ESP_LOGE(TAG, "Failed to set output voltage: %s", esp_err_to_name(ret));
+        gp8413_config_t config = {
+            .bus_handle = tool_bus_handles[i2c_port],
+            .device_addr = GP8413_I2C_ADDRESS,
+            .output_range = GP8413_OUTPUT_RANGE_10V,
+            .channel0 = {
+                .voltage = 0,
+                .enable = true
+            },
+            .channel1 = {
+                .voltage = 0,
+                .enable = true
+            }
+        };
+
+        gp8413_handle_t *dac = gp8413_init(&config);
+        if (dac == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to initialize DAC");
+            return;
+        }
+
+        ESP_LOGI(TAG, "DAC initialized successfully");
+        ESP_LOGI(TAG, "Setting output voltage to 0V on channel 0");
+        esp_err_t ret = gp8413_set_output_voltage(dac, 0, 0);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to set output voltage: %s", esp_err_to_name(ret));
+            gp8413_deinit(&dac);
+            return;
+        }
+
+        ret = gp8413_set_output_voltage(dac, 0, 1);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to set output voltage: %s", esp_err_to_name(ret));
+            gp8413_deinit(&dac);
+            return;
+        }
+        ESP_LOGI(TAG, "Output voltage set successfully");
+        ESP_LOGI(TAG, "Setting output voltage to 0V on channel 1");
+        ESP_LOGE(TAG, "OK initialize DAC");
+
         gp8413_deinit(&dac);
-        return;
     }
-
-    ret = gp8413_set_output_voltage(dac, 0, 1);
-    if (ret != ESP_OK)
+    boot_trace_mark("dac");
+#endif
+#if CONFIG_EXAMPLE_STORE_HISTORY
+    i2ctools_set_command_hook(history_sync);
+    if (xTaskCreate(filesystem_task, "fs_mount", 4096, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
     {
-        ESP_LOGE(TAG, "Failed to set output voltage: %s", esp_err_to_name(ret));
-        gp8413_deinit(&dac);
-        return;
+        ESP_LOGE(TAG, "Failed to start the filesystem task, no history");
     }
-    ESP_LOGI(TAG, "Output voltage set successfully");
-    ESP_LOGI(TAG, "Setting output voltage to 0V on channel 1");
-    ESP_LOGE(TAG, "OK initialize DAC");
-
-    gp8413_deinit(&dac);
 #endif
     // Register system commands
-    printf("timer : %lld\r\n",esp_timer_get_time());
+    boot_trace_mark("ready");
+    boot_trace_print(stdout); // capture for tools/bootprof_compare.py, later again with 'bootprof'
     ESP_ERROR_CHECK(esp_console_start_repl(repl));
 }
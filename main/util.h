@@ -11,20 +11,13 @@
 // #include <driver/i2c.h>
 // #include <driver/i2c_master.h>
 
-// typedef struct {
-//     uint8_t device_address; // 8-bit adres van het apparaat
-//     const char *name;       // Pointer naar de naam van het apparaat
-//     uint8_t found;          // Boolean vlag (1 of 0)
-// } device_description_t;
-
 // // math map range to other range
 // float map(float x, float in_min, float in_max, float out_min, float out_max);
 
 // // i2c stuff
-// void initialize_i2c_pin(gpio_num_t pin, uint32_t level);
-// void unfreeze_i2c(void);
+// bus unfreeze (9 clocks + STOP): see i2c_recover.h in components/i2c_bus
 // void scan_i2c_bus(i2c_master_bus_handle_t bus_handle);
-// int test_i2c_devices_present(i2c_master_bus_handle_t bus_handle, device_description_t device_list[]);
+// device table + presence test (device_description_t, test_i2c_devices_present): see i2c_inventory.h in components/i2c_bus
 
 /* smart arrays size macros, from linux kernel */
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]) + __must_be_array(arr))
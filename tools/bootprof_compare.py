@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+# bootprof_compare.py
+# Compare two boot traces printed by boot_trace_print() (boot log or the 'bootprof' command)
+# Edwin vd Oetelaar, juni 2025
+#
+# usage: bootprof_compare.py before.txt after.txt [--fail-above US]
+#
+# The capture may contain other output; the last trace in each file is used. Stages are
+# matched by name, a stage missing in one of the traces is shown with '-'. A name that occurs
+# more than once gets '#2', '#3', .. from its second occurrence on. The total is the end time
+# of one stage ('ready' by default), not of the last mark: marks of background tasks (the
+# filesystem mount) can come after it and vary from boot to boot.
+
+import argparse
+import re
+import sys
+
+HEADER = re.compile(r'^bootprof (\d+) stages')
+ROW = re.compile(r'^\s*(\d+)\s+(\S+)\s+(-?\d+)\s+(-?\d+)\s*$')
+
+
+def read_trace(path):
+    """Return [(stage, end_us, took_us)] of the last trace in the file."""
+    trace = None
+    with open(path, errors='replace') as f:
+        for line in f:
+            line = line.rstrip('\r\n')
+            if HEADER.match(line):
+                trace = []
+                continue
+            m = ROW.match(line)
+            if trace is not None and m:
+                trace.append((m.group(2), int(m.group(3)), int(m.group(4))))
+    if not trace:
+        sys.exit('%s: no bootprof trace found' % path)
+    return unique_names(trace)
+
+
+def unique_names(trace):
+    """Suffix repeated stage names with their occurrence, so no stage is lost in a dict."""
+    seen = {}
+    out = []
+    for name, end, took in trace:
+        seen[name] = seen.get(name, 0) + 1
+        out.append((name if seen[name] == 1 else '%s#%d' % (name, seen[name]), end, took))
+    return out
+
+
+def stage_end(trace, stage, path):
+    for name, end, _ in trace:
+        if name == stage:
+            return end
+    sys.exit('%s: no stage %s in the trace' % (path, stage))
+
+
+def fmt(value):
+    return '-' if value is None else str(value)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare two boot traces stage by stage')
+    parser.add_argument('before')
+    parser.add_argument('after')
+    parser.add_argument('--fail-above', type=int, metavar='US',
+                        help='exit 1 when the time to the total stage grew by more than US')
+    parser.add_argument('--stage', default='ready',
+                        help='stage whose end time is the total (default: ready)')
+    args = parser.parse_args()
+
+    a = read_trace(args.before)
+    b = read_trace(args.after)
+    end_a = stage_end(a, args.stage, args.before)
+    end_b = stage_end(b, args.stage, args.after)
+    took_a = {name: took for name, _, took in a}
+    took_b = {name: took for name, _, took in b}
+
+    # order of the new trace, stages that disappeared at the end
+    names = [name for name, _, _ in b] + [name for name, _, _ in a if name not in took_b]
+
+    print('%-16s %10s %10s %10s %8s' % ('stage', 'before', 'after', 'diff', 'diff%'))
+    for name in names:
+        ta = took_a.get(name)
+        tb = took_b.get(name)
+        diff = pct = ''
+        if ta is not None and tb is not None:
+            diff = '%+d' % (tb - ta)
+            pct = '%+.1f' % (100.0 * (tb - ta) / ta) if ta else ''
+        print('%-16s %10s %10s %10s %8s' % (name, fmt(ta), fmt(tb), diff, pct))
+
+    print('%-16s %10d %10d %+10d' % ('total (' + args.stage + ')', end_a, end_b, end_b - end_a))
+
+    if args.fail_above is not None and end_b - end_a > args.fail_above:
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+# fontgen.py
+# Convert a BDF or TTF font to the proportional font tables of ssd1306_font.h
+# Edwin vd Oetelaar, juni 2025
+#
+# usage: fontgen.py FONT.bdf|FONT.ttf NAME [-o OUT.c] [--chars RANGES] [--spacing N] [--trim]
+#                   [--size PX] [--preview TEXT]
+#
+# Glyphs become column bytes, LSB at the top, one band of 8 rows (a page) after the other,
+# as the SSD1306 buffer holds them. ASCII ' '..'~' are always glyphs 0..94, so the lookup of
+# those is an index; the other code points follow in order and are found through a sorted
+# table of ranges. A code point the source lacks draws the fallback glyph (DEFAULT_CHAR of a
+# BDF, else '?'). Identical bitmaps are stored once.
+#
+# TTF needs Pillow (pip install pillow); the glyphs are rendered at --size pixels and
+# thresholded at half intensity. Small sizes look better from a bitmap (BDF) font.
+
+import argparse
+import os
+import sys
+
+ASCII_FIRST = 0x20
+ASCII_LAST = 0x7E
+
+
+def parse_ranges(text):
+    """'0x20-0x7e,0xa0-0xff,0x20ac' -> set of code points"""
+    points = set()
+    for part in text.split(','):
+        part = part.strip()
+        if not part:
+            continue
+        lo, _, hi = part.partition('-')
+        lo = int(lo, 0)
+        hi = int(hi, 0) if hi else lo
+        points.update(range(lo, hi + 1))
+    return points
+
+
+def read_bdf(path):
+    """Return (height, glyphs, default): glyphs[cp] = (advance, rows of 0/1 pixels, height rows)."""
+    ascent = descent = None
+    box = None
+    default = None
+    glyphs = {}
+    with open(path, errors='replace') as f:
+        lines = iter(f.read().splitlines())
+    for line in lines:
+        key, _, rest = line.partition(' ')
+        if key == 'FONTBOUNDINGBOX':
+            box = [int(v) for v in rest.split()]
+        elif key == 'FONT_ASCENT':
+            ascent = int(rest)
+        elif key == 'FONT_DESCENT':
+            descent = int(rest)
+        elif key == 'DEFAULT_CHAR':
+            default = int(rest)
+        elif key == 'STARTCHAR':
+            cp, advance, bbx, bitmap = -1, 0, (0, 0, 0, 0), []
+            for line in lines:
+                key, _, rest = line.partition(' ')
+                if key == 'ENCODING':
+                    cp = int(rest.split()[0])
+                elif key == 'DWIDTH':
+                    advance = int(rest.split()[0])
+                elif key == 'BBX':
+                    bbx = tuple(int(v) for v in rest.split())
+                elif key == 'BITMAP':
+                    for line in lines:
+                        if line.startswith('ENDCHAR'):
+                            break
+                        bitmap.append(line.strip())
+                    break
+            if cp >= 0:
+                glyphs[cp] = (advance, bbx, bitmap)
+    if ascent is None or descent is None:
+        if box is None:
+            sys.exit('%s: no FONT_ASCENT/FONT_DESCENT and no FONTBOUNDINGBOX' % path)
+        ascent, descent = box[1] + box[3], -box[3]
+    height = ascent + descent
+
+    cells = {}
+    for cp, (advance, (w, h, xoff, yoff), bitmap) in glyphs.items():
+        cols = max(advance, xoff + w, 0)
+        rows = [[0] * cols for _ in range(height)]
+        for i, hexrow in enumerate(bitmap[:h]):
+            bits = int(hexrow, 16) if hexrow else 0
+            nbits = len(hexrow) * 4
+            y = ascent - (yoff + h) + i  # row in the cell, 0 at the top
+            if not 0 <= y < height:
+                continue
+            for x in range(w):
+                if bits >> (nbits - 1 - x) & 1 and 0 <= xoff + x < cols:
+                    rows[y][xoff + x] = 1
+        cells[cp] = (advance, rows)
+    return height, cells, default
+
+
+def read_ttf(path, size, points):
+    try:
+        from PIL import Image, ImageDraw, ImageFont
+    except ImportError:
+        sys.exit('TTF input needs Pillow: pip install pillow')
+    font = ImageFont.truetype(path, size)
+    ascent, descent = font.getmetrics()
+    height = ascent + descent
+    cells = {}
+    for cp in sorted(points):
+        ch = chr(cp)
+        advance = int(round(font.getlength(ch)))
+        if advance <= 0 and cp != 0x20:
+            continue
+        img = Image.new('L', (max(advance, 1), height), 0)
+        ImageDraw.Draw(img).text((0, 0), ch, font=font, fill=255)
+        rows = [[1 if img.getpixel((x, y)) >= 128 else 0 for x in range(advance)] for y in range(height)]
+        cells[cp] = (advance, rows)
+    return height, cells, None
+
+
+def columns(rows, spacing, trim):
+    """Width and column bits of a glyph; spacing columns are added by the renderer."""
+    width = len(rows[0]) if rows else 0
+    ink = [x for x in range(width) if any(r[x] for r in rows)]
+    if not ink:
+        return max(width - spacing, 1), [0] * max(width - spacing, 1)
+    lo, hi = (ink[0], ink[-1]) if trim else (0, max(ink[-1], width - 1 - spacing))
+    return hi - lo + 1, [sum(rows[y][x] << y for y in range(len(rows))) for x in range(lo, hi + 1)]
+
+
+def glyph_bytes(cols, pages):
+    out = []
+    for p in range(pages):
+        out += [(c >> (8 * p)) & 0xFF for c in cols]
+    return out
+
+
+def hex_lines(values, per_line, indent='    '):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append(indent + ', '.join('0x%02X' % v for v in values[i:i + per_line]) + ',')
+    return '\n'.join(lines)
+
+
+def preview(text, font, pages):
+    cols = []
+    for ch in text:
+        cols += font.get(ord(ch), font[ord('?')])[1] + [0] * font['spacing']
+    for y in range(pages * 8):
+        print(''.join('#' if c >> y & 1 else '.' for c in cols))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='BDF/TTF to ssd1306_font_t tables')
+    parser.add_argument('font', help='.bdf or .ttf')
+    parser.add_argument('name', help='C name of the font, e.g. ssd1306_font_sans8')
+    parser.add_argument('-o', '--output', help='C file (default: NAME.c)')
+    parser.add_argument('--chars', default='0x20-0x7e,0xa0-0xff',
+                        help='code points, e.g. 0x20-0x7e,0xa0-0xff,0x20ac (default ASCII and Latin-1)')
+    parser.add_argument('--spacing', type=int, default=1, help='blank columns after each glyph (default 1)')
+    parser.add_argument('--trim', action='store_true',
+                        help='drop blank columns at both sides of the ink (fixed fonts made proportional)')
+    parser.add_argument('--size', type=int, default=8, help='TTF: pixel size (default 8)')
+    parser.add_argument('--preview', metavar='TEXT', help='print TEXT with the converted glyphs')
+    args = parser.parse_args()
+
+    points = parse_ranges(args.chars) | set(range(ASCII_FIRST, ASCII_LAST + 1))
+    if args.font.lower().endswith('.bdf'):
+        height, cells, default = read_bdf(args.font)
+    else:
+        height, cells, default = read_ttf(args.font, args.size, points)
+    pages = (height + 7) // 8
+    if pages > 4:
+        sys.exit('%d rows: at most 32 (4 pages)' % height)
+    if default not in cells:
+        default = ord('?') if ord('?') in cells else None
+    if default is None:
+        sys.exit('%s: no default character and no \'?\'' % args.font)
+
+    conv = {cp: columns(rows, args.spacing, args.trim) for cp, (_, rows) in cells.items() if cp in points}
+    if max(w for w, _ in conv.values()) > 255:
+        sys.exit('glyph wider than 255 columns')
+    missing = [cp for cp in range(ASCII_FIRST, ASCII_LAST + 1) if cp not in conv]
+    extra = sorted(cp for cp in conv if cp > ASCII_LAST or cp < ASCII_FIRST)
+
+    # glyphs: ASCII in order (missing ones draw the default), then the rest by code point
+    order = list(range(ASCII_FIRST, ASCII_LAST + 1)) + extra
+    bitmap, offsets, widths, seen = [], [], [], {}
+    for cp in order:
+        w, cols = conv.get(cp, conv[default])
+        data = tuple(glyph_bytes(cols, pages))
+        if data not in seen:
+            seen[data] = len(bitmap)
+            bitmap += data
+        offsets.append(seen[data])
+        widths.append(w)
+    if len(bitmap) > 0xFFFF:
+        sys.exit('bitmap of %d bytes: offsets are 16 bits' % len(bitmap))
+    fallback = order.index(default) if default in order else order.index(ord('?'))
+
+    ranges = [(ASCII_FIRST, ASCII_LAST - ASCII_FIRST + 1, 0)]
+    for i, cp in enumerate(extra):
+        glyph = ASCII_LAST - ASCII_FIRST + 1 + i
+        first, count, start = ranges[-1]
+        if len(ranges) > 1 and cp == first + count:
+            ranges[-1] = (first, count + 1, start)
+        else:
+            ranges.append((cp, 1, glyph))
+
+    if args.preview:
+        font = {cp: conv.get(cp, conv[default]) for cp in order}
+        font['spacing'] = args.spacing
+        preview(args.preview, font, pages)
+
+    out = args.output or args.name + '.c'
+    src = os.path.basename(args.font)
+    with open(out, 'w') as f:
+        f.write('// %s\n' % os.path.basename(out))
+        f.write('// Generated by tools/fontgen.py from %s, do not edit\n' % src)
+        f.write('// %d glyphs, %d rows in %d page(s), %d bytes of bitmap; missing ASCII: %s\n' %
+                (len(order), height, pages, len(bitmap),
+                 ' '.join('%02x' % cp for cp in missing) if missing else 'none'))
+        f.write('\n#include "ssd1306_font.h"\n\n')
+        f.write('static const uint8_t %s_bitmap[%d] = {\n%s\n};\n\n' % (args.name, len(bitmap), hex_lines(bitmap, 16)))
+        f.write('static const uint8_t %s_width[%d] = {\n%s\n};\n\n' %
+                (args.name, len(widths), '\n'.join('    ' + ', '.join(str(w) for w in widths[i:i + 16]) + ','
+                                                  for i in range(0, len(widths), 16))))
+        f.write('static const uint16_t %s_offset[%d] = {\n%s\n};\n\n' %
+                (args.name, len(offsets), '\n'.join('    ' + ', '.join(str(o) for o in offsets[i:i + 12]) + ','
+                                                   for i in range(0, len(offsets), 12))))
+        f.write('static const ssd1306_font_range_t %s_ranges[%d] = {\n' % (args.name, len(ranges)))
+        for first, count, glyph in ranges:
+            f.write('    {0x%04X, %d, %d},\n' % (first, count, glyph))
+        f.write('};\n\n')
+        f.write('const ssd1306_font_t %s = {\n' % args.name)
+        f.write('    .pages = %d,\n    .spacing = %d,\n    .fixed_width = 0,\n    .fallback = %d,\n' %
+                (pages, args.spacing, fallback))
+        f.write('    .bitmap = %s_bitmap,\n    .width = %s_width,\n    .offset = %s_offset,\n' %
+                (args.name, args.name, args.name))
+        f.write('    .ranges = %s_ranges,\n    .n_ranges = %d,\n};\n' % (args.name, len(ranges)))
+    print('%s: %d glyphs, %d ranges, %d bytes of bitmap, %d of tables' %
+          (out, len(order), len(ranges), len(bitmap), len(widths) + 2 * len(offsets) + 8 * len(ranges)))
+
+
+if __name__ == '__main__':
+    main()